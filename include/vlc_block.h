@@ -134,6 +134,10 @@ struct block_t
  *      with preheader and or body (increase
  *      and decrease are supported). Use it as it is optimised.
  * - block_Duplicate : create a copy of a block.
+ * - block_Share : make the payload of a block shareable (consumes the block).
+ * - block_Hold : create a block with the same payload as a shareable block,
+ *      without copying it. The payload is read-only while it is shared.
+ * - block_Unshare : copy the payload if it is shared, before writing to it.
  ****************************************************************************/
 VLC_API void block_Init( block_t *, void *, size_t );
 VLC_API block_t *block_Alloc( size_t ) VLC_USED VLC_MALLOC;
@@ -166,6 +170,10 @@ static inline void block_Release( block_t *p_block )
     p_block->pf_release( p_block );
 }
 
+VLC_API block_t *block_Share( block_t * ) VLC_USED;
+VLC_API block_t *block_Hold( block_t * ) VLC_USED;
+VLC_API block_t *block_Unshare( block_t * ) VLC_USED;
+
 VLC_API block_t *block_heap_Alloc(void *, size_t) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_mmap_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
 VLC_API block_t * block_shm_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
@@ -187,6 +195,8 @@ static inline void block_Cleanup (void *block)
  * - block_ChainLastAppend : use a pointer over a pointer to the next blocks,
  *      and update it.
  * - block_ChainRelease : release a chain of block
+ * - block_ChainUnshare : copy the shared payloads of a chain, before writing
+ *      to them
  * - block_ChainExtract : extract data from a chain, return real bytes counts
  * - block_ChainGather : gather a chain, free it and return one block.
  ****************************************************************************/
@@ -225,6 +235,23 @@ static inline void block_ChainRelease( block_t *p_block )
     }
 }
 
+static inline block_t *block_ChainUnshare( block_t *p_block )
+{
+    block_t *p_chain = NULL, **pp_last = &p_chain;
+
+    while( p_block )
+    {
+        block_t *p_next = p_block->p_next;
+
+        p_block->p_next = NULL;
+        p_block = block_Unshare( p_block );
+        if( p_block != NULL )
+            block_ChainLastAppend( &pp_last, p_block );
+        p_block = p_next;
+    }
+    return p_chain;
+}
+
 static size_t block_ChainExtract( block_t *p_list, void *p_data, size_t i_max )
 {
     size_t  i_total = 0;
@@ -138,6 +138,10 @@ enum demux_query_e
     DEMUX_CAN_RECORD,           /* arg1=bool*   res=can fail(assume false) */
     DEMUX_SET_RECORD_STATE,     /* arg1=bool    res=can fail */
 
+    /* Seek index: fraction of the input covered by the demuxer seek index,
+     * 1.0 once seeking no longer needs to guess positions */
+    DEMUX_GET_INDEX_COVERAGE,   /* arg1= double *       res=can fail */
+
 
     /* II. Specific access_demux queries */
     /* PAUSE you are ensured that it is never called twice with the same state */
@@ -24,6 +24,8 @@
 #ifndef VLC_ES_OUT_H
 #define VLC_ES_OUT_H 1
 
+#include <vlc_block.h>
+
 /**
  * \file
  * This file defines functions and structures for handling es_out in stream output
@@ -100,6 +102,9 @@ struct es_out_t
     void         (*pf_del)    ( es_out_t *, es_out_id_t * );
     int          (*pf_control)( es_out_t *, int i_query, va_list );
     void         (*pf_destroy)( es_out_t * );
+    /* Optional, NULL if not implemented (allocate es_out_t zeroed):
+     * sends a chain of blocks (linked by p_next) */
+    int          (*pf_send_chain)( es_out_t *, es_out_id_t *, block_t * );
 
     es_out_sys_t    *p_sys;
 };
@@ -121,6 +126,33 @@ static inline int es_out_Send( es_out_t *out, es_out_id_t *id,
     return out->pf_send( out, id, p_block );
 }
 
+/**
+ * Sends a chain of blocks (linked through p_next) belonging to the same ES.
+ *
+ * The es_out handles the whole chain at once when it supports it, so that
+ * demuxers producing many small blocks per call pay the per-send overhead
+ * only once.
+ */
+static inline int es_out_SendChain( es_out_t *out, es_out_id_t *id,
+                                    block_t *p_chain )
+{
+    int i_ret = VLC_SUCCESS;
+
+    if( out->pf_send_chain != NULL )
+        return out->pf_send_chain( out, id, p_chain );
+
+    while( p_chain != NULL )
+    {
+        block_t *p_next = p_chain->p_next;
+
+        p_chain->p_next = NULL;
+        if( out->pf_send( out, id, p_chain ) != VLC_SUCCESS )
+            i_ret = VLC_EGENERIC;
+        p_chain = p_next;
+    }
+    return i_ret;
+}
+
 static inline int es_out_vaControl( es_out_t *out, int i_query, va_list args )
 {
     return out->pf_control( out, i_query, args );
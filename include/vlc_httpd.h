@@ -106,7 +106,11 @@ typedef struct httpd_callback_sys_t httpd_callback_sys_t;
 typedef int    (*httpd_callback_t)( httpd_callback_sys_t *, httpd_client_t *, httpd_message_t *answer, const httpd_message_t *query );
 /* register a new url */
 VLC_API httpd_url_t * httpd_UrlNew( httpd_host_t *, const char *psz_url, const char *psz_user, const char *psz_password ) VLC_USED;
-/* register callback on a url */
+/* register callback on a url
+ * An HTTP answer with a "Transfer-Encoding: chunked" header and a non-zero
+ * i_body_offset is sent in chunks: the callback is called again with that
+ * offset for more body data (leaving the answer untouched means none yet),
+ * until it resets i_body_offset to 0. */
 VLC_API int httpd_UrlCatch( httpd_url_t *, int i_msg, httpd_callback_t, httpd_callback_sys_t * );
 /* delete a url */
 VLC_API void httpd_UrlDelete( httpd_url_t * );
@@ -139,6 +143,8 @@ VLC_API httpd_stream_t * httpd_StreamNew( httpd_host_t *, const char *psz_url, c
 VLC_API void httpd_StreamDelete( httpd_stream_t * );
 VLC_API int httpd_StreamHeader( httpd_stream_t *, uint8_t *p_data, int i_data );
 VLC_API int httpd_StreamSend( httpd_stream_t *, uint8_t *p_data, int i_data );
+/* send a chain of blocks (consumed), without copying them */
+VLC_API int httpd_StreamSendBlock( httpd_stream_t *, block_t * );
 
 
 /* Msg functions facilities */
@@ -268,6 +268,8 @@ struct input_thread_t
  *  - "signal-strength"
  *  - "program-scrambled" (if the current program is scrambled)
  *  - "cache" (level of data cached [0 .. 1])
+ *  - "index-coverage" (part of the input covered by the demuxer seek index
+ *                      [0 .. 1], -1 if the demuxer has no such index)
  *
  * The read-write variables are:
  *  - state (\see input_state_e)
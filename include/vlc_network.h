@@ -150,6 +150,7 @@ VLC_API ssize_t net_Write( vlc_object_t *p_this, int fd, const v_socket_t *, con
 #define net_Write(a,b,c,d,e) net_Write(VLC_OBJECT(a),b,c,d,e)
 VLC_API char * net_Gets( vlc_object_t *p_this, int fd, const v_socket_t * );
 #define net_Gets(a,b,c) net_Gets(VLC_OBJECT(a),b,c)
+VLC_API int net_SendBlocks( int fd, block_t *const *pp_blocks, unsigned i_count );
 
 
 VLC_API ssize_t net_Printf( vlc_object_t *p_this, int fd, const v_socket_t *, const char *psz_fmt, ... ) VLC_FORMAT( 4, 5 );
@@ -1310,6 +1310,10 @@ static int EsOutSend( es_out_t *p_out, es_out_id_t *p_es, block_t *p_block )
 {
     return es_out_Send( p_out->p_sys->p_demux->out, p_es, p_block );
 }
+static int EsOutSendChain( es_out_t *p_out, es_out_id_t *p_es, block_t *p_chain )
+{
+    return es_out_SendChain( p_out->p_sys->p_demux->out, p_es, p_chain );
+}
 static void EsOutDel( es_out_t *p_out, es_out_id_t *p_es )
 {
     es_out_Del( p_out->p_sys->p_demux->out, p_es );
@@ -1326,7 +1330,7 @@ static void EsOutDestroy( es_out_t *p_out )
 
 static es_out_t *EsOutNew( demux_t *p_demux )
 {
-    es_out_t *p_out = malloc( sizeof(*p_out) );
+    es_out_t *p_out = calloc( 1, sizeof(*p_out) );
     es_out_sys_t *p_sys;
 
     if( !p_out )
@@ -1337,6 +1341,7 @@ static es_out_t *EsOutNew( demux_t *p_demux )
     p_out->pf_del     = EsOutDel;
     p_out->pf_control = EsOutControl;
     p_out->pf_destroy = EsOutDestroy;
+    p_out->pf_send_chain = EsOutSendChain;
 
     p_out->p_sys = p_sys = malloc( sizeof(*p_sys) );
     if( !p_sys )
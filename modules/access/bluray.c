@@ -486,6 +486,11 @@ static int esOutSend( es_out_t *p_out, es_out_id_t *p_es, block_t *p_block )
     return es_out_Send( p_out->p_sys->p_demux->out, p_es, p_block );
 }
 
+static int esOutSendChain( es_out_t *p_out, es_out_id_t *p_es, block_t *p_chain )
+{
+    return es_out_SendChain( p_out->p_sys->p_demux->out, p_es, p_chain );
+}
+
 static void esOutDel( es_out_t *p_out, es_out_id_t *p_es )
 {
     int idx = findEsPairIndexByEs( p_out->p_sys->p_demux->p_sys, p_es );
@@ -514,7 +519,7 @@ static void esOutDestroy( es_out_t *p_out )
 static es_out_t *esOutNew( demux_t *p_demux )
 {
     assert( vlc_array_count(&p_demux->p_sys->es) == 0 );
-    es_out_t    *p_out = malloc( sizeof(*p_out) );
+    es_out_t    *p_out = calloc( 1, sizeof(*p_out) );
     if ( unlikely(p_out == NULL) )
         return NULL;
 
@@ -523,6 +528,7 @@ static es_out_t *esOutNew( demux_t *p_demux )
     p_out->pf_del       = &esOutDel;
     p_out->pf_destroy   = &esOutDestroy;
     p_out->pf_send      = &esOutSend;
+    p_out->pf_send_chain = &esOutSendChain;
 
     p_out->p_sys = malloc( sizeof(*p_out->p_sys) );
     if ( unlikely( p_out->p_sys == NULL ) ) {
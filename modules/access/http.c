@@ -54,6 +54,9 @@
 
 #include <assert.h>
 #include <limits.h>
+#ifdef HAVE_POLL
+#   include <poll.h>
+#endif
 
 /*****************************************************************************
  * Module descriptor
@@ -176,6 +179,7 @@ struct access_sys_t
     char       *psz_icy_title;
 
     uint64_t i_remaining;
+    uint64_t i_range;   /* bytes asked for at once, 0 for the whole file */
 
     bool b_seekable;
     bool b_reconnect;
@@ -200,6 +204,9 @@ static int Control( access_t *, int, va_list );
 /* */
 static int Connect( access_t *, uint64_t );
 static int Request( access_t *p_access, uint64_t i_tell );
+static int NextRange( access_t * );
+static void Drain( access_t * );
+static void Release( access_t * );
 static void Disconnect( access_t * );
 
 /* Small Cookie utilities. Cookies support is partial. */
@@ -214,6 +221,107 @@ static void AuthReply( access_t *p_acces, const char *psz_prefix,
 static int AuthCheckReply( access_t *p_access, const char *psz_header,
                            vlc_url_t *p_url, http_auth_t *p_auth );
 
+/*****************************************************************************
+ * Kept-alive connections, shared by all the HTTP accesses of the process,
+ * so that the seeks and the successive segments of adaptive streams don't
+ * pay for a new connection each
+ *****************************************************************************/
+#define HTTP_RANGE_MIN    (64 * 1024)   /* first range after a seek */
+#define HTTP_RANGE_MAX    (64 * 1024 * 1024)
+#define HTTP_DRAIN_MAX    (64 * 1024)   /* read rather than reconnect */
+#define HTTP_POOL_SIZE    8
+#define HTTP_POOL_TIMEOUT (15 * CLOCK_FREQ)
+
+static struct
+{
+    char   *psz_host;   /* NULL if the slot is free */
+    int     i_port;
+    int     fd;
+    mtime_t i_date;     /* when the connection was released */
+} pool[HTTP_POOL_SIZE];
+static vlc_mutex_t pool_lock = VLC_STATIC_MUTEX;
+
+/* Whether the connection can carry another request */
+static bool ConnectionIdle( const access_sys_t *p_sys )
+{
+    return p_sys->fd != -1 && p_sys->b_persist && p_sys->b_has_size
+        && !p_sys->b_chunked && p_sys->i_icy_meta == 0
+        && p_sys->i_remaining == 0;
+}
+
+/* Closes a pooled connection (pool lock held) */
+static void PoolClear( unsigned i )
+{
+    net_Close( pool[i].fd );
+    FREENULL( pool[i].psz_host );
+}
+
+/* Returns a kept connection to the given server, or -1 */
+static int PoolGet( const char *psz_host, int i_port )
+{
+    mtime_t now = mdate();
+    int fd = -1;
+
+    vlc_mutex_lock( &pool_lock );
+    for( unsigned i = 0; i < HTTP_POOL_SIZE; i++ )
+    {
+        if( pool[i].psz_host == NULL )
+            continue;
+        if( pool[i].i_date + HTTP_POOL_TIMEOUT < now )
+        {
+            PoolClear( i );
+            continue;
+        }
+        if( fd != -1 || pool[i].i_port != i_port
+         || strcasecmp( pool[i].psz_host, psz_host ) )
+            continue;
+
+        /* an idle connection has nothing to read, unless it was closed */
+        struct pollfd ufd = { .fd = pool[i].fd, .events = POLLIN };
+        if( poll( &ufd, 1, 0 ) != 0 )
+        {
+            PoolClear( i );
+            continue;
+        }
+        fd = pool[i].fd;
+        FREENULL( pool[i].psz_host );
+    }
+    vlc_mutex_unlock( &pool_lock );
+    return fd;
+}
+
+/* Keeps an idle connection, instead of the oldest one if the pool is full */
+static void PoolPut( const char *psz_host, int i_port, int fd )
+{
+    char *psz_dup = strdup( psz_host );
+    if( unlikely(psz_dup == NULL) )
+    {
+        net_Close( fd );
+        return;
+    }
+
+    vlc_mutex_lock( &pool_lock );
+    unsigned i_slot = 0;
+    for( unsigned i = 0; i < HTTP_POOL_SIZE; i++ )
+    {
+        if( pool[i].psz_host == NULL )
+        {
+            i_slot = i;
+            break;
+        }
+        if( pool[i].i_date < pool[i_slot].i_date )
+            i_slot = i;
+    }
+    if( pool[i_slot].psz_host != NULL )
+        PoolClear( i_slot );
+
+    pool[i_slot].psz_host = psz_dup;
+    pool[i_slot].i_port = i_port;
+    pool[i_slot].fd = fd;
+    pool[i_slot].i_date = mdate();
+    vlc_mutex_unlock( &pool_lock );
+}
+
 /*****************************************************************************
  * Open:
  *****************************************************************************/
@@ -279,6 +387,7 @@ static int OpenWithCookies( vlc_object_t *p_this, const char *psz_access,
     p_sys->psz_icy_genre = NULL;
     p_sys->psz_icy_title = NULL;
     p_sys->i_remaining = 0;
+    p_sys->i_range = 0;
     p_sys->b_persist = false;
     p_sys->b_has_size = false;
     p_access->info.i_size = 0;
@@ -647,7 +756,8 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->psz_user_agent );
     free( p_sys->psz_referrer );
 
-    Disconnect( p_access );
+    Drain( p_access );
+    Release( p_access );
     vlc_tls_Delete( p_sys->p_creds );
 
     if( p_sys->cookies )
@@ -726,6 +836,12 @@ static ssize_t Read( access_t *p_access, uint8_t *p_buffer, size_t i_len )
     access_sys_t *p_sys = p_access->p_sys;
     int i_read;
 
+    /* End of the requested range, but not of the file */
+    if( p_sys->i_range > 0 && p_sys->b_has_size && p_sys->i_remaining == 0
+     && p_access->info.i_pos < p_access->info.i_size
+     && NextRange( p_access ) )
+        goto fatal;
+
     if( p_sys->fd == -1 )
         goto fatal;
 
@@ -925,13 +1041,34 @@ static ssize_t ReadCompressed( access_t *p_access, uint8_t *p_buffer,
 #endif
 
 /*****************************************************************************
- * Seek: close and re-open a connection at the right place
+ * Seek: request the data at the right place, on the same connection if
+ * possible
  *****************************************************************************/
 static int Seek( access_t *p_access, uint64_t i_pos )
 {
+    access_sys_t *p_sys = p_access->p_sys;
+
     msg_Dbg( p_access, "trying to seek to %"PRId64, i_pos );
 
-    Disconnect( p_access );
+    /* Once the size is known, ask for a small range first: the connection
+     * can then be kept for the next seek if this one is not read to the
+     * end. The range grows as long as the file is read sequentially. */
+    if( p_sys->b_has_size )
+        p_sys->i_range = HTTP_RANGE_MIN;
+
+    Drain( p_access );
+    if( p_sys->i_range > 0 && i_pos < p_access->info.i_size
+     && ConnectionIdle( p_sys ) )
+    {
+        p_access->info.i_pos = i_pos;
+        p_access->info.b_eof = false;
+        p_sys->i_icy_offset = i_pos;
+        if( Request( p_access, i_pos ) == VLC_SUCCESS
+         && p_sys->i_code == 206 )
+            return VLC_SUCCESS;
+        msg_Dbg( p_access, "cannot reuse the connection" );
+    }
+    Release( p_access );
 
     if( p_access->info.i_size
      && i_pos >= p_access->info.i_size ) {
@@ -1064,13 +1201,27 @@ static int Connect( access_t *p_access, uint64_t i_tell )
 
     /* Open connection */
     assert( p_sys->fd == -1 ); /* No open sockets (leaking fds is BAD) */
-    p_sys->fd = net_ConnectTCP( p_access, srv.psz_host, srv.i_port );
-    if( p_sys->fd == -1 )
+    bool b_pooled = false;
+    if( p_sys->p_creds == NULL )
+    {
+        p_sys->fd = PoolGet( srv.psz_host, srv.i_port );
+        b_pooled = p_sys->fd != -1;
+    }
+    if( b_pooled )
+        msg_Dbg( p_access, "reusing a connection to %s:%d", srv.psz_host,
+                 srv.i_port );
+    else
     {
-        msg_Err( p_access, "cannot connect to %s:%d", srv.psz_host, srv.i_port );
-        return -1;
+        p_sys->fd = net_ConnectTCP( p_access, srv.psz_host, srv.i_port );
+        if( p_sys->fd == -1 )
+        {
+            msg_Err( p_access, "cannot connect to %s:%d", srv.psz_host,
+                     srv.i_port );
+            return -1;
+        }
+        setsockopt (p_sys->fd, SOL_SOCKET, SO_KEEPALIVE, &(int){ 1 },
+                    sizeof (int));
     }
-    setsockopt (p_sys->fd, SOL_SOCKET, SO_KEEPALIVE, &(int){ 1 }, sizeof (int));
 
     /* Initialize TLS/SSL session */
     if( p_sys->p_creds != NULL )
@@ -1148,7 +1299,42 @@ static int Connect( access_t *p_access, uint64_t i_tell )
         p_sys->p_vs = &p_sys->p_tls->sock;
     }
 
-    return Request( p_access, i_tell ) ? -2 : 0;
+    if( Request( p_access, i_tell ) )
+    {
+        /* The server closed the kept connection meanwhile */
+        if( b_pooled && p_sys->i_code == 0 && vlc_object_alive( p_access ) )
+            return Connect( p_access, i_tell );
+        return -2;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * NextRange: request the range following the one that was read
+ *****************************************************************************/
+static int NextRange( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    uint64_t i_pos = p_access->info.i_pos;
+
+    /* reading sequentially: read ahead more */
+    p_sys->i_range = __MIN( 2 * p_sys->i_range, HTTP_RANGE_MAX );
+
+    if( ConnectionIdle( p_sys ) )
+    {
+        if( Request( p_access, i_pos ) == VLC_SUCCESS
+         && p_sys->i_code == 206 && p_access->info.i_pos == i_pos )
+            return VLC_SUCCESS;
+        msg_Dbg( p_access, "cannot reuse the connection" );
+    }
+    Release( p_access );
+
+    if( Connect( p_access, i_pos ) || p_access->info.i_pos != i_pos )
+    {
+        msg_Err( p_access, "cannot request the data at %"PRIu64, i_pos );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
 }
 
 
@@ -1159,6 +1345,7 @@ static int Request( access_t *p_access, uint64_t i_tell )
     v_socket_t     *pvs = p_sys->p_vs;
     p_sys->b_persist = false;
 
+    p_sys->i_code = 0;
     p_sys->i_remaining = 0;
 
     const char *psz_path = p_sys->url.psz_path;
@@ -1190,10 +1377,19 @@ static int Request( access_t *p_access, uint64_t i_tell )
     /* Offset */
     if( p_sys->i_version == 1 && ! p_sys->b_continuous )
     {
+        /* the connection is kept alive, unless the server refuses */
         p_sys->b_persist = true;
-        net_Printf( p_access, p_sys->fd, pvs,
-                    "Range: bytes=%"PRIu64"-\r\n", i_tell );
-        net_Printf( p_access, p_sys->fd, pvs, "Connection: close\r\n" );
+        if( p_sys->i_range > 0 )
+        {
+            uint64_t i_end = i_tell + p_sys->i_range - 1;
+            if( p_sys->b_has_size && i_end >= p_access->info.i_size )
+                i_end = p_access->info.i_size - 1;
+            net_Printf( p_access, p_sys->fd, pvs,
+                        "Range: bytes=%"PRIu64"-%"PRIu64"\r\n", i_tell, i_end );
+        }
+        else
+            net_Printf( p_access, p_sys->fd, pvs,
+                        "Range: bytes=%"PRIu64"-\r\n", i_tell );
     }
 
     /* Cookies */
@@ -1251,12 +1447,15 @@ static int Request( access_t *p_access, uint64_t i_tell )
     {
         p_sys->psz_protocol = "HTTP";
         p_sys->i_code = atoi( &psz[9] );
+        if( psz[7] == '0' )
+            p_sys->b_persist = false;
     }
     else if( !strncmp( psz, "ICY", 3 ) )
     {
         p_sys->psz_protocol = "ICY";
         p_sys->i_code = atoi( &psz[4] );
         p_sys->b_reconnect = true;
+        p_sys->b_persist = false;
     }
     else
     {
@@ -1537,11 +1736,11 @@ static int Request( access_t *p_access, uint64_t i_tell )
 
         free( psz );
     }
-    /* We close the stream for zero length data, unless of course the
-     * server has already promised to do this for us.
+    /* We release the connection for zero length data, unless of course the
+     * server has already promised to close it.
      */
     if( p_sys->b_has_size && p_sys->i_remaining == 0 && p_sys->b_persist ) {
-        Disconnect( p_access );
+        Release( p_access );
     }
     return VLC_SUCCESS;
 
@@ -1550,6 +1749,52 @@ error:
     return VLC_EGENERIC;
 }
 
+/*****************************************************************************
+ * Drain: read the end of a short response, so that the connection can carry
+ * another request
+ *****************************************************************************/
+static void Drain( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    uint8_t buf[4096];
+
+    if( p_sys->fd == -1 || !p_sys->b_persist || !p_sys->b_has_size
+     || p_sys->b_chunked || p_sys->i_icy_meta > 0
+     || p_sys->i_remaining > HTTP_DRAIN_MAX )
+        return;
+
+    while( p_sys->i_remaining > 0 )
+    {
+        int i_read = net_Read( p_access, p_sys->fd, p_sys->p_vs, buf,
+                               __MIN( p_sys->i_remaining, sizeof( buf ) ),
+                               false );
+        if( i_read <= 0 )
+        {
+            p_sys->b_persist = false;
+            return;
+        }
+        p_sys->i_remaining -= i_read;
+    }
+}
+
+/*****************************************************************************
+ * Release: keep the connection for a later request if it is idle, or close it
+ *****************************************************************************/
+static void Release( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    /* TLS sessions belong to the credentials of this access */
+    if( p_sys->p_tls == NULL && ConnectionIdle( p_sys ) )
+    {
+        const vlc_url_t *srv = p_sys->b_proxy ? &p_sys->proxy : &p_sys->url;
+
+        PoolPut( srv->psz_host, srv->i_port, p_sys->fd );
+        p_sys->fd = -1;
+    }
+    Disconnect( p_access );
+}
+
 /*****************************************************************************
  * Disconnect:
  *****************************************************************************/
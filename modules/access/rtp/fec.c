@@ -0,0 +1,306 @@
+/**
+ * @file fec.c
+ * @brief RTP forward error correction (SMPTE 2022-1)
+ */
+/*****************************************************************************
+ * Copyright © 2013 VLC authors and VideoLAN
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_cpu.h>
+
+#include "fec.h"
+
+/*
+ * A FEC packet protects a row (consecutive sequence numbers) or a column
+ * (sequence numbers L apart) of media packets, by the XOR of their payloads
+ * and header fields, as per RFC2733. SMPTE 2022-1 extends the FEC header with
+ * the offset between the protected sequence numbers, and their count:
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |      SNBase low bits          |        Length recovery        |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |E| PT recovery |                    Mask                       |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                          TS recovery                          |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |X|D|type |index|    Offset     |       NA      |SNBase ext bits|
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * The P, X, CC and M bits of the RTP header of the FEC packet are the XOR of
+ * those of the protected packets.
+ */
+#define FEC_HEADER 28 /* RTP and FEC headers */
+
+/* Media packets kept for recovery: enough for twice the largest matrix
+ * (L x D <= 100), as the column FEC packets follow their matrix */
+#define FEC_WINDOW 256
+/* FEC packets kept: the rows and columns of a few matrices */
+#define FEC_COUNT  128
+
+typedef struct
+{
+    int64_t  ext;   /* extended sequence number, -1 if none */
+    size_t   len;
+    uint8_t  data[RTP_FEC_MTU];
+} rtp_fec_slot_t;
+
+struct rtp_fec_t
+{
+    void   (*xor_block) (uint8_t *restrict, const uint8_t *restrict, size_t);
+    int64_t  max_ext;  /* highest extended sequence number, -1 if none */
+    uint32_t ssrc;     /* of the last media packet */
+
+    block_t *fecv[FEC_COUNT]; /* circular */
+    unsigned fec_next;
+    rtp_fec_slot_t slots[FEC_WINDOW]; /* by sequence number */
+};
+
+static void xor_c (uint8_t *restrict dst, const uint8_t *restrict src,
+                   size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+#ifdef CAN_COMPILE_SSE2
+VLC_SSE
+static void xor_sse2 (uint8_t *restrict dst, const uint8_t *restrict src,
+                      size_t len)
+{
+    for (; len >= 64; dst += 64, src += 64, len -= 64)
+        asm volatile (
+            "movdqu   (%[src]), %%xmm0\n"
+            "movdqu 16(%[src]), %%xmm1\n"
+            "movdqu 32(%[src]), %%xmm2\n"
+            "movdqu 48(%[src]), %%xmm3\n"
+            "movdqu   (%[dst]), %%xmm4\n"
+            "movdqu 16(%[dst]), %%xmm5\n"
+            "movdqu 32(%[dst]), %%xmm6\n"
+            "movdqu 48(%[dst]), %%xmm7\n"
+            "pxor     %%xmm4, %%xmm0\n"
+            "pxor     %%xmm5, %%xmm1\n"
+            "pxor     %%xmm6, %%xmm2\n"
+            "pxor     %%xmm7, %%xmm3\n"
+            "movdqu   %%xmm0,   (%[dst])\n"
+            "movdqu   %%xmm1, 16(%[dst])\n"
+            "movdqu   %%xmm2, 32(%[dst])\n"
+            "movdqu   %%xmm3, 48(%[dst])\n"
+            : : [dst]"r"(dst), [src]"r"(src)
+            : "xmm0", "xmm1", "xmm2", "xmm3",
+              "xmm4", "xmm5", "xmm6", "xmm7", "memory");
+    xor_c (dst, src, len);
+}
+#endif
+
+/**
+ * Creates an empty FEC recovery context.
+ */
+rtp_fec_t *rtp_fec_create (void)
+{
+    rtp_fec_t *fec = malloc (sizeof (*fec));
+    if (unlikely(fec == NULL))
+        return NULL;
+
+    fec->xor_block = xor_c;
+#ifdef CAN_COMPILE_SSE2
+    if (vlc_CPU_SSE2 ())
+        fec->xor_block = xor_sse2;
+#endif
+    fec->max_ext = -1;
+    fec->ssrc = 0;
+    for (unsigned i = 0; i < FEC_COUNT; i++)
+        fec->fecv[i] = NULL;
+    fec->fec_next = 0;
+    for (unsigned i = 0; i < FEC_WINDOW; i++)
+        fec->slots[i].ext = -1;
+    return fec;
+}
+
+void rtp_fec_destroy (rtp_fec_t *fec)
+{
+    for (unsigned i = 0; i < FEC_COUNT; i++)
+        if (fec->fecv[i] != NULL)
+            block_Release (fec->fecv[i]);
+    free (fec);
+}
+
+/* Extends a sequence number from the closest to the highest one */
+static int64_t rtp_fec_extend (const rtp_fec_t *fec, uint16_t seq)
+{
+    return fec->max_ext + (int16_t)(seq - (uint16_t)fec->max_ext);
+}
+
+static void rtp_fec_store (rtp_fec_t *fec, const block_t *block)
+{
+    uint16_t seq = GetWBE (block->p_buffer + 2);
+    int64_t ext;
+
+    if (fec->max_ext >= 0)
+    {
+        ext = rtp_fec_extend (fec, seq);
+        if (ext <= fec->max_ext - FEC_WINDOW)
+            return; /* too old to be of any use */
+    }
+    else
+        ext = 0x10000 + seq; /* never negative */
+    if (ext > fec->max_ext)
+        fec->max_ext = ext;
+
+    rtp_fec_slot_t *slot = &fec->slots[ext & (FEC_WINDOW - 1)];
+    slot->ext = ext;
+    slot->len = block->i_buffer;
+    memcpy (slot->data, block->p_buffer, block->i_buffer);
+}
+
+/**
+ * Keeps a copy of a media packet, should it be needed to recover another one.
+ */
+void rtp_fec_media (rtp_fec_t *fec, const block_t *block)
+{
+    if (block->i_buffer < 12 || block->i_buffer > RTP_FEC_MTU)
+        return; /* cannot be protected */
+
+    fec->ssrc = GetDWBE (block->p_buffer + 8);
+    rtp_fec_store (fec, block);
+}
+
+/**
+ * Queues a FEC packet (or drops it if not usable).
+ */
+void rtp_fec_queue (rtp_fec_t *fec, block_t *block)
+{
+    const uint8_t *p = block->p_buffer;
+
+    if (block->i_buffer < FEC_HEADER
+     || (p[0] >> 6) != 2 /* RTP version */
+     || !(p[16] & 0x80) /* no SMPTE 2022-1 header extension */
+     || (p[24] & 0x38) != 0 /* not XOR */
+     || p[25] == 0 || p[26] == 0 /* no offset or no packets */
+     || p[25] * (p[26] - 1) >= FEC_WINDOW) /* could never be used */
+    {
+        block_Release (block);
+        return;
+    }
+
+    block_t **pp = &fec->fecv[fec->fec_next++ % FEC_COUNT];
+    if (*pp != NULL)
+        block_Release (*pp);
+    *pp = block;
+}
+
+/**
+ * Rebuilds a media packet from a FEC packet protecting it, if all the other
+ * ones are available.
+ */
+static block_t *rtp_fec_rebuild (rtp_fec_t *fec, const block_t *f,
+                                 int64_t base, int64_t ext)
+{
+    const uint8_t *p = f->p_buffer;
+    const unsigned offset = p[25], count = p[26];
+    const size_t size = f->i_buffer - FEC_HEADER; /* longest payload */
+    const rtp_fec_slot_t *others[255];
+    unsigned n = 0;
+
+    for (unsigned k = 0; k < count; k++)
+    {
+        int64_t e = base + k * offset;
+        if (e == ext)
+            continue;
+
+        const rtp_fec_slot_t *slot = &fec->slots[e & (FEC_WINDOW - 1)];
+        if (slot->ext != e || slot->len - 12 > size)
+            return NULL; /* another one is missing (or not protected) */
+        others[n++] = slot;
+    }
+
+    uint8_t flags = p[0], mpt = (p[1] & 0x80) | (p[16] & 0x7F);
+    uint16_t len = GetWBE (p + 14);
+    uint32_t ts = GetDWBE (p + 20);
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        flags ^= others[i]->data[0];
+        mpt ^= others[i]->data[1];
+        len ^= others[i]->len - 12;
+        ts ^= GetDWBE (others[i]->data + 4);
+    }
+    if (len > size)
+        return NULL; /* corrupt */
+
+    block_t *block = block_Alloc (12 + size);
+    if (unlikely(block == NULL))
+        return NULL;
+
+    uint8_t *buf = block->p_buffer;
+    memcpy (buf + 12, p + FEC_HEADER, size);
+    for (unsigned i = 0; i < n; i++)
+        fec->xor_block (buf + 12, others[i]->data + 12, others[i]->len - 12);
+
+    buf[0] = 0x80 | (flags & 0x3F);
+    buf[1] = mpt;
+    SetWBE (buf + 2, (uint16_t)ext);
+    SetDWBE (buf + 4, ts);
+    SetDWBE (buf + 8, fec->ssrc);
+    block->i_buffer = 12 + len;
+
+    rtp_fec_store (fec, block);
+    return block;
+}
+
+/**
+ * Recovers a missing media packet, if the queued FEC packets allow.
+ * @return the rebuilt RTP packet, or NULL
+ */
+block_t *rtp_fec_recover (rtp_fec_t *fec, uint16_t seq)
+{
+    if (fec->max_ext < 0 || fec->fec_next == 0)
+        return NULL;
+
+    int64_t ext = rtp_fec_extend (fec, seq);
+    if (ext <= fec->max_ext - FEC_WINDOW)
+        return NULL;
+
+    for (unsigned i = 0; i < FEC_COUNT; i++)
+    {
+        const block_t *f = fec->fecv[i];
+        if (f == NULL)
+            continue;
+
+        /* Is the packet protected by that one? */
+        const unsigned offset = f->p_buffer[25], count = f->p_buffer[26];
+        int64_t base = rtp_fec_extend (fec, GetWBE (f->p_buffer + 12));
+        int64_t d = ext - base;
+        if (d < 0 || (d % offset) != 0 || d / offset >= count)
+            continue;
+
+        block_t *block = rtp_fec_rebuild (fec, f, base, ext);
+        if (block != NULL)
+            return block;
+    }
+    return NULL;
+}
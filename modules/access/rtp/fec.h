@@ -0,0 +1,40 @@
+/**
+ * @file fec.h
+ * @brief RTP forward error correction (SMPTE 2022-1)
+ */
+/*****************************************************************************
+ * Copyright © 2013 VLC authors and VideoLAN
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ ****************************************************************************/
+
+#ifndef VLC_RTP_FEC_H
+# define VLC_RTP_FEC_H 1
+
+/** Largest media packet that can be protected */
+# define RTP_FEC_MTU    1500
+/** Largest FEC packet: RTP and FEC headers, and the protected payload */
+# define RTP_FEC_SIZE   (RTP_FEC_MTU + 16)
+
+typedef struct rtp_fec_t rtp_fec_t;
+
+rtp_fec_t *rtp_fec_create (void);
+void rtp_fec_destroy (rtp_fec_t *);
+
+void rtp_fec_media (rtp_fec_t *, const block_t *);
+void rtp_fec_queue (rtp_fec_t *, block_t *);
+block_t *rtp_fec_recover (rtp_fec_t *, uint16_t);
+
+#endif
@@ -30,12 +30,15 @@
 #include <vlc_network.h>
 
 #include <limits.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
 
 #include "rtp.h"
+#include "fec.h"
 #ifdef HAVE_SRTP
 # include <srtp.h>
 #endif
@@ -66,6 +69,9 @@ static void rtp_process (demux_t *demux, block_t *block)
     }
 #endif
 
+    if (sys->fec != NULL)
+        rtp_fec_media (sys->fec, block);
+
     /* TODO: use SDP and get rid of this hack */
     if (unlikely(sys->autodetect))
     {   /* Autodetect payload type, _before_ rtp_queue() */
@@ -79,6 +85,77 @@ drop:
     block_Release (block);
 }
 
+#ifdef SO_TIMESTAMPNS
+/**
+ * Receives a datagram, and dates it when it reached the socket.
+ */
+static ssize_t rtp_recv (int fd, block_t *block)
+{
+    struct iovec iov = {
+        .iov_base = block->p_buffer,
+        .iov_len = block->i_buffer,
+    };
+    union
+    {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof (struct timespec))];
+    } ctl;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = &ctl,
+        .msg_controllen = sizeof (ctl),
+    };
+
+    ssize_t len = recvmsg (fd, &msg, 0);
+    if (len == -1)
+        return -1;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET
+         || cmsg->cmsg_type != SCM_TIMESTAMPNS)
+            continue;
+
+        /* The kernel uses the real time clock: convert to the VLC one */
+        struct timespec ts, now;
+        memcpy (&ts, CMSG_DATA (cmsg), sizeof (ts));
+        clock_gettime (CLOCK_REALTIME, &now);
+
+        mtime_t delay = (now.tv_sec - ts.tv_sec) * CLOCK_FREQ
+                      + (now.tv_nsec - ts.tv_nsec) / 1000;
+        if (delay < 0) /* clock stepped */
+            delay = 0;
+        block->i_dts = mdate () - delay;
+    }
+    return len;
+}
+#else
+# define rtp_recv(fd, block) recv (fd, (block)->p_buffer, (block)->i_buffer, 0)
+#endif
+
+/**
+ * Receives a packet from a FEC socket.
+ */
+static void rtp_fec_recv (demux_t *demux, int fd)
+{
+    block_t *block = block_Alloc (RTP_FEC_SIZE + 1);
+    if (unlikely(block == NULL))
+        return;
+
+    ssize_t len = recv (fd, block->p_buffer, block->i_buffer, 0);
+    if (len == -1)
+        msg_Warn (demux, "FEC network error: %m");
+    if (len == -1 || (size_t)len > RTP_FEC_SIZE) /* or truncated */
+    {
+        block_Release (block);
+        return;
+    }
+    block->i_buffer = len;
+    rtp_fec_queue (demux->p_sys->fec, block);
+}
+
 static int rtp_timeout (mtime_t deadline)
 {
     if (deadline == VLC_TS_INVALID)
@@ -104,13 +181,25 @@ void *rtp_dgram_thread (void *opaque)
     mtime_t deadline = VLC_TS_INVALID;
     int rtp_fd = sys->fd;
 
-    struct pollfd ufd[1];
-    ufd[0].fd = rtp_fd;
-    ufd[0].events = POLLIN;
+#ifdef SO_TIMESTAMPNS
+    /* date the packets when they reach the socket, not when we read them,
+     * for the jitter estimate not to include our own scheduling delays */
+    setsockopt (rtp_fd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){ 1 }, sizeof (int));
+#endif
+
+    struct pollfd ufd[3];
+    unsigned nfd = 0;
+
+    ufd[nfd++].fd = rtp_fd;
+    for (unsigned i = 0; i < 2; i++)
+        if (sys->fec_fd[i] != -1)
+            ufd[nfd++].fd = sys->fec_fd[i];
+    for (unsigned i = 0; i < nfd; i++)
+        ufd[i].events = POLLIN;
 
     for (;;)
     {
-        int n = poll (ufd, 1, rtp_timeout (deadline));
+        int n = poll (ufd, nfd, rtp_timeout (deadline));
         if (n == -1)
             continue;
 
@@ -128,7 +217,7 @@ void *rtp_dgram_thread (void *opaque)
             if (unlikely(block == NULL))
                 break; /* we are totallly screwed */
 
-            ssize_t len = recv (rtp_fd, block->p_buffer, block->i_buffer, 0);
+            ssize_t len = rtp_recv (rtp_fd, block);
             if (len != -1)
             {
                 block->i_buffer = len;
@@ -141,6 +230,10 @@ void *rtp_dgram_thread (void *opaque)
             }
         }
 
+        for (unsigned i = 1; i < nfd; i++)
+            if (ufd[i].revents)
+                rtp_fec_recv (demux, ufd[i].fd);
+
     dequeue:
         if (!rtp_dequeue (demux, sys->session, &deadline))
             deadline = VLC_TS_INVALID;
@@ -36,6 +36,7 @@
 #include <vlc_aout.h> /* aout_FormatPrepare() */
 
 #include "rtp.h"
+#include "fec.h"
 #ifdef HAVE_SRTP
 # include <srtp.h>
 # include <gcrypt.h>
@@ -76,6 +77,12 @@
     "RTP packets will be discarded if they are too far behind (i.e. in the " \
     "past) by this many packets from the last received packet." )
 
+#define RTP_FEC_TEXT N_("SMPTE 2022-1 FEC")
+#define RTP_FEC_LONGTEXT N_( \
+    "Lost RTP packets will be recovered from the forward error correction " \
+    "packets of SMPTE 2022-1, received on the RTP port plus 2 (columns) " \
+    "and plus 4 (rows)." )
+
 #define RTP_DYNAMIC_PT_TEXT N_("RTP payload format assumed for dynamic " \
                                "payloads")
 #define RTP_DYNAMIC_PT_LONGTEXT N_( \
@@ -123,6 +130,8 @@ vlc_module_begin ()
     add_integer ("rtp-max-misorder", 100, RTP_MAX_MISORDER_TEXT,
                  RTP_MAX_MISORDER_LONGTEXT, true)
         change_integer_range (0, 32767)
+    add_bool ("rtp-fec", false, RTP_FEC_TEXT, RTP_FEC_LONGTEXT, true)
+        change_safe ()
     add_string ("rtp-dynamic-pt", NULL, RTP_DYNAMIC_PT_TEXT,
                 RTP_DYNAMIC_PT_LONGTEXT, true)
         change_string_list (dynamic_pt_list, dynamic_pt_list_text)
@@ -206,7 +215,7 @@ static int Open (vlc_object_t *obj)
     int rtcp_dport = var_CreateGetInteger (obj, "rtcp-port");
 
     /* Try to connect */
-    int fd = -1, rtcp_fd = -1;
+    int fd = -1, rtcp_fd = -1, fec_fd[2] = { -1, -1 };
 
     switch (tp)
     {
@@ -217,6 +226,15 @@ static int Open (vlc_object_t *obj)
                 break;
             if (rtcp_dport > 0) /* XXX: source port is unknown */
                 rtcp_fd = net_OpenDgram (obj, dhost, rtcp_dport, shost, 0, tp);
+            if (var_CreateGetBool (obj, "rtp-fec"))
+                for (unsigned i = 0; i < 2; i++)
+                {   /* XXX: source port is unknown */
+                    fec_fd[i] = net_OpenDgram (obj, dhost, dport + 2 * (i + 1),
+                                               shost, 0, tp);
+                    if (fec_fd[i] == -1)
+                        msg_Warn (obj, "cannot receive FEC on port %d",
+                                  dport + 2 * (i + 1));
+                }
             break;
 
          case IPPROTO_DCCP:
@@ -251,6 +269,9 @@ static int Open (vlc_object_t *obj)
         net_Close (fd);
         if (rtcp_fd != -1)
             net_Close (rtcp_fd);
+        for (unsigned i = 0; i < 2; i++)
+            if (fec_fd[i] != -1)
+                net_Close (fec_fd[i]);
         return VLC_EGENERIC;
     }
 
@@ -258,8 +279,11 @@ static int Open (vlc_object_t *obj)
 #ifdef HAVE_SRTP
     p_sys->srtp         = NULL;
 #endif
+    p_sys->fec          = NULL;
     p_sys->fd           = fd;
     p_sys->rtcp_fd      = rtcp_fd;
+    p_sys->fec_fd[0]    = fec_fd[0];
+    p_sys->fec_fd[1]    = fec_fd[1];
     p_sys->max_src      = var_CreateGetInteger (obj, "rtp-max-src");
     p_sys->timeout      = var_CreateGetInteger (obj, "rtp-timeout")
                         * CLOCK_FREQ;
@@ -276,6 +300,13 @@ static int Open (vlc_object_t *obj)
     if (p_sys->session == NULL)
         goto error;
 
+    if (fec_fd[0] != -1 || fec_fd[1] != -1)
+    {
+        p_sys->fec = rtp_fec_create ();
+        if (p_sys->fec == NULL)
+            goto error;
+    }
+
 #ifdef HAVE_SRTP
     char *key = var_CreateGetNonEmptyString (demux, "srtp-key");
     if (key)
@@ -334,6 +365,11 @@ static void Close (vlc_object_t *obj)
 #endif
     if (p_sys->session)
         rtp_session_destroy (demux, p_sys->session);
+    if (p_sys->fec)
+        rtp_fec_destroy (p_sys->fec);
+    for (unsigned i = 0; i < 2; i++)
+        if (p_sys->fec_fd[i] != -1)
+            net_Close (p_sys->fec_fd[i]);
     if (p_sys->rtcp_fd != -1)
         net_Close (p_sys->rtcp_fd);
     net_Close (p_sys->fd);
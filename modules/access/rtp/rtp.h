@@ -66,8 +66,10 @@ struct demux_sys_t
 #ifdef HAVE_SRTP
     struct srtp_session_t *srtp;
 #endif
+    struct rtp_fec_t *fec;
     int           fd;
     int           rtcp_fd;
+    int           fec_fd[2]; /**< SMPTE 2022-1 columns and rows FEC */
     vlc_thread_t  thread;
 
     mtime_t       timeout;
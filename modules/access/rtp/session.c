@@ -25,6 +25,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -32,9 +33,17 @@
 #include <vlc_demux.h>
 
 #include "rtp.h"
+#include "fec.h"
 
 typedef struct rtp_source_t rtp_source_t;
 
+/* Jitter buffer bounds: how long to wait for a missing packet */
+#define RTP_WAIT_MIN    (CLOCK_FREQ / 200)
+#define RTP_DELAY_MAX   (CLOCK_FREQ / 2)
+/* Time for the wait learnt from late packets to decrease by one e-fold */
+#define RTP_DELAY_DECAY (INT64_C(30) * CLOCK_FREQ)
+#define STATS_PERIOD    (INT64_C(10) * CLOCK_FREQ)
+
 /** State for a RTP session: */
 struct rtp_session_t
 {
@@ -133,6 +142,17 @@ int rtp_add_type (demux_t *demux, rtp_session_t *ses, const rtp_pt_t *pt)
     return 0;
 }
 
+/** Reception statistics of an RTP source, for the last period */
+typedef struct
+{
+    uint64_t received;
+    uint64_t lost;       /* given up on */
+    uint64_t reordered;  /* out of order, but in time */
+    uint64_t late;       /* arrived after being given up on */
+    uint64_t duplicates;
+    uint64_t recovered;  /* from FEC packets */
+} rtp_stats_t;
+
 /** State for an RTP source */
 struct rtp_source_t
 {
@@ -141,6 +161,15 @@ struct rtp_source_t
     mtime_t  last_rx; /* last received packet local timestamp */
     uint32_t last_ts; /* last received packet RTP timestamp */
 
+    mtime_t  delay;    /* extra wait for missing packets, learnt from late */
+    mtime_t  wait;     /* last wait for a missing packet */
+    mtime_t  lost_rx;  /* reception of the packet after the last lost ones */
+    uint16_t lost_seq; /* first of the last lost packets */
+    uint16_t lost_count;
+
+    rtp_stats_t stats;
+    mtime_t  report;  /* next statistics report */
+
     uint32_t ref_rtp; /* sender RTP timestamp reference */
     mtime_t  ref_ntp; /* sender NTP timestamp reference */
 
@@ -167,6 +196,12 @@ rtp_source_create (demux_t *demux, const rtp_session_t *session,
 
     source->ssrc = ssrc;
     source->jitter = 0;
+    source->delay = 0;
+    source->wait = RTP_WAIT_MIN;
+    source->lost_seq = source->lost_count = 0;
+    source->lost_rx = 0;
+    memset (&source->stats, 0, sizeof (source->stats));
+    source->report = mdate () + STATS_PERIOD;
     source->ref_rtp = 0;
     /* TODO: use VLC_TS_0, but VLC does not like negative PTS at the moment */
     source->ref_ntp = UINT64_C (1) << 62;
@@ -183,6 +218,23 @@ rtp_source_create (demux_t *demux, const rtp_session_t *session,
 }
 
 
+/**
+ * Reports the reception statistics of an RTP source, and resets them.
+ */
+static void rtp_source_report (demux_t *demux, rtp_source_t *source)
+{
+    const rtp_stats_t *stats = &source->stats;
+
+    if (stats->received > 0)
+        msg_Dbg (demux, "RTP source (%08x): %"PRIu64" packets, %"PRIu64
+                 " lost, %"PRIu64" recovered, %"PRIu64" reordered, %"PRIu64
+                 " late, %"PRIu64" duplicate(s), waiting up to %"PRId64
+                 " us for the missing", source->ssrc, stats->received,
+                 stats->lost, stats->recovered, stats->reordered,
+                 stats->late, stats->duplicates, source->wait);
+    memset (&source->stats, 0, sizeof (source->stats));
+}
+
 /**
  * Destroys an RTP source and its associated streams.
  */
@@ -190,6 +242,7 @@ static void
 rtp_source_destroy (demux_t *demux, const rtp_session_t *session,
                     rtp_source_t *source)
 {
+    rtp_source_report (demux, source);
     msg_Dbg (demux, "removing RTP source (%08x)", source->ssrc);
 
     for (unsigned i = 0; i < session->ptc; i++)
@@ -228,6 +281,23 @@ rtp_find_ptype (const rtp_session_t *session, rtp_source_t *source,
     return NULL;
 }
 
+/**
+ * Removes the padding of an RTP packet, if any.
+ * @return false if the packet is invalid
+ */
+static bool rtp_unpad (block_t *block)
+{
+    if (block->p_buffer[0] & 0x20)
+    {
+        uint8_t padding = block->p_buffer[block->i_buffer - 1];
+        if ((padding == 0) || (block->i_buffer < (12u + padding)))
+            return false; /* illegal value */
+
+        block->i_buffer -= padding;
+    }
+    return true;
+}
+
 /**
  * Receives an RTP packet and queues it. Not a cancellation point.
  *
@@ -247,16 +317,12 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
         goto drop;
 
     /* Remove padding if present */
-    if (block->p_buffer[0] & 0x20)
-    {
-        uint8_t padding = block->p_buffer[block->i_buffer - 1];
-        if ((padding == 0) || (block->i_buffer < (12u + padding)))
-            goto drop; /* illegal value */
-
-        block->i_buffer -= padding;
-    }
+    if (!rtp_unpad (block))
+        goto drop;
 
-    mtime_t        now = mdate ();
+    /* The access dates the packets as they reach the socket, if it can */
+    mtime_t        now = (block->i_dts > VLC_TS_INVALID) ? block->i_dts
+                                                         : mdate ();
     rtp_source_t  *src  = NULL;
     const uint16_t seq  = rtp_seq (block);
     const uint32_t ssrc = GetDWBE (block->p_buffer + 8);
@@ -318,10 +384,24 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
             if (d < 0) d = -d;
             src->jitter += ((d - src->jitter) + 8) >> 4;
         }
+
+        /* Forget what late packets taught, slowly */
+        if (now > src->last_rx)
+            src->delay -= src->delay * __MIN(now - src->last_rx,
+                                             RTP_DELAY_DECAY)
+                          / RTP_DELAY_DECAY;
     }
     src->last_rx = now;
     block->i_pts = now; /* store reception time until dequeued */
+    block->i_dts = VLC_TS_INVALID;
     src->last_ts = rtp_timestamp (block);
+    src->stats.received++;
+
+    if (now >= src->report)
+    {
+        rtp_source_report (demux, src);
+        src->report = now + STATS_PERIOD;
+    }
 
     /* Check sequence number */
     /* NOTE: the sequence number is per-source,
@@ -349,6 +429,9 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
     else
     if (delta_seq >= 0)
         src->max_seq = seq + 1;
+    else
+    if ((int16_t)(seq - (src->last_seq + 1)) >= 0)
+        src->stats.reordered++; /* else late, see rtp_decode() */
 
     /* Queues the block in sequence order,
      * hence there is a single queue for all payload types. */
@@ -361,6 +444,7 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
         if (delta_seq == 0)
         {
             msg_Dbg (demux, "duplicate packet (sequence: %"PRIu16")", seq);
+            src->stats.duplicates++;
             goto drop; /* duplicate */
         }
         pp = &prev->p_next;
@@ -378,6 +462,81 @@ drop:
 
 static void rtp_decode (demux_t *, const rtp_session_t *, rtp_source_t *);
 
+/**
+ * Computes how long to wait for the packets missing before a given one
+ * (the depth of the jitter buffer).
+ */
+static mtime_t rtp_wait (const rtp_session_t *session, rtp_source_t *src,
+                         const block_t *block)
+{
+    mtime_t wait;
+
+    /* Wait for 3 times the inter-arrival delay variance (about 99.7%
+     * match for random gaussian jitter), as per the RFC3550 estimate.
+     */
+    const rtp_pt_t *pt = rtp_find_ptype (session, src, block, NULL);
+    if (pt)
+        wait = CLOCK_FREQ * 3 * src->jitter / pt->frequency;
+    else
+        wait = 0; /* no jitter estimate with no frequency :( */
+
+    /* Then for as long as recent packets were late, if they were */
+    wait += src->delay;
+
+    if (wait < RTP_WAIT_MIN)
+        wait = RTP_WAIT_MIN;
+    src->wait = wait;
+    return wait;
+}
+
+/**
+ * Rebuilds the packets missing from the queue of a source, as far as the
+ * FEC packets allow, and queues them.
+ * @return whether any packet was recovered
+ */
+static bool rtp_recover (demux_t *demux, rtp_source_t *src, mtime_t now)
+{
+    rtp_fec_t *fec = demux->p_sys->fec;
+    bool recovered = false;
+
+    if (fec == NULL)
+        return false;
+
+    /* A recovered packet may complete a row or column for another one */
+    for (bool progress = true; progress;)
+    {
+        uint16_t seq = src->last_seq + 1;
+
+        progress = false;
+        for (block_t **pp = &src->blocks; *pp != NULL; pp = &(*pp)->p_next)
+        {
+            /* Try the packets missing before that one */
+            for (; (int16_t)(rtp_seq (*pp) - seq) > 0; seq++)
+            {
+                block_t *block = rtp_fec_recover (fec, seq);
+                if (block == NULL)
+                    continue;
+                if (GetDWBE (block->p_buffer + 8) != src->ssrc
+                 || !rtp_unpad (block))
+                {
+                    block_Release (block);
+                    continue;
+                }
+
+                block->i_pts = now; /* as if just received */
+                block->p_next = *pp;
+                *pp = block;
+                pp = &block->p_next;
+                src->stats.recovered++;
+                progress = recovered = true;
+            }
+            if (rtp_seq (*pp) == seq)
+                seq++;
+        }
+    }
+    return recovered;
+}
+
 /**
  * Dequeues RTP packets and pass them to decoder. Not cancellation-safe(?).
  * A packet is decoded if it is the next in sequence order, or if we have
@@ -427,19 +586,11 @@ bool rtp_dequeue (demux_t *demux, const rtp_session_t *session,
                 continue;
             }
 
-            /* Wait for 3 times the inter-arrival delay variance (about 99.7%
-             * match for random gaussian jitter).
-             */
-            mtime_t deadline;
-            const rtp_pt_t *pt = rtp_find_ptype (session, src, block, NULL);
-            if (pt)
-                deadline = CLOCK_FREQ * 3 * src->jitter / pt->frequency;
-            else
-                deadline = 0; /* no jitter estimate with no frequency :( */
+            /* Maybe the FEC packets can fill the gap */
+            if (rtp_recover (demux, src, now))
+                continue;
 
-            /* Make sure we wait at least for 25 msec */
-            if (deadline < (CLOCK_FREQ / 40))
-                deadline = CLOCK_FREQ / 40;
+            mtime_t deadline = rtp_wait (session, src, block);
 
             /* Additionnaly, we implicitly wait for the packetization time
              * multiplied by the number of missing packets. block is the first
@@ -497,10 +648,26 @@ rtp_decode (demux_t *demux, const rtp_session_t *session, rtp_source_t *src)
         {   /* Trash too late packets (and PIM Assert duplicates) */
             msg_Dbg (demux, "ignoring late packet (sequence: %"PRIu16")",
                       rtp_seq (block));
+            if ((uint16_t)(rtp_seq (block) - src->lost_seq)
+                 < src->lost_count)
+            {   /* Wait long enough for the next ones, as far as it helps */
+                mtime_t need = block->i_pts - src->lost_rx;
+                mtime_t delay = src->delay + need - src->wait;
+
+                if (delay > src->delay)
+                    src->delay = __MIN(delay, RTP_DELAY_MAX);
+                src->stats.late++;
+            }
+            else
+                src->stats.duplicates++;
             goto drop;
         }
         msg_Warn (demux, "%"PRIu16" packet(s) lost", delta_seq);
         block->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+        src->lost_seq = src->last_seq + 1;
+        src->lost_count = delta_seq;
+        src->lost_rx = block->i_pts;
+        src->stats.lost += delta_seq;
     }
     src->last_seq = rtp_seq (block);
 
@@ -40,9 +40,25 @@
 #include <vlc_plugin.h>
 #include <vlc_access.h>
 #include <vlc_network.h>
+#include <vlc_block.h>
+
+#include <errno.h>
+#include <time.h>
 
 #define MTU 65535
 
+#ifdef HAVE_RECVMMSG
+/* datagrams received with one system call */
+# define RECV_BATCH 64
+/* initial size of the datagram buffers, enough for the usual TS over UDP
+ * and RTP packets; it grows if larger datagrams are received */
+# define RECV_SLOT  2048
+/* maximum size of a receive slab */
+# define RECV_SLAB  (1 << 20)
+#endif
+/* interval between statistics reports */
+#define STATS_PERIOD (INT64_C(10) * CLOCK_FREQ)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -68,6 +84,30 @@ vlc_module_end ()
  *****************************************************************************/
 static block_t *BlockUDP( access_t * );
 static int Control( access_t *, int, va_list );
+static void StatsReport( access_t * );
+
+typedef struct
+{
+    unsigned      i_calls;
+    unsigned      i_datagrams;
+    unsigned      i_truncated;
+    uint64_t      i_overruns;   /* datagrams dropped by the kernel */
+    mtime_t       i_delay_sum;  /* time spent in the socket buffer */
+    mtime_t       i_delay_max;
+} udp_stats_t;
+
+struct access_sys_t
+{
+    int           fd;
+#ifdef HAVE_RECVMMSG
+    block_t      *p_slab;       /* receive buffers, NULL if given away */
+    size_t        i_slot;       /* size of each datagram buffer */
+    unsigned      i_batch;      /* number of datagram buffers */
+    uint32_t      i_overflow;   /* last kernel drop counter */
+#endif
+    mtime_t       i_report;
+    udp_stats_t   stats;
+};
 
 /*****************************************************************************
  * Open: open the socket
@@ -136,7 +176,29 @@ static int Open( vlc_object_t *p_this )
         msg_Err( p_access, "cannot open socket" );
         return VLC_EGENERIC;
     }
-    p_access->p_sys = (void *)(intptr_t)fd;
+
+    access_sys_t *p_sys = calloc( 1, sizeof( *p_sys ) );
+    if( unlikely(p_sys == NULL) )
+    {
+        net_Close( fd );
+        return VLC_ENOMEM;
+    }
+    p_sys->fd = fd;
+#ifdef HAVE_RECVMMSG
+    p_sys->p_slab = NULL;
+    p_sys->i_slot = RECV_SLOT;
+    p_sys->i_batch = RECV_BATCH;
+# ifdef SO_TIMESTAMPNS
+    /* date the datagrams when they reach the socket, not when we read them */
+    setsockopt( fd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){ 1 }, sizeof (int) );
+# endif
+# ifdef SO_RXQ_OVFL
+    /* count the datagrams dropped because the receive buffer was full */
+    setsockopt( fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){ 1 }, sizeof (int) );
+# endif
+#endif
+    p_sys->i_report = mdate() + STATS_PERIOD;
+    p_access->p_sys = p_sys;
 
     return VLC_SUCCESS;
 }
@@ -147,8 +209,15 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t *p_this )
 {
     access_t     *p_access = (access_t*)p_this;
+    access_sys_t *p_sys = p_access->p_sys;
 
-    net_Close( (intptr_t)p_access->p_sys );
+    StatsReport( p_access );
+#ifdef HAVE_RECVMMSG
+    if( p_sys->p_slab != NULL )
+        block_Release( p_sys->p_slab );
+#endif
+    net_Close( p_sys->fd );
+    free( p_sys );
 }
 
 /*****************************************************************************
@@ -193,19 +262,236 @@ static int Control( access_t *p_access, int i_query, va_list args )
     return VLC_SUCCESS;
 }
 
+static void StatsReport( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    udp_stats_t *p_stats = &p_sys->stats;
+
+    if( p_stats->i_datagrams > 0 )
+        msg_Dbg( p_access, "%u datagrams in %u reads, socket delay average %"
+                 PRId64" us max %"PRId64" us", p_stats->i_datagrams,
+                 p_stats->i_calls,
+                 p_stats->i_delay_sum / p_stats->i_datagrams,
+                 p_stats->i_delay_max );
+    if( p_stats->i_overruns > 0 )
+        msg_Warn( p_access, "%"PRIu64" datagrams lost (receive buffer "
+                  "overrun)", p_stats->i_overruns );
+    if( p_stats->i_truncated > 0 )
+        msg_Warn( p_access, "%u datagrams lost (truncated)",
+                  p_stats->i_truncated );
+
+    memset( p_stats, 0, sizeof( *p_stats ) );
+}
+
+#ifdef HAVE_RECVMMSG
+/*****************************************************************************
+ * RecvBatch: receive as many datagrams as available, waiting for one at least
+ *****************************************************************************/
+static int RecvBatch( access_t *p_access, struct mmsghdr *msgv, unsigned n,
+                      uint8_t *p_buf, size_t i_buf )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    for( ;; )
+    {
+        /* with MSG_TRUNC, Linux returns the real size of long datagrams */
+        int val = recvmmsg( p_sys->fd, msgv, n, MSG_TRUNC, NULL );
+        if( val > 0 )
+            return val;
+        if( val == 0 || errno == EAGAIN || errno == EWOULDBLOCK )
+            break;
+        if( errno != EINTR )
+        {
+            msg_Err( p_access, "receive error: %m" );
+            return -1;
+        }
+    }
+
+    /* Nothing queued: wait for the next datagram the usual way. It is read
+     * into the whole slab, so that it cannot be truncated. */
+    ssize_t len = net_Read( p_access, p_sys->fd, NULL, p_buf, i_buf, false );
+    if( len < 0 )
+        return -1;
+    msgv[0].msg_len = len;
+    msgv[0].msg_hdr.msg_controllen = 0;
+    msgv[0].msg_hdr.msg_flags = 0;
+    return 1;
+}
+
+/*****************************************************************************
+ * BlockUDP: receive a batch of datagrams as a chain of blocks
+ *****************************************************************************
+ * The datagrams are received into a slab of fixed size buffers. If they fill
+ * a good part of it, the blocks refer to the slab without copying; else they
+ * are copied to blocks of their own size, and the slab is kept for the next
+ * time, so that a few datagrams never pin a large buffer.
+ *****************************************************************************/
+static block_t *BlockUDP( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    const size_t i_slot = p_sys->i_slot;
+    const unsigned i_batch = p_sys->i_batch;
+
+    block_t *p_slab = p_sys->p_slab;
+    if( p_slab == NULL )
+    {
+        p_slab = block_Alloc( i_batch * i_slot );
+        if( unlikely(p_slab == NULL) )
+            return NULL;
+    }
+    p_sys->p_slab = NULL;
+
+    struct mmsghdr msgv[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+    union
+    {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof (struct timespec))
+               + CMSG_SPACE(sizeof (uint32_t))];
+    } ctlv[RECV_BATCH];
+
+    memset( msgv, 0, i_batch * sizeof( *msgv ) );
+    for( unsigned i = 0; i < i_batch; i++ )
+    {
+        iov[i].iov_base = p_slab->p_buffer + i * i_slot;
+        iov[i].iov_len = i_slot;
+        msgv[i].msg_hdr.msg_iov = &iov[i];
+        msgv[i].msg_hdr.msg_iovlen = 1;
+        msgv[i].msg_hdr.msg_control = &ctlv[i];
+        msgv[i].msg_hdr.msg_controllen = sizeof( ctlv[i] );
+    }
+
+    int n = RecvBatch( p_access, msgv, i_batch, p_slab->p_buffer,
+                       i_batch * i_slot );
+    if( n <= 0 )
+    {
+        p_sys->p_slab = p_slab;
+        return NULL;
+    }
+
+    mtime_t i_now = mdate();
+#ifdef SO_TIMESTAMPNS
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now );
+#endif
+
+    bool b_share = (unsigned)n >= ( i_batch + 1 ) / 2;
+    if( b_share && ( p_slab = block_Share( p_slab ) ) == NULL )
+        return NULL;
+
+    block_t *p_chain = NULL, **pp_last = &p_chain;
+    size_t i_need = 0;
+
+    for( int i = 0; i < n; i++ )
+    {
+        const struct msghdr *p_msg = &msgv[i].msg_hdr;
+        size_t i_len = msgv[i].msg_len;
+        mtime_t i_date = i_now;
+
+        for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( p_msg ); cmsg != NULL;
+             cmsg = CMSG_NXTHDR( (struct msghdr *)p_msg, cmsg ) )
+        {
+            if( cmsg->cmsg_level != SOL_SOCKET )
+                continue;
+# ifdef SO_TIMESTAMPNS
+            if( cmsg->cmsg_type == SCM_TIMESTAMPNS )
+            {
+                struct timespec ts;
+                memcpy( &ts, CMSG_DATA( cmsg ), sizeof( ts ) );
+
+                mtime_t i_delay = ( now.tv_sec - ts.tv_sec ) * CLOCK_FREQ
+                                + ( now.tv_nsec - ts.tv_nsec ) / 1000;
+                if( i_delay < 0 ) /* clock stepped */
+                    i_delay = 0;
+                i_date = i_now - i_delay;
+                p_sys->stats.i_delay_sum += i_delay;
+                if( p_sys->stats.i_delay_max < i_delay )
+                    p_sys->stats.i_delay_max = i_delay;
+            }
+# endif
+# ifdef SO_RXQ_OVFL
+            if( cmsg->cmsg_type == SO_RXQ_OVFL )
+            {
+                uint32_t i_overflow;
+                memcpy( &i_overflow, CMSG_DATA( cmsg ), sizeof( i_overflow ) );
+                p_sys->stats.i_overruns += i_overflow - p_sys->i_overflow;
+                p_sys->i_overflow = i_overflow;
+            }
+# endif
+        }
+
+        if( p_msg->msg_flags & MSG_TRUNC )
+        {   /* i_len is the real size if the kernel told, else guess */
+            p_sys->stats.i_truncated++;
+            i_need = __MAX( i_need, i_len > i_slot ? i_len : 2 * i_slot );
+            continue;
+        }
+        if( i_len > i_slot ) /* read whole by net_Read(), across buffers */
+            i_need = __MAX( i_need, i_len );
+
+        block_t *p_block;
+        if( b_share )
+        {
+            p_block = block_Hold( p_slab );
+            if( unlikely(p_block == NULL) )
+                continue;
+            p_block->p_buffer = iov[i].iov_base;
+            p_block->i_buffer = i_len;
+        }
+        else
+        {
+            p_block = block_Alloc( i_len );
+            if( unlikely(p_block == NULL) )
+                continue;
+            memcpy( p_block->p_buffer, iov[i].iov_base, i_len );
+        }
+        p_block->i_dts = i_date;
+        block_ChainLastAppend( &pp_last, p_block );
+    }
+
+    if( b_share )
+        block_Release( p_slab );
+    else
+        p_sys->p_slab = p_slab;
+
+    if( i_need > 0 )
+    {   /* make room for the larger datagrams from now on */
+        p_sys->i_slot = __MIN( ( i_need + 63 ) & ~(size_t)63, (size_t)MTU );
+        p_sys->i_batch = __MAX( __MIN( RECV_BATCH,
+                                       RECV_SLAB / p_sys->i_slot ), 1 );
+        msg_Warn( p_access, "datagram too large, receiving up to %zu bytes",
+                  p_sys->i_slot );
+        if( p_sys->p_slab != NULL )
+        {
+            block_Release( p_sys->p_slab );
+            p_sys->p_slab = NULL;
+        }
+    }
+
+    p_sys->stats.i_calls++;
+    p_sys->stats.i_datagrams += n;
+    if( i_now >= p_sys->i_report )
+    {
+        StatsReport( p_access );
+        p_sys->i_report = i_now + STATS_PERIOD;
+    }
+    return p_chain;
+}
+
+#else
 /*****************************************************************************
  * BlockUDP:
  *****************************************************************************/
 static block_t *BlockUDP( access_t *p_access )
 {
-    int fd = (intptr_t)p_access->p_sys;
+    access_sys_t *p_sys = p_access->p_sys;
 
     /* Read data */
     block_t *p_block = block_Alloc( MTU );
     if( unlikely(p_block == NULL) )
         return NULL;
 
-    ssize_t len = net_Read( p_access, fd, NULL,
+    ssize_t len = net_Read( p_access, p_sys->fd, NULL,
                             p_block->p_buffer, MTU, false );
     if( len < 0 )
     {
@@ -213,5 +499,14 @@ static block_t *BlockUDP( access_t *p_access )
         return NULL;
     }
 
+    p_sys->stats.i_calls++;
+    p_sys->stats.i_datagrams++;
+    p_block->i_dts = mdate();
+    if( p_block->i_dts >= p_sys->i_report )
+    {
+        StatsReport( p_access );
+        p_sys->i_report = p_block->i_dts + STATS_PERIOD;
+    }
     return block_Realloc( p_block, 0, len );
 }
+#endif
@@ -49,12 +49,27 @@
 
 #ifndef _WIN32
 #   include <unistd.h>
+#   include <limits.h>
+#   include <sys/uio.h>
 #endif
 
 #ifndef O_LARGEFILE
 #   define O_LARGEFILE 0
 #endif
 
+#ifndef HAVE_POSIX_FADVISE
+# define posix_fadvise(fd, off, len, adv) ((void)0)
+#endif
+
+/* maximum number of blocks written with a single system call */
+#if defined( IOV_MAX ) && IOV_MAX < 256
+#   define WRITE_IOV IOV_MAX
+#else
+#   define WRITE_IOV 256
+#endif
+/* interval between write-behind statistics reports */
+#define STATS_PERIOD (INT64_C(10) * CLOCK_FREQ)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -73,6 +88,19 @@ static void Close( vlc_object_t * );
     "on the file path")
 #define SYNC_TEXT N_("Synchronous writing")
 #define SYNC_LONGTEXT N_( "Open the file with synchronous writing.")
+#define ASYNC_TEXT N_("Write in the background")
+#define ASYNC_LONGTEXT N_( "Queue the data and write it from a separate " \
+    "thread, so that a slow disk does not stall the stream output.")
+#define BUFFER_TEXT N_("Write-behind buffer (KiB)")
+#define BUFFER_LONGTEXT N_( "Maximum amount of data waiting to be written " \
+    "in the background.")
+#define DROP_TEXT N_("Drop data when the buffer is full")
+#define DROP_LONGTEXT N_( "Discard the data that does not fit in the " \
+    "write-behind buffer instead of waiting for the disk.")
+#define FLUSH_TEXT N_("Flush interval (KiB)")
+#define FLUSH_LONGTEXT N_( "When writing in the background, flush the " \
+    "data to the disk and evict it from the page cache every time that " \
+    "amount has been written. 0 leaves it to the system.")
 
 vlc_module_begin ()
     set_description( N_("File stream output") )
@@ -91,6 +119,14 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "sync", false, SYNC_TEXT,SYNC_LONGTEXT,
               false )
 #endif
+    add_bool( SOUT_CFG_PREFIX "async", false, ASYNC_TEXT, ASYNC_LONGTEXT,
+              true )
+    add_integer( SOUT_CFG_PREFIX "async-buffer", 32768, BUFFER_TEXT,
+                 BUFFER_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "async-drop", false, DROP_TEXT, DROP_LONGTEXT,
+              true )
+    add_integer( SOUT_CFG_PREFIX "async-flush", 8192, FLUSH_TEXT,
+                 FLUSH_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -100,6 +136,10 @@ vlc_module_end ()
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
     "append",
+    "async",
+    "async-buffer",
+    "async-drop",
+    "async-flush",
     "format",
     "overwrite",
 #ifdef O_SYNC
@@ -112,6 +152,49 @@ static ssize_t Write( sout_access_out_t *, block_t * );
 static int Seek ( sout_access_out_t *, off_t  );
 static ssize_t Read ( sout_access_out_t *, block_t * );
 static int Control( sout_access_out_t *, int, va_list );
+static void *Thread( void * );
+static void StatsReport( sout_access_out_t * );
+
+typedef struct
+{
+    unsigned      i_writes;
+    uint64_t      i_bytes;
+    mtime_t       i_latency_sum;
+    mtime_t       i_latency_max;
+    unsigned      i_flushes;
+    mtime_t       i_flush_max;
+    size_t        i_queued_max;
+    unsigned      i_stalls;     /* times the stream output waited for room */
+    mtime_t       i_stall_time;
+    uint64_t      i_dropped;
+} file_stats_t;
+
+struct sout_access_out_sys_t
+{
+    int           fd;
+    bool          b_async;
+
+    /* write-behind, protected by lock */
+    vlc_thread_t  thread;
+    vlc_mutex_t   lock;
+    vlc_cond_t    wait;         /* data was queued */
+    vlc_cond_t    done;         /* data was written */
+    block_t      *p_queue;
+    block_t     **pp_last;
+    size_t        i_queued;     /* bytes queued or being written */
+    size_t        i_max;
+    bool          b_drop;
+    bool          b_exit;
+    int           i_error;      /* errno of the first failed write */
+    mtime_t       i_report;
+    file_stats_t  stats;
+
+    /* owned by the thread */
+    size_t        i_flush;
+    size_t        i_unflushed;
+    off_t         i_dirty_start; /* file range written since the last flush */
+    off_t         i_dirty_end;
+};
 
 /*****************************************************************************
  * Open: open the file
@@ -119,6 +202,7 @@ static int Control( sout_access_out_t *, int, va_list );
 static int Open( vlc_object_t *p_this )
 {
     sout_access_out_t   *p_access = (sout_access_out_t*)p_this;
+    sout_access_out_sys_t *p_sys;
     int                 fd;
 
     config_ChainParse( p_access, SOUT_CFG_PREFIX, ppsz_sout_options, p_access->p_cfg );
@@ -207,16 +291,58 @@ static int Open( vlc_object_t *p_this )
             return VLC_EGENERIC;
     }
 
+    p_sys = calloc( 1, sizeof( *p_sys ) );
+    if( unlikely(p_sys == NULL) )
+    {
+        close( fd );
+        return VLC_ENOMEM;
+    }
+    p_sys->fd = fd;
+
     p_access->pf_write = Write;
     p_access->pf_read  = Read;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
-    p_access->p_sys    = (void *)(intptr_t)fd;
+    p_access->p_sys    = p_sys;
 
     msg_Dbg( p_access, "file access output opened (%s)", p_access->psz_path );
     if (append)
         lseek (fd, 0, SEEK_END);
 
+    if( var_GetBool( p_access, SOUT_CFG_PREFIX "async" ) )
+    {
+        int64_t i_max = var_GetInteger( p_access,
+                                        SOUT_CFG_PREFIX "async-buffer" );
+        int64_t i_flush = var_GetInteger( p_access,
+                                          SOUT_CFG_PREFIX "async-flush" );
+
+        p_sys->i_max = __MAX( i_max, 64 ) * 1024;
+        p_sys->i_flush = __MAX( i_flush, 0 ) * 1024;
+        p_sys->b_drop = var_GetBool( p_access, SOUT_CFG_PREFIX "async-drop" );
+        p_sys->p_queue = NULL;
+        p_sys->pp_last = &p_sys->p_queue;
+        p_sys->i_report = mdate() + STATS_PERIOD;
+        vlc_mutex_init( &p_sys->lock );
+        vlc_cond_init( &p_sys->wait );
+        vlc_cond_init( &p_sys->done );
+
+        if( vlc_clone( &p_sys->thread, Thread, p_access,
+                       VLC_THREAD_PRIORITY_OUTPUT ) )
+        {
+            msg_Warn( p_access, "cannot write in the background" );
+            vlc_cond_destroy( &p_sys->done );
+            vlc_cond_destroy( &p_sys->wait );
+            vlc_mutex_destroy( &p_sys->lock );
+        }
+        else
+        {
+            p_sys->b_async = true;
+            msg_Dbg( p_access, "writing in the background, %zu KiB buffer%s",
+                     p_sys->i_max / 1024,
+                     p_sys->b_drop ? ", dropping overflow" : "" );
+        }
+    }
+
     return VLC_SUCCESS;
 }
 
@@ -226,8 +352,30 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t * p_this )
 {
     sout_access_out_t *p_access = (sout_access_out_t*)p_this;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->b_async )
+    {
+        /* the thread writes whatever is left before exiting */
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->b_exit = true;
+        vlc_cond_signal( &p_sys->wait );
+        vlc_mutex_unlock( &p_sys->lock );
+        vlc_join( p_sys->thread, NULL );
+
+        if( p_sys->i_error )
+        {
+            errno = p_sys->i_error;
+            msg_Err( p_access, "cannot write: %m" );
+        }
+        StatsReport( p_access );
+        vlc_cond_destroy( &p_sys->done );
+        vlc_cond_destroy( &p_sys->wait );
+        vlc_mutex_destroy( &p_sys->lock );
+    }
 
-    close( (intptr_t)p_access->p_sys );
+    close( p_sys->fd );
+    free( p_sys );
 
     msg_Dbg( p_access, "file access output closed" );
 }
@@ -249,60 +397,291 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * Drain: wait until the data written in the background reaches the file
+ *****************************************************************************/
+static int Drain( sout_access_out_sys_t *p_sys )
+{
+    int i_error;
+
+    vlc_mutex_lock( &p_sys->lock );
+    mutex_cleanup_push( &p_sys->lock );
+    while( p_sys->i_queued > 0 )
+        vlc_cond_wait( &p_sys->done, &p_sys->lock );
+    i_error = p_sys->i_error;
+    vlc_cleanup_run();
+    return i_error;
+}
+
 /*****************************************************************************
  * Read: standard read on a file descriptor.
  *****************************************************************************/
 static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
 {
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
     ssize_t val;
 
+    if( p_sys->b_async && ( errno = Drain( p_sys ) ) != 0 )
+        return -1;
+
     do
-        val = read( (intptr_t)p_access->p_sys, p_buffer->p_buffer,
-                    p_buffer->i_buffer );
+        val = read( p_sys->fd, p_buffer->p_buffer, p_buffer->i_buffer );
     while (val == -1 && errno == EINTR);
     return val;
 }
 
 /*****************************************************************************
- * Write: standard write on a file descriptor.
+ * WriteChain: write and release a chain of blocks, gathering as many blocks
+ * as possible in each system call.
  *****************************************************************************/
-static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
+static ssize_t WriteChain( int fd, block_t *p_buffer )
 {
     size_t i_write = 0;
 
     while( p_buffer )
     {
-        ssize_t val = write ((intptr_t)p_access->p_sys,
-                             p_buffer->p_buffer, p_buffer->i_buffer);
-        if (val <= 0)
+#ifndef _WIN32
+        struct iovec iov[WRITE_IOV];
+        unsigned i_iov = 0;
+
+        for( block_t *p_block = p_buffer; p_block != NULL && i_iov < WRITE_IOV;
+             p_block = p_block->p_next )
+        {
+            if( p_block->i_buffer == 0 )
+                continue;
+            iov[i_iov].iov_base = p_block->p_buffer;
+            iov[i_iov].iov_len = p_block->i_buffer;
+            i_iov++;
+        }
+
+        ssize_t val = 0;
+        if( i_iov > 0 )
+            val = writev( fd, iov, i_iov );
+#else
+        unsigned i_iov = p_buffer->i_buffer > 0;
+        ssize_t val = 0;
+        if( i_iov > 0 )
+            val = write( fd, p_buffer->p_buffer, p_buffer->i_buffer );
+#endif
+        if( i_iov > 0 && val <= 0 )
         {
             if (errno == EINTR)
                 continue;
             block_ChainRelease (p_buffer);
-            msg_Err( p_access, "cannot write: %m" );
             return -1;
         }
+        i_write += val;
 
-        if ((size_t)val >= p_buffer->i_buffer)
+        /* release the blocks that were written completely */
+        while( p_buffer && (size_t)val >= p_buffer->i_buffer )
         {
             block_t *p_next = p_buffer->p_next;
+
+            val -= p_buffer->i_buffer;
             block_Release (p_buffer);
             p_buffer = p_next;
         }
-        else
+        if( p_buffer )
         {
             p_buffer->p_buffer += val;
             p_buffer->i_buffer -= val;
         }
-        i_write += val;
     }
     return i_write;
 }
 
+/*****************************************************************************
+ * Write: standard write on a file descriptor, or queue for the thread.
+ *****************************************************************************/
+static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !p_sys->b_async )
+    {
+        ssize_t val = WriteChain( p_sys->fd, p_buffer );
+        if( val < 0 )
+            msg_Err( p_access, "cannot write: %m" );
+        return val;
+    }
+
+    size_t i_size = 0;
+    for( block_t *p_block = p_buffer; p_block; p_block = p_block->p_next )
+        i_size += p_block->i_buffer;
+
+    int i_error;
+
+    vlc_mutex_lock( &p_sys->lock );
+    mutex_cleanup_push( &p_sys->lock );
+    /* the buffer is exceeded only when a single chain does not fit in it */
+    while( p_sys->i_queued > 0 && p_sys->i_queued + i_size > p_sys->i_max
+        && !p_sys->i_error )
+    {
+        if( p_sys->b_drop )
+        {
+            p_sys->stats.i_dropped += i_size;
+            block_ChainRelease( p_buffer );
+            p_buffer = NULL;
+            break;
+        }
+
+        mtime_t i_start = mdate();
+        vlc_cond_wait( &p_sys->done, &p_sys->lock );
+        p_sys->stats.i_stalls++;
+        p_sys->stats.i_stall_time += mdate() - i_start;
+    }
+
+    i_error = p_sys->i_error;
+    if( p_buffer != NULL && !i_error )
+    {
+        block_ChainLastAppend( &p_sys->pp_last, p_buffer );
+        p_sys->i_queued += i_size;
+        if( p_sys->stats.i_queued_max < p_sys->i_queued )
+            p_sys->stats.i_queued_max = p_sys->i_queued;
+        vlc_cond_signal( &p_sys->wait );
+        p_buffer = NULL;
+    }
+    vlc_cleanup_run();
+
+    if( i_error )
+    {
+        block_ChainRelease( p_buffer );
+        errno = i_error;
+        msg_Err( p_access, "cannot write: %m" );
+        return -1;
+    }
+    return i_size;
+}
+
 /*****************************************************************************
  * Seek: seek to a specific location in a file
  *****************************************************************************/
 static int Seek( sout_access_out_t *p_access, off_t i_pos )
 {
-    return lseek( (intptr_t)p_access->p_sys, i_pos, SEEK_SET );
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->b_async && ( errno = Drain( p_sys ) ) != 0 )
+        return -1;
+    return lseek( p_sys->fd, i_pos, SEEK_SET );
+}
+
+static void StatsReport( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    file_stats_t *p_stats = &p_sys->stats;
+
+    if( p_stats->i_writes > 0 )
+        msg_Dbg( p_access, "%u writes of %"PRIu64" KiB, latency average %"
+                 PRId64" us max %"PRId64" us, %u flushes max %"PRId64" us, "
+                 "queue max %zu KiB", p_stats->i_writes,
+                 p_stats->i_bytes / 1024,
+                 p_stats->i_latency_sum / p_stats->i_writes,
+                 p_stats->i_latency_max, p_stats->i_flushes,
+                 p_stats->i_flush_max, p_stats->i_queued_max / 1024 );
+    if( p_stats->i_stalls > 0 )
+        msg_Warn( p_access, "waited %u times (%"PRId64" ms) for the disk",
+                  p_stats->i_stalls, p_stats->i_stall_time / 1000 );
+    if( p_stats->i_dropped > 0 )
+        msg_Warn( p_access, "dropped %"PRIu64" KiB for the disk was too slow",
+                  p_stats->i_dropped / 1024 );
+
+    memset( p_stats, 0, sizeof( *p_stats ) );
+}
+
+/*****************************************************************************
+ * Thread: write the queued data, flushing it to the disk at regular intervals
+ *****************************************************************************/
+static void *Thread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        while( p_sys->p_queue == NULL && !p_sys->b_exit )
+            vlc_cond_wait( &p_sys->wait, &p_sys->lock );
+        if( p_sys->p_queue == NULL )
+            break;
+
+        /* take everything that has been queued, to write it at once */
+        block_t *p_chain = p_sys->p_queue;
+        bool b_failed = p_sys->i_error != 0;
+        p_sys->p_queue = NULL;
+        p_sys->pp_last = &p_sys->p_queue;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        size_t i_size = 0;
+        for( block_t *p_block = p_chain; p_block; p_block = p_block->p_next )
+            i_size += p_block->i_buffer;
+
+        mtime_t i_start = mdate(), i_flush = 0;
+        off_t i_offset = -1;
+        int i_error = 0;
+        if( !b_failed && p_sys->i_flush > 0 )
+            i_offset = lseek( p_sys->fd, 0, SEEK_CUR );
+        if( b_failed )
+            block_ChainRelease( p_chain );
+        else if( WriteChain( p_sys->fd, p_chain ) < 0 )
+            i_error = errno;
+        mtime_t i_latency = mdate() - i_start;
+
+        if( i_offset >= 0 && !i_error )
+        {
+            if( p_sys->i_unflushed == 0
+             || p_sys->i_dirty_start > i_offset )
+                p_sys->i_dirty_start = i_offset;
+            if( p_sys->i_unflushed == 0
+             || p_sys->i_dirty_end < i_offset + (off_t)i_size )
+                p_sys->i_dirty_end = i_offset + i_size;
+        }
+        p_sys->i_unflushed += i_size;
+        if( !i_error && p_sys->i_flush > 0
+         && p_sys->i_unflushed >= p_sys->i_flush )
+        {
+            /* keep the dirty and cached data from piling up */
+#if defined(__APPLE__) || defined(__ANDROID__)
+            fsync( p_sys->fd );
+#else
+            fdatasync( p_sys->fd );
+#endif
+            /* only drop the pages just written back */
+            if( p_sys->i_dirty_end > p_sys->i_dirty_start )
+                posix_fadvise( p_sys->fd, p_sys->i_dirty_start,
+                               p_sys->i_dirty_end - p_sys->i_dirty_start,
+                               POSIX_FADV_DONTNEED );
+            p_sys->i_unflushed = 0;
+            i_flush = mdate() - i_start - i_latency;
+        }
+
+        vlc_mutex_lock( &p_sys->lock );
+        if( i_error && !p_sys->i_error )
+            p_sys->i_error = i_error;
+        p_sys->i_queued -= i_size;
+        vlc_cond_broadcast( &p_sys->done );
+
+        if( !b_failed )
+        {
+            file_stats_t *p_stats = &p_sys->stats;
+
+            p_stats->i_writes++;
+            p_stats->i_bytes += i_size;
+            p_stats->i_latency_sum += i_latency;
+            if( p_stats->i_latency_max < i_latency )
+                p_stats->i_latency_max = i_latency;
+            if( i_flush > 0 )
+            {
+                p_stats->i_flushes++;
+                if( p_stats->i_flush_max < i_flush )
+                    p_stats->i_flush_max = i_flush;
+            }
+        }
+        if( i_start >= p_sys->i_report )
+        {
+            StatsReport( p_access );
+            p_sys->i_report = i_start + STATS_PERIOD;
+        }
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    return NULL;
 }
@@ -45,6 +45,7 @@
 #include <vlc_fs.h>
 #include <vlc_strings.h>
 #include <vlc_charset.h>
+#include <vlc_httpd.h>
 
 #include <gcrypt.h>
 #include <vlc_gcrypt.h>
@@ -59,6 +60,10 @@
 
 #define MAX_RENAME_RETRIES        10
 
+/* segments kept in memory when serving through httpd without numsegs */
+#define HTTPD_NUMSEGS             5
+#define STATS_INTERVAL            (CLOCK_FREQ * 60)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -104,6 +109,19 @@ static void Close( vlc_object_t * );
 #define RANDOMIV_TEXT N_("Use randomized IV for encryption")
 #define RANDOMIV_LONGTEXT N_("Generate IV instead using segment-number as IV")
 
+#define PARTLEN_TEXT N_("Partial segment length (ms)")
+#define PARTLEN_LONGTEXT N_("When serving from memory, also publish parts "\
+                            "of the segment being written, cut at keyframes "\
+                            "where possible, as low latency HLS partial "\
+                            "segments. 0 disables them.")
+
+#define HTTPD_TEXT N_("Serve segments from memory")
+#define HTTPD_LONGTEXT N_("Keep the last segments in memory and serve them "\
+                          "along with the index through the built-in HTTP "\
+                          "server (see http-host and http-port) instead of "\
+                          "writing files. The segment path and the index are "\
+                          "then URL paths, starting with /.")
+
 vlc_module_begin ()
     set_description( N_("HTTP Live streaming output") )
     set_shortname( N_("LiveHTTP" ))
@@ -123,6 +141,10 @@ vlc_module_begin ()
               NOCACHE_TEXT, NOCACHE_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "generate-iv", false,
               RANDOMIV_TEXT, RANDOMIV_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "httpd", false,
+              HTTPD_TEXT, HTTPD_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "partlen", 0,
+                 PARTLEN_TEXT, PARTLEN_LONGTEXT, true )
     add_string( SOUT_CFG_PREFIX "index", NULL,
                 INDEX_TEXT, INDEX_LONGTEXT, false )
     add_string( SOUT_CFG_PREFIX "index-url", NULL,
@@ -153,6 +175,8 @@ static const char *const ppsz_sout_options[] = {
     "key-file",
     "key-loadfile",
     "generate-iv",
+    "httpd",
+    "partlen",
     NULL
 };
 
@@ -160,6 +184,13 @@ static ssize_t Write( sout_access_out_t *, block_t * );
 static int Seek ( sout_access_out_t *, off_t  );
 static int Control( sout_access_out_t *, int, va_list );
 
+typedef struct output_part
+{
+    size_t i_end; /* offset in the segment */
+    mtime_t i_length;
+    bool b_independent;
+} output_part_t;
+
 typedef struct output_segment
 {
     char *psz_filename;
@@ -169,6 +200,18 @@ typedef struct output_segment
     float f_seglength;
     uint32_t i_segment_number;
     uint8_t aes_ivs[16];
+
+    /* in-memory mode: psz_filename is the URL path of the segment */
+    sout_access_out_sys_t *p_sys;
+    httpd_url_t *p_url;
+    uint8_t *p_buffer; /* payload while being written */
+    size_t i_buffer;
+    size_t i_buffer_size;
+    block_t *p_data; /* shared payload once complete */
+    bool b_complete;
+    bool b_expired;
+    output_part_t *p_parts; /* complete parts */
+    unsigned i_parts;
 } output_segment_t;
 
 struct sout_access_out_sys_t
@@ -197,10 +240,42 @@ struct sout_access_out_sys_t
     uint8_t stuffing_bytes[16];
     ssize_t stuffing_size;
     vlc_array_t *segments_t;
+
+    /* in-memory mode */
+    bool b_httpd;
+    bool b_segment_open;
+    size_t i_segment_size; /* of the last segment, to preallocate the next */
+    httpd_host_t *p_httpd_host;
+    httpd_url_t *p_index_url;
+    vlc_array_t *expired_t; /* still answering, as misses */
+    vlc_mutex_t lock; /* protects p_index, the segments payload and the counters */
+    block_t *p_index;
+    uint32_t i_index_firstseg; /* window of the last full index update */
+    unsigned i_index_offset;
+
+    /* partial segments */
+    mtime_t i_partlenm;
+    mtime_t i_part_dts;
+    bool b_part_independent;
+
+    struct
+    {
+        unsigned i_segments;
+        mtime_t  i_latency_total;
+        mtime_t  i_latency_max;
+        mtime_t  i_last_report;
+        unsigned i_parts;
+        unsigned i_index_requests;
+        unsigned i_chunked;
+        unsigned i_hits;
+        unsigned i_misses;
+        uint64_t i_bytes;
+    } stats;
 };
 
 static int LoadCryptFile( sout_access_out_t *p_access);
 static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
+static int HttpdSetup( sout_access_out_t *p_access );
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -232,6 +307,26 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_ratecontrol = var_GetBool( p_access, SOUT_CFG_PREFIX "ratecontrol") ;
     p_sys->b_caching = var_GetBool( p_access, SOUT_CFG_PREFIX "caching") ;
     p_sys->b_generate_iv = var_GetBool( p_access, SOUT_CFG_PREFIX "generate-iv") ;
+    p_sys->b_httpd = var_GetBool( p_access, SOUT_CFG_PREFIX "httpd" );
+
+    if( p_sys->b_httpd )
+    {
+        /* The memory ring must be bounded */
+        if( p_sys->i_numsegs == 0 )
+        {
+            msg_Warn( p_access, "number of segments not set, keeping %d in memory",
+                      HTTPD_NUMSEGS );
+            p_sys->i_numsegs = HTTPD_NUMSEGS;
+        }
+        p_sys->b_delsegs = true;
+    }
+
+    p_sys->i_partlenm = var_GetInteger( p_access, SOUT_CFG_PREFIX "partlen" ) * (CLOCK_FREQ / 1000);
+    if( p_sys->i_partlenm < 0 || ( p_sys->i_partlenm && !p_sys->b_httpd ) )
+    {
+        msg_Warn( p_access, "partial segments need serving from memory" );
+        p_sys->i_partlenm = 0;
+    }
 
     p_sys->segments_t = vlc_array_new();
 
@@ -240,7 +335,9 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->psz_indexPath = NULL;
     psz_idx = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "index" );
-    if ( psz_idx )
+    if ( psz_idx && p_sys->b_httpd )
+        p_sys->psz_indexPath = psz_idx;
+    else if ( psz_idx )
     {
         char *psz_tmp;
         psz_tmp = str_format_time( psz_idx );
@@ -278,9 +375,46 @@ static int Open( vlc_object_t *p_this )
         return VLC_EGENERIC;
     }
 
+    /* Parts of an encrypted segment cannot be decrypted on their own */
+    if( p_sys->i_partlenm && p_sys->key_uri )
+    {
+        msg_Warn( p_access, "partial segments are not supported with encryption" );
+        p_sys->i_partlenm = 0;
+    }
+
     p_sys->i_handle = -1;
     p_sys->i_segment = 0;
     p_sys->psz_cursegPath = NULL;
+    p_sys->b_segment_open = false;
+    p_sys->i_segment_size = 0;
+    p_sys->i_index_firstseg = 1;
+    p_sys->i_index_offset = 0;
+    p_sys->i_part_dts = VLC_TS_INVALID;
+    p_sys->b_part_independent = false;
+    p_sys->p_httpd_host = NULL;
+    p_sys->p_index_url = NULL;
+    p_sys->p_index = NULL;
+    p_sys->expired_t = vlc_array_new();
+    memset( &p_sys->stats, 0, sizeof( p_sys->stats ) );
+    p_sys->stats.i_last_report = mdate();
+    vlc_mutex_init( &p_sys->lock );
+
+    if( p_sys->b_httpd && HttpdSetup( p_access ) )
+    {
+        vlc_mutex_destroy( &p_sys->lock );
+        vlc_array_destroy( p_sys->expired_t );
+        vlc_array_destroy( p_sys->segments_t );
+        if( p_sys->key_uri )
+        {
+            gcry_cipher_close( p_sys->aes_ctx );
+            free( p_sys->key_uri );
+        }
+        free( p_sys->psz_keyfile );
+        free( p_sys->psz_indexUrl );
+        free( p_sys->psz_indexPath );
+        free( p_sys );
+        return VLC_EGENERIC;
+    }
 
     p_access->pf_write = Write;
     p_access->pf_seek  = Seek;
@@ -481,8 +615,16 @@ static char *formatSegmentPath( char *psz_path, uint32_t i_seg, bool b_sanitize
     return psz_result;
 }
 
+/* Must not be called with p_sys->lock held: deleting the URL waits for the
+ * httpd host thread, which may be running one of our callbacks. */
 static void destroySegment( output_segment_t *segment )
 {
+    if( segment->p_url )
+        httpd_UrlDelete( segment->p_url );
+    if( segment->p_data )
+        block_Release( segment->p_data );
+    free( segment->p_buffer );
+    free( segment->p_parts );
     free( segment->psz_filename );
     free( segment->psz_duration );
     free( segment->psz_uri );
@@ -490,6 +632,491 @@ static void destroySegment( output_segment_t *segment )
     free( segment );
 }
 
+/*****************************************************************************
+ * In-memory origin: segments and index are served by the httpd host thread.
+ * The segment being written grows in a plain buffer, from which requests
+ * for it (or its parts) are answered in chunks as data comes in. Once
+ * complete, it becomes a shared block, and a request only holds a reference
+ * on it for the time of the copy, so that the muxing thread never waits for
+ * a client.
+ *****************************************************************************/
+static void httpdAnswer( httpd_message_t *answer, const httpd_message_t *query,
+                         int i_status, const char *psz_mime,
+                         const char *psz_cache )
+{
+    const char *psz_connection;
+
+    answer->i_proto  = HTTPD_PROTO_HTTP;
+    answer->i_version= 1;
+    answer->i_type   = HTTPD_MSG_ANSWER;
+    answer->i_status = i_status;
+
+    if( i_status == 200 )
+    {
+        httpd_MsgAdd( answer, "Content-type", "%s", psz_mime );
+        httpd_MsgAdd( answer, "Cache-Control", "%s", psz_cache );
+    }
+
+    /* We respect client request */
+    psz_connection = httpd_MsgGet( query, "Connection" );
+    if( psz_connection != NULL )
+        httpd_MsgAdd( answer, "Connection", "%s", psz_connection );
+}
+
+static void httpdBody( httpd_message_t *answer, const httpd_message_t *query,
+                       const uint8_t *p_data, size_t i_data )
+{
+    if( i_data > 0 && query->i_type != HTTPD_MSG_HEAD )
+    {
+        answer->p_body = malloc( i_data );
+        if( likely( answer->p_body != NULL ) )
+        {
+            memcpy( answer->p_body, p_data, i_data );
+            answer->i_body = i_data;
+        }
+        else
+        {
+            answer->i_status = 500;
+            i_data = 0;
+        }
+    }
+    httpd_MsgAdd( answer, "Content-Length", "%zu", i_data );
+}
+
+static int IndexCallback( httpd_callback_sys_t *p_cbsys, httpd_client_t *cl,
+                          httpd_message_t *answer,
+                          const httpd_message_t *query )
+{
+    sout_access_out_sys_t *p_sys = (sout_access_out_sys_t *)p_cbsys;
+    block_t *p_index = NULL;
+    (void) cl;
+
+    if( answer == NULL || query == NULL )
+        return VLC_SUCCESS;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( p_sys->p_index )
+        p_index = block_Hold( p_sys->p_index );
+    p_sys->stats.i_index_requests++;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    /* 404 until the first segment or part is complete */
+    httpdAnswer( answer, query, p_index ? 200 : 404,
+                 "application/vnd.apple.mpegurl", "no-cache" );
+    if( p_index )
+    {
+        httpdBody( answer, query, p_index->p_buffer, p_index->i_buffer );
+        block_Release( p_index );
+    }
+    else
+        httpdBody( answer, query, NULL, 0 );
+    return VLC_SUCCESS;
+}
+
+/* Part requested with a part=N argument, -1 for the whole segment */
+static int segmentPart( const httpd_message_t *query )
+{
+    const char *psz_arg = (const char *)query->psz_args;
+
+    while( psz_arg != NULL && *psz_arg )
+    {
+        if( !strncmp( psz_arg, "part=", 5 ) )
+        {
+            int i_part = atoi( psz_arg + 5 );
+            return i_part >= 0 ? i_part : -2;
+        }
+        psz_arg = strchr( psz_arg, '&' );
+        if( psz_arg )
+            psz_arg++;
+    }
+    return -1;
+}
+
+/* Locates a part, or the whole segment, in the payload. *pb_final tells
+ * whether the end of the range is known yet. Called with p_sys->lock */
+static bool segmentRange( const output_segment_t *segment, int i_part,
+                          size_t *pi_start, size_t *pi_end, bool *pb_final )
+{
+    if( segment->b_expired || i_part < -1 )
+        return false;
+
+    if( i_part == -1 )
+    {
+        *pi_start = 0;
+        *pi_end = segment->i_buffer;
+        *pb_final = segment->b_complete;
+        return true;
+    }
+
+    /* The part being written can be requested, not the next ones */
+    if( (unsigned)i_part > segment->i_parts ||
+        ( (unsigned)i_part == segment->i_parts && segment->b_complete ) )
+        return false;
+
+    *pi_start = i_part > 0 ? segment->p_parts[i_part - 1].i_end : 0;
+    *pb_final = (unsigned)i_part < segment->i_parts;
+    *pi_end = *pb_final ? segment->p_parts[i_part].i_end : segment->i_buffer;
+    return true;
+}
+
+static const uint8_t *segmentPayload( const output_segment_t *segment )
+{
+    return segment->b_complete ? segment->p_data->p_buffer : segment->p_buffer;
+}
+
+/* Sends what was written since the last chunk, ends the answer once the
+ * range is complete */
+static int SegmentChunk( output_segment_t *segment, httpd_message_t *answer,
+                         int i_part )
+{
+    sout_access_out_sys_t *p_sys = segment->p_sys;
+    size_t i_pos = answer->i_body_offset - 1, i_start, i_end;
+    bool b_final;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( !segmentRange( segment, i_part, &i_start, &i_end, &b_final ) )
+    {
+        /* expired meanwhile, nothing more to send */
+        i_end = i_pos;
+        b_final = true;
+    }
+
+    if( i_pos >= i_end && !b_final )
+    {
+        vlc_mutex_unlock( &p_sys->lock );
+        return VLC_EGENERIC; /* wait, no data available */
+    }
+
+    if( i_pos < i_end )
+    {
+        answer->p_body = malloc( i_end - i_pos );
+        if( likely( answer->p_body != NULL ) )
+        {
+            memcpy( answer->p_body, segmentPayload( segment ) + i_pos,
+                    i_end - i_pos );
+            answer->i_body = i_end - i_pos;
+            p_sys->stats.i_bytes += i_end - i_pos;
+        }
+        else
+            b_final = true;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    answer->i_proto  = HTTPD_PROTO_HTTP;
+    answer->i_version= 1;
+    answer->i_type   = HTTPD_MSG_ANSWER;
+    answer->i_body_offset = b_final ? 0 : 1 + i_end;
+    return VLC_SUCCESS;
+}
+
+static int SegmentCallback( httpd_callback_sys_t *p_cbsys, httpd_client_t *cl,
+                            httpd_message_t *answer,
+                            const httpd_message_t *query )
+{
+    output_segment_t *segment = (output_segment_t *)p_cbsys;
+    sout_access_out_sys_t *p_sys = segment->p_sys;
+    size_t i_start, i_end;
+    block_t *p_data = NULL;
+    bool b_final;
+    (void) cl;
+
+    if( answer == NULL || query == NULL )
+        return VLC_SUCCESS;
+
+    int i_part = segmentPart( query );
+    if( answer->i_body_offset > 0 )
+        return SegmentChunk( segment, answer, i_part );
+
+    vlc_mutex_lock( &p_sys->lock );
+    bool b_found = segmentRange( segment, i_part, &i_start, &i_end, &b_final );
+    if( !b_found && segment->b_expired )
+        p_sys->stats.i_misses++;
+
+    /* HTTP/1.0 has no chunked transfer: only complete data can be sent */
+    if( b_found && !b_final && query->i_version == 0 &&
+        query->i_type != HTTPD_MSG_HEAD )
+        b_found = false;
+
+    if( !b_found )
+    {
+        vlc_mutex_unlock( &p_sys->lock );
+        httpdAnswer( answer, query, 404, NULL, NULL );
+        httpdBody( answer, query, NULL, 0 );
+        return VLC_SUCCESS;
+    }
+
+    p_sys->stats.i_hits++;
+    if( query->i_type != HTTPD_MSG_HEAD )
+        p_sys->stats.i_bytes += i_end - i_start;
+    if( !b_final && query->i_type != HTTPD_MSG_HEAD )
+        p_sys->stats.i_chunked++;
+
+    /* Complete segments never change: copy without the lock */
+    if( segment->b_complete )
+    {
+        p_data = block_Hold( segment->p_data );
+        vlc_mutex_unlock( &p_sys->lock );
+        if( unlikely( p_data == NULL ) )
+        {
+            httpdAnswer( answer, query, 500, NULL, NULL );
+            httpdBody( answer, query, NULL, 0 );
+            return VLC_SUCCESS;
+        }
+        httpdAnswer( answer, query, 200, "video/MP2T", "max-age=3600" );
+        httpdBody( answer, query, &p_data->p_buffer[i_start], i_end - i_start );
+        block_Release( p_data );
+        return VLC_SUCCESS;
+    }
+
+    httpdAnswer( answer, query, 200, "video/MP2T",
+                 b_final ? "max-age=3600" : "no-cache" );
+    if( b_final || query->i_type == HTTPD_MSG_HEAD )
+        httpdBody( answer, query, &segment->p_buffer[i_start], i_end - i_start );
+    else
+    {
+        /* Being written: send what is there and follow up in chunks */
+        if( i_end > i_start )
+        {
+            answer->p_body = malloc( i_end - i_start );
+            if( likely( answer->p_body != NULL ) )
+            {
+                memcpy( answer->p_body, &segment->p_buffer[i_start],
+                        i_end - i_start );
+                answer->i_body = i_end - i_start;
+            }
+            else
+                i_end = i_start;
+        }
+        httpd_MsgAdd( answer, "Transfer-Encoding", "chunked" );
+        answer->i_body_offset = 1 + i_end;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    return VLC_SUCCESS;
+}
+
+static int HttpdSetup( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_access->psz_path[0] != '/' ||
+        !p_sys->psz_indexPath || p_sys->psz_indexPath[0] != '/' )
+    {
+        msg_Err( p_access, "serving from memory needs URL paths for both "
+                 "the segments and the index" );
+        return VLC_EGENERIC;
+    }
+
+    p_sys->p_httpd_host = vlc_http_HostNew( VLC_OBJECT(p_access) );
+    if( p_sys->p_httpd_host == NULL )
+    {
+        msg_Err( p_access, "cannot start HTTP server" );
+        return VLC_EGENERIC;
+    }
+
+    p_sys->p_index_url = httpd_UrlNew( p_sys->p_httpd_host,
+                                       p_sys->psz_indexPath, NULL, NULL );
+    if( p_sys->p_index_url == NULL )
+    {
+        msg_Err( p_access, "cannot add index %s", p_sys->psz_indexPath );
+        httpd_HostDelete( p_sys->p_httpd_host );
+        return VLC_EGENERIC;
+    }
+    httpd_UrlCatch( p_sys->p_index_url, HTTPD_MSG_HEAD, IndexCallback,
+                    (httpd_callback_sys_t *)p_sys );
+    httpd_UrlCatch( p_sys->p_index_url, HTTPD_MSG_GET, IndexCallback,
+                    (httpd_callback_sys_t *)p_sys );
+    return VLC_SUCCESS;
+}
+
+/* Makes a new segment available at its URL, while it is written */
+static int registerSegment( sout_access_out_t *p_access,
+                            sout_access_out_sys_t *p_sys,
+                            output_segment_t *segment )
+{
+    segment->p_sys = p_sys;
+    segment->p_url = httpd_UrlNew( p_sys->p_httpd_host, segment->psz_filename,
+                                   NULL, NULL );
+    if( segment->p_url == NULL )
+    {
+        msg_Err( p_access, "cannot add segment %s", segment->psz_filename );
+        return -1;
+    }
+    httpd_UrlCatch( segment->p_url, HTTPD_MSG_HEAD, SegmentCallback,
+                    (httpd_callback_sys_t *)segment );
+    httpd_UrlCatch( segment->p_url, HTTPD_MSG_GET, SegmentCallback,
+                    (httpd_callback_sys_t *)segment );
+    return 0;
+}
+
+/*****************************************************************************
+ * segmentWrite: write to the current segment, as write()
+ *****************************************************************************/
+static ssize_t segmentWrite( sout_access_out_sys_t *p_sys,
+                             const uint8_t *p_data, size_t i_data )
+{
+    if( !p_sys->b_httpd )
+        return write( p_sys->i_handle, p_data, i_data );
+
+    if( !p_sys->b_segment_open )
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t,
+                                    vlc_array_count( p_sys->segments_t ) - 1 );
+    ssize_t i_ret = i_data;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( segment->i_buffer + i_data > segment->i_buffer_size )
+    {
+        /* Start from the size of the previous segment */
+        size_t i_size = segment->i_buffer_size ? 2 * segment->i_buffer_size
+                      : p_sys->i_segment_size + p_sys->i_segment_size / 8;
+        i_size = __MAX( i_size, segment->i_buffer + i_data );
+
+        uint8_t *p_buffer = realloc( segment->p_buffer, i_size );
+        if( likely( p_buffer != NULL ) )
+        {
+            segment->p_buffer = p_buffer;
+            segment->i_buffer_size = i_size;
+        }
+        else
+        {
+            errno = ENOMEM;
+            i_ret = -1;
+        }
+    }
+    if( i_ret >= 0 )
+    {
+        memcpy( &segment->p_buffer[segment->i_buffer], p_data, i_data );
+        segment->i_buffer += i_data;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    return i_ret;
+}
+
+static size_t partStart( const output_segment_t *segment )
+{
+    return segment->i_parts ? segment->p_parts[segment->i_parts - 1].i_end : 0;
+}
+
+/* Ends the current part at the current end of the segment */
+static void addPart( sout_access_out_sys_t *p_sys, output_segment_t *segment,
+                     mtime_t i_length )
+{
+    vlc_mutex_lock( &p_sys->lock );
+    output_part_t *p_parts = realloc( segment->p_parts,
+                                      ( segment->i_parts + 1 ) * sizeof( *p_parts ) );
+    if( likely( p_parts != NULL ) )
+    {
+        p_parts[segment->i_parts].i_end = segment->i_buffer;
+        p_parts[segment->i_parts].i_length = i_length;
+        p_parts[segment->i_parts].b_independent = p_sys->b_part_independent;
+        segment->p_parts = p_parts;
+        segment->i_parts++;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    p_sys->stats.i_parts++;
+}
+
+/* Freezes the payload of the segment into a shared block */
+static void completeSegment( sout_access_out_sys_t *p_sys,
+                             output_segment_t *segment )
+{
+    if( p_sys->i_partlenm && segment->i_buffer > partStart( segment ) )
+        addPart( p_sys, segment, p_sys->i_opendts +
+                 (mtime_t)( p_sys->f_seglen * CLOCK_FREQ ) - p_sys->i_part_dts );
+
+    block_t *p_data = NULL;
+    if( segment->p_buffer )
+        p_data = block_Share( block_heap_Alloc( segment->p_buffer,
+                                                segment->i_buffer ) );
+
+    vlc_mutex_lock( &p_sys->lock );
+    segment->p_data = p_data;
+    segment->p_buffer = NULL; /* owned by the block now */
+    segment->b_complete = true;
+    segment->b_expired = p_data == NULL;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    p_sys->i_segment_size = segment->i_buffer;
+}
+
+/* Replaces the served index, consumes the string */
+static int publishIndex( sout_access_out_sys_t *p_sys, char *psz_index,
+                         size_t i_index )
+{
+    block_t *p_index = block_Share( block_heap_Alloc( psz_index, i_index ) );
+    if( unlikely( p_index == NULL ) )
+        return -1;
+
+    vlc_mutex_lock( &p_sys->lock );
+    block_t *p_old = p_sys->p_index;
+    p_sys->p_index = p_index;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    if( p_old )
+        block_Release( p_old );
+    return 0;
+}
+
+/* Drops the payload of a segment removed from the ring. Its URL answers
+ * (and counts misses) for another numsegs segments before going away. */
+static void expireSegment( sout_access_out_sys_t *p_sys,
+                           output_segment_t *segment )
+{
+    vlc_mutex_lock( &p_sys->lock );
+    block_t *p_data = segment->p_data;
+    segment->p_data = NULL;
+    segment->b_expired = true;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    if( p_data )
+        block_Release( p_data );
+
+    vlc_array_append( p_sys->expired_t, segment );
+    while( (unsigned)vlc_array_count( p_sys->expired_t ) > p_sys->i_numsegs )
+    {
+        output_segment_t *oldest = vlc_array_item_at_index( p_sys->expired_t, 0 );
+        vlc_array_remove( p_sys->expired_t, 0 );
+        destroySegment( oldest );
+    }
+}
+
+static void reportStats( sout_access_out_t *p_access,
+                         sout_access_out_sys_t *p_sys )
+{
+    unsigned i_index_requests, i_chunked, i_hits, i_misses;
+    uint64_t i_bytes;
+
+    p_sys->stats.i_last_report = mdate();
+    if( p_sys->stats.i_segments == 0 )
+        return;
+
+    msg_Dbg( p_access, "%u segment(s) created, latency %"PRId64" us average, "
+             "%"PRId64" us max", p_sys->stats.i_segments,
+             p_sys->stats.i_latency_total / p_sys->stats.i_segments,
+             p_sys->stats.i_latency_max );
+
+    if( !p_sys->b_httpd )
+        return;
+
+    vlc_mutex_lock( &p_sys->lock );
+    i_index_requests = p_sys->stats.i_index_requests;
+    i_chunked = p_sys->stats.i_chunked;
+    i_hits = p_sys->stats.i_hits;
+    i_misses = p_sys->stats.i_misses;
+    i_bytes = p_sys->stats.i_bytes;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    msg_Dbg( p_access, "served %u index request(s), %u segment hit(s) "
+             "(%u chunked, %"PRIu64" bytes), %u miss(es)", i_index_requests,
+             i_hits, i_chunked, i_bytes, i_misses );
+    if( p_sys->i_partlenm )
+        msg_Dbg( p_access, "%u part(s) created", p_sys->stats.i_parts );
+}
+
 /************************************************************************
  * segmentAmountNeeded: check that playlist has atleast 3*p_sys->i_seglength of segments
  * return how many segments are needed for that (max of p_sys->i_segment )
@@ -532,6 +1159,152 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
     return duration >= (first->f_seglength + (float)p_sys->i_seglen);
 }
 
+/************************************************************************
+ * indexPrintf: append to the index being formatted
+ ************************************************************************/
+static int indexPrintf( char **ppsz_index, size_t *pi_index,
+                        const char *psz_format, ... ) VLC_FORMAT( 3, 4 );
+static int indexPrintf( char **ppsz_index, size_t *pi_index,
+                        const char *psz_format, ... )
+{
+    va_list args;
+    char *psz_line;
+
+    va_start( args, psz_format );
+    int i_line = vasprintf( &psz_line, psz_format, args );
+    va_end( args );
+    if( i_line < 0 )
+        return -1;
+
+    char *psz_index = realloc( *ppsz_index, *pi_index + i_line + 1 );
+    if( unlikely( psz_index == NULL ) )
+    {
+        free( psz_line );
+        return -1;
+    }
+    memcpy( &psz_index[*pi_index], psz_line, i_line + 1 );
+    free( psz_line );
+    *ppsz_index = psz_index;
+    *pi_index += i_line;
+    return 0;
+}
+
+/************************************************************************
+ * formatParts: list the parts of a segment, and the one being written
+ ************************************************************************/
+static int formatParts( char **ppsz_index, size_t *pi_index,
+                        const output_segment_t *segment )
+{
+    const char *psz_sep = strchr( segment->psz_uri, '?' ) ? "&" : "?";
+
+    for( unsigned i = 0; i < segment->i_parts; i++ )
+    {
+        const output_part_t *part = &segment->p_parts[i];
+        mtime_t i_ms = __MAX( part->i_length, 0 ) * 1000 / CLOCK_FREQ;
+
+        if( indexPrintf( ppsz_index, pi_index, "#EXT-X-PART:DURATION=%"PRId64".%03u,URI=\"%s%spart=%u\"%s\n",
+                         i_ms / 1000, (unsigned)( i_ms % 1000 ), segment->psz_uri, psz_sep, i,
+                         part->b_independent ? ",INDEPENDENT=YES" : "" ) < 0 )
+            return -1;
+    }
+
+    /* The client can ask for the next part early, it is sent as it is written */
+    if( !segment->b_complete &&
+        indexPrintf( ppsz_index, pi_index, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%spart=%u\"\n",
+                     segment->psz_uri, psz_sep, segment->i_parts ) < 0 )
+        return -1;
+    return 0;
+}
+
+/************************************************************************
+ * formatIndex: format the index listing segments i_firstseg to i_lastseg,
+ * and the parts of the segment being written if any
+ ************************************************************************/
+static char *formatIndex( sout_access_out_sys_t *p_sys, uint32_t i_firstseg,
+                          unsigned i_index_offset, uint32_t i_lastseg,
+                          bool b_isend, size_t *pi_index )
+{
+    char *psz_index = NULL;
+    const char *psz_current_uri = NULL;
+
+    *pi_index = 0;
+    /* Partial segments and preload hints need protocol version 6 */
+    if ( indexPrintf( &psz_index, pi_index, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:%d\n#EXT-X-ALLOW-CACHE:%s"
+                      "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
+                      p_sys->i_partlenm ? 6 : 3,
+                      p_sys->b_caching ? "YES" : "NO",
+                      p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
+                      i_firstseg ) < 0 )
+        goto error;
+
+    if ( p_sys->i_partlenm )
+    {
+        mtime_t i_ms = p_sys->i_partlenm * 1000 / CLOCK_FREQ;
+        if ( indexPrintf( &psz_index, pi_index, "#EXT-X-PART-INF:PART-TARGET=%"PRId64".%03u\n"
+                          "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%"PRId64".%03u\n",
+                          i_ms / 1000, (unsigned)( i_ms % 1000 ),
+                          3 * i_ms / 1000, (unsigned)( 3 * i_ms % 1000 ) ) < 0 )
+            goto error;
+    }
+
+    for ( uint32_t i = i_firstseg; i <= i_lastseg; i++ )
+    {
+        //scale to i_index_offset..numsegs + i_index_offset
+        uint32_t index = i - i_firstseg + i_index_offset;
+
+        output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
+        if( p_sys->key_uri &&
+            ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
+          )
+        {
+            int ret = 0;
+            psz_current_uri = segment->psz_key_uri;
+            if( p_sys->b_generate_iv )
+            {
+                unsigned long long iv_hi = 0, iv_lo = 0;
+                for( unsigned short j = 0; j < 8; j++ )
+                {
+                    iv_hi |= segment->aes_ivs[j] & 0xff;
+                    iv_hi <<= 8;
+                    iv_lo |= segment->aes_ivs[8+j] & 0xff;
+                    iv_lo <<= 8;
+                }
+                ret = indexPrintf( &psz_index, pi_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                   segment->psz_key_uri, iv_hi, iv_lo );
+
+            } else {
+                ret = indexPrintf( &psz_index, pi_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
+            }
+            if( ret < 0 )
+                goto error;
+        }
+
+        /* Keep the parts of the last segment for the clients still on them */
+        if ( p_sys->i_partlenm && i == i_lastseg &&
+             formatParts( &psz_index, pi_index, segment ) < 0 )
+            goto error;
+
+        if ( indexPrintf( &psz_index, pi_index, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri ) < 0 )
+            goto error;
+    }
+
+    if ( p_sys->i_partlenm && p_sys->b_segment_open )
+    {
+        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
+        if ( formatParts( &psz_index, pi_index, segment ) < 0 )
+            goto error;
+    }
+
+    if ( b_isend && indexPrintf( &psz_index, pi_index, STR_ENDLIST ) < 0 )
+        goto error;
+
+    return psz_index;
+
+error:
+    free( psz_index );
+    return NULL;
+}
+
 /************************************************************************
  * updateIndexAndDel: If necessary, update index file & delete old segments
  ************************************************************************/
@@ -553,102 +1326,57 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
     // First update index
     if ( p_sys->psz_indexPath )
     {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        size_t i_index;
+        char *psz_index = formatIndex( p_sys, i_firstseg, i_index_offset, p_sys->i_segment, b_isend, &i_index );
+        if ( !psz_index )
             return -1;
 
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
+        if ( p_sys->b_httpd )
         {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
-            return -1;
-        }
-
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
-                          "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
-                          p_sys->b_caching ? "YES" : "NO",
-                          p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
-                          i_firstseg ) < 0 )
-        {
-            free( psz_idxTmp );
-            fclose( fp );
-            return -1;
+            if ( publishIndex( p_sys, psz_index, i_index ) < 0 )
+                return -1;
         }
-        char *psz_current_uri=NULL;
-
-
-        for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+        else
         {
-            //scale to i_index_offset..numsegs + i_index_offset
-            uint32_t index = i - i_firstseg + i_index_offset;
-
-            output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
-            if( p_sys->key_uri &&
-                ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
-              )
+            int val;
+            FILE *fp;
+            char *psz_idxTmp;
+            if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
             {
-                int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
-                if( p_sys->b_generate_iv )
-                {
-                    unsigned long long iv_hi = 0, iv_lo = 0;
-                    for( unsigned short i = 0; i < 8; i++ )
-                    {
-                        iv_hi |= segment->aes_ivs[i] & 0xff;
-                        iv_hi <<= 8;
-                        iv_lo |= segment->aes_ivs[8+i] & 0xff;
-                        iv_lo <<= 8;
-                    }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
-
-                } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
-                }
-                if( ret < 0 )
-                {
-                    free( psz_idxTmp );
-                    fclose( fp );
-                    return -1;
-                }
+                free( psz_index );
+                return -1;
             }
 
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
-            if ( val < 0 )
+            fp = vlc_fopen( psz_idxTmp, "wt");
+            if ( !fp )
             {
-                fclose( fp );
+                msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
+                free( psz_idxTmp );
+                free( psz_index );
                 return -1;
             }
-        }
-        free( psz_current_uri );
 
-        if ( b_isend )
-        {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
+            val = fwrite( psz_index, 1, i_index, fp ) == i_index ? 0 : -1;
+            free( psz_index );
+            if ( fclose( fp ) || val < 0 )
             {
+                vlc_unlink( psz_idxTmp );
                 free( psz_idxTmp );
-                fclose( fp ) ;
                 return -1;
             }
 
-        }
-        fclose( fp );
+            val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
 
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+            if ( val < 0 )
+            {
+                vlc_unlink( psz_idxTmp );
+                msg_Err( p_access, "Error moving LiveHttp index file" );
+            }
+            else
+                msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
 
-        if ( val < 0 )
-        {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
+            free( psz_idxTmp );
         }
-        else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
-
-        free( psz_idxTmp );
     }
 
     // Then take care of deletion
@@ -661,27 +1389,71 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
          msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
          vlc_array_remove( p_sys->segments_t, 0 );
 
-         if ( segment->psz_filename )
+         if ( p_sys->b_httpd )
          {
-             vlc_unlink( segment->psz_filename );
+             expireSegment( p_sys, segment );
          }
+         else
+         {
+             if ( segment->psz_filename )
+             {
+                 vlc_unlink( segment->psz_filename );
+             }
 
-         destroySegment( segment );
+             destroySegment( segment );
+         }
          i_index_offset -=1;
     }
 
-
+    p_sys->i_index_firstseg = i_firstseg;
+    p_sys->i_index_offset = i_index_offset;
     return 0;
 }
 
+/************************************************************************
+ * updatePartIndex: publish the index with the parts of the segment
+ * being written, within the window of the last update
+ ************************************************************************/
+static void updatePartIndex( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
+{
+    size_t i_index;
+    char *psz_index = formatIndex( p_sys, p_sys->i_index_firstseg, p_sys->i_index_offset,
+                                   p_sys->i_segment - 1, false, &i_index );
+
+    if ( !psz_index || publishIndex( p_sys, psz_index, i_index ) < 0 )
+        msg_Err( p_access, "Couldn't update index with parts" );
+}
+
+/************************************************************************
+ * cutPart: end the current part before a block of the given dts if it is
+ * long enough, preferably on a keyframe
+ ************************************************************************/
+static void cutPart( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                     mtime_t i_dts, bool b_keyframe )
+{
+    output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
+    mtime_t i_length = i_dts - p_sys->i_part_dts;
+
+    if ( segment->i_buffer == partStart( segment ) ||
+         ( i_length < p_sys->i_partlenm &&
+           !( b_keyframe && i_length >= p_sys->i_partlenm / 2 ) ) )
+        return;
+
+    addPart( p_sys, segment, i_length );
+    p_sys->i_part_dts = i_dts;
+    p_sys->b_part_independent = b_keyframe;
+    updatePartIndex( p_access, p_sys );
+}
+
 /*****************************************************************************
  * closeCurrentSegment: Close the segment file
  *****************************************************************************/
 static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
 {
-    if ( p_sys->i_handle >= 0 )
+    if ( p_sys->b_segment_open )
     {
         output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
+        mtime_t i_start = mdate();
 
         if( p_sys->key_uri )
         {
@@ -692,7 +1464,7 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
             if( err ) {
                msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
             } else {
-            int ret = write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
+            int ret = segmentWrite( p_sys, p_sys->stuffing_bytes, 16 );
             if( ret != 16 )
                 msg_Err( p_access, "Couldn't write 16 bytes" );
             }
@@ -700,8 +1472,12 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
         }
 
 
-        close( p_sys->i_handle );
+        if ( p_sys->b_httpd )
+            completeSegment( p_sys, segment );
+        else
+            close( p_sys->i_handle );
         p_sys->i_handle = -1;
+        p_sys->b_segment_open = false;
 
         if( ! ( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) ) )
         {
@@ -718,6 +1494,14 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
             free( p_sys->psz_cursegPath );
             p_sys->psz_cursegPath = 0;
             updateIndexAndDel( p_access, p_sys, b_isend );
+
+            mtime_t i_latency = mdate() - i_start;
+            p_sys->stats.i_segments++;
+            p_sys->stats.i_latency_total += i_latency;
+            if ( i_latency > p_sys->stats.i_latency_max )
+                p_sys->stats.i_latency_max = i_latency;
+            if ( mdate() - p_sys->stats.i_last_report >= STATS_INTERVAL )
+                reportStats( p_access, p_sys );
         }
     }
 }
@@ -763,7 +1547,7 @@ static void Close( vlc_object_t * p_this )
             }
             crypted = true;
         }
-        ssize_t val = write( p_sys->i_handle, p_sys->block_buffer->p_buffer, p_sys->block_buffer->i_buffer );
+        ssize_t val = segmentWrite( p_sys, p_sys->block_buffer->p_buffer, p_sys->block_buffer->i_buffer );
         if ( val == -1 )
         {
            if ( errno == EINTR )
@@ -792,6 +1576,11 @@ static void Close( vlc_object_t * p_this )
     }
 
     closeCurrentSegment( p_access, p_sys, true );
+    reportStats( p_access, p_sys );
+
+    /* No more requests once the index is gone */
+    if( p_sys->p_index_url )
+        httpd_UrlDelete( p_sys->p_index_url );
 
     if( p_sys->key_uri )
     {
@@ -807,6 +1596,20 @@ static void Close( vlc_object_t * p_this )
     }
     vlc_array_destroy( p_sys->segments_t );
 
+    while( vlc_array_count( p_sys->expired_t ) > 0 )
+    {
+        output_segment_t *segment = vlc_array_item_at_index( p_sys->expired_t, 0 );
+        vlc_array_remove( p_sys->expired_t, 0 );
+        destroySegment( segment );
+    }
+    vlc_array_destroy( p_sys->expired_t );
+
+    if( p_sys->p_index )
+        block_Release( p_sys->p_index );
+    if( p_sys->p_httpd_host )
+        httpd_HostDelete( p_sys->p_httpd_host );
+    vlc_mutex_destroy( &p_sys->lock );
+
     free( p_sys->psz_indexUrl );
     free( p_sys->psz_indexPath );
     free( p_sys );
@@ -851,7 +1654,7 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
     memset( segment, 0 , sizeof( output_segment_t ) );
 
     segment->i_segment_number = i_newseg;
-    segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg, true );
+    segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg, !p_sys->b_httpd );
     char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
     segment->psz_uri = formatSegmentPath( psz_idxFormat , i_newseg, false );
 
@@ -861,13 +1664,25 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
+    if ( p_sys->b_httpd )
     {
-        msg_Err( p_access, "cannot open `%s' (%m)", segment->psz_filename );
-        destroySegment( segment );
-        return -1;
+        fd = -1;
+        if ( registerSegment( p_access, p_sys, segment ) )
+        {
+            destroySegment( segment );
+            return -1;
+        }
+    }
+    else
+    {
+        fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
+                         O_TRUNC, 0666 );
+        if ( fd == -1 )
+        {
+            msg_Err( p_access, "cannot open `%s' (%m)", segment->psz_filename );
+            destroySegment( segment );
+            return -1;
+        }
     }
 
     vlc_array_append( p_sys->segments_t, segment);
@@ -888,8 +1703,85 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
 
     p_sys->psz_cursegPath = strdup(segment->psz_filename);
     p_sys->i_handle = fd;
+    p_sys->b_segment_open = true;
     p_sys->i_segment = i_newseg;
-    return fd;
+
+    if ( p_sys->i_partlenm )
+    {
+        p_sys->i_part_dts = p_sys->i_opendts;
+        updatePartIndex( p_access, p_sys );
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * writeSegment: encrypt and write a chain of blocks to the current segment
+ *****************************************************************************/
+static ssize_t writeSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, block_t *output )
+{
+    size_t i_write = 0;
+    bool crypted = false;
+
+    while( output )
+    {
+        if( p_sys->key_uri && !crypted )
+        {
+            if( p_sys->stuffing_size )
+            {
+                output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
+                if( unlikely(!output ) )
+                    return VLC_ENOMEM;
+                memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
+                p_sys->stuffing_size = 0;
+            }
+            size_t original = output->i_buffer;
+            size_t padded = (output->i_buffer + 15 ) & ~15;
+            size_t pad = padded - original;
+            if( pad )
+            {
+                p_sys->stuffing_size = 16-pad;
+                output->i_buffer -= p_sys->stuffing_size;
+                memcpy(p_sys->stuffing_bytes, &output->p_buffer[output->i_buffer], p_sys->stuffing_size);
+            }
+
+            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
+                                output->p_buffer, output->i_buffer, NULL, 0 );
+            if( err )
+            {
+                msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
+                block_ChainRelease( output );
+                return -1;
+            }
+            crypted=true;
+
+        }
+        ssize_t val = segmentWrite( p_sys, output->p_buffer, output->i_buffer );
+        if ( val == -1 )
+        {
+           if ( errno == EINTR )
+              continue;
+           block_ChainRelease( output );
+           return -1;
+        }
+        p_sys->f_seglen =
+            (float)output->i_length / INT64_C(1000000) +
+            (float)(output->i_dts - p_sys->i_opendts) / CLOCK_FREQ;
+
+        if ( (size_t)val >= output->i_buffer )
+        {
+           block_t *p_next = output->p_next;
+           block_Release (output);
+           output = p_next;
+           crypted=false;
+        }
+        else
+        {
+           output->p_buffer += val;
+           output->i_buffer -= val;
+        }
+        i_write += val;
+    }
+    return i_write;
 }
 
 /*****************************************************************************
@@ -903,20 +1795,57 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
     while( p_buffer )
     {
-        if ( ( p_sys->b_splitanywhere || ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) ) )
+        bool b_boundary = p_sys->b_splitanywhere || ( p_buffer->i_flags & BLOCK_FLAG_HEADER );
+
+        /* With parts, blocks are written as they come instead of a GOP at a
+         * time, so that the part being written can be sent right away */
+        if ( p_sys->i_partlenm )
+        {
+            p_temp = p_buffer->p_next;
+            p_buffer->p_next = NULL;
+
+            if( p_sys->b_segment_open && b_boundary &&
+                p_buffer->i_dts - p_sys->i_opendts >= p_sys->i_seglenm )
+                closeCurrentSegment( p_access, p_sys, false );
+
+            if ( !p_sys->b_segment_open )
+            {
+                p_sys->i_opendts = p_buffer->i_dts;
+                p_sys->b_part_independent = b_boundary;
+                if ( openNextFile( p_access, p_sys ) < 0 )
+                {
+                   block_Release( p_buffer );
+                   block_ChainRelease( p_temp );
+                   return -1;
+                }
+            }
+            else
+                cutPart( p_access, p_sys, p_buffer->i_dts, b_boundary );
+
+            ssize_t val = writeSegment( p_access, p_sys, p_buffer );
+            if ( val < 0 )
+            {
+                block_ChainRelease( p_temp );
+                return -1;
+            }
+            i_write += val;
+            p_buffer = p_temp;
+            continue;
+        }
+
+        if ( b_boundary )
         {
-            bool crypted = false;
             block_t *output = p_sys->block_buffer;
             p_sys->block_buffer = NULL;
 
 
-            if( p_sys->i_handle > 0 &&
+            if( p_sys->b_segment_open &&
                 ( p_buffer->i_dts - p_sys->i_opendts +
                   p_buffer->i_length * CLOCK_FREQ / INT64_C(1000000)
                 ) >= p_sys->i_seglenm )
                 closeCurrentSegment( p_access, p_sys, false );
 
-            if ( p_sys->i_handle < 0 )
+            if ( !p_sys->b_segment_open )
             {
                 p_sys->i_opendts = output ? output->i_dts : p_buffer->i_dts;
                 //For first segment we can get negative duration otherwise...?
@@ -927,64 +1856,13 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                    return -1;
             }
 
-            while( output )
+            ssize_t val = writeSegment( p_access, p_sys, output );
+            if ( val < 0 )
             {
-                if( p_sys->key_uri && !crypted )
-                {
-                    if( p_sys->stuffing_size )
-                    {
-                        output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
-                        if( unlikely(!output ) )
-                            return VLC_ENOMEM;
-                        memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
-                        p_sys->stuffing_size = 0;
-                    }
-                    size_t original = output->i_buffer;
-                    size_t padded = (output->i_buffer + 15 ) & ~15;
-                    size_t pad = padded - original;
-                    if( pad )
-                    {
-                        p_sys->stuffing_size = 16-pad;
-                        output->i_buffer -= p_sys->stuffing_size;
-                        memcpy(p_sys->stuffing_bytes, &output->p_buffer[output->i_buffer], p_sys->stuffing_size);
-                    }
-
-                    gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
-                                        output->p_buffer, output->i_buffer, NULL, 0 );
-                    if( err )
-                    {
-                        msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
-                        return -1;
-                    }
-                    crypted=true;
-
-                }
-                ssize_t val = write( p_sys->i_handle, output->p_buffer, output->i_buffer );
-                if ( val == -1 )
-                {
-                   if ( errno == EINTR )
-                      continue;
-                   block_ChainRelease ( p_buffer );
-                   return -1;
-                }
-                p_sys->f_seglen =
-                    (float)output->i_length / INT64_C(1000000) +
-                    (float)(output->i_dts - p_sys->i_opendts) / CLOCK_FREQ;
-
-                if ( (size_t)val >= output->i_buffer )
-                {
-                   block_t *p_next = output->p_next;
-                   block_Release (output);
-                   output = p_next;
-                   crypted=false;
-                }
-                else
-                {
-                   output->p_buffer += val;
-                   output->i_buffer -= val;
-                }
-                i_write += val;
+                block_ChainRelease ( p_buffer );
+                return -1;
             }
+            i_write += val;
         }
 
         p_temp = p_buffer->p_next;
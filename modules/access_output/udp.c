@@ -48,10 +48,23 @@
 #else
 #   include <sys/socket.h>
 #endif
+#ifdef __linux__
+#   include <sys/prctl.h>
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
+/* most packets sent with one system call */
+#define MAX_BATCH_BLOCKS 64
+
+/* pacing: the token bucket fills slightly faster than the stream bitrate so
+ * that late packets catch up, and holds a few packets at most */
+#define PACER_HEADROOM   1.05
+#define PACER_DEPTH      4
+/* interval between statistics reports (debug log, stream outputs do not
+ * feed the input statistics) */
+#define STATS_PERIOD     (INT64_C(10) * CLOCK_FREQ)
 
 /*****************************************************************************
  * Module descriptor
@@ -72,6 +85,17 @@ static void Close( vlc_object_t * );
                           "of packets that will be sent at a time. It " \
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
+#define WINDOW_TEXT N_("Sending window (ms)")
+#define WINDOW_LONGTEXT N_("Packets due within this delay are sent " \
+                           "together with the packet being sent, with a " \
+                           "single system call. 0 sends each packet on " \
+                           "its own." )
+#define PACE_TEXT N_("Pace packets")
+#define PACE_LONGTEXT N_("Spread the packets evenly at the stream bitrate, " \
+                         "as given by the PCRs, instead of sending them " \
+                         "as soon as they are due. This avoids bursts " \
+                         "when the sender runs late. Packets are still " \
+                         "grouped as requested." )
 
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
@@ -81,6 +105,9 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer( SOUT_CFG_PREFIX "window", 1, WINDOW_TEXT, WINDOW_LONGTEXT,
+                                 true )
+    add_bool( SOUT_CFG_PREFIX "pace", false, PACE_TEXT, PACE_LONGTEXT, true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -94,6 +121,8 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "window",
+    "pace",
     NULL
 };
 
@@ -112,6 +141,29 @@ static int Control( sout_access_out_t *, int, va_list );
 static void* ThreadWrite( void * );
 static block_t *NewUDPPacket( sout_access_out_t *, mtime_t );
 
+/* Token bucket filled at the bitrate given by the PCR slope */
+typedef struct
+{
+    double        f_rate;       /* bytes per second, 0 while unknown */
+    double        f_tokens;     /* bytes */
+    double        f_depth;
+    mtime_t       i_tokens_date;
+
+    mtime_t       i_pcr_date;   /* due date of the last PCR packet */
+    size_t        i_pcr_bytes;  /* bytes since that packet */
+} udp_pacer_t;
+
+typedef struct
+{
+    unsigned      i_packets;
+    mtime_t       i_jitter_sum; /* distance between sending and due dates */
+    mtime_t       i_jitter_max;
+    mtime_t       i_pcr_jitter_max;
+    unsigned      i_burst;      /* packets sent back to back */
+    unsigned      i_burst_max;
+    mtime_t       i_last_sent;
+} udp_stats_t;
+
 struct sout_access_out_sys_t
 {
     mtime_t       i_caching;
@@ -124,8 +176,14 @@ struct sout_access_out_sys_t
     block_t      *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* owned by the thread */
+    udp_pacer_t   pacer;
+    udp_stats_t   stats;
 };
 
+static void StatsReport( sout_access_out_t * );
+
 #define DEFAULT_PORT 1234
 
 /*****************************************************************************
@@ -215,6 +273,9 @@ static int Open( vlc_object_t *p_this )
     p_sys->p_fifo = block_FifoNew();
     p_sys->p_empty_blocks = block_FifoNew();
     p_sys->p_buffer = NULL;
+    memset( &p_sys->pacer, 0, sizeof( p_sys->pacer ) );
+    p_sys->pacer.f_depth = PACER_DEPTH * p_sys->i_mtu;
+    memset( &p_sys->stats, 0, sizeof( p_sys->stats ) );
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -244,6 +305,7 @@ static void Close( vlc_object_t * p_this )
 
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
+    StatsReport( p_access );
     block_FifoRelease( p_sys->p_fifo );
     block_FifoRelease( p_sys->p_empty_blocks );
 
@@ -394,6 +456,107 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     return p_buffer;
 }
 
+/*****************************************************************************
+ * Pacing
+ *****************************************************************************/
+
+/* Returns when the packet due at i_date may be sent: tokens come at the
+ * rate of the stream, so a late sender catches up without bursting */
+static mtime_t PacerDate( const udp_pacer_t *p_pacer, const block_t *p_pk,
+                          mtime_t i_date )
+{
+    if( p_pacer->f_rate <= 0 )
+        return i_date;
+
+    double f_missing = p_pk->i_buffer - p_pacer->f_tokens;
+    mtime_t i_ready = p_pacer->i_tokens_date;
+    if( f_missing > 0 )
+        i_ready += f_missing * CLOCK_FREQ / ( p_pacer->f_rate * PACER_HEADROOM );
+    return __MAX( i_date, i_ready );
+}
+
+/* Accounts a packet due at i_date and sent at i_sent */
+static void PacerSent( udp_pacer_t *p_pacer, const block_t *p_pk,
+                       mtime_t i_date, mtime_t i_sent )
+{
+    if( p_pacer->f_rate > 0 && i_sent > p_pacer->i_tokens_date )
+    {
+        p_pacer->f_tokens += ( i_sent - p_pacer->i_tokens_date )
+                           * p_pacer->f_rate * PACER_HEADROOM / CLOCK_FREQ;
+        if( p_pacer->f_tokens > p_pacer->f_depth )
+            p_pacer->f_tokens = p_pacer->f_depth;
+    }
+    p_pacer->f_tokens = __MAX( p_pacer->f_tokens - p_pk->i_buffer, 0. );
+    p_pacer->i_tokens_date = __MAX( p_pacer->i_tokens_date, i_sent );
+
+    if( !( p_pk->i_flags & BLOCK_FLAG_CLOCK ) )
+    {
+        p_pacer->i_pcr_bytes += p_pk->i_buffer;
+        return;
+    }
+
+    /* the bytes between two PCRs give the stream bitrate */
+    if( p_pacer->i_pcr_date > 0 && i_date > p_pacer->i_pcr_date &&
+        i_date - p_pacer->i_pcr_date < CLOCK_FREQ )
+    {
+        double f_rate = (double)p_pacer->i_pcr_bytes * CLOCK_FREQ
+                      / ( i_date - p_pacer->i_pcr_date );
+        if( p_pacer->f_rate > 0 )
+            p_pacer->f_rate = ( 7 * p_pacer->f_rate + f_rate ) / 8;
+        else
+            p_pacer->f_rate = f_rate;
+    }
+    p_pacer->i_pcr_date = i_date;
+    p_pacer->i_pcr_bytes = p_pk->i_buffer;
+}
+
+static void StatsUpdate( sout_access_out_t *p_access, const block_t *p_pk,
+                         mtime_t i_send, mtime_t i_sent )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    udp_stats_t *p_stats = &p_sys->stats;
+    mtime_t i_jitter = i_sent > i_send ? i_sent - i_send : i_send - i_sent;
+
+    p_stats->i_packets++;
+    p_stats->i_jitter_sum += i_jitter;
+    p_stats->i_jitter_max = __MAX( p_stats->i_jitter_max, i_jitter );
+    if( p_pk->i_flags & BLOCK_FLAG_CLOCK )
+        p_stats->i_pcr_jitter_max = __MAX( p_stats->i_pcr_jitter_max, i_jitter );
+
+    /* back to back: less than half the time of the packet at the bitrate */
+    if( p_sys->pacer.f_rate > 0 &&
+        ( i_sent - p_stats->i_last_sent ) * p_sys->pacer.f_rate
+            < p_pk->i_buffer * CLOCK_FREQ / 2 )
+    {
+        p_stats->i_burst++;
+        p_stats->i_burst_max = __MAX( p_stats->i_burst_max, p_stats->i_burst );
+    }
+    else
+        p_stats->i_burst = 1;
+    p_stats->i_last_sent = i_sent;
+}
+
+static void StatsReport( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    udp_stats_t *p_stats = &p_sys->stats;
+
+    if( p_stats->i_packets == 0 )
+        return;
+
+    msg_Dbg( p_access, "%u packets at %.0f kb/s, jitter average %"PRId64
+             " us max %"PRId64" us (PCR max %"PRId64" us), burst max %u packets",
+             p_stats->i_packets, p_sys->pacer.f_rate * 8 / 1000,
+             p_stats->i_jitter_sum / p_stats->i_packets,
+             p_stats->i_jitter_max, p_stats->i_pcr_jitter_max,
+             p_stats->i_burst_max );
+
+    p_stats->i_packets = 0;
+    p_stats->i_jitter_sum = p_stats->i_jitter_max = 0;
+    p_stats->i_pcr_jitter_max = 0;
+    p_stats->i_burst_max = 0;
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
  *****************************************************************************/
@@ -406,11 +569,22 @@ static void* ThreadWrite( void *data )
                                              SOUT_CFG_PREFIX "group" );
     mtime_t i_to_send = i_group;
     unsigned i_dropped_packets = 0;
+    const mtime_t i_window = INT64_C(1000)
+                   * var_GetInteger( p_access, SOUT_CFG_PREFIX "window" );
+    const bool b_pace = var_GetBool( p_access, SOUT_CFG_PREFIX "pace" );
+    block_t *pp_batch[MAX_BATCH_BLOCKS];
+    mtime_t pi_batch_send[MAX_BATCH_BLOCKS]; /* due dates of the batch */
+    mtime_t i_report = mdate() + STATS_PERIOD;
+
+#ifdef __linux__
+    /* wake up on time, not within the default 50us timer slack */
+    prctl( PR_SET_TIMERSLACK, 1UL );
+#endif
 
     for (;;)
     {
         block_t *p_pk = block_FifoGet( p_sys->p_fifo );
-        mtime_t       i_date, i_sent;
+        mtime_t       i_date, i_send, i_sent;
 
         i_date = p_sys->i_caching + p_pk->i_dts;
         if( i_date_last > 0 )
@@ -425,6 +599,9 @@ static void* ThreadWrite( void *data )
 
                 i_date_last = i_date;
                 i_dropped_packets++;
+                /* the stream restarts, so does its bitrate */
+                p_sys->pacer.f_rate = 0.;
+                p_sys->pacer.i_pcr_date = 0;
                 continue;
             }
             else if( i_date - i_date_last < -1000 )
@@ -435,17 +612,60 @@ static void* ThreadWrite( void *data )
             }
         }
 
+        i_send = b_pace ? PacerDate( &p_sys->pacer, p_pk, i_date ) : i_date;
+
         block_cleanup_push( p_pk );
         i_to_send--;
         if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
         {
-            mwait( i_date );
+            mwait( i_send );
             i_to_send = i_group;
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %m" );
         vlc_cleanup_pop();
 
+        /* Take along the queued packets due within the window, but do not
+         * send a PCR ahead of time */
+        unsigned i_batch = 0;
+        mtime_t i_now = mdate();
+
+        pi_batch_send[i_batch] = i_send;
+        pp_batch[i_batch++] = p_pk;
+        PacerSent( &p_sys->pacer, p_pk, i_date, i_now );
+        i_date_last = i_date;
+        while( i_batch < MAX_BATCH_BLOCKS && block_FifoCount( p_sys->p_fifo ) > 0 )
+        {
+            block_t *p_next = block_FifoShow( p_sys->p_fifo );
+            mtime_t i_next_date = p_sys->i_caching + p_next->i_dts;
+            mtime_t i_next_send = b_pace ?
+                PacerDate( &p_sys->pacer, p_next, i_next_date ) : i_next_date;
+
+            if( i_next_send > i_now + i_window ||
+                ( (p_next->i_flags & BLOCK_FLAG_CLOCK) && i_next_send > i_now ) )
+                break;
+            pi_batch_send[i_batch] = i_next_send;
+            pp_batch[i_batch++] = block_FifoGet( p_sys->p_fifo );
+            PacerSent( &p_sys->pacer, p_next, i_next_date, i_now );
+            i_date_last = __MAX( i_date_last, i_next_date );
+        }
+
+        int canc = vlc_savecancel();
+        for( unsigned i = 0; i < i_batch; )
+        {
+            int val = net_SendBlocks( p_sys->i_handle, &pp_batch[i], i_batch - i );
+            if( val == -1 )
+            {
+                msg_Warn( p_access, "send error: %m" );
+                val = 1; /* skip that packet */
+            }
+            i += val;
+        }
+        vlc_restorecancel( canc );
+
+        /* the jitter is measured once the packets are actually sent */
+        i_sent = mdate();
+        for( unsigned i = 0; i < i_batch; i++ )
+            StatsUpdate( p_access, pp_batch[i], pi_batch_send[i], i_sent );
+
         if( i_dropped_packets )
         {
             msg_Dbg( p_access, "dropped %i packets", i_dropped_packets );
@@ -453,17 +673,22 @@ static void* ThreadWrite( void *data )
         }
 
 #if 1
-        i_sent = mdate();
-        if ( i_sent > i_date + 20000 )
+        if ( i_sent > i_send + 20000 )
         {
             msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
-                     i_sent - i_date );
+                     i_sent - i_send );
         }
 #endif
+        if( i_sent >= i_report )
+        {
+            StatsReport( p_access );
+            i_report = i_sent + STATS_PERIOD;
+        }
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-        i_date_last = i_date;
+        block_t *p_empty = NULL, **pp_last = &p_empty;
+        for( unsigned i = 0; i < i_batch; i++ )
+            block_ChainLastAppend( &pp_last, pp_batch[i] );
+        block_FifoPut( p_sys->p_empty_blocks, p_empty );
     }
     return NULL;
 }
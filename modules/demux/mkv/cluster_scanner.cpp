@@ -0,0 +1,335 @@
+/*****************************************************************************
+ * cluster_scanner.cpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "cluster_scanner.hpp"
+#include "stream_io_callback.hpp"
+
+#define MKV_CLUSTER_ID      0x1F43B675
+#define MKV_TIMECODE_ID     0xE7
+#define MKV_CRC32_ID        0xBF
+#define MKV_VOID_ID         0xEC
+
+/* don't bother splitting ranges smaller than that between workers */
+#define SCAN_MIN_RANGE      (INT64_C(8) * 1024 * 1024)
+#define SCAN_BUFFER_SIZE    (64 * 1024)
+/* enough for the cluster header, a CRC-32, the timecode and the next id */
+#define SCAN_HEADER_SIZE    64
+
+/*****************************************************************************
+ * EBML helpers working on raw memory
+ *****************************************************************************/
+static int ReadVint( const uint8_t *p, size_t i_len, uint64_t *pi_value,
+                     bool b_keep_marker )
+{
+    int i_size = 1;
+    uint8_t i_mask = 0x80;
+
+    if( i_len < 1 || p[0] == 0 )
+        return 0;
+    while( !( p[0] & i_mask ) )
+    {
+        i_mask >>= 1;
+        i_size++;
+    }
+    if( (size_t)i_size > i_len )
+        return 0;
+
+    uint64_t i_value = b_keep_marker ? p[0] : p[0] & ( i_mask - 1 );
+    bool b_unknown = ( p[0] & ( i_mask - 1 ) ) == i_mask - 1;
+    for( int i = 1; i < i_size; i++ )
+    {
+        i_value = ( i_value << 8 ) | p[i];
+        b_unknown &= p[i] == 0xff;
+    }
+    *pi_value = ( b_unknown && !b_keep_marker ) ? UINT64_MAX : i_value;
+    return i_size;
+}
+
+static bool IsClusterChild( uint64_t i_id )
+{
+    switch( i_id )
+    {
+        case 0xA3:   /* SimpleBlock */
+        case 0xA0:   /* BlockGroup */
+        case 0xA7:   /* Position */
+        case 0xAB:   /* PrevSize */
+        case 0xAF:   /* EncryptedBlock */
+        case 0x5854: /* SilentTracks */
+        case MKV_CRC32_ID:
+        case MKV_VOID_ID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Validates a cluster header: it must be followed by its timecode and the
+ * timecode by another cluster element, which is enough to reject the odd
+ * cluster id showing up inside frame data.
+ * Returns -1 if more data is needed, 0 if it is not a cluster, else the
+ * size of the cluster header (id and size) */
+static int ParseClusterHeader( const uint8_t *p, size_t i_len,
+                               uint64_t *pi_size, uint64_t *pi_timecode )
+{
+    uint64_t i_id, i_size;
+    size_t i_header, i_off;
+    int i_ret;
+
+    if( i_len < SCAN_HEADER_SIZE )
+        return -1;
+
+    i_off = 4;
+    if( ( i_ret = ReadVint( &p[i_off], i_len - i_off, pi_size, false ) ) <= 0 )
+        return 0;
+    i_off += i_ret;
+    i_header = i_off;
+
+    for( ;; )
+    {
+        if( ( i_ret = ReadVint( &p[i_off], i_len - i_off, &i_id, true ) ) <= 0 ||
+            i_ret > 4 )
+            return 0;
+        i_off += i_ret;
+        if( ( i_ret = ReadVint( &p[i_off], i_len - i_off, &i_size, false ) ) <= 0 )
+            return 0;
+        i_off += i_ret;
+
+        if( i_id == MKV_TIMECODE_ID )
+            break;
+        if( i_id != MKV_CRC32_ID && i_id != MKV_VOID_ID )
+            return 0;
+        if( i_size > i_len - i_off )
+            return 0;
+        i_off += i_size;
+    }
+
+    if( i_size < 1 || i_size > 8 || i_size > i_len - i_off )
+        return 0;
+    *pi_timecode = 0;
+    for( size_t i = 0; i < i_size; i++ )
+        *pi_timecode = ( *pi_timecode << 8 ) | p[i_off++];
+
+    if( ReadVint( &p[i_off], i_len - i_off, &i_id, true ) <= 0 ||
+        !IsClusterChild( i_id ) )
+        return 0;
+    return i_header;
+}
+
+/*****************************************************************************
+ * cluster_scanner_c
+ *****************************************************************************/
+cluster_scanner_c::cluster_scanner_c( demux_t *p_demux_, int64_t i_start_,
+                                      int64_t i_end_, uint64_t i_timescale_ )
+    :p_demux(p_demux_)
+    ,i_start(i_start_)
+    ,i_end(i_end_)
+    ,i_timescale(i_timescale_)
+    ,i_running(0)
+    ,b_abort(false)
+{
+    s_url = std::string( p_demux->psz_access ) + "://" + p_demux->psz_location;
+    vlc_mutex_init( &lock );
+}
+
+cluster_scanner_c::~cluster_scanner_c()
+{
+    vlc_mutex_lock( &lock );
+    b_abort = true;
+    vlc_mutex_unlock( &lock );
+
+    for( size_t i = 0; i < workers.size(); i++ )
+    {
+        vlc_join( workers[i]->thread, NULL );
+        delete workers[i];
+    }
+    vlc_mutex_destroy( &lock );
+}
+
+bool cluster_scanner_c::Start( unsigned i_workers )
+{
+    int64_t i_range;
+
+    if( i_end <= i_start || i_workers == 0 )
+        return false;
+
+    if( (uint64_t)( i_end - i_start ) / i_workers < SCAN_MIN_RANGE )
+        i_workers = __MAX( 1, ( i_end - i_start ) / SCAN_MIN_RANGE );
+    i_range = ( i_end - i_start + i_workers - 1 ) / i_workers;
+
+    for( unsigned i = 0; i < i_workers; i++ )
+    {
+        worker_t *p_worker = new worker_t;
+        p_worker->p_scanner = this;
+        p_worker->i_start   = i_start + i * i_range;
+        p_worker->i_end     = __MIN( i_end, p_worker->i_start + i_range );
+
+        vlc_mutex_lock( &lock );
+        i_running++;
+        vlc_mutex_unlock( &lock );
+
+        if( vlc_clone( &p_worker->thread, Run, p_worker,
+                       VLC_THREAD_PRIORITY_LOW ) )
+        {
+            vlc_mutex_lock( &lock );
+            i_running--;
+            vlc_mutex_unlock( &lock );
+            delete p_worker;
+            break;
+        }
+        workers.push_back( p_worker );
+    }
+
+    msg_Dbg( p_demux, "scanning for clusters with %d thread(s)",
+             (int)workers.size() );
+    return !workers.empty();
+}
+
+bool cluster_scanner_c::Fetch( std::vector<mkv_index_t> & found )
+{
+    bool b_done;
+
+    vlc_mutex_lock( &lock );
+    found.insert( found.end(), pending.begin(), pending.end() );
+    pending.clear();
+    b_done = i_running == 0;
+    vlc_mutex_unlock( &lock );
+
+    return b_done;
+}
+
+bool cluster_scanner_c::Publish( int64_t i_position, uint64_t i_timecode )
+{
+    mkv_index_t idx;
+
+    idx.i_track        = -1;
+    idx.i_block_number = -1;
+    idx.i_position     = i_position;
+    idx.i_time         = i_timecode * i_timescale / (mtime_t) 1000;
+    idx.b_key          = true;
+
+    vlc_mutex_lock( &lock );
+    bool b_continue = !b_abort;
+    if( b_continue )
+        pending.push_back( idx );
+    vlc_mutex_unlock( &lock );
+
+    return b_continue;
+}
+
+void *cluster_scanner_c::Run( void *data )
+{
+    worker_t *p_worker = (worker_t *)data;
+    cluster_scanner_c *p_scanner = p_worker->p_scanner;
+    stream_t *s;
+
+    s = stream_UrlNew( p_scanner->p_demux, p_scanner->s_url.c_str() );
+    if( s != NULL )
+    {
+        vlc_stream_io_callback io( s, true );
+        p_scanner->Scan( io, p_worker->i_start, p_worker->i_end );
+    }
+    else
+        msg_Warn( p_scanner->p_demux, "cannot open %s for cluster scan",
+                  p_scanner->s_url.c_str() );
+
+    vlc_mutex_lock( &p_scanner->lock );
+    p_scanner->i_running--;
+    vlc_mutex_unlock( &p_scanner->lock );
+    return NULL;
+}
+
+/* Reports every cluster starting in [i_pos, i_stop) */
+void cluster_scanner_c::Scan( IOCallback & io, int64_t i_pos, int64_t i_stop )
+{
+    uint8_t *p_buffer = (uint8_t *)malloc( SCAN_BUFFER_SIZE );
+    int i_found = 0;
+
+    if( unlikely( p_buffer == NULL ) )
+        return;
+
+    while( i_pos < i_stop )
+    {
+        size_t i_read;
+        int64_t i_next;
+        bool b_stop;
+
+        vlc_mutex_lock( &lock );
+        b_stop = b_abort;
+        vlc_mutex_unlock( &lock );
+        if( b_stop )
+            break;
+
+        io.setFilePointer( i_pos, seek_beginning );
+        i_read = io.read( p_buffer, SCAN_BUFFER_SIZE );
+        if( i_read < 4 )
+            break;
+        /* keep the last bytes, they may be the start of an id */
+        i_next = i_pos + i_read - 3;
+
+        for( size_t i_off = 0; i_off + 4 <= i_read; i_off++ )
+        {
+            uint64_t i_size, i_timecode;
+            int64_t i_cur = i_pos + i_off;
+            int i_header;
+
+            if( i_cur >= i_stop )
+            {
+                i_next = i_stop;
+                break;
+            }
+            if( p_buffer[i_off] != 0x1F ||
+                GetDWBE( &p_buffer[i_off] ) != MKV_CLUSTER_ID )
+                continue;
+
+            i_header = ParseClusterHeader( &p_buffer[i_off], i_read - i_off,
+                                           &i_size, &i_timecode );
+            if( i_header < 0 && i_off > 0 )
+            {
+                /* read again from this cluster */
+                i_next = i_cur;
+                break;
+            }
+            if( i_header <= 0 )
+                continue;
+
+            if( !Publish( i_cur, i_timecode ) )
+            {
+                i_next = i_stop;
+                break;
+            }
+            i_found++;
+
+            /* clusters are usually back to back, jump to the next one */
+            if( i_size != UINT64_MAX )
+            {
+                if( i_size < (uint64_t)( i_stop - i_cur ) )
+                    i_next = i_cur + i_header + i_size;
+                else
+                    i_next = i_stop;
+                break;
+            }
+        }
+        i_pos = i_next;
+    }
+
+    msg_Dbg( p_demux, "found %d clusters in the scanned range", i_found );
+    free( p_buffer );
+}
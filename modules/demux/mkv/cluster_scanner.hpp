@@ -0,0 +1,73 @@
+/*****************************************************************************
+ * cluster_scanner.hpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _CLUSTER_SCANNER_HPP_
+#define _CLUSTER_SCANNER_HPP_
+
+#include "mkv.hpp"
+
+/*****************************************************************************
+ * Background cluster index builder
+ *****************************************************************************
+ * Used when a segment has no (usable) Cues: the file is split in ranges and
+ * each worker thread looks for cluster headers in its own range through its
+ * own stream, so that the demux thread never blocks on the scan. Found
+ * clusters are collected here and fetched by the segment at seek time.
+ *****************************************************************************/
+class cluster_scanner_c
+{
+public:
+    cluster_scanner_c( demux_t *, int64_t i_start, int64_t i_end,
+                       uint64_t i_timescale );
+    ~cluster_scanner_c();
+
+    bool Start( unsigned i_workers );
+    /* moves the clusters found since the last call to found,
+     * returns true once every worker is done */
+    bool Fetch( std::vector<mkv_index_t> & found );
+
+private:
+    struct worker_t
+    {
+        cluster_scanner_c *p_scanner;
+        vlc_thread_t      thread;
+        int64_t           i_start;
+        int64_t           i_end;
+    };
+
+    static void *Run( void * );
+    void Scan( IOCallback &, int64_t i_start, int64_t i_end );
+    bool Publish( int64_t i_position, uint64_t i_timecode );
+
+    demux_t                  *p_demux;
+    std::string              s_url;
+    int64_t                  i_start;
+    int64_t                  i_end;
+    uint64_t                 i_timescale;
+
+    std::vector<worker_t*>   workers;
+    std::vector<mkv_index_t> pending;
+    unsigned                 i_running;
+    bool                     b_abort;
+    vlc_mutex_t              lock;
+};
+
+#endif
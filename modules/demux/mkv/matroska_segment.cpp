@@ -27,6 +27,7 @@
 #include "demux.hpp"
 #include "util.hpp"
 #include "Ebml_parser.hpp"
+#include "cluster_scanner.hpp"
 
 matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estream )
     :segment(NULL)
@@ -52,6 +53,8 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,b_cues(false)
     ,i_index(0)
     ,i_index_max(1024)
+    ,p_scanner(NULL)
+    ,b_scanned(false)
     ,psz_muxing_application(NULL)
     ,psz_writing_application(NULL)
     ,psz_segment_filename(NULL)
@@ -68,6 +71,8 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
 
 matroska_segment_c::~matroska_segment_c()
 {
+    delete p_scanner;
+
     for( size_t i_track = 0; i_track < tracks.size(); i_track++ )
     {
         delete tracks[i_track]->p_compression_data;
@@ -592,6 +597,92 @@ void matroska_segment_c::IndexAppendCluster( KaxCluster *cluster )
 #undef idx
 }
 
+/*****************************************************************************
+ * IndexScanStart : build the index in the background when there are no cues
+ * IndexUpdate : merge the clusters found so far, returns true if the index
+ *               holds some of them
+ *****************************************************************************/
+void matroska_segment_c::IndexScanStart()
+{
+    bool b_fastseek;
+    int i_threads;
+    int64_t i_size;
+
+    if( p_scanner != NULL || b_scanned )
+        return;
+
+    /* only the main input can be opened again by the workers */
+    if( sys.streams.empty() || sys.streams[0]->p_estream != &es )
+        return;
+
+    i_threads = var_InheritInteger( &sys.demuxer, "mkv-index-threads" );
+    if( i_threads <= 0 )
+        return;
+
+    if( stream_Control( sys.demuxer.s, STREAM_CAN_FASTSEEK, &b_fastseek ) ||
+        !b_fastseek )
+        return;
+
+    i_size = stream_Size( sys.demuxer.s );
+    if( i_size <= i_start_pos )
+        return;
+
+    p_scanner = new cluster_scanner_c( &sys.demuxer, i_start_pos, i_size,
+                                       i_timescale );
+    if( !p_scanner->Start( i_threads ) )
+    {
+        delete p_scanner;
+        p_scanner = NULL;
+    }
+}
+
+static bool IndexPositionLess( const mkv_index_t & a, const mkv_index_t & b )
+{
+    return a.i_position < b.i_position;
+}
+
+static bool IndexPositionEqual( const mkv_index_t & a, const mkv_index_t & b )
+{
+    return a.i_position == b.i_position;
+}
+
+bool matroska_segment_c::IndexUpdate()
+{
+    std::vector<mkv_index_t> found;
+    bool b_done;
+
+    if( p_scanner == NULL )
+        return b_scanned;
+
+    b_done = p_scanner->Fetch( found );
+    if( !found.empty() )
+    {
+        /* keep room for the entry BlockGet() may fill in */
+        if( i_index + (int)found.size() >= i_index_max )
+        {
+            i_index_max = i_index + found.size() + 1024;
+            p_indexes = (mkv_index_t*)xrealloc( p_indexes,
+                                        sizeof( mkv_index_t ) * i_index_max );
+        }
+        for( size_t i = 0; i < found.size(); i++ )
+            p_indexes[i_index++] = found[i];
+
+        /* the clusters already known come first and win over the scan */
+        std::stable_sort( p_indexes, p_indexes + i_index, IndexPositionLess );
+        i_index = std::unique( p_indexes, p_indexes + i_index,
+                               IndexPositionEqual ) - p_indexes;
+        b_scanned = true;
+    }
+
+    if( b_done )
+    {
+        msg_Dbg( &sys.demuxer, "cluster scan done, %d index entries", i_index );
+        delete p_scanner;
+        p_scanner = NULL;
+    }
+    return b_scanned;
+}
+
 bool matroska_segment_c::PreloadFamily( const matroska_segment_c & of_segment )
 {
     if ( b_preloaded )
@@ -849,6 +940,8 @@ void matroska_segment_c::Seek( mtime_t i_date, mtime_t i_time_offset, int64_t i_
     for( size_t i = 0; i < tracks.size(); i++)
         tracks[i]->i_last_dts = VLC_TS_INVALID;
 
+    IndexUpdate();
+
     if( i_global_position >= 0 )
     {
         /* Special case for seeking in files with no cues */
@@ -28,6 +28,7 @@
 #include "mkv.hpp"
 
 class EbmlParser;
+class cluster_scanner_c;
 
 class chapter_edition_c;
 class chapter_translation_c;
@@ -110,6 +111,8 @@ public:
     int                     i_index;
     int                     i_index_max;
     mkv_index_t             *p_indexes;
+    cluster_scanner_c       *p_scanner;
+    bool                    b_scanned;
 
     /* info */
     char                    *psz_muxing_application;
@@ -145,6 +148,9 @@ public:
     bool Select( mtime_t i_start_time );
     void UnSelect();
 
+    void IndexScanStart();
+    bool IndexUpdate();
+
     static bool CompareSegmentUIDs( const matroska_segment_c * item_a, const matroska_segment_c * item_b );
 
 private:
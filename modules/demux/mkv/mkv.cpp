@@ -70,6 +70,10 @@ vlc_module_begin ()
             N_("Dummy Elements"),
             N_("Read and discard unknown EBML elements (not good for broken files)."), true );
 
+    add_integer( "mkv-index-threads", 2,
+            N_("Cluster scan threads"),
+            N_("Number of threads looking for clusters in the background when a file has no cues (0 disables it)."), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -430,6 +434,7 @@ static void Seek( demux_t *p_demux, mtime_t i_date, double f_percent, virtual_ch
     int64_t            i_global_position = -1;
 
     int         i_index;
+    bool        b_indexed;
 
     msg_Dbg( p_demux, "seek request to %"PRId64" (%f%%)", i_date, f_percent );
     if( i_date < 0 && f_percent < 0 )
@@ -448,11 +453,14 @@ static void Seek( demux_t *p_demux, mtime_t i_date, double f_percent, virtual_ch
         return;
     }
 
+    /* clusters found by the background scan are as good as cues */
+    b_indexed = p_segment->b_cues || p_segment->IndexUpdate();
+
     /* seek without index or without date */
-    if( f_percent >= 0 && (var_InheritBool( p_demux, "mkv-seek-percent" ) || !p_segment->b_cues || i_date < 0 ))
+    if( f_percent >= 0 && (var_InheritBool( p_demux, "mkv-seek-percent" ) || !b_indexed || i_date < 0 ))
     {
         i_date = int64_t( f_percent * p_sys->f_duration * 1000.0 );
-        if( !p_segment->b_cues )
+        if( !b_indexed )
         {
             int64_t i_pos = int64_t( f_percent * stream_Size( p_demux->s ) );
 
@@ -697,6 +697,25 @@ static int MP4_ReadBox_tfhd(  stream_t *p_stream, MP4_Box_t *p_box )
     MP4_READBOX_EXIT( 1 );
 }
 
+static int MP4_ReadBox_tfdt( stream_t *p_stream, MP4_Box_t *p_box )
+{
+    MP4_READBOX_ENTER( MP4_Box_data_tfdt_t );
+
+    MP4_GETVERSIONFLAGS( p_box->data.p_tfdt );
+
+    if( p_box->data.p_tfdt->i_version == 1 )
+        MP4_GET8BYTES( p_box->data.p_tfdt->i_base_media_decode_time );
+    else
+        MP4_GET4BYTES( p_box->data.p_tfdt->i_base_media_decode_time );
+
+#ifdef MP4_VERBOSE
+    msg_Dbg( p_stream, "read box: \"tfdt\" base media decode time %"PRIu64,
+             p_box->data.p_tfdt->i_base_media_decode_time );
+#endif
+
+    MP4_READBOX_EXIT( 1 );
+}
+
 static int MP4_ReadBox_trun(  stream_t *p_stream, MP4_Box_t *p_box )
 {
     MP4_READBOX_ENTER( MP4_Box_data_trun_t );
@@ -2969,8 +2988,11 @@ static int MP4_ReadBox_tfra( stream_t *p_stream, MP4_Box_t *p_box )
     {
         if( p_tfra->i_version == 1 )
         {
-            MP4_GET8BYTES( p_tfra->p_time[i*2] );
-            MP4_GET8BYTES( p_tfra->p_moof_offset[i*2] );
+            uint64_t i_time, i_moof_offset;
+            MP4_GET8BYTES( i_time );
+            MP4_GET8BYTES( i_moof_offset );
+            ((uint64_t *)p_tfra->p_time)[i] = i_time;
+            ((uint64_t *)p_tfra->p_moof_offset)[i] = i_moof_offset;
         }
         else
         {
@@ -3352,6 +3374,7 @@ static const struct
     { ATOM_mfhd,    MP4_ReadBox_mfhd,         MP4_FreeBox_Common },
     { ATOM_sidx,    MP4_ReadBox_sidx,         MP4_FreeBox_sidx },
     { ATOM_tfhd,    MP4_ReadBox_tfhd,         MP4_FreeBox_Common },
+    { ATOM_tfdt,    MP4_ReadBox_tfdt,         MP4_FreeBox_Common },
     { ATOM_trun,    MP4_ReadBox_trun,         MP4_FreeBox_trun },
     { ATOM_trex,    MP4_ReadBox_trex,         MP4_FreeBox_Common },
     { ATOM_mehd,    MP4_ReadBox_mehd,         MP4_FreeBox_Common },
@@ -3533,6 +3556,34 @@ MP4_Box_t *MP4_BoxGetNextChunk( stream_t *s )
     return p_chunk;
 }
 
+/*****************************************************************************
+ * MP4_BoxGetNextBox : Parse the box at the current position of the stream
+ *****************************************************************************/
+MP4_Box_t *MP4_BoxGetNextBox( stream_t *s )
+{
+    MP4_Box_t *p_box = MP4_ReadBox( s, NULL );
+    if( p_box == NULL )
+        return NULL;
+
+    /* Readers leave the position undefined, go to the end of the box */
+    const int64_t i_end = p_box->i_pos + p_box->i_size;
+    const int64_t i_pos = stream_Tell( s );
+    if( i_pos < i_end )
+    {
+        if( stream_Read( s, NULL, i_end - i_pos ) < i_end - i_pos )
+        {
+            MP4_BoxFree( s, p_box );
+            return NULL;
+        }
+    }
+    else if( i_pos > i_end && stream_Seek( s, i_end ) )
+    {
+        MP4_BoxFree( s, p_box );
+        return NULL;
+    }
+    return p_box;
+}
+
 /*****************************************************************************
  * MP4_BoxGetRoot : Parse the entire file, and create all boxes in memory
  *****************************************************************************
@@ -29,6 +29,7 @@
 #define ATOM_uuid VLC_FOURCC( 'u', 'u', 'i', 'd' )
 
 #define ATOM_ftyp VLC_FOURCC( 'f', 't', 'y', 'p' )
+#define ATOM_styp VLC_FOURCC( 's', 't', 'y', 'p' )
 #define ATOM_moov VLC_FOURCC( 'm', 'o', 'o', 'v' )
 #define ATOM_foov VLC_FOURCC( 'f', 'o', 'o', 'v' )
 #define ATOM_cmov VLC_FOURCC( 'c', 'm', 'o', 'v' )
@@ -82,6 +83,7 @@
 #define ATOM_traf VLC_FOURCC( 't', 'r', 'a', 'f' )
 #define ATOM_sidx VLC_FOURCC( 's', 'i', 'd', 'x' )
 #define ATOM_tfhd VLC_FOURCC( 't', 'f', 'h', 'd' )
+#define ATOM_tfdt VLC_FOURCC( 't', 'f', 'd', 't' )
 #define ATOM_trun VLC_FOURCC( 't', 'r', 'u', 'n' )
 #define ATOM_cprt VLC_FOURCC( 'c', 'p', 'r', 't' )
 #define ATOM_iods VLC_FOURCC( 'i', 'o', 'd', 's' )
@@ -913,6 +915,7 @@ typedef struct MP4_Box_data_sidx_s
 #define MP4_TFHD_DFLT_SAMPLE_SIZE     (1LL<<4)
 #define MP4_TFHD_DFLT_SAMPLE_FLAGS    (1LL<<5)
 #define MP4_TFHD_DURATION_IS_EMPTY    (1LL<<16)
+#define MP4_TFHD_DEFAULT_BASE_IS_MOOF (1LL<<17)
 typedef struct MP4_Box_data_tfhd_s
 {
     uint8_t  i_version;
@@ -929,6 +932,15 @@ typedef struct MP4_Box_data_tfhd_s
 
 } MP4_Box_data_tfhd_t;
 
+typedef struct MP4_Box_data_tfdt_s
+{
+    uint8_t  i_version;
+    uint32_t i_flags;
+
+    uint64_t i_base_media_decode_time;
+
+} MP4_Box_data_tfdt_t;
+
 #define MP4_TRUN_DATA_OFFSET         (1<<0)
 #define MP4_TRUN_FIRST_FLAGS         (1<<2)
 #define MP4_TRUN_SAMPLE_DURATION     (1<<8)
@@ -1122,8 +1134,8 @@ typedef struct
     uint8_t i_length_size_of_trun_num;
     uint8_t i_length_size_of_sample_num;
 
-    uint32_t *p_time;
-    uint32_t *p_moof_offset;
+    uint32_t *p_time;          /* uint64_t entries when i_version == 1 */
+    uint32_t *p_moof_offset;   /* uint64_t entries when i_version == 1 */
     uint8_t *p_traf_number;
     uint8_t *p_trun_number;
     uint8_t *p_sample_number;
@@ -1166,6 +1178,7 @@ typedef union MP4_Box_data_s
     MP4_Box_data_mfhd_t *p_mfhd;
     MP4_Box_data_sidx_t *p_sidx;
     MP4_Box_data_tfhd_t *p_tfhd;
+    MP4_Box_data_tfdt_t *p_tfdt;
     MP4_Box_data_trun_t *p_trun;
     MP4_Box_data_tkhd_t *p_tkhd;
     MP4_Box_data_mdhd_t *p_mdhd;
@@ -1488,6 +1501,15 @@ MP4_Box_t *MP4_BoxGetSmooBox( stream_t * );
  *****************************************************************************/
 MP4_Box_t *MP4_BoxGetNextChunk( stream_t * );
 
+/*****************************************************************************
+ * MP4_BoxGetNextBox : Parse the box at the current position of the stream
+ *****************************************************************************
+ *  The box is read with all its children, and the stream is left at the
+ *  end of the box. Only forward reads are done, so it can be used on non
+ *  seekable streams (to read a 'moof' while leaving its 'mdat' untouched).
+ *****************************************************************************/
+MP4_Box_t *MP4_BoxGetNextBox( stream_t * );
+
 /*****************************************************************************
  * MP4_BoxGetRoot : Parse the entire file, and create all boxes in memory
  *****************************************************************************
@@ -36,6 +36,7 @@
 #include <vlc_meta.h>                              /* vlc_meta_t, vlc_meta_ */
 #include <vlc_input.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "libmp4.h"
 #include "id3genres.h"                             /* for ATOM_gnre */
@@ -61,9 +62,29 @@ vlc_module_end ()
 static int   Demux   ( demux_t * );
 static int   DemuxRef( demux_t *p_demux ){ (void)p_demux; return 0;}
 static int   DemuxFrg( demux_t * );
+static int   DemuxFragmented( demux_t * );
 static int   Seek    ( demux_t *, mtime_t );
 static int   Control ( demux_t *, int, va_list );
 
+/* A sample of the 'moof' being demuxed in streaming mode */
+typedef struct
+{
+    uint64_t     i_offset;      /* absolute position in the file */
+    uint32_t     i_size;
+    int64_t      i_dts;         /* in microsecond */
+    int64_t      i_pts_delta;   /* in microsecond */
+    bool         b_pts_delta;   /* whether i_pts_delta is known */
+    int64_t      i_pcr;         /* lowest dts of this and following samples */
+    mp4_track_t  *p_track;
+} mp4_fragment_sample_t;
+
+/* A random access point: the beginning of a 'moof' */
+typedef struct
+{
+    int64_t      i_time;        /* in microsecond */
+    uint64_t     i_offset;      /* absolute position of the 'moof' */
+} mp4_fragment_point_t;
+
 struct demux_sys_t
 {
     MP4_Box_t    *p_root;      /* container for the whole file */
@@ -80,6 +101,25 @@ struct demux_sys_t
 
     bool         b_fragmented;   /* fMP4 */
 
+    /* Streaming of fragmented files: only the samples of the current 'moof'
+     * are kept in memory, finished fragments are discarded */
+    struct
+    {
+        bool                  b_enabled;
+        bool                  b_seekable;
+        bool                  b_fastseekable;
+
+        mp4_fragment_sample_t *p_samples;  /* sorted by file offset */
+        unsigned              i_samples;
+        unsigned              i_current;   /* next sample to send */
+        uint64_t              i_next_box;  /* next top level box to parse */
+        uint64_t              i_first_box; /* first top level box after moov */
+
+        mp4_fragment_point_t  *p_points;   /* sorted by time */
+        unsigned              i_points;
+        bool                  b_points_complete; /* from 'mfra' or 'sidx' */
+    } frag;
+
     /* */
     MP4_Box_t    *p_tref_chap;
 
@@ -193,6 +233,55 @@ static inline int64_t MP4_GetMoviePTS(demux_sys_t *p_sys )
 
 static void LoadChapter( demux_t  *p_demux );
 
+static void FragmentInit( demux_t * );
+static int  FragmentSeek( demux_t *, mtime_t );
+static void FragmentClean( demux_sys_t * );
+
+/* Maximum amount of data peeked to find the 'moov' of a non seekable stream */
+#define MP4_PROBE_SIZE (1 << 20)
+
+/**
+ * Check, without consuming any data, that the stream starts with a 'moov'
+ * announcing movie fragments. Only those files can be played without seeking.
+ */
+static bool IsFragmentedPeek( stream_t *s )
+{
+    const uint8_t *p_peek;
+    int i_pos = 0;
+
+    for( ;; )
+    {
+        if( stream_Peek( s, &p_peek, i_pos + 8 ) < i_pos + 8 )
+            return false;
+
+        const uint32_t i_size = GetDWBE( &p_peek[i_pos] );
+        const uint32_t i_type = VLC_FOURCC( p_peek[i_pos + 4], p_peek[i_pos + 5],
+                                            p_peek[i_pos + 6], p_peek[i_pos + 7] );
+        if( i_size < 8 || i_size > MP4_PROBE_SIZE - i_pos ||
+            i_type == ATOM_mdat || i_type == ATOM_moof )
+            return false;
+
+        if( i_type == ATOM_moov )
+        {
+            const int i_end = i_pos + i_size;
+            if( stream_Peek( s, &p_peek, i_end ) < i_end )
+                return false;
+
+            for( i_pos += 8; i_pos + 8 <= i_end; )
+            {
+                const uint32_t i_child = GetDWBE( &p_peek[i_pos] );
+                if( !memcmp( &p_peek[i_pos + 4], "mvex", 4 ) )
+                    return true;
+                if( i_child < 8 )
+                    return false;
+                i_pos += i_child;
+            }
+            return false;
+        }
+        i_pos += i_size;
+    }
+}
+
 static int LoadInitFrag( demux_t *p_demux, const bool b_smooth )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -334,9 +423,9 @@ static int Open( vlc_object_t * p_this )
             return VLC_EGENERIC;
     }
 
-    /* I need to seek */
+    /* I need to seek, unless the movie is fragmented */
     stream_Control( p_demux->s, STREAM_CAN_SEEK, &b_seekable );
-    if( !b_seekable )
+    if( !b_seekable && !IsFragmentedPeek( p_demux->s ) )
     {
         msg_Warn( p_demux, "MP4 plugin discarded (not seekable)" );
         return VLC_EGENERIC;
@@ -348,6 +437,9 @@ static int Open( vlc_object_t * p_this )
 
     /* create our structure that will contains all data */
     p_demux->p_sys = p_sys = calloc( 1, sizeof( demux_sys_t ) );
+    if( unlikely( p_sys == NULL ) )
+        return VLC_ENOMEM;
+    p_sys->frag.b_seekable = b_seekable;
 
     /* Is it Smooth Streaming? */
     bool b_smooth = false;
@@ -365,12 +457,19 @@ static int Open( vlc_object_t * p_this )
     {
         p_sys->b_fragmented = true;
     }
-    if( p_sys->b_fragmented )
+    if( b_smooth )
     {
         p_demux->pf_demux = DemuxFrg;
     }
+    else if( p_sys->b_fragmented )
+    {
+        /* moof/mdat pairs are parsed one at a time while playing */
+        p_sys->frag.b_enabled = true;
+        p_demux->pf_demux = DemuxFragmented;
+    }
 
     stream_Control( p_demux->s, STREAM_CAN_FASTSEEK, &b_seekable );
+    p_sys->frag.b_fastseekable = p_sys->frag.b_seekable && b_seekable;
     if( b_smooth )
     {
         if( InitTracks( p_demux ) != VLC_SUCCESS )
@@ -378,16 +477,6 @@ static int Open( vlc_object_t * p_this )
         CreateTracksFromSmooBox( p_demux );
         return VLC_SUCCESS;
     }
-    else if( p_sys->b_fragmented && b_seekable )
-    {
-        /* We are not yet able to demux a fragmented MP4 file, using the 'mfra'
-         * box. So if STREAM_CAN_FASTSEEK is true, we're assuming we've got such
-         * a file, and we let avformat do the job. */
-        msg_Warn( p_demux, "MP4 plugin discarded "\
-                "(fast-seekable and fragmented, let avformat demux it)" );
-        stream_Seek( p_demux->s, 0 ); /* rewind, for other demux */
-        goto error;
-    }
     else if( !p_sys->b_fragmented && !b_seekable )
     {
         msg_Warn( p_demux, "MP4 plugin discarded (not fast-seekable)" );
@@ -631,6 +720,9 @@ static int Open( vlc_object_t * p_this )
     /* */
     LoadChapter( p_demux );
 
+    if( p_sys->frag.b_enabled )
+        FragmentInit( p_demux );
+
     return VLC_SUCCESS;
 
 error:
@@ -910,7 +1002,16 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_SET_POSITION:
             f = (double)va_arg( args, double );
-            if( p_sys->b_fragmented )
+            if( p_sys->frag.b_enabled )
+            {
+                if( p_sys->i_duration == 0 )
+                    return VLC_EGENERIC;
+                i64 = (int64_t)( f * (double)1000000 *
+                                 (double)p_sys->i_duration /
+                                 (double)p_sys->i_timescale );
+                return FragmentSeek( p_demux, i64 );
+            }
+            else if( p_sys->b_fragmented )
             {
                 return MP4_frg_Seek( p_demux, f );
             }
@@ -936,6 +1037,8 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_SET_TIME:
             i64 = (int64_t)va_arg( args, int64_t );
+            if( p_sys->frag.b_enabled )
+                return FragmentSeek( p_demux, i64 );
             return Seek( p_demux, i64 );
 
         case DEMUX_GET_LENGTH:
@@ -1177,6 +1280,8 @@ static void Close ( vlc_object_t * p_this )
     if( p_sys->p_title )
         vlc_input_title_Delete( p_sys->p_title );
 
+    FragmentClean( p_sys );
+    free( p_sys->frag.p_points );
     free( p_sys );
 }
 
@@ -3750,3 +3855,602 @@ int DemuxFrg( demux_t *p_demux )
     }
     return 1;
 }
+
+/******************************************************************************
+ *     Here are the functions used to stream fragmented MP4 files
+ ******************************************************************************
+ * Only the 'moov' is kept in p_root. Each 'moof' is parsed when the previous
+ * one has been fully sent, its 'trun' entries are turned into a flat sample
+ * table sorted by file offset, and the samples are then read straight from
+ * the following 'mdat'. Random access points come from 'mfra' or 'sidx' when
+ * present, or are collected while playing.
+ *****************************************************************************/
+
+static void FragmentClean( demux_sys_t *p_sys )
+{
+    FREENULL( p_sys->frag.p_samples );
+    p_sys->frag.i_samples = 0;
+    p_sys->frag.i_current = 0;
+}
+
+static int FragmentAddPoint( demux_sys_t *p_sys, int64_t i_time,
+                             uint64_t i_offset )
+{
+    if( p_sys->frag.i_points > 0 &&
+        p_sys->frag.p_points[p_sys->frag.i_points - 1].i_time >= i_time )
+        return VLC_SUCCESS;
+
+    /* grow by steps of 64 entries */
+    if( ( p_sys->frag.i_points % 64 ) == 0 )
+    {
+        mp4_fragment_point_t *p_points =
+            realloc( p_sys->frag.p_points, ( p_sys->frag.i_points + 64 ) *
+                                           sizeof( *p_points ) );
+        if( unlikely( p_points == NULL ) )
+            return VLC_ENOMEM;
+        p_sys->frag.p_points = p_points;
+    }
+    p_sys->frag.p_points[p_sys->frag.i_points].i_time = i_time;
+    p_sys->frag.p_points[p_sys->frag.i_points].i_offset = i_offset;
+    p_sys->frag.i_points++;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Go to i_pos, reading forward when the stream cannot seek.
+ */
+static int FragmentGoto( demux_t *p_demux, uint64_t i_pos )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    uint64_t i_tell = stream_Tell( p_demux->s );
+
+    if( i_tell == i_pos )
+        return VLC_SUCCESS;
+    if( p_sys->frag.b_seekable )
+        return stream_Seek( p_demux->s, i_pos );
+    if( i_pos < i_tell )
+        return VLC_EGENERIC;
+
+    while( i_tell < i_pos )
+    {
+        const int i_skip = __MIN( i_pos - i_tell, INT_MAX );
+        if( stream_Read( p_demux->s, NULL, i_skip ) < i_skip )
+            return VLC_EGENERIC;
+        i_tell += i_skip;
+    }
+    return VLC_SUCCESS;
+}
+
+static mp4_track_t *FragmentGetTrack( demux_sys_t *p_sys, uint32_t i_track_ID )
+{
+    for( unsigned i = 0; i < p_sys->i_tracks; i++ )
+    {
+        if( p_sys->track[i].i_track_ID == i_track_ID )
+            return &p_sys->track[i];
+    }
+    return NULL;
+}
+
+static const MP4_Box_data_trex_t *FragmentGetTrex( demux_sys_t *p_sys,
+                                                   uint32_t i_track_ID )
+{
+    MP4_Box_t *p_mvex = MP4_BoxGet( p_sys->p_root, "/moov/mvex" );
+    if( p_mvex == NULL )
+        return NULL;
+
+    for( MP4_Box_t *p_trex = p_mvex->p_first; p_trex; p_trex = p_trex->p_next )
+    {
+        if( p_trex->i_type == ATOM_trex && p_trex->data.p_trex &&
+            p_trex->data.p_trex->i_track_ID == i_track_ID )
+            return p_trex->data.p_trex;
+    }
+    return NULL;
+}
+
+static int FragmentSampleCmp( const void *a, const void *b )
+{
+    const mp4_fragment_sample_t *p_a = a, *p_b = b;
+
+    if( p_a->i_offset != p_b->i_offset )
+        return p_a->i_offset < p_b->i_offset ? -1 : 1;
+    return p_a->i_dts < p_b->i_dts ? -1 : p_a->i_dts > p_b->i_dts;
+}
+
+/**
+ * Build the sample table of a 'moof' from its 'traf'/'trun' entries.
+ */
+static int FragmentParseMoof( demux_t *p_demux, MP4_Box_t *p_moof )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    unsigned i_count = 0;
+
+    for( MP4_Box_t *p_traf = p_moof->p_first; p_traf; p_traf = p_traf->p_next )
+    {
+        if( p_traf->i_type != ATOM_traf )
+            continue;
+        for( MP4_Box_t *p_trun = p_traf->p_first; p_trun; p_trun = p_trun->p_next )
+        {
+            if( p_trun->i_type == ATOM_trun && p_trun->data.p_trun )
+                i_count += p_trun->data.p_trun->i_sample_count;
+        }
+    }
+    if( i_count == 0 )
+        return VLC_SUCCESS;
+    if( i_count > SIZE_MAX / sizeof( mp4_fragment_sample_t ) )
+        return VLC_EGENERIC;
+
+    mp4_fragment_sample_t *p_samples = malloc( i_count * sizeof( *p_samples ) );
+    if( unlikely( p_samples == NULL ) )
+        return VLC_ENOMEM;
+
+    unsigned i_sample = 0;
+    uint64_t i_data_end = p_moof->i_pos;
+    bool b_first_traf = true;
+
+    for( MP4_Box_t *p_traf = p_moof->p_first; p_traf; p_traf = p_traf->p_next )
+    {
+        if( p_traf->i_type != ATOM_traf )
+            continue;
+
+        MP4_Box_t *p_tfhd = MP4_BoxGet( p_traf, "tfhd" );
+        if( p_tfhd == NULL || p_tfhd->data.p_tfhd == NULL )
+            continue;
+        const MP4_Box_data_tfhd_t *p_tfhd_data = p_tfhd->data.p_tfhd;
+
+        mp4_track_t *tk = FragmentGetTrack( p_sys, p_tfhd_data->i_track_ID );
+        if( tk == NULL || !tk->b_ok || tk->i_timescale == 0 )
+        {
+            msg_Dbg( p_demux, "skipping fragment of track %"PRIu32,
+                     p_tfhd_data->i_track_ID );
+            continue;
+        }
+        const MP4_Box_data_trex_t *p_trex =
+            FragmentGetTrex( p_sys, p_tfhd_data->i_track_ID );
+
+        /* base offset of the sample data, see ISO/IEC 14496-12 8.8.7 */
+        uint64_t i_base;
+        if( p_tfhd_data->i_flags & MP4_TFHD_BASE_DATA_OFFSET )
+            i_base = p_tfhd_data->i_base_data_offset;
+        else if( b_first_traf ||
+                 ( p_tfhd_data->i_flags & MP4_TFHD_DEFAULT_BASE_IS_MOOF ) )
+            i_base = p_moof->i_pos;
+        else
+            i_base = i_data_end;
+        b_first_traf = false;
+
+        uint32_t i_default_duration = p_trex ? p_trex->i_default_sample_duration : 0;
+        uint32_t i_default_size = p_trex ? p_trex->i_default_sample_size : 0;
+        if( p_tfhd_data->i_flags & MP4_TFHD_DFLT_SAMPLE_DURATION )
+            i_default_duration = p_tfhd_data->i_default_sample_duration;
+        if( p_tfhd_data->i_flags & MP4_TFHD_DFLT_SAMPLE_SIZE )
+            i_default_size = p_tfhd_data->i_default_sample_size;
+
+        /* Without 'tfdt', the fragment follows the previous one */
+        MP4_Box_t *p_tfdt = MP4_BoxGet( p_traf, "tfdt" );
+        if( p_tfdt && p_tfdt->data.p_tfdt )
+            tk->i_first_dts = p_tfdt->data.p_tfdt->i_base_media_decode_time;
+
+        uint64_t i_offset = i_base;
+        for( MP4_Box_t *p_trun = p_traf->p_first; p_trun; p_trun = p_trun->p_next )
+        {
+            if( p_trun->i_type != ATOM_trun || p_trun->data.p_trun == NULL )
+                continue;
+            const MP4_Box_data_trun_t *p_trun_data = p_trun->data.p_trun;
+
+            if( p_trun_data->i_flags & MP4_TRUN_DATA_OFFSET )
+                i_offset = i_base + p_trun_data->i_data_offset;
+
+            for( uint32_t i = 0; i < p_trun_data->i_sample_count; i++ )
+            {
+                const MP4_descriptor_trun_sample_t *p_entry =
+                    &p_trun_data->p_samples[i];
+                mp4_fragment_sample_t *p_sample = &p_samples[i_sample++];
+
+                uint32_t i_duration = i_default_duration;
+                if( p_trun_data->i_flags & MP4_TRUN_SAMPLE_DURATION )
+                    i_duration = p_entry->i_duration;
+
+                p_sample->i_size = i_default_size;
+                if( p_trun_data->i_flags & MP4_TRUN_SAMPLE_SIZE )
+                    p_sample->i_size = p_entry->i_size;
+
+                p_sample->i_offset = i_offset;
+                p_sample->i_dts = INT64_C(1000000) * tk->i_first_dts /
+                                  tk->i_timescale;
+                p_sample->b_pts_delta = ( p_trun_data->i_flags &
+                                          MP4_TRUN_SAMPLE_TIME_OFFSET ) != 0;
+                if( p_sample->b_pts_delta )
+                    /* signed in version 1, and unlikely above 2^31 in version 0 */
+                    p_sample->i_pts_delta = INT64_C(1000000) *
+                        (int32_t)p_entry->i_composition_time_offset /
+                        (int64_t)tk->i_timescale;
+                else
+                    p_sample->i_pts_delta = 0;
+                p_sample->p_track = tk;
+
+                i_offset += p_sample->i_size;
+                tk->i_first_dts += i_duration;
+            }
+        }
+        i_data_end = i_offset;
+    }
+
+    if( i_sample == 0 )
+    {
+        free( p_samples );
+        return VLC_SUCCESS;
+    }
+
+    /* Samples are read in file order, and the PCR must not go past any
+     * sample that is still to be sent */
+    qsort( p_samples, i_sample, sizeof( *p_samples ), FragmentSampleCmp );
+    p_samples[i_sample - 1].i_pcr = p_samples[i_sample - 1].i_dts;
+    for( unsigned i = i_sample - 1; i > 0; i-- )
+        p_samples[i - 1].i_pcr = __MIN( p_samples[i - 1].i_dts,
+                                        p_samples[i].i_pcr );
+
+    FragmentClean( p_sys );
+    p_sys->frag.p_samples = p_samples;
+    p_sys->frag.i_samples = i_sample;
+
+    if( p_sys->frag.b_seekable && !p_sys->frag.b_points_complete )
+        FragmentAddPoint( p_sys, p_samples[0].i_pcr, p_moof->i_pos );
+
+    return VLC_SUCCESS;
+}
+
+/**
+ * Parse the top level boxes up to the next 'moof' holding samples.
+ */
+static int FragmentNext( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    stream_t *s = p_demux->s;
+
+    FragmentClean( p_sys );
+
+    while( p_sys->frag.i_samples == 0 )
+    {
+        MP4_Box_t box;
+
+        if( FragmentGoto( p_demux, p_sys->frag.i_next_box ) ||
+            !MP4_ReadBoxCommon( s, &box ) )
+            return VLC_EGENERIC;
+
+        if( box.i_type != ATOM_moof )
+        {
+            /* 0 means up to the end of the stream */
+            if( box.i_size < 8 )
+                return VLC_EGENERIC;
+            if( box.i_type == ATOM_moov )
+                msg_Warn( p_demux, "ignoring new initialization segment" );
+            p_sys->frag.i_next_box += box.i_size;
+            continue;
+        }
+
+        MP4_Box_t *p_moof = MP4_BoxGetNextBox( s );
+        if( p_moof == NULL )
+            return VLC_EGENERIC;
+        p_sys->frag.i_next_box = p_moof->i_pos + p_moof->i_size;
+
+        /* The data usually follows in a 'mdat', which can be skipped as a
+         * whole once its samples have been read */
+        if( MP4_ReadBoxCommon( s, &box ) && box.i_type == ATOM_mdat &&
+            box.i_size >= 8 )
+            p_sys->frag.i_next_box += box.i_size;
+
+        int i_ret = FragmentParseMoof( p_demux, p_moof );
+        MP4_BoxFree( s, p_moof );
+        if( i_ret != VLC_SUCCESS )
+            return i_ret;
+    }
+    return VLC_SUCCESS;
+}
+
+/**
+ * Load random access points from the 'mfra' at the end of the file.
+ */
+static void FragmentLoadMfra( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    stream_t *s = p_demux->s;
+    const uint64_t i_size = stream_Size( s );
+    const uint64_t i_pos = stream_Tell( s );
+    const uint8_t *p_peek;
+
+    if( i_size < 16 || stream_Seek( s, i_size - 16 ) ||
+        stream_Peek( s, &p_peek, 16 ) < 16 || memcmp( &p_peek[4], "mfro", 4 ) )
+        goto end;
+
+    const uint32_t i_mfra_size = GetDWBE( &p_peek[12] );
+    if( i_mfra_size < 16 || i_mfra_size > i_size ||
+        stream_Seek( s, i_size - i_mfra_size ) )
+        goto end;
+
+    MP4_Box_t *p_mfra = MP4_BoxGetNextBox( s );
+    if( p_mfra == NULL )
+        goto end;
+
+    /* Use the video track if any: its entries are the keyframes */
+    MP4_Box_data_tfra_t *p_tfra = NULL;
+    mp4_track_t *tk = NULL;
+    for( MP4_Box_t *p_box = p_mfra->p_first; p_box; p_box = p_box->p_next )
+    {
+        if( p_box->i_type != ATOM_tfra || p_box->data.p_tfra == NULL )
+            continue;
+        mp4_track_t *p_track = FragmentGetTrack( p_sys,
+                                                 p_box->data.p_tfra->i_track_ID );
+        if( p_track == NULL || p_track->i_timescale == 0 )
+            continue;
+        if( p_tfra == NULL || p_track->fmt.i_cat == VIDEO_ES )
+        {
+            p_tfra = p_box->data.p_tfra;
+            tk = p_track;
+        }
+    }
+
+    for( uint32_t i = 0; p_tfra && i < p_tfra->i_number_of_entries; i++ )
+    {
+        uint64_t i_time, i_offset;
+        if( p_tfra->i_version == 1 )
+        {
+            i_time = ((uint64_t *)p_tfra->p_time)[i];
+            i_offset = ((uint64_t *)p_tfra->p_moof_offset)[i];
+        }
+        else
+        {
+            i_time = p_tfra->p_time[i];
+            i_offset = p_tfra->p_moof_offset[i];
+        }
+        /* Several entries may point to the same 'moof' */
+        if( p_sys->frag.i_points > 0 &&
+            p_sys->frag.p_points[p_sys->frag.i_points - 1].i_offset == i_offset )
+            continue;
+        FragmentAddPoint( p_sys, INT64_C(1000000) * i_time / tk->i_timescale,
+                          i_offset );
+    }
+    if( p_sys->frag.i_points > 0 )
+    {
+        msg_Dbg( p_demux, "loaded %u random access points from mfra",
+                 p_sys->frag.i_points );
+        p_sys->frag.b_points_complete = true;
+    }
+    MP4_BoxFree( s, p_mfra );
+
+end:
+    stream_Seek( s, i_pos );
+}
+
+/**
+ * Load random access points from a 'sidx' following the 'moov'.
+ */
+static void FragmentLoadSidx( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    MP4_Box_t box;
+
+    if( FragmentGoto( p_demux, p_sys->frag.i_next_box ) ||
+        !MP4_ReadBoxCommon( p_demux->s, &box ) || box.i_type != ATOM_sidx )
+        return;
+
+    MP4_Box_t *p_sidx = MP4_BoxGetNextBox( p_demux->s );
+    if( p_sidx == NULL )
+        return;
+    p_sys->frag.i_next_box = p_sidx->i_pos + p_sidx->i_size;
+
+    const MP4_Box_data_sidx_t *p_data = p_sidx->data.p_sidx;
+    if( p_data && p_data->i_timescale > 0 && p_sys->frag.i_points == 0 )
+    {
+        uint64_t i_offset = p_sys->frag.i_next_box + p_data->i_first_offset;
+        uint64_t i_time = p_data->i_earliest_presentation_time;
+
+        for( unsigned i = 0; i < p_data->i_reference_count; i++ )
+        {
+            /* references to other sidx only add up to the offset */
+            if( !p_data->p_items[i].b_reference_type )
+                FragmentAddPoint( p_sys, INT64_C(1000000) * i_time /
+                                         p_data->i_timescale, i_offset );
+            i_offset += p_data->p_items[i].i_referenced_size;
+            i_time += p_data->p_items[i].i_subsegment_duration;
+        }
+        p_sys->frag.b_points_complete = p_sys->frag.i_points > 0;
+
+        if( p_sys->i_duration == 0 )
+            p_sys->i_duration = i_time * p_sys->i_timescale / p_data->i_timescale;
+    }
+    MP4_BoxFree( p_demux->s, p_sidx );
+}
+
+static void FragmentInit( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    p_sys->frag.i_first_box = p_sys->frag.i_next_box = stream_Tell( p_demux->s );
+
+    for( unsigned i = 0; i < p_sys->i_tracks; i++ )
+        p_sys->track[i].i_first_dts = 0;
+
+    MP4_Box_t *p_mehd = MP4_BoxGet( p_sys->p_root, "/moov/mvex/mehd" );
+    if( p_sys->i_duration == 0 && p_mehd && p_mehd->data.p_mehd )
+        p_sys->i_duration = p_mehd->data.p_mehd->i_fragment_duration;
+
+    FragmentLoadSidx( p_demux );
+    if( p_sys->frag.b_fastseekable && !p_sys->frag.b_points_complete )
+        FragmentLoadMfra( p_demux );
+
+    if( p_sys->i_duration == 0 && p_sys->frag.b_points_complete )
+    {
+        const mp4_fragment_point_t *p_last =
+            &p_sys->frag.p_points[p_sys->frag.i_points - 1];
+        p_sys->i_duration = p_last->i_time * p_sys->i_timescale / 1000000;
+    }
+}
+
+/**
+ * Extend the random access points up to i_date by parsing the 'moof' boxes
+ * only, the 'mdat' are skipped. Only used on fast seekable streams.
+ */
+static void FragmentScan( demux_t *p_demux, mtime_t i_date )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    stream_t *s = p_demux->s;
+    uint64_t i_pos = p_sys->frag.i_first_box;
+
+    if( p_sys->frag.i_points > 0 )
+        i_pos = p_sys->frag.p_points[p_sys->frag.i_points - 1].i_offset;
+
+    while( p_sys->frag.i_points == 0 ||
+           p_sys->frag.p_points[p_sys->frag.i_points - 1].i_time < i_date )
+    {
+        MP4_Box_t box;
+
+        if( stream_Seek( s, i_pos ) || !MP4_ReadBoxCommon( s, &box ) ||
+            box.i_size < 8 )
+            break;
+        i_pos += box.i_size;
+        if( box.i_type != ATOM_moof )
+            continue;
+
+        MP4_Box_t *p_moof = MP4_BoxGetNextBox( s );
+        if( p_moof == NULL )
+            break;
+
+        /* The fragment time is only known from its 'tfdt' */
+        int64_t i_time = INT64_MAX;
+        for( MP4_Box_t *p_traf = p_moof->p_first; p_traf; p_traf = p_traf->p_next )
+        {
+            MP4_Box_t *p_tfhd = MP4_BoxGet( p_traf, "tfhd" );
+            MP4_Box_t *p_tfdt = MP4_BoxGet( p_traf, "tfdt" );
+            if( p_traf->i_type != ATOM_traf || !p_tfhd || !p_tfhd->data.p_tfhd ||
+                !p_tfdt || !p_tfdt->data.p_tfdt )
+                continue;
+            mp4_track_t *tk = FragmentGetTrack( p_sys,
+                                                p_tfhd->data.p_tfhd->i_track_ID );
+            if( tk == NULL || tk->i_timescale == 0 )
+                continue;
+            i_time = __MIN( i_time, (int64_t)( INT64_C(1000000) *
+                            p_tfdt->data.p_tfdt->i_base_media_decode_time /
+                            tk->i_timescale ) );
+        }
+        if( i_time != INT64_MAX )
+            FragmentAddPoint( p_sys, i_time, p_moof->i_pos );
+        MP4_BoxFree( s, p_moof );
+
+        if( i_time == INT64_MAX )
+            break;
+    }
+}
+
+static int FragmentSeek( demux_t *p_demux, mtime_t i_date )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( !p_sys->frag.b_seekable )
+        return VLC_EGENERIC;
+
+    if( !p_sys->frag.b_points_complete && p_sys->frag.b_fastseekable )
+        FragmentScan( p_demux, i_date );
+    if( p_sys->frag.i_points == 0 )
+        return VLC_EGENERIC;
+
+    /* last point not after i_date */
+    unsigned i_low = 0, i_high = p_sys->frag.i_points;
+    while( i_high - i_low > 1 )
+    {
+        const unsigned i_mid = ( i_low + i_high ) / 2;
+        if( p_sys->frag.p_points[i_mid].i_time <= i_date )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+    const mp4_fragment_point_t *p_point = &p_sys->frag.p_points[i_low];
+
+    if( stream_Seek( p_demux->s, p_point->i_offset ) )
+        return VLC_EGENERIC;
+    msg_Dbg( p_demux, "seeking to fragment at %"PRIu64" (%"PRId64"us)",
+             p_point->i_offset, p_point->i_time );
+
+    FragmentClean( p_sys );
+    p_sys->frag.i_next_box = p_point->i_offset;
+
+    /* Used by fragments without 'tfdt' */
+    for( unsigned i = 0; i < p_sys->i_tracks; i++ )
+    {
+        mp4_track_t *tk = &p_sys->track[i];
+        tk->i_first_dts = p_point->i_time * tk->i_timescale / 1000000;
+    }
+
+    p_sys->i_pcr = p_point->i_time;
+    p_sys->i_time = p_point->i_time * p_sys->i_timescale / 1000000;
+    es_out_Control( p_demux->out, ES_OUT_SET_NEXT_DISPLAY_TIME, i_date );
+
+    return VLC_SUCCESS;
+}
+
+/**
+ * DemuxFragmented: send the next sample of the current fragment
+ * \return 1 on success, 0 on error or end of stream.
+ */
+static int DemuxFragmented( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    /* check for newly selected/unselected track */
+    for( unsigned i = 0; i < p_sys->i_tracks; i++ )
+    {
+        mp4_track_t *tk = &p_sys->track[i];
+        bool b;
+
+        if( !tk->b_ok || tk->b_chapter )
+            continue;
+
+        es_out_Control( p_demux->out, ES_OUT_GET_ES_STATE, tk->p_es, &b );
+        if( tk->b_selected && !b )
+            MP4_TrackUnselect( p_demux, tk );
+        else if( !tk->b_selected && b )
+            MP4_frg_TrackSelect( p_demux, tk );
+    }
+
+    if( p_sys->frag.i_current >= p_sys->frag.i_samples &&
+        FragmentNext( p_demux ) != VLC_SUCCESS )
+    {
+        msg_Dbg( p_demux, "no more fragments" );
+        return 0;
+    }
+
+    const mp4_fragment_sample_t *p_sample =
+        &p_sys->frag.p_samples[p_sys->frag.i_current++];
+    mp4_track_t *tk = p_sample->p_track;
+
+    if( p_sample->i_pcr > p_sys->i_pcr )
+    {
+        p_sys->i_pcr = p_sample->i_pcr;
+        p_sys->i_time = p_sys->i_pcr * p_sys->i_timescale / 1000000;
+    }
+    es_out_Control( p_demux->out, ES_OUT_SET_PCR, VLC_TS_0 + p_sys->i_pcr );
+
+    if( !tk->b_selected || p_sample->i_size == 0 )
+        return 1;
+
+    if( FragmentGoto( p_demux, p_sample->i_offset ) )
+    {
+        msg_Warn( p_demux, "cannot reach sample of track[Id 0x%x]",
+                  tk->i_track_ID );
+        return 1;
+    }
+
+    block_t *p_block = stream_Block( p_demux->s, p_sample->i_size );
+    if( p_block == NULL )
+        return 0;
+
+    p_block->i_dts = VLC_TS_0 + p_sample->i_dts;
+    if( p_sample->b_pts_delta )
+        p_block->i_pts = p_block->i_dts + p_sample->i_pts_delta;
+    else if( tk->fmt.i_cat != VIDEO_ES )
+        p_block->i_pts = p_block->i_dts;
+    else
+        p_block->i_pts = VLC_TS_INVALID;
+
+    es_out_Send( p_demux->out, tk->p_es, p_block );
+    return 1;
+}
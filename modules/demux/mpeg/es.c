@@ -268,44 +268,46 @@ static int Demux( demux_t *p_demux )
     else
         ret = Parse( p_demux, &p_block_out ) ? 0 : 1;
 
-    while( p_block_out )
-    {
-        block_t *p_next = p_block_out->p_next;
+    mtime_t i_pcr = VLC_TS_INVALID;
 
+    for( block_t *p_block = p_block_out; p_block; p_block = p_block->p_next )
+    {
         /* Correct timestamp */
         if( p_sys->p_packetizer->fmt_out.i_cat == VIDEO_ES )
         {
-            if( p_block_out->i_pts <= VLC_TS_INVALID &&
-                p_block_out->i_dts <= VLC_TS_INVALID )
-                p_block_out->i_dts = VLC_TS_0 + p_sys->i_pts + 1000000 / p_sys->f_fps;
-            if( p_block_out->i_dts > VLC_TS_INVALID )
-                p_sys->i_pts = p_block_out->i_dts - VLC_TS_0;
+            if( p_block->i_pts <= VLC_TS_INVALID &&
+                p_block->i_dts <= VLC_TS_INVALID )
+                p_block->i_dts = VLC_TS_0 + p_sys->i_pts + 1000000 / p_sys->f_fps;
+            if( p_block->i_dts > VLC_TS_INVALID )
+                p_sys->i_pts = p_block->i_dts - VLC_TS_0;
         }
         else
         {
-            p_sys->i_pts = p_block_out->i_pts - VLC_TS_0;
+            p_sys->i_pts = p_block->i_pts - VLC_TS_0;
         }
 
-        if( p_block_out->i_pts > VLC_TS_INVALID )
+        if( p_block->i_pts > VLC_TS_INVALID )
         {
-            p_block_out->i_pts += p_sys->i_time_offset;
+            p_block->i_pts += p_sys->i_time_offset;
         }
-        if( p_block_out->i_dts > VLC_TS_INVALID )
+        if( p_block->i_dts > VLC_TS_INVALID )
         {
-            p_block_out->i_dts += p_sys->i_time_offset;
-            es_out_Control( p_demux->out, ES_OUT_SET_PCR, p_block_out->i_dts );
+            p_block->i_dts += p_sys->i_time_offset;
+            i_pcr = p_block->i_dts;
         }
         /* Re-estimate bitrate */
         if( p_sys->b_estimate_bitrate && p_sys->i_pts > INT64_C(500000) )
             p_sys->i_bitrate_avg = 8*INT64_C(1000000)*p_sys->i_bytes/(p_sys->i_pts-1);
-        p_sys->i_bytes += p_block_out->i_buffer;
-
+        p_sys->i_bytes += p_block->i_buffer;
+    }
 
-        p_block_out->p_next = NULL;
-        es_out_Send( p_demux->out, p_sys->p_es, p_block_out );
+    /* Send everything the packetizer gave us at once, the PCR is only
+     * updated afterwards so that it never gets ahead of the data sent */
+    if( p_block_out )
+        es_out_SendChain( p_demux->out, p_sys->p_es, p_block_out );
+    if( i_pcr > VLC_TS_INVALID )
+        es_out_Control( p_demux->out, ES_OUT_SET_PCR, i_pcr );
 
-        p_block_out = p_next;
-    }
     return ret;
 }
 
@@ -249,6 +249,7 @@ static int Demux( demux_t * p_demux )
         if( p_sys->i_eos )
         {
             msg_Dbg( p_demux, "end of a group of logical streams" );
+            p_sys->b_chained = true;
             /* We keep the ES to try reusing it in Ogg_BeginningOfStream
              * only 1 ES is supported (common case for ogg web radio) */
             if( p_sys->i_streams == 1 )
@@ -289,6 +290,14 @@ static int Demux( demux_t * p_demux )
         if( Ogg_ReadPage( p_demux, &p_sys->current_page ) != VLC_SUCCESS )
             return 0; /* EOF */
 
+        if( p_sys->p_index )
+        {
+            int64_t i_pagepos = stream_Tell( p_demux->s )
+                - ( p_sys->oy.fill - p_sys->oy.returned )
+                - ( p_sys->current_page.header_len + p_sys->current_page.body_len );
+            oggseek_index_Page( p_sys->p_index, &p_sys->current_page, i_pagepos );
+        }
+
         /* Test for End of Stream */
         if( ogg_page_eos( &p_sys->current_page ) )
             p_sys->i_eos++;
@@ -464,6 +473,34 @@ static void Ogg_ResetStreamHelper( demux_sys_t *p_sys )
     ogg_sync_reset( &p_sys->oy );
 }
 
+/* Seeks to the last indexed page before i_time, the decoders will preroll
+ * from there */
+static int Ogg_SeekIndex( demux_t *p_demux, int64_t i_time )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    mtime_t i_found;
+    int64_t i_pagepos;
+
+    if( p_sys->p_index == NULL || p_sys->i_bos > 0 )
+        return VLC_EGENERIC;
+
+    i_pagepos = oggseek_index_Find( p_sys->p_index, i_time, &i_found );
+    if( i_pagepos < 0 )
+        return VLC_EGENERIC;
+
+    Ogg_ResetStreamHelper( p_sys );
+    oggseek_index_Reset( p_sys->p_index );
+    if( stream_Seek( p_demux->s, i_pagepos ) )
+        return VLC_EGENERIC;
+    p_sys->b_page_waiting = false;
+
+    msg_Dbg( p_demux, "seeking to %"PRId64" from index point %"PRId64
+             " at offset %"PRId64, i_time, i_found, i_pagepos );
+    es_out_Control( p_demux->out, ES_OUT_SET_NEXT_DISPLAY_TIME,
+                    VLC_TS_0 + i_time );
+    return VLC_SUCCESS;
+}
+
 /*****************************************************************************
  * Control:
  *****************************************************************************/
@@ -493,7 +530,16 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
             return VLC_SUCCESS;
 
         case DEMUX_SET_TIME:
-            return VLC_EGENERIC;
+            return Ogg_SeekIndex( p_demux, (int64_t)va_arg( args, int64_t ) );
+
+        case DEMUX_GET_INDEX_COVERAGE:
+        {
+            double *pf = (double*)va_arg( args, double * );
+            if( p_sys->p_index == NULL )
+                return VLC_EGENERIC;
+            *pf = oggseek_index_Coverage( p_sys->p_index );
+            return VLC_SUCCESS;
+        }
 
         case DEMUX_GET_ATTACHMENTS:
         {
@@ -520,6 +566,16 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
                 return VLC_EGENERIC;
             }
 
+            if( p_sys->p_index && p_sys->i_length > 0 )
+            {
+                va_list ap;
+                va_copy( ap, args );
+                double f = (double)va_arg( ap, double );
+                va_end( ap );
+                if( Ogg_SeekIndex( p_demux, f * p_sys->i_length * 1000000 ) == VLC_SUCCESS )
+                    return VLC_SUCCESS;
+            }
+
             Ogg_ResetStreamHelper( p_sys );
             return demux_vaControlHelper( p_demux->s, 0, -1, p_sys->i_bitrate,
                                           1, i_query, args );
@@ -1666,6 +1722,32 @@ static int Ogg_BeginningOfStream( demux_t *p_demux )
     /* get total frame count for video stream; we will need this for seeking */
     p_ogg->i_total_frames = 0;
 
+    /* Index the first stream dated by granule positions alone, video first.
+     * Chained groups restart their time base, don't bother with them. */
+    if( !p_ogg->b_chained && p_ogg->p_index == NULL )
+    {
+        logical_stream_t *p_ref = NULL;
+
+        for( i_stream = 0 ; i_stream < p_ogg->i_streams; i_stream++ )
+        {
+            logical_stream_t *p_stream = p_ogg->pp_stream[i_stream];
+
+            if( p_stream->fmt.i_codec == VLC_CODEC_THEORA )
+            {
+                p_ref = p_stream;
+                break;
+            }
+            if( p_ref == NULL &&
+                ( p_stream->fmt.i_codec == VLC_CODEC_VORBIS ||
+                  p_stream->fmt.i_codec == VLC_CODEC_SPEEX ||
+                  p_stream->fmt.i_codec == VLC_CODEC_OPUS ||
+                  p_stream->fmt.i_codec == VLC_CODEC_FLAC ) )
+                p_ref = p_stream;
+        }
+        if( p_ref )
+            p_ogg->p_index = oggseek_index_New( p_demux, p_ref );
+    }
+
     return VLC_SUCCESS;
 }
 
@@ -1677,6 +1759,10 @@ static void Ogg_EndOfStream( demux_t *p_demux )
     demux_sys_t *p_ogg = p_demux->p_sys  ;
     int i_stream;
 
+    if( p_ogg->p_index )
+        oggseek_index_Delete( p_ogg->p_index );
+    p_ogg->p_index = NULL;
+
     for( i_stream = 0 ; i_stream < p_ogg->i_streams; i_stream++ )
         Ogg_LogicalStreamDelete( p_demux, p_ogg->pp_stream[i_stream] );
     free( p_ogg->pp_stream );
@@ -27,6 +27,7 @@
  *****************************************************************************/
 
 typedef struct oggseek_index_entry demux_index_entry_t;
+typedef struct oggseek_index_s oggseek_index_t;
 
 typedef struct logical_stream_s
 {
@@ -130,4 +131,8 @@ struct demux_sys_t
 
     /* Length, if available. */
     int64_t i_length;
+
+    /* seek index of the first group of logical streams */
+    oggseek_index_t *p_index;
+    bool    b_chained;
 };
@@ -32,6 +32,11 @@
 
 #include <vlc_common.h>
 #include <vlc_demux.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+#include <vlc_configuration.h>
+
+#include <sys/stat.h>
 
 #include <ogg/ogg.h>
 
@@ -923,3 +928,510 @@ int64_t oggseek_read_page( demux_t *p_demux )
 }
 
 
+
+
+
+/************************************************************
+* granule index
+*************************************************************/
+
+/* don't index audio pages closer than that */
+#define INDEX_SPACING   (CLOCK_FREQ / 2)
+#define INDEX_MAGIC     "vlc-ogg-index 1"
+/* indexes kept in the cache directory, the oldest ones are removed */
+#define INDEX_CACHE_MAX 100
+
+typedef struct
+{
+    mtime_t i_time;
+    int64_t i_pagepos;
+} index_point_t;
+
+/* last dated page of the reference stream seen by a feeder */
+typedef struct
+{
+    int64_t i_granule;
+    int64_t i_pagepos;
+} index_feed_t;
+
+struct oggseek_index_s
+{
+    demux_t      *p_demux;
+    char         *psz_url;
+    char         *psz_cache;
+
+    /* reference stream parameters */
+    vlc_fourcc_t i_codec;
+    int          i_serial_no;
+    int          i_granule_shift;
+    int64_t      i_keyframe_offset;
+    int          i_pre_skip;
+    double       f_rate;
+    int64_t      i_size;
+
+    vlc_mutex_t  lock;
+    index_point_t *p_points;
+    size_t       i_points;
+    size_t       i_points_max;
+    bool         b_complete;    /* every page of the file went through */
+
+    index_feed_t feed;          /* playback */
+
+    /* background scan */
+    vlc_thread_t thread;
+    bool         b_scanning;
+    bool         b_abort;
+    int64_t      i_scan_pos;
+};
+
+static bool index_IsVideo( const oggseek_index_t *p_idx )
+{
+    return p_idx->i_codec == VLC_CODEC_THEORA;
+}
+
+static mtime_t index_GranuleTime( const oggseek_index_t *p_idx, int64_t i_granule )
+{
+    if ( index_IsVideo( p_idx ) )
+    {
+        int64_t i_iframe = i_granule >> p_idx->i_granule_shift;
+        int64_t i_pframe = i_granule - ( i_iframe << p_idx->i_granule_shift );
+        return ( i_iframe + i_pframe - p_idx->i_keyframe_offset )
+               * INT64_C(1000000) / p_idx->f_rate;
+    }
+
+    i_granule = __MAX( i_granule - p_idx->i_pre_skip, 0 );
+    return i_granule * INT64_C(1000000) / p_idx->f_rate;
+}
+
+/* first point strictly after i_time; called with the lock held */
+static size_t index_Upper( const oggseek_index_t *p_idx, mtime_t i_time )
+{
+    size_t i_low = 0, i_high = p_idx->i_points;
+
+    while ( i_low < i_high )
+    {
+        size_t i_mid = ( i_low + i_high ) / 2;
+        if ( p_idx->p_points[i_mid].i_time <= i_time )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
+}
+
+/* called with the lock held */
+static void index_Insert( oggseek_index_t *p_idx, mtime_t i_time, int64_t i_pagepos )
+{
+    size_t i = index_Upper( p_idx, i_time );
+
+    if ( ( i > 0 && i_time - p_idx->p_points[i - 1].i_time < INDEX_SPACING ) ||
+         ( i < p_idx->i_points && p_idx->p_points[i].i_time - i_time < INDEX_SPACING ) )
+        return;
+
+    if ( p_idx->i_points >= p_idx->i_points_max )
+    {
+        size_t i_max = __MAX( 64, 2 * p_idx->i_points_max );
+        index_point_t *p_points = realloc( p_idx->p_points,
+                                           i_max * sizeof( *p_points ) );
+        if ( unlikely( p_points == NULL ) )
+            return;
+        p_idx->p_points = p_points;
+        p_idx->i_points_max = i_max;
+    }
+
+    memmove( &p_idx->p_points[i + 1], &p_idx->p_points[i],
+             ( p_idx->i_points - i ) * sizeof( *p_idx->p_points ) );
+    p_idx->p_points[i].i_time = i_time;
+    p_idx->p_points[i].i_pagepos = i_pagepos;
+    p_idx->i_points++;
+}
+
+/* Adds the seek point given by a dated page of the reference stream.
+ * Audio pages can be seeked to directly. For theora, the point for a new
+ * keyframe is the previous dated page, which ends before the keyframe. */
+static void index_Feed( oggseek_index_t *p_idx, index_feed_t *p_feed,
+                        int64_t i_granule, int64_t i_pagepos )
+{
+    if ( i_granule < 0 )
+        return;
+
+    vlc_mutex_lock( &p_idx->lock );
+    if ( !index_IsVideo( p_idx ) )
+    {
+        index_Insert( p_idx, index_GranuleTime( p_idx, i_granule ), i_pagepos );
+    }
+    else if ( p_feed->i_granule >= 0 )
+    {
+        int64_t i_kframe = i_granule >> p_idx->i_granule_shift;
+        if ( i_kframe != p_feed->i_granule >> p_idx->i_granule_shift )
+            index_Insert( p_idx,
+                          index_GranuleTime( p_idx, i_kframe << p_idx->i_granule_shift ),
+                          p_feed->i_pagepos );
+    }
+    vlc_mutex_unlock( &p_idx->lock );
+
+    p_feed->i_granule = i_granule;
+    p_feed->i_pagepos = i_pagepos;
+}
+
+static bool index_Load( oggseek_index_t *p_idx )
+{
+    FILE *p_file = vlc_fopen( p_idx->psz_cache, "rt" );
+    if ( p_file == NULL )
+        return false;
+
+    char psz_magic[32];
+    int64_t i_size;
+    int i_serial_no;
+    unsigned i_count;
+    bool b_ok = false;
+
+    if ( fgets( psz_magic, sizeof( psz_magic ), p_file ) != NULL &&
+         !strncmp( psz_magic, INDEX_MAGIC"\n", sizeof( psz_magic ) ) &&
+         fscanf( p_file, "%"SCNd64" %d %u", &i_size, &i_serial_no, &i_count ) == 3 &&
+         i_size == p_idx->i_size && i_serial_no == p_idx->i_serial_no )
+    {
+        unsigned i;
+        for ( i = 0; i < i_count; i++ )
+        {
+            int64_t i_time, i_pagepos;
+            if ( fscanf( p_file, "%"SCNd64" %"SCNd64, &i_time, &i_pagepos ) != 2 ||
+                 i_pagepos < 0 || i_pagepos >= i_size )
+                break;
+            index_Insert( p_idx, i_time, i_pagepos );
+        }
+        b_ok = i == i_count;
+    }
+    fclose( p_file );
+
+    if ( !b_ok )
+    {
+        p_idx->i_points = 0;
+        return false;
+    }
+    msg_Dbg( p_idx->p_demux, "loaded %zu index points from %s",
+             p_idx->i_points, p_idx->psz_cache );
+    return true;
+}
+
+/* Removes the oldest indexes of the cache directory beyond the limit */
+static void index_Prune( demux_t *p_demux, const char *psz_dir )
+{
+    DIR *p_dir = vlc_opendir( psz_dir );
+    if ( p_dir == NULL )
+        return;
+
+    for ( ;; )
+    {
+        char *psz_oldest = NULL;
+        time_t i_oldest = 0;
+        unsigned i_count = 0;
+        char *psz_entry;
+
+        rewinddir( p_dir );
+        while ( ( psz_entry = vlc_readdir( p_dir ) ) != NULL )
+        {
+            char *psz_path;
+            struct stat st;
+
+            if ( psz_entry[0] == '.' ||
+                 asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_entry ) == -1 )
+            {
+                free( psz_entry );
+                continue;
+            }
+            free( psz_entry );
+
+            if ( vlc_stat( psz_path, &st ) || !S_ISREG( st.st_mode ) )
+            {
+                free( psz_path );
+                continue;
+            }
+            i_count++;
+            if ( psz_oldest == NULL || st.st_mtime < i_oldest )
+            {
+                free( psz_oldest );
+                psz_oldest = psz_path;
+                i_oldest = st.st_mtime;
+            }
+            else
+                free( psz_path );
+        }
+
+        bool b_done = i_count <= INDEX_CACHE_MAX || psz_oldest == NULL ||
+                      vlc_unlink( psz_oldest );
+        if ( !b_done )
+            msg_Dbg( p_demux, "removed cached index %s", psz_oldest );
+        free( psz_oldest );
+        if ( b_done )
+            break;
+    }
+    closedir( p_dir );
+}
+
+static void index_Save( oggseek_index_t *p_idx )
+{
+    char *psz_dir = strdup( p_idx->psz_cache );
+    if ( unlikely( psz_dir == NULL ) )
+        return;
+    *strrchr( psz_dir, DIR_SEP_CHAR ) = '\0';
+    vlc_mkdir( psz_dir, 0700 );
+
+    FILE *p_file = vlc_fopen( p_idx->psz_cache, "wt" );
+    if ( p_file == NULL )
+    {
+        msg_Warn( p_idx->p_demux, "cannot write %s", p_idx->psz_cache );
+        free( psz_dir );
+        return;
+    }
+
+    fprintf( p_file, INDEX_MAGIC"\n%"PRId64" %d %zu\n",
+             p_idx->i_size, p_idx->i_serial_no, p_idx->i_points );
+    for ( size_t i = 0; i < p_idx->i_points; i++ )
+        fprintf( p_file, "%"PRId64" %"PRId64"\n",
+                 p_idx->p_points[i].i_time, p_idx->p_points[i].i_pagepos );
+    if ( fclose( p_file ) )
+        vlc_unlink( p_idx->psz_cache );
+
+    index_Prune( p_idx->p_demux, psz_dir );
+    free( psz_dir );
+}
+
+/* Walks the page headers of the whole file through its own stream;
+ * page bodies are skipped, so this mostly costs seeks */
+static void *index_Scan( void *data )
+{
+    oggseek_index_t *p_idx = data;
+    stream_t *s = stream_UrlNew( p_idx->p_demux, p_idx->psz_url );
+    index_feed_t feed = { -1, -1 };
+    int64_t i_pos = 0;
+    bool b_complete = false;
+
+    if ( s == NULL )
+    {
+        msg_Warn( p_idx->p_demux, "cannot open %s for index scan", p_idx->psz_url );
+        goto end;
+    }
+
+    for ( ;; )
+    {
+        const uint8_t *p_peek;
+        bool b_abort;
+
+        vlc_mutex_lock( &p_idx->lock );
+        b_abort = p_idx->b_abort;
+        p_idx->i_scan_pos = i_pos;
+        vlc_mutex_unlock( &p_idx->lock );
+        if ( b_abort )
+            break;
+
+        int i_peek = stream_Peek( s, &p_peek, PAGE_HEADER_BYTES + 255 );
+        if ( i_peek < PAGE_HEADER_BYTES )
+        {
+            b_complete = true;
+            break;
+        }
+
+        if ( memcmp( p_peek, "OggS", 4 ) )
+        {
+            /* lost sync, look for the next capture pattern */
+            int i_skip;
+            i_peek = stream_Peek( s, &p_peek, OGGSEEK_BYTES_TO_READ );
+            for ( i_skip = 1; i_skip + 4 <= i_peek; i_skip++ )
+                if ( !memcmp( &p_peek[i_skip], "OggS", 4 ) )
+                    break;
+            if ( i_skip + 4 > i_peek )
+                i_skip = __MAX( i_peek - 3, 1 );
+            if ( stream_Read( s, NULL, i_skip ) < i_skip )
+                break;
+            i_pos += i_skip;
+            continue;
+        }
+
+        int i_segments = p_peek[26];
+        if ( i_peek < PAGE_HEADER_BYTES + i_segments )
+        {
+            b_complete = true; /* truncated last page */
+            break;
+        }
+        int i_body = 0;
+        for ( int i = 0; i < i_segments; i++ )
+            i_body += p_peek[PAGE_HEADER_BYTES + i];
+
+        if ( (int)GetDWLE( &p_peek[14] ) == p_idx->i_serial_no )
+        {
+            index_Feed( p_idx, &feed, GetQWLE( &p_peek[6] ), i_pos );
+            if ( p_peek[5] & 0x04 )
+            {
+                /* end of the reference stream, chained streams may follow */
+                b_complete = true;
+                break;
+            }
+        }
+
+        i_pos += PAGE_HEADER_BYTES + i_segments + i_body;
+        if ( stream_Seek( s, i_pos ) )
+            break;
+    }
+    stream_Delete( s );
+
+end:
+    vlc_mutex_lock( &p_idx->lock );
+    p_idx->b_complete = b_complete;
+    p_idx->i_scan_pos = i_pos;
+    msg_Dbg( p_idx->p_demux, "index scan %s, %zu points",
+             b_complete ? "done" : "stopped", p_idx->i_points );
+    vlc_mutex_unlock( &p_idx->lock );
+    return NULL;
+}
+
+static char *index_CachePath( const char *psz_url )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_path;
+    struct md5_s md5;
+
+    if ( psz_cachedir == NULL )
+        return NULL;
+
+    InitMD5( &md5 );
+    AddMD5( &md5, psz_url, strlen( psz_url ) );
+    EndMD5( &md5 );
+    char *psz_hash = psz_md5_hash( &md5 );
+
+    if ( psz_hash == NULL ||
+         asprintf( &psz_path, "%s" DIR_SEP "ogg-index" DIR_SEP "%s",
+                   psz_cachedir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_hash );
+    free( psz_cachedir );
+    return psz_path;
+}
+
+/* Creates the index of p_stream, which must be dated by its granule
+ * positions alone (theora or a xiph audio codec). The index is loaded from
+ * the cache, or built in the background if the input can seek fast. */
+oggseek_index_t *oggseek_index_New( demux_t *p_demux, const logical_stream_t *p_stream )
+{
+    bool b_fastseek;
+    int64_t i_size = stream_Size( p_demux->s );
+
+    if ( p_stream->f_rate <= 0 || i_size <= 0 ||
+         p_demux->psz_access == NULL || p_demux->psz_location == NULL )
+        return NULL;
+
+    oggseek_index_t *p_idx = calloc( 1, sizeof( *p_idx ) );
+    if ( unlikely( p_idx == NULL ) )
+        return NULL;
+
+    if ( asprintf( &p_idx->psz_url, "%s://%s", p_demux->psz_access,
+                   p_demux->psz_location ) == -1 )
+    {
+        free( p_idx );
+        return NULL;
+    }
+
+    p_idx->p_demux = p_demux;
+    p_idx->i_codec = p_stream->fmt.i_codec;
+    p_idx->i_serial_no = p_stream->i_serial_no;
+    p_idx->i_granule_shift = p_stream->i_granule_shift;
+    p_idx->i_keyframe_offset = p_stream->i_keyframe_offset;
+    p_idx->i_pre_skip = p_stream->i_pre_skip;
+    p_idx->f_rate = p_stream->f_rate;
+    p_idx->i_size = i_size;
+    p_idx->feed.i_granule = -1;
+    vlc_mutex_init( &p_idx->lock );
+
+    p_idx->psz_cache = index_CachePath( p_idx->psz_url );
+    if ( p_idx->psz_cache != NULL && index_Load( p_idx ) )
+    {
+        p_idx->b_complete = true;
+        return p_idx;
+    }
+
+    /* the start of the file is always a valid seek point */
+    index_Insert( p_idx, 0, 0 );
+
+    if ( stream_Control( p_demux->s, STREAM_CAN_FASTSEEK, &b_fastseek ) ||
+         !b_fastseek )
+        return p_idx;
+
+    if ( vlc_clone( &p_idx->thread, index_Scan, p_idx, VLC_THREAD_PRIORITY_LOW ) )
+        return p_idx;
+    p_idx->b_scanning = true;
+    return p_idx;
+}
+
+void oggseek_index_Delete( oggseek_index_t *p_idx )
+{
+    if ( p_idx->b_scanning )
+    {
+        vlc_mutex_lock( &p_idx->lock );
+        p_idx->b_abort = true;
+        vlc_mutex_unlock( &p_idx->lock );
+        vlc_join( p_idx->thread, NULL );
+
+        if ( p_idx->b_complete && p_idx->psz_cache != NULL )
+            index_Save( p_idx );
+    }
+
+    vlc_mutex_destroy( &p_idx->lock );
+    free( p_idx->p_points );
+    free( p_idx->psz_cache );
+    free( p_idx->psz_url );
+    free( p_idx );
+}
+
+/* to be called when the demuxer is about to read from a new position */
+void oggseek_index_Reset( oggseek_index_t *p_idx )
+{
+    p_idx->feed.i_granule = -1;
+    p_idx->feed.i_pagepos = -1;
+}
+
+/* indexes a page read by the demuxer from i_pagepos */
+void oggseek_index_Page( oggseek_index_t *p_idx, const ogg_page *p_page,
+                         int64_t i_pagepos )
+{
+    if ( ogg_page_serialno( p_page ) != p_idx->i_serial_no )
+        return;
+    index_Feed( p_idx, &p_idx->feed, ogg_page_granulepos( p_page ), i_pagepos );
+}
+
+/* Returns the offset of the last seek point at or before i_time, and its
+ * time in *pi_time, or -1 if the index cannot tell yet */
+int64_t oggseek_index_Find( oggseek_index_t *p_idx, mtime_t i_time, mtime_t *pi_time )
+{
+    int64_t i_pagepos = -1;
+
+    vlc_mutex_lock( &p_idx->lock );
+    size_t i = index_Upper( p_idx, i_time );
+    /* past the last point, the target may be anywhere in the unknown part */
+    if ( i > 0 && ( i < p_idx->i_points || p_idx->b_complete ) )
+    {
+        i_pagepos = p_idx->p_points[i - 1].i_pagepos;
+        *pi_time = p_idx->p_points[i - 1].i_time;
+    }
+    vlc_mutex_unlock( &p_idx->lock );
+
+    return i_pagepos;
+}
+
+double oggseek_index_Coverage( oggseek_index_t *p_idx )
+{
+    double f_coverage;
+
+    vlc_mutex_lock( &p_idx->lock );
+    if ( p_idx->b_complete )
+        f_coverage = 1.0;
+    else
+    {
+        int64_t i_pos = p_idx->i_scan_pos;
+        if ( p_idx->i_points > 0 )
+            i_pos = __MAX( i_pos, p_idx->p_points[p_idx->i_points - 1].i_pagepos );
+        f_coverage = (double)i_pos / p_idx->i_size;
+    }
+    vlc_mutex_unlock( &p_idx->lock );
+
+    return __MIN( f_coverage, 1.0 );
+}
@@ -60,3 +60,17 @@ int64_t oggseek_get_last_frame ( demux_t *, logical_stream_t *);
 int oggseek_find_frame ( demux_t *, logical_stream_t *, int64_t i_tframe );
 
 int64_t oggseek_read_page ( demux_t * );
+
+
+/* Granule index: maps times to page offsets of a reference logical stream.
+ * It is seeded by a page header scan running in its own thread, completed
+ * by the pages read during playback and cached on disk once complete.
+ * oggseek_index_t is typedefed in ogg.h */
+oggseek_index_t *oggseek_index_New ( demux_t *, const logical_stream_t * );
+void oggseek_index_Delete ( oggseek_index_t * );
+
+void oggseek_index_Reset ( oggseek_index_t * );
+void oggseek_index_Page ( oggseek_index_t *, const ogg_page *, int64_t i_pagepos );
+
+int64_t oggseek_index_Find ( oggseek_index_t *, mtime_t i_time, mtime_t *pi_time );
+double oggseek_index_Coverage ( oggseek_index_t * );
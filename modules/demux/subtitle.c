@@ -115,15 +115,20 @@ enum
                          and Gnome subtitles SubViewer 1.0 */
 };
 
+/* Lines are read from the stream as the parsers ask for them, and the
+ * ones already parsed are dropped */
 typedef struct
 {
+    stream_t *s;
     int     i_line_count;
+    int     i_line_max;
     int     i_line;
     char    **line;
 } text_t;
 
 static int  TextLoad( text_t *, stream_t *s );
 static void TextUnload( text_t * );
+static void TextFlush( text_t * );
 
 typedef struct
 {
@@ -133,6 +138,8 @@ typedef struct
     char    *psz_text;
 } subtitle_t;
 
+typedef int (*subtitle_read_t)( demux_t *, subtitle_t *, int );
+
 
 struct demux_sys_t
 {
@@ -146,8 +153,13 @@ struct demux_sys_t
     char        *psz_header;
     int         i_subtitle;
     int         i_subtitles;
+    int         i_subtitles_max;
     subtitle_t  *subtitle;
 
+    /* subtitles are parsed on demand, ahead of the demux date */
+    subtitle_read_t pf_read;
+    bool        b_parsed;
+
     int64_t     i_length;
 
     /* */
@@ -223,6 +235,8 @@ static int Demux( demux_t * );
 static int Control( demux_t *, int, va_list );
 
 static void Fix( demux_t * );
+static void Parse( demux_t *, int64_t i_date );
+static int  Lookup( demux_sys_t *, int64_t i_date );
 
 /*****************************************************************************
  * Module initializer
@@ -234,8 +248,7 @@ static int Open ( vlc_object_t *p_this )
     es_format_t    fmt;
     float          f_fps;
     char           *psz_type;
-    int  (*pf_read)( demux_t *, subtitle_t*, int );
-    int            i, i_max;
+    int            i;
 
     if( !p_demux->b_force )
     {
@@ -252,7 +265,9 @@ static int Open ( vlc_object_t *p_this )
     p_sys->psz_header         = NULL;
     p_sys->i_subtitle         = 0;
     p_sys->i_subtitles        = 0;
+    p_sys->i_subtitles_max    = 0;
     p_sys->subtitle           = NULL;
+    p_sys->b_parsed           = false;
     p_sys->i_microsecperframe = 40000;
 
     p_sys->jss.b_inited       = false;
@@ -472,58 +487,28 @@ static int Open ( vlc_object_t *p_this )
         {
             msg_Dbg( p_demux, "detected %s format",
                      sub_read_subtitle_function[i].psz_name );
-            pf_read = sub_read_subtitle_function[i].pf_read;
+            p_sys->pf_read = sub_read_subtitle_function[i].pf_read;
             break;
         }
     }
 
-    msg_Dbg( p_demux, "loading all subtitles..." );
-
-    /* Load the whole file */
-    TextLoad( &p_sys->txt, p_demux->s );
-
-    /* Parse it */
-    for( i_max = 0;; )
+    if( TextLoad( &p_sys->txt, p_demux->s ) )
     {
-        if( p_sys->i_subtitles >= i_max )
-        {
-            i_max += 500;
-            if( !( p_sys->subtitle = realloc_or_free( p_sys->subtitle,
-                                              sizeof(subtitle_t) * i_max ) ) )
-            {
-                TextUnload( &p_sys->txt );
-                free( p_sys );
-                return VLC_ENOMEM;
-            }
-        }
-
-        if( pf_read( p_demux, &p_sys->subtitle[p_sys->i_subtitles],
-                     p_sys->i_subtitles ) )
-            break;
-
-        p_sys->i_subtitles++;
+        free( p_sys );
+        return VLC_ENOMEM;
     }
-    /* Unload */
-    TextUnload( &p_sys->txt );
-
-    msg_Dbg(p_demux, "loaded %d subtitles", p_sys->i_subtitles );
-
-    /* Fix subtitle (order and time) *** */
     p_sys->i_subtitle = 0;
     p_sys->i_length = 0;
-    if( p_sys->i_subtitles > 0 )
-    {
-        p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_stop;
-        /* +1 to avoid 0 */
-        if( p_sys->i_length <= 0 )
-            p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_start+1;
-    }
 
     /* *** add subtitle ES *** */
     if( p_sys->i_type == SUB_TYPE_SSA1 ||
              p_sys->i_type == SUB_TYPE_SSA2_4 ||
              p_sys->i_type == SUB_TYPE_ASS )
     {
+        /* The header is needed by the decoder and events may be stored in
+         * any order: parse the whole file now */
+        msg_Dbg( p_demux, "loading all subtitles..." );
+        Parse( p_demux, INT64_MAX );
         Fix( p_demux );
         es_format_Init( &fmt, SPU_ES, VLC_CODEC_SSA );
     }
@@ -556,6 +541,8 @@ static void Close( vlc_object_t *p_this )
     demux_sys_t *p_sys = p_demux->p_sys;
     int i;
 
+    TextUnload( &p_sys->txt );
+
     for( i = 0; i < p_sys->i_subtitles; i++ )
         free( p_sys->subtitle[i].psz_text );
     free( p_sys->subtitle );
@@ -576,11 +563,13 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     {
         case DEMUX_GET_LENGTH:
             pi64 = (int64_t*)va_arg( args, int64_t * );
+            Parse( p_demux, INT64_MAX );
             *pi64 = p_sys->i_length;
             return VLC_SUCCESS;
 
         case DEMUX_GET_TIME:
             pi64 = (int64_t*)va_arg( args, int64_t * );
+            Parse( p_demux, -1 );
             if( p_sys->i_subtitle < p_sys->i_subtitles )
             {
                 *pi64 = p_sys->subtitle[p_sys->i_subtitle].i_start;
@@ -590,17 +579,17 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_SET_TIME:
             i64 = (int64_t)va_arg( args, int64_t );
-            p_sys->i_subtitle = 0;
-            while( p_sys->i_subtitle < p_sys->i_subtitles )
+            Parse( p_demux, i64 );
+            p_sys->i_subtitle = Lookup( p_sys, i64 );
+            /* go back to the subtitles still displayed at that time */
+            while( p_sys->i_subtitle > 0 )
             {
-                const subtitle_t *p_subtitle = &p_sys->subtitle[p_sys->i_subtitle];
+                const subtitle_t *p_subtitle = &p_sys->subtitle[p_sys->i_subtitle - 1];
 
-                if( p_subtitle->i_start > i64 )
-                    break;
-                if( p_subtitle->i_stop > p_subtitle->i_start && p_subtitle->i_stop > i64 )
+                if( p_subtitle->i_stop <= p_subtitle->i_start || p_subtitle->i_stop <= i64 )
                     break;
 
-                p_sys->i_subtitle++;
+                p_sys->i_subtitle--;
             }
 
             if( p_sys->i_subtitle >= p_sys->i_subtitles )
@@ -609,6 +598,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_GET_POSITION:
             pf = (double*)va_arg( args, double * );
+            Parse( p_demux, INT64_MAX );
             if( p_sys->i_subtitle >= p_sys->i_subtitles )
             {
                 *pf = 1.0;
@@ -626,14 +616,10 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_SET_POSITION:
             f = (double)va_arg( args, double );
+            Parse( p_demux, INT64_MAX );
             i64 = f * p_sys->i_length;
 
-            p_sys->i_subtitle = 0;
-            while( p_sys->i_subtitle < p_sys->i_subtitles &&
-                   p_sys->subtitle[p_sys->i_subtitle].i_start < i64 )
-            {
-                p_sys->i_subtitle++;
-            }
+            p_sys->i_subtitle = Lookup( p_sys, i64 - 1 );
             if( p_sys->i_subtitle >= p_sys->i_subtitles )
                 return VLC_EGENERIC;
             return VLC_SUCCESS;
@@ -649,6 +635,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
         case DEMUX_GET_TITLE_INFO:
         case DEMUX_HAS_UNSUPPORTED_META:
         case DEMUX_CAN_RECORD:
+        case DEMUX_GET_INDEX_COVERAGE:
             return VLC_EGENERIC;
 
         default:
@@ -665,10 +652,12 @@ static int Demux( demux_t *p_demux )
     demux_sys_t *p_sys = p_demux->p_sys;
     int64_t i_maxdate;
 
+    i_maxdate = p_sys->i_next_demux_date - var_GetTime( p_demux->p_parent, "spu-delay" );;
+    Parse( p_demux, i_maxdate );
+
     if( p_sys->i_subtitle >= p_sys->i_subtitles )
         return 0;
 
-    i_maxdate = p_sys->i_next_demux_date - var_GetTime( p_demux->p_parent, "spu-delay" );;
     if( i_maxdate <= 0 && p_sys->i_subtitle < p_sys->i_subtitles )
     {
         /* Should not happen */
@@ -713,6 +702,76 @@ static int Demux( demux_t *p_demux )
     return 1;
 }
 
+/*****************************************************************************
+ * Parse: parse subtitles until the one at the read index is available and
+ * one starts after i_date, or up to the end of the file
+ *****************************************************************************/
+static void Parse( demux_t *p_demux, int64_t i_date )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    while( !p_sys->b_parsed &&
+           ( p_sys->i_subtitle >= p_sys->i_subtitles ||
+             p_sys->subtitle[p_sys->i_subtitles - 1].i_start <= i_date ) )
+    {
+        if( p_sys->i_subtitles >= p_sys->i_subtitles_max )
+        {
+            subtitle_t *p_subtitles =
+                realloc( p_sys->subtitle, sizeof(subtitle_t) *
+                         ( p_sys->i_subtitles_max + 500 ) );
+            if( !p_subtitles )
+                break;
+            p_sys->subtitle = p_subtitles;
+            p_sys->i_subtitles_max += 500;
+        }
+
+        if( p_sys->pf_read( p_demux, &p_sys->subtitle[p_sys->i_subtitles],
+                            p_sys->i_subtitles ) )
+        {
+            p_sys->b_parsed = true;
+            break;
+        }
+
+        p_sys->i_subtitles++;
+        TextFlush( &p_sys->txt );
+    }
+
+    if( !p_sys->b_parsed )
+        return;
+
+    /* Unload */
+    TextUnload( &p_sys->txt );
+    msg_Dbg( p_demux, "loaded %d subtitles", p_sys->i_subtitles );
+
+    p_sys->i_length = 0;
+    if( p_sys->i_subtitles > 0 )
+    {
+        p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_stop;
+        /* +1 to avoid 0 */
+        if( p_sys->i_length <= 0 )
+            p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_start+1;
+    }
+}
+
+/*****************************************************************************
+ * Lookup: index of the first parsed subtitle starting after i_date
+ *****************************************************************************/
+static int Lookup( demux_sys_t *p_sys, int64_t i_date )
+{
+    int i_low = 0, i_high = p_sys->i_subtitles;
+
+    while( i_low < i_high )
+    {
+        int i_mid = ( i_low + i_high ) / 2;
+
+        if( p_sys->subtitle[i_mid].i_start <= i_date )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
+}
+
 /*****************************************************************************
  * Fix: fix time stamp and order of subtitle
  *****************************************************************************/
@@ -751,40 +810,15 @@ static void Fix( demux_t *p_demux )
 
 static int TextLoad( text_t *txt, stream_t *s )
 {
-    int   i_line_max;
-
     /* init txt */
-    i_line_max          = 500;
+    txt->s              = s;
+    txt->i_line_max     = 100;
     txt->i_line_count   = 0;
     txt->i_line         = 0;
-    txt->line           = calloc( i_line_max, sizeof( char * ) );
+    txt->line           = calloc( txt->i_line_max, sizeof( char * ) );
     if( !txt->line )
         return VLC_ENOMEM;
 
-    /* load the complete file */
-    for( ;; )
-    {
-        char *psz = stream_ReadLine( s );
-
-        if( psz == NULL )
-            break;
-
-        txt->line[txt->i_line_count++] = psz;
-        if( txt->i_line_count >= i_line_max )
-        {
-            i_line_max += 100;
-            txt->line = realloc_or_free( txt->line, i_line_max * sizeof( char * ) );
-            if( !txt->line )
-                return VLC_ENOMEM;
-        }
-    }
-
-    if( txt->i_line_count <= 0 )
-    {
-        free( txt->line );
-        return VLC_EGENERIC;
-    }
-
     return VLC_SUCCESS;
 }
 static void TextUnload( text_t *txt )
@@ -796,13 +830,61 @@ static void TextUnload( text_t *txt )
         free( txt->line[i] );
     }
     free( txt->line );
+    txt->line         = NULL;
     txt->i_line       = 0;
     txt->i_line_count = 0;
+    txt->i_line_max   = 0;
+}
+
+/* Drops the lines already parsed, but the last one that a parser may still
+ * put back with TextPreviousLine */
+static void TextFlush( text_t *txt )
+{
+    int i, i_drop = txt->i_line - 1;
+
+    if( i_drop <= 0 )
+        return;
+
+    for( i = 0; i < i_drop; i++ )
+        free( txt->line[i] );
+    memmove( txt->line, &txt->line[i_drop],
+             ( txt->i_line_count - i_drop ) * sizeof( char * ) );
+    txt->i_line_count -= i_drop;
+    txt->i_line       -= i_drop;
+}
+
+/* Reads the next line of the file, returns false at the end of it */
+static bool TextReadLine( text_t *txt )
+{
+    char *psz;
+
+    if( txt->line == NULL || ( psz = stream_ReadLine( txt->s ) ) == NULL )
+        return false;
+
+    if( txt->i_line_count >= txt->i_line_max )
+    {
+        char **line = realloc( txt->line,
+                               ( txt->i_line_max + 100 ) * sizeof( char * ) );
+        if( !line )
+        {
+            free( psz );
+            return false;
+        }
+        txt->line = line;
+        txt->i_line_max += 100;
+    }
+    txt->line[txt->i_line_count++] = psz;
+    return true;
+}
+
+static bool TextEndOfFile( text_t *txt )
+{
+    return txt->i_line >= txt->i_line_count && !TextReadLine( txt );
 }
 
 static char *TextGetLine( text_t *txt )
 {
-    if( txt->i_line >= txt->i_line_count )
+    if( TextEndOfFile( txt ) )
         return( NULL );
 
     return txt->line[txt->i_line++];
@@ -1422,7 +1504,7 @@ static int ParseAQT( demux_t *p_demux, subtitle_t *p_subtitle, int i_idx )
                  return VLC_ENOMEM;
             strcat( psz_text, s );
             strcat( psz_text, "\n" );
-            if( txt->i_line == txt->i_line_count )
+            if( TextEndOfFile( txt ) )
                 break;
         }
     }
@@ -247,6 +247,10 @@ typedef struct
     block_t     *p_data;
     block_t     **pp_last;
 
+    /* data parsed during the current Demux() call, see SendFlush() */
+    block_t     *p_send;
+    block_t     **pp_send_last;
+
     es_mpeg4_descriptor_t *p_mpeg4desc;
 
 } ts_es_t;
@@ -284,6 +288,11 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     int         i_ts_read;
 
+    /* ES with data waiting to be sent */
+    int         i_send;
+    int         i_send_max;
+    ts_es_t     **pp_send;
+
     /* to determine length and time */
     int         i_pid_ref_pcr;
     mtime_t     i_first_pcr;
@@ -366,6 +375,9 @@ static void GetLastPCR( demux_t *p_demux );
 static void CheckPCR( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, block_t * );
 
+static void SendQueue( demux_t *p_demux, ts_es_t *es, block_t *p_block );
+static void SendFlush( demux_t *p_demux );
+
 static void              IODFree( iod_descriptor_t * );
 
 #define TS_USER_PMT_NUMBER (0)
@@ -897,6 +909,7 @@ static void Close( vlc_object_t *p_this )
     }
 
     free( p_sys->buffer );
+    free( p_sys->pp_send );
 
     free( p_sys->p_pcrs );
     free( p_sys->p_pos );
@@ -935,13 +948,14 @@ static int Demux( demux_t *p_demux )
     demux_sys_t *p_sys = p_demux->p_sys;
     bool b_wait_es = p_sys->i_pmt_es <= 0;
 
-    /* We read at most 100 TS packet or until a frame is completed */
+    /* We read at most i_ts_read TS packets, the frames completed meanwhile
+     * are sent per ES at the end (or before anything they depend on) */
     for( int i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
-        bool         b_frame = false;
         block_t     *p_pkt;
         if( !(p_pkt = ReadTSPacket( p_demux )) )
         {
+            SendFlush( p_demux );
             return 0;
         }
 
@@ -965,6 +979,9 @@ static int Demux( demux_t *p_demux )
         {
             if( p_pid->psi )
             {
+                /* tables may add or remove ES */
+                SendFlush( p_demux );
+
                 if( p_pid->i_pid == 0 || ( p_sys->b_dvb_meta && ( p_pid->i_pid == 0x11 || p_pid->i_pid == 0x12 || p_pid->i_pid == 0x14 ) ) )
                 {
                     dvbpsi_PushPacket( p_pid->psi->handle, p_pkt->p_buffer );
@@ -981,7 +998,7 @@ static int Demux( demux_t *p_demux )
             }
             else if( !p_sys->b_udp_out )
             {
-                b_frame = GatherData( p_demux, p_pid, p_pkt );
+                GatherData( p_demux, p_pid, p_pkt );
             }
             else
             {
@@ -1001,10 +1018,12 @@ static int Demux( demux_t *p_demux )
         }
         p_pid->b_seen = true;
 
-        if( b_frame || ( b_wait_es && p_sys->i_pmt_es > 0 ) )
+        if( b_wait_es && p_sys->i_pmt_es > 0 )
             break;
     }
 
+    SendFlush( p_demux );
+
     if( p_sys->b_udp_out )
     {
         /* Send the complete block */
@@ -1460,6 +1479,7 @@ static void PIDInit( ts_pid_t *pid, bool b_psi, ts_psi_t *p_owner )
         es_format_Init( &pid->es->fmt, UNKNOWN_ES, 0 );
         pid->es->data_type = TS_ES_DATA_PES;
         pid->es->pp_last = &pid->es->p_data;
+        pid->es->pp_send_last = &pid->es->p_send;
     }
 }
 
@@ -1746,11 +1766,12 @@ static void ParsePES( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes )
 
         for( int i = 0; i < pid->i_extra_es; i++ )
         {
-            es_out_Send( p_demux->out, pid->extra_es[i]->id,
-                         block_Duplicate( p_block ) );
+            block_t *p_dup = block_Duplicate( p_block );
+            if( p_dup )
+                SendQueue( p_demux, pid->extra_es[i], p_dup );
         }
 
-        es_out_Send( p_demux->out, pid->es->id, p_block );
+        SendQueue( p_demux, pid->es, p_block );
     }
     else
     {
@@ -1804,7 +1825,7 @@ static void ParseTableSection( demux_t *p_demux, ts_pid_t *pid, block_t *p_data
         p_content->i_dts =
         p_content->i_pts = VLC_TS_0 + i_date * 100 / 9;
     }
-    es_out_Send( p_demux->out, pid->es->id, p_content );
+    SendQueue( p_demux, pid->es, p_content );
 }
 static void ParseData( demux_t *p_demux, ts_pid_t *pid )
 {
@@ -2162,6 +2183,9 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
     if( p_sys->i_pid_ref_pcr == pid->i_pid )
         p_sys->i_current_pcr = AdjustPCRWrapAround( p_demux, i_pcr );
 
+    /* the data parsed so far must not end up behind the new PCR */
+    SendFlush( p_demux );
+
     /* Search program and set the PCR */
     for( int i = 0; i < p_sys->i_pmt; i++ )
         for( int i_prg = 0; i_prg < p_sys->pmt[i]->psi->i_prg; i_prg++ )
@@ -2174,6 +2198,49 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             }
 }
 
+/*****************************************************************************
+ * SendQueue: queues a block parsed from an ES
+ * SendFlush: sends the queued blocks, one chain per ES
+ *****************************************************************************/
+static void SendQueue( demux_t *p_demux, ts_es_t *es, block_t *p_block )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( es->p_send == NULL )
+    {
+        if( p_sys->i_send >= p_sys->i_send_max )
+        {
+            ts_es_t **pp_send = realloc( p_sys->pp_send,
+                        ( p_sys->i_send_max + 16 ) * sizeof( *pp_send ) );
+            if( unlikely( pp_send == NULL ) )
+            {
+                es_out_Send( p_demux->out, es->id, p_block );
+                return;
+            }
+            p_sys->pp_send = pp_send;
+            p_sys->i_send_max += 16;
+        }
+        p_sys->pp_send[p_sys->i_send++] = es;
+        es->pp_send_last = &es->p_send;
+    }
+    block_ChainLastAppend( &es->pp_send_last, p_block );
+}
+
+static void SendFlush( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    for( int i = 0; i < p_sys->i_send; i++ )
+    {
+        ts_es_t *es = p_sys->pp_send[i];
+
+        es_out_SendChain( p_demux->out, es->id, es->p_send );
+        es->p_send = NULL;
+        es->pp_send_last = &es->p_send;
+    }
+    p_sys->i_send = 0;
+}
+
 static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
 {
     const uint8_t *p = p_bk->p_buffer;
@@ -3486,6 +3553,8 @@ static void PMTSetupEsTeletext( demux_t *p_demux, ts_pid_t *pid,
                 p_es->i_data_size = 0;
                 p_es->i_data_gathered = 0;
                 p_es->pp_last = &p_es->p_data;
+                p_es->p_send  = NULL;
+                p_es->pp_send_last = &p_es->p_send;
                 p_es->data_type = TS_ES_DATA_PES;
                 p_es->p_mpeg4desc = NULL;
 
@@ -3570,6 +3639,8 @@ static void PMTSetupEsDvbSubtitle( demux_t *p_demux, ts_pid_t *pid,
                 p_es->i_data_size = 0;
                 p_es->i_data_gathered = 0;
                 p_es->pp_last = &p_es->p_data;
+                p_es->p_send  = NULL;
+                p_es->pp_send_last = &p_es->p_send;
                 p_es->data_type = TS_ES_DATA_PES;
                 p_es->p_mpeg4desc = NULL;
 
@@ -333,6 +333,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
         case DEMUX_HAS_UNSUPPORTED_META:
         case DEMUX_GET_ATTACHMENTS:
         case DEMUX_CAN_RECORD:
+        case DEMUX_GET_INDEX_COVERAGE:
             return VLC_EGENERIC;
 
         default:
@@ -174,8 +174,18 @@ struct vlc_tls_sys
 {
     gnutls_session_t session;
     bool handshaked;
+    char *cache_key; /* client: to remember the session, NULL if not valid */
+    size_t burst; /* bytes sent since the start, or since the last pause */
+    mtime_t last_send;
 };
 
+/* The first bytes of a stream are sent in records fitting in one TCP
+ * segment, so that the receiver can decrypt them as soon as they arrive,
+ * even while the congestion window is small. Later records are as large as
+ * possible, to lower the overhead. */
+#define TLS_RECORD_SMALL 1360
+#define TLS_BURST_SMALL  (1024 * 1024)
+#define TLS_BURST_PAUSE  CLOCK_FREQ /* idle time before small records again */
 
 /**
  * Sends data through a TLS session.
@@ -184,9 +194,32 @@ static int gnutls_Send (void *opaque, const void *buf, size_t length)
 {
     vlc_tls_t *session = opaque;
     vlc_tls_sys_t *sys = session->sys;
+    mtime_t now = mdate ();
+    size_t sent = 0;
 
-    int val = gnutls_record_send (sys->session, buf, length);
-    return (val < 0) ? gnutls_Error (session, val) : val;
+    if (now - sys->last_send > TLS_BURST_PAUSE)
+        sys->burst = 0;
+    sys->last_send = now;
+
+    /* gnutls_record_send() sends at most one record per call */
+    while (sent < length)
+    {
+        size_t size = length - sent;
+        if (sys->burst < TLS_BURST_SMALL && size > TLS_RECORD_SMALL)
+            size = TLS_RECORD_SMALL;
+
+        int val = gnutls_record_send (sys->session,
+                                      (const uint8_t *)buf + sent, size);
+        if (val < 0)
+        {
+            if (sent > 0)
+                break; /* the caller will try the rest again */
+            return gnutls_Error (session, val);
+        }
+        sent += val;
+        sys->burst += val;
+    }
+    return sent;
 }
 
 
@@ -240,6 +273,9 @@ static int gnutls_ContinueHandshake (vlc_tls_t *session, const char *host,
     }
 
     sys->handshaked = true;
+    msg_Dbg (session, "TLS session %s",
+             gnutls_session_is_resumed (sys->session) ? "resumed"
+                                                      : "established");
     (void) host; (void) service;
     return 0;
 }
@@ -443,6 +479,8 @@ gnutls_SessionPrioritize (vlc_object_t *obj, gnutls_session_t session)
 }
 
 
+#define SERVER_CACHE_SIZE 64
+
 /**
  * TLS credentials private data
  */
@@ -452,9 +490,161 @@ struct vlc_tls_creds_sys
     gnutls_dh_params_t dh_params; /* XXX: used for server only */
     int (*handshake) (vlc_tls_t *, const char *, const char *);
         /* ^^ XXX: useful for server only */
+
+    /* XXX: sessions resumption, used for server only */
+    gnutls_datum_t ticket_key;
+    vlc_mutex_t cache_lock;
+    struct
+    {
+        gnutls_datum_t id; /* NULL if the entry is free */
+        gnutls_datum_t data; /* allocated with the ID */
+    } cache[SERVER_CACHE_SIZE];
+    unsigned cache_next;
 };
 
 
+/*
+ * Server side session cache, for the clients resuming sessions by ID
+ * rather than with tickets
+ */
+static int gnutls_DbStore (void *opaque, gnutls_datum_t id,
+                           gnutls_datum_t data)
+{
+    vlc_tls_creds_sys_t *sys = opaque;
+    uint8_t *buf = malloc (id.size + data.size);
+    if (unlikely(buf == NULL))
+        return -1;
+
+    memcpy (buf, id.data, id.size);
+    memcpy (buf + id.size, data.data, data.size);
+
+    vlc_mutex_lock (&sys->cache_lock);
+    unsigned i = sys->cache_next;
+    sys->cache_next = (i + 1) % SERVER_CACHE_SIZE;
+    free (sys->cache[i].id.data); /* replaces the oldest entry */
+    sys->cache[i].id.data = buf;
+    sys->cache[i].id.size = id.size;
+    sys->cache[i].data.data = buf + id.size;
+    sys->cache[i].data.size = data.size;
+    vlc_mutex_unlock (&sys->cache_lock);
+    return 0;
+}
+
+/* Looks up a cached session (cache lock held) */
+static int gnutls_DbFind (vlc_tls_creds_sys_t *sys, const gnutls_datum_t *id)
+{
+    for (unsigned i = 0; i < SERVER_CACHE_SIZE; i++)
+        if (sys->cache[i].id.data != NULL && sys->cache[i].id.size == id->size
+         && !memcmp (sys->cache[i].id.data, id->data, id->size))
+            return i;
+    return -1;
+}
+
+static gnutls_datum_t gnutls_DbFetch (void *opaque, gnutls_datum_t id)
+{
+    vlc_tls_creds_sys_t *sys = opaque;
+    gnutls_datum_t data = { NULL, 0 };
+
+    vlc_mutex_lock (&sys->cache_lock);
+    int i = gnutls_DbFind (sys, &id);
+    if (i >= 0)
+    {
+        data.data = gnutls_malloc (sys->cache[i].data.size);
+        if (likely(data.data != NULL))
+        {
+            memcpy (data.data, sys->cache[i].data.data,
+                    sys->cache[i].data.size);
+            data.size = sys->cache[i].data.size;
+        }
+    }
+    vlc_mutex_unlock (&sys->cache_lock);
+    return data;
+}
+
+static int gnutls_DbRemove (void *opaque, gnutls_datum_t id)
+{
+    vlc_tls_creds_sys_t *sys = opaque;
+
+    vlc_mutex_lock (&sys->cache_lock);
+    int i = gnutls_DbFind (sys, &id);
+    if (i >= 0)
+    {
+        free (sys->cache[i].id.data);
+        sys->cache[i].id.data = NULL;
+    }
+    vlc_mutex_unlock (&sys->cache_lock);
+    return (i >= 0) ? 0 : -1;
+}
+
+
+/*
+ * Client side sessions, kept to be resumed on the next connections to the
+ * same server. They outlive the credentials, which are usually allocated for
+ * each connection.
+ */
+#define CLIENT_CACHE_SIZE 16
+
+static struct
+{
+    char *key; /* server host name, NULL if the entry is free */
+    gnutls_datum_t data;
+} client_cache[CLIENT_CACHE_SIZE];
+static unsigned client_cache_next = 0;
+static vlc_mutex_t client_cache_lock = VLC_STATIC_MUTEX;
+
+/**
+ * Sets the data of the last session with the same server, if any.
+ */
+static void gnutls_ClientResume (vlc_tls_t *session)
+{
+    vlc_tls_sys_t *sys = session->sys;
+
+    vlc_mutex_lock (&client_cache_lock);
+    for (unsigned i = 0; i < CLIENT_CACHE_SIZE; i++)
+        if (client_cache[i].key != NULL
+         && !strcmp (client_cache[i].key, sys->cache_key))
+        {
+            if (gnutls_session_set_data (sys->session,
+                                         client_cache[i].data.data,
+                                         client_cache[i].data.size) == 0)
+                msg_Dbg (session, "resuming TLS session with %s",
+                         sys->cache_key);
+            break;
+        }
+    vlc_mutex_unlock (&client_cache_lock);
+}
+
+/**
+ * Remembers a valid session, to resume it later.
+ */
+static void gnutls_ClientRemember (vlc_tls_sys_t *sys)
+{
+    gnutls_datum_t data;
+
+    /* with TLS 1.3, the tickets are received after the handshake */
+    if (gnutls_session_get_data2 (sys->session, &data))
+        return;
+
+    vlc_mutex_lock (&client_cache_lock);
+    unsigned i;
+    for (i = 0; i < CLIENT_CACHE_SIZE; i++)
+        if (client_cache[i].key != NULL
+         && !strcmp (client_cache[i].key, sys->cache_key))
+            break;
+    if (i == CLIENT_CACHE_SIZE)
+    {   /* replaces the oldest entry */
+        i = client_cache_next;
+        client_cache_next = (i + 1) % CLIENT_CACHE_SIZE;
+        free (client_cache[i].key);
+        client_cache[i].key = sys->cache_key;
+        sys->cache_key = NULL;
+    }
+    gnutls_free (client_cache[i].data.data);
+    client_cache[i].data = data;
+    vlc_mutex_unlock (&client_cache_lock);
+}
+
+
 /**
  * Terminates TLS session and releases session data.
  * You still have to close the socket yourself.
@@ -464,9 +654,14 @@ static void gnutls_SessionClose (vlc_tls_creds_t *crd, vlc_tls_t *session)
     vlc_tls_sys_t *sys = session->sys;
 
     if (sys->handshaked)
+    {
+        if (sys->cache_key != NULL)
+            gnutls_ClientRemember (sys);
         gnutls_bye (sys->session, GNUTLS_SHUT_WR);
+    }
     gnutls_deinit (sys->session);
 
+    free (sys->cache_key);
     free (sys);
     (void) crd;
 }
@@ -488,6 +683,9 @@ static int gnutls_SessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *session,
     session->sock.pf_recv = gnutls_Recv;
     session->handshake = crd->sys->handshake;
     sys->handshaked = false;
+    sys->cache_key = NULL;
+    sys->burst = 0;
+    sys->last_send = 0;
 
     int val = gnutls_init (&sys->session, type);
     if (val != 0)
@@ -530,6 +728,17 @@ static int gnutls_ServerSessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *session,
         gnutls_certificate_server_set_request (session->sys->session,
                                                GNUTLS_CERT_REQUIRE);
     assert (hostname == NULL);
+
+    /* session resumption, with tickets or by session ID */
+    vlc_tls_creds_sys_t *sys = crd->sys;
+    gnutls_session_t s = session->sys->session;
+
+    if (sys->ticket_key.data != NULL)
+        gnutls_session_ticket_enable_server (s, &sys->ticket_key);
+    gnutls_db_set_ptr (s, sys);
+    gnutls_db_set_store_function (s, gnutls_DbStore);
+    gnutls_db_set_retrieve_function (s, gnutls_DbFetch);
+    gnutls_db_set_remove_function (s, gnutls_DbRemove);
     return VLC_SUCCESS;
 }
 
@@ -550,9 +759,27 @@ static int gnutls_ClientSessionOpen (vlc_tls_creds_t *crd, vlc_tls_t *session,
         gnutls_server_name_set (sys->session, GNUTLS_NAME_DNS,
                                 hostname, strlen (hostname));
 
+    /* resume the last session with that server if possible */
+    gnutls_session_ticket_enable_client (sys->session);
+    sys->cache_key = strdup ((hostname != NULL) ? hostname : "");
+    if (likely(sys->cache_key != NULL))
+        gnutls_ClientResume (session);
+
     return VLC_SUCCESS;
 }
 
+/**
+ * Client handshake: the session is only kept if the server is valid.
+ */
+static int gnutls_ClientHandshake (vlc_tls_t *session, const char *host,
+                                   const char *service)
+{
+    int val = gnutls_HandshakeAndValidate (session, host, service);
+    if (val < 0)
+        FREENULL (session->sys->cache_key);
+    return val;
+}
+
 
 /**
  * Adds one or more Certificate Authorities to the trusted set.
@@ -715,6 +942,19 @@ static int OpenServer (vlc_tls_creds_t *crd, const char *cert, const char *key)
                  gnutls_strerror (val));
     }
 
+    /* sessions resumption */
+    val = gnutls_session_ticket_key_generate (&sys->ticket_key);
+    if (val < 0)
+    {
+        msg_Err (crd, "cannot generate session ticket key: %s",
+                 gnutls_strerror (val));
+        sys->ticket_key.data = NULL;
+    }
+    vlc_mutex_init (&sys->cache_lock);
+    for (unsigned i = 0; i < SERVER_CACHE_SIZE; i++)
+        sys->cache[i].id.data = NULL;
+    sys->cache_next = 0;
+
     return VLC_SUCCESS;
 
 error:
@@ -733,6 +973,10 @@ static void CloseServer (vlc_tls_creds_t *crd)
     /* all sessions depending on the server are now deinitialized */
     gnutls_certificate_free_credentials (sys->x509_cred);
     gnutls_dh_params_deinit (sys->dh_params);
+    for (unsigned i = 0; i < SERVER_CACHE_SIZE; i++)
+        free (sys->cache[i].id.data);
+    vlc_mutex_destroy (&sys->cache_lock);
+    gnutls_free (sys->ticket_key.data);
     free (sys);
 
     gnutls_Deinit (VLC_OBJECT(crd));
@@ -755,7 +999,7 @@ static int OpenClient (vlc_tls_creds_t *crd)
     //crd->add_CRL = gnutls_AddCRL;
     crd->open = gnutls_ClientSessionOpen;
     crd->close = gnutls_SessionClose;
-    sys->handshake = gnutls_HandshakeAndValidate;
+    sys->handshake = gnutls_ClientHandshake;
 
     int val = gnutls_certificate_allocate_credentials (&sys->x509_cred);
     if (val != 0)
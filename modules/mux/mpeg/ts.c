@@ -168,6 +168,15 @@ static void    Close  ( vlc_object_t * );
 #define CU_LONGTEXT N_("CSA encryption key used. It can be the odd/first/1 " \
   "(default) or the even/second/2 one.")
 
+#define PSI_TEXT N_("PSI interval (ms)")
+#define PSI_LONGTEXT N_("Set at which interval the PAT, PMT and SDT " \
+  "will be repeated (in milliseconds). By default, they are only sent at " \
+  "the beginning of each shaping slice.")
+
+#define BATCH_TEXT N_("TS packets per output block")
+#define BATCH_LONGTEXT N_("Number of TS packets written into each block " \
+  "handed to the access output (7 packets fill a default UDP datagram).")
+
 #define CPKT_TEXT N_("Packet size in bytes to encrypt")
 #define CPKT_LONGTEXT N_("Size of the TS packet to encrypt. " \
     "The encryption routines subtract the TS-header from the value before " \
@@ -201,6 +210,9 @@ vlc_module_begin ()
     add_bool(SOUT_CFG_PREFIX "use-key-frames", false, KEYF_TEXT, KEYF_LONGTEXT, true)
 
     add_integer( SOUT_CFG_PREFIX "pcr", 70, PCR_TEXT, PCR_LONGTEXT, true)
+    add_integer( SOUT_CFG_PREFIX "psi", 0, PSI_TEXT, PSI_LONGTEXT, true)
+    add_integer_with_range( SOUT_CFG_PREFIX "batch", 7, 1, 512,
+                            BATCH_TEXT, BATCH_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
@@ -221,7 +233,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "pid-video", "pid-audio", "pid-spu", "pid-pmt", "tsid",
     "netid", "sdtdesc",
-    "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
+    "es-id-pid", "shaping", "pcr", "psi", "batch", "bmin", "bmax", "use-key-frames",
     "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
     "muxpmt", "program-pmt", "alignment",
     NULL
@@ -335,6 +347,17 @@ typedef struct ts_stream_t
 
 } ts_stream_t;
 
+/* A TS packet of the slice being muxed. Packets are built in place in the
+ * blocks given to the access output, and only dated once the whole slice
+ * is known. */
+typedef struct
+{
+    uint8_t     *p_data;
+    block_t     *p_block;   /* output block holding the packet */
+    mtime_t     i_dts;      /* dts of the payload, 0 for PSI and PCR only */
+    uint32_t    i_flags;
+} ts_packet_t;
+
 struct sout_mux_sys_t
 {
     int             i_pcr_pid;
@@ -383,6 +406,21 @@ struct sout_mux_sys_t
     bool            b_use_key_frames;
 
     mtime_t         i_pcr;  /* last PCR emited */
+    int64_t         i_psi_delay;
+    mtime_t         i_psi;  /* last PSI emited */
+
+    /* PAT, PMT and SDT packets, rebuilt when the programs change */
+    uint8_t         *p_psi;
+    ts_stream_t     **pp_psi_stream;
+    int             i_psi_packets;
+    bool            b_psi_changed;
+
+    /* packets of the current slice */
+    ts_packet_t     *p_packets;
+    int             i_packets;
+    int             i_packets_max;
+    block_t         *p_block;   /* output block being filled */
+    int             i_batch;
 
     csa_t           *csa;
     int             i_csa_pkt_size;
@@ -439,15 +477,18 @@ static int Mux      ( sout_mux_t * );
 
 static block_t *FixPES( sout_mux_t *p_mux, block_fifo_t *p_fifo );
 static block_t *Add_ADTS( block_t *, es_format_t * );
-static void TSSchedule  ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSSchedule  ( sout_mux_t *p_mux, int i_first, int i_count,
                           mtime_t i_pcr_length, mtime_t i_pcr_dts );
-static void TSDate      ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSDate      ( sout_mux_t *p_mux, int i_first, int i_count,
                           mtime_t i_pcr_length, mtime_t i_pcr_dts );
 static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
+static int  TSInsertPSI( sout_mux_t *p_mux, uint32_t i_flags );
 
-static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream, bool b_pcr );
-static void TSSetPCR( block_t *p_ts, mtime_t i_dts );
+static bool TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream, bool b_pcr,
+                   uint32_t i_flags );
+static bool TSNewPCR( sout_mux_t *p_mux, ts_stream_t *p_stream );
+static void TSSetPCR( uint8_t *p_ts, mtime_t i_dts );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
 {
@@ -719,6 +760,15 @@ static int Open( vlc_object_t *p_this )
         p_sys->i_pcr_delay = 70000;
     }
 
+    p_sys->i_psi_delay = var_GetInteger( p_mux, SOUT_CFG_PREFIX "psi" ) * 1000;
+    if( p_sys->i_psi_delay < 0 )
+        p_sys->i_psi_delay = 0;
+    p_sys->b_psi_changed = true;
+
+    p_sys->i_batch = var_GetInteger( p_mux, SOUT_CFG_PREFIX "batch" );
+    if( p_sys->i_batch < 1 )
+        p_sys->i_batch = 1;
+
     var_Get( p_mux, SOUT_CFG_PREFIX "dts-delay", &val );
     p_sys->i_dts_delay = val.i_int * 1000;
 
@@ -761,6 +811,9 @@ static void Close( vlc_object_t * p_this )
     }
 
     free( p_sys->dvbpmt );
+    free( p_sys->p_psi );
+    free( p_sys->pp_psi_stream );
+    free( p_sys->p_packets );
     free( p_sys );
 }
 
@@ -1083,6 +1136,7 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number = ( p_sys->i_pmt_version_number + 1 )%32;
+    p_sys->b_psi_changed = true;
 
     /* Update pcr_pid */
     if( p_input->p_fmt->i_cat != SPU_ES &&
@@ -1192,20 +1246,25 @@ static int DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number++;
     p_sys->i_pmt_version_number %= 32;
+    p_sys->b_psi_changed = true;
 
     return VLC_SUCCESS;
 }
 
-static void SetHeader( sout_buffer_chain_t *c,
-                        int depth )
+static void SetHeader( sout_mux_sys_t *p_sys, int i_packet )
 {
-    block_t *p_ts = BufferChainPeek( c );
-    while( depth > 0 )
-    {
-        p_ts = p_ts->p_next;
-        depth--;
-    }
-    p_ts->i_flags |= BLOCK_FLAG_HEADER;
+    if( i_packet < p_sys->i_packets )
+        p_sys->p_packets[i_packet].i_flags |= BLOCK_FLAG_HEADER;
+}
+
+/* Whether the next TS packet of the stream starts a key frame */
+static bool TSKeyFrame( const ts_stream_t *p_stream )
+{
+    const block_t *p_pes = p_stream->chain_pes.p_first;
+
+    return p_stream->i_pes_used <= 0 &&
+           !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) &&
+           (p_pes->i_flags & BLOCK_FLAG_TYPE_I);
 }
 
 /* returns true if needs more data */
@@ -1214,7 +1273,6 @@ static bool MuxStreams(sout_mux_t *p_mux )
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
     ts_stream_t *p_pcr_stream = (ts_stream_t*)p_sys->p_pcr_input->p_sys;
 
-    sout_buffer_chain_t chain_ts;
     mtime_t i_shaping_delay = p_pcr_stream->b_key_frame
         ? p_pcr_stream->i_pes_length
         : p_sys->i_shaping_delay;
@@ -1465,16 +1523,17 @@ static bool MuxStreams(sout_mux_t *p_mux )
     i_packet_count += (8 * i_pcr_length / p_sys->i_pcr_delay + 175) / 176;
 
     /* 3: mux PES into TS */
-    BufferChainInit( &chain_ts );
-    /* append PAT/PMT  -> FIXME with big pcr delay it won't have enough pat/pmt */
+    p_sys->i_packets = 0;
+    p_sys->p_block = NULL;
+    /* append PAT/PMT, and again every psi interval if requested */
     bool pat_was_previous = true; //This is to prevent unnecessary double PAT/PMT insertions
-    GetPAT( p_mux, &chain_ts );
-    GetPMT( p_mux, &chain_ts );
+    int i_psi_first = 0;
+    i_packet_count += TSInsertPSI( p_mux, 0 );
     int i_packet_pos = 0;
-    i_packet_count += chain_ts.i_depth;
     /* msg_Dbg( p_mux, "estimated pck=%d", i_packet_count ); */
 
     const mtime_t i_pcr_dts = p_pcr_stream->i_pes_dts;
+    p_sys->i_psi = i_pcr_dts;
     for (;;)
     {
         int          i_stream = -1;
@@ -1504,51 +1563,64 @@ static bool MuxStreams(sout_mux_t *p_mux )
         p_stream = (ts_stream_t*)p_mux->pp_inputs[i_stream]->p_sys;
         sout_input_t *p_input = p_mux->pp_inputs[i_stream];
 
-        /* do we need to issue pcr */
-        bool b_pcr = false;
-        if( p_stream == p_pcr_stream &&
-            i_pcr_dts + i_packet_pos * i_pcr_length / i_packet_count >=
-            p_sys->i_pcr + p_sys->i_pcr_delay )
+        /* PSI and PCR are due at fixed intervals of the estimated date of
+         * the packet, whatever the stream it belongs to */
+        const mtime_t i_now = i_pcr_dts +
+            i_packet_pos * i_pcr_length / i_packet_count;
+
+        if( p_sys->i_psi_delay > 0 &&
+            i_now >= p_sys->i_psi + p_sys->i_psi_delay )
         {
-            b_pcr = true;
-            p_sys->i_pcr = i_pcr_dts + i_packet_pos *
-                i_pcr_length / i_packet_count;
+            i_psi_first = p_sys->i_packets;
+            i_packet_count += TSInsertPSI( p_mux, 0 );
+            p_sys->i_psi = i_now;
+            pat_was_previous = true;
         }
 
-        /* Build the TS packet */
-        block_t *p_ts = TSNew( p_mux, p_stream, b_pcr );
-        if( p_sys->csa != NULL &&
-             (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
-             (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
+        /* do we need to issue pcr */
+        bool b_pcr = false;
+        if( i_now >= p_sys->i_pcr + p_sys->i_pcr_delay )
         {
-            p_ts->i_flags |= BLOCK_FLAG_SCRAMBLED;
+            p_sys->i_pcr = i_now;
+            if( p_stream == p_pcr_stream )
+                b_pcr = true;
+            else if( TSNewPCR( p_mux, p_pcr_stream ) )
+                i_packet_count++;
         }
-        i_packet_pos++;
 
         /* Write PAT/PMT before every keyframe if use-key-frames is enabled,
          * this helps to do segmenting with livehttp-output so it can cut segment
          * and start new one with pat,pmt,keyframe*/
-        if( ( p_sys->b_use_key_frames ) && ( p_ts->i_flags & BLOCK_FLAG_TYPE_I ) )
+        if( p_sys->b_use_key_frames && TSKeyFrame( p_stream ) )
         {
             if( likely( !pat_was_previous ) )
             {
-                int startcount = chain_ts.i_depth;
-                GetPAT( p_mux, &chain_ts );
-                GetPMT( p_mux, &chain_ts );
-                SetHeader( &chain_ts, startcount );
-                i_packet_count += (chain_ts.i_depth - startcount );
+                i_psi_first = p_sys->i_packets;
+                i_packet_count += TSInsertPSI( p_mux, BLOCK_FLAG_HEADER );
             } else {
-                SetHeader( &chain_ts, 0); //We just inserted pat/pmt,so just flag it instead of adding new one
+                SetHeader( p_sys, i_psi_first ); //We just inserted pat/pmt,so just flag it instead of adding new one
             }
         }
-        pat_was_previous = false;
 
-        /* */
-        BufferChainAppend( &chain_ts, p_ts );
+        /* Build the TS packet */
+        uint32_t i_flags = 0;
+        if( p_sys->csa != NULL &&
+             (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
+             (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
+        {
+            i_flags |= BLOCK_FLAG_SCRAMBLED;
+        }
+        if( !TSNew( p_mux, p_stream, b_pcr, i_flags ) )
+            break;
+        i_packet_pos++;
+        pat_was_previous = false;
     }
 
     /* 4: date and send */
-    TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    if( p_sys->i_packets > 0 )
+        TSSchedule( p_mux, 0, p_sys->i_packets, i_pcr_length, i_pcr_dts );
+    p_sys->i_packets = 0;
+    p_sys->p_block = NULL;
     return false;
 }
 
@@ -1691,119 +1763,154 @@ static block_t *Add_ADTS( block_t *p_data, es_format_t *p_fmt )
     return p_new_block;
 }
 
-static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+/* Returns room for a new TS packet of the slice in the current output block */
+static uint8_t *TSPacketNew( sout_mux_sys_t *p_sys, mtime_t i_dts,
+                             uint32_t i_flags )
+{
+    if( p_sys->i_packets >= p_sys->i_packets_max )
+    {
+        int i_max = __MAX( 2 * p_sys->i_packets_max, 1024 );
+        ts_packet_t *p_packets = realloc( p_sys->p_packets,
+                                          i_max * sizeof(*p_packets) );
+        if( unlikely(p_packets == NULL) )
+            return NULL;
+        p_sys->p_packets = p_packets;
+        p_sys->i_packets_max = i_max;
+    }
+
+    /* A PCR starts a new block, so that the block is dated as the PCR */
+    block_t *p_block = p_sys->p_block;
+    if( p_block == NULL || ( i_flags & BLOCK_FLAG_CLOCK ) ||
+        p_block->i_buffer >= (size_t)p_sys->i_batch * 188 )
+    {
+        p_block = block_Alloc( p_sys->i_batch * 188 );
+        if( unlikely(p_block == NULL) )
+            return NULL;
+        p_block->i_buffer = 0;
+        p_sys->p_block = p_block;
+    }
+
+    ts_packet_t *p_packet = &p_sys->p_packets[p_sys->i_packets++];
+    p_packet->p_data  = &p_block->p_buffer[p_block->i_buffer];
+    p_packet->p_block = p_block;
+    p_packet->i_dts   = i_dts;
+    p_packet->i_flags = i_flags;
+    p_block->i_buffer += 188;
+
+    return p_packet->p_data;
+}
+
+static void TSSchedule( sout_mux_t *p_mux, int i_first, int i_count,
                         mtime_t i_pcr_length, mtime_t i_pcr_dts )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
-    sout_buffer_chain_t new_chain;
-    int i_packet_count = p_chain_ts->i_depth;
-
-    BufferChainInit( &new_chain );
+    const ts_packet_t *p_packets = &p_sys->p_packets[i_first];
 
     if ( i_pcr_length <= 0 )
     {
-        i_pcr_length = i_packet_count;
+        i_pcr_length = i_count;
     }
 
-    for (int i = 0; i < i_packet_count; i++ )
+    for (int i = 0; i < i_count; i++ )
     {
-        block_t *p_ts = BufferChainGet( p_chain_ts );
-        mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
-
-        BufferChainAppend( &new_chain, p_ts );
+        mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_count;
+        mtime_t i_dts = p_packets[i].i_dts;
 
-        if (!p_ts->i_dts || p_ts->i_dts + p_sys->i_dts_delay * 2/3 >= i_new_dts)
+        if (!i_dts || i_dts + p_sys->i_dts_delay * 2/3 >= i_new_dts)
             continue;
 
-        mtime_t i_max_diff = i_new_dts - p_ts->i_dts;
-        mtime_t i_cut_dts = p_ts->i_dts;
+        mtime_t i_max_diff = i_new_dts - i_dts;
+        mtime_t i_cut_dts = i_dts;
 
-        p_ts = BufferChainPeek( p_chain_ts );
-        i++;
-        i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
-        while ( p_ts != NULL && i_new_dts - p_ts->i_dts >= i_max_diff )
+        /* take the following packets as long as they are even later */
+        while( ++i < i_count )
         {
-            p_ts = BufferChainGet( p_chain_ts );
-            i_max_diff = i_new_dts - p_ts->i_dts;
-            i_cut_dts = p_ts->i_dts;
-            BufferChainAppend( &new_chain, p_ts );
-
-            p_ts = BufferChainPeek( p_chain_ts );
-            i++;
-            i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
+            i_new_dts = i_pcr_dts + i_pcr_length * i / i_count;
+            i_dts = p_packets[i].i_dts;
+            if( !i_dts )
+                continue;
+            if( i_new_dts - i_dts < i_max_diff )
+                break;
+            i_max_diff = i_new_dts - i_dts;
+            i_cut_dts = i_dts;
         }
         msg_Dbg( p_mux, "adjusting rate at %"PRId64"/%"PRId64" (%d/%d)",
-                 i_cut_dts - i_pcr_dts, i_pcr_length, new_chain.i_depth,
-                 p_chain_ts->i_depth );
-        if ( new_chain.i_depth )
-            TSDate( p_mux, &new_chain, i_cut_dts - i_pcr_dts, i_pcr_dts );
-        if ( p_chain_ts->i_depth )
-            TSSchedule( p_mux, p_chain_ts, i_pcr_dts + i_pcr_length - i_cut_dts,
-                        i_cut_dts );
+                 i_cut_dts - i_pcr_dts, i_pcr_length, i, i_count - i );
+        TSDate( p_mux, i_first, i, i_cut_dts - i_pcr_dts, i_pcr_dts );
+        if ( i < i_count )
+            TSSchedule( p_mux, i_first + i, i_count - i,
+                        i_pcr_dts + i_pcr_length - i_cut_dts, i_cut_dts );
         return;
     }
 
-    if ( new_chain.i_depth )
-        TSDate( p_mux, &new_chain, i_pcr_length, i_pcr_dts );
+    TSDate( p_mux, i_first, i_count, i_pcr_length, i_pcr_dts );
 }
 
-static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSDate( sout_mux_t *p_mux, int i_first, int i_count,
                     mtime_t i_pcr_length, mtime_t i_pcr_dts )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
-    int i_packet_count = p_chain_ts->i_depth;
 
     if ( i_pcr_length / 1000 > 0 )
     {
-        int i_bitrate = ((uint64_t)i_packet_count * 188 * 8000)
+        int i_bitrate = ((uint64_t)i_count * 188 * 8000)
                           / (uint64_t)(i_pcr_length / 1000);
         if ( p_sys->i_bitrate_max && p_sys->i_bitrate_max < i_bitrate )
         {
             msg_Warn( p_mux, "max bitrate exceeded at %"PRId64
                       " (%d bi/s for %d pkt in %"PRId64" us)",
                       i_pcr_dts + p_sys->i_shaping_delay * 3 / 2 - mdate(),
-                      i_bitrate, i_packet_count, i_pcr_length);
+                      i_bitrate, i_count, i_pcr_length);
         }
     }
     else
     {
         /* This shouldn't happen, but happens in some rare heavy load
          * and packet losses conditions. */
-        i_pcr_length = i_packet_count;
+        i_pcr_length = i_count;
     }
 
-    /* msg_Dbg( p_mux, "real pck=%d", i_packet_count ); */
-    for (int i = 0; i < i_packet_count; i++ )
+    /* msg_Dbg( p_mux, "real pck=%d", i_count ); */
+    for (int i = 0; i < i_count; i++ )
     {
-        block_t *p_ts = BufferChainGet( p_chain_ts );
-        mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
-
-        p_ts->i_dts    = i_new_dts;
-        p_ts->i_length = i_pcr_length / i_packet_count;
+        ts_packet_t *p_packet = &p_sys->p_packets[i_first + i];
+        block_t *p_block = p_packet->p_block;
+        mtime_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_count;
 
-        if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+        if( p_packet->i_flags & BLOCK_FLAG_CLOCK )
         {
-            /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
-            TSSetPCR( p_ts, p_ts->i_dts - p_sys->i_dts_delay );
+            /* msg_Dbg( p_mux, "pcr=%lld ms", i_new_dts / 1000 ); */
+            TSSetPCR( p_packet->p_data, i_new_dts - p_sys->i_dts_delay );
         }
-        if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+        if( p_packet->i_flags & BLOCK_FLAG_SCRAMBLED )
         {
             vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
+            csa_Encrypt( p_sys->csa, p_packet->p_data, p_sys->i_csa_pkt_size );
             vlc_mutex_unlock( &p_sys->csa_lock );
         }
 
-        /* latency */
-        p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+        /* the block is dated by its first packet */
+        if( p_packet->p_data == p_block->p_buffer )
+        {
+            /* latency */
+            p_block->i_dts    = i_new_dts + p_sys->i_shaping_delay * 3 / 2;
+            p_block->i_length = 0;
+            p_block->i_flags  = p_packet->i_flags &
+                                ( BLOCK_FLAG_CLOCK | BLOCK_FLAG_HEADER );
+        }
+        p_block->i_length += i_pcr_length / i_count;
 
-        sout_AccessOutWrite( p_mux->p_access, p_ts );
+        /* and sent with its last one */
+        int i_next = i_first + i + 1;
+        if( i_next >= p_sys->i_packets ||
+            p_sys->p_packets[i_next].p_block != p_block )
+            sout_AccessOutWrite( p_mux->p_access, p_block );
     }
 }
 
-static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
-                       bool b_pcr )
+static bool TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream, bool b_pcr,
+                   uint32_t i_flags )
 {
-    VLC_UNUSED(p_mux);
     block_t *p_pes = p_stream->chain_pes.p_first;
 
     bool b_new_pes = false;
@@ -1823,20 +1930,18 @@ static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
         b_adaptation_field = true;
     }
 
-    block_t *p_ts = block_Alloc( 188 );
-
-    if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
-    {
-        p_ts->i_flags |= BLOCK_FLAG_TYPE_I;
-    }
+    if( b_pcr )
+        i_flags |= BLOCK_FLAG_CLOCK;
 
-    p_ts->i_dts = p_pes->i_dts;
+    uint8_t *p_ts = TSPacketNew( p_mux->p_sys, p_pes->i_dts, i_flags );
+    if( unlikely(p_ts == NULL) )
+        return false;
 
-    p_ts->p_buffer[0] = 0x47;
-    p_ts->p_buffer[1] = ( b_new_pes ? 0x40 : 0x00 ) |
+    p_ts[0] = 0x47;
+    p_ts[1] = ( b_new_pes ? 0x40 : 0x00 ) |
         ( ( p_stream->i_pid >> 8 )&0x1f );
-    p_ts->p_buffer[2] = p_stream->i_pid & 0xff;
-    p_ts->p_buffer[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
+    p_ts[2] = p_stream->i_pid & 0xff;
+    p_ts[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
         p_stream->i_continuity_counter;
 
     p_stream->i_continuity_counter = (p_stream->i_continuity_counter+1)%16;
@@ -1847,43 +1952,41 @@ static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
         int i_stuffing = i_payload_max - i_payload;
         if( b_pcr )
         {
-            p_ts->i_flags |= BLOCK_FLAG_CLOCK;
-
-            p_ts->p_buffer[4] = 7 + i_stuffing;
-            p_ts->p_buffer[5] = 0x10;   /* flags */
+            p_ts[4] = 7 + i_stuffing;
+            p_ts[5] = 0x10;   /* flags */
             if( p_stream->b_discontinuity )
             {
-                p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
+                p_ts[5] |= 0x80; /* flag TS dicontinuity */
                 p_stream->b_discontinuity = false;
             }
-            p_ts->p_buffer[6] = 0 &0xff;
-            p_ts->p_buffer[7] = 0 &0xff;
-            p_ts->p_buffer[8] = 0 &0xff;
-            p_ts->p_buffer[9] = 0 &0xff;
-            p_ts->p_buffer[10]= ( 0 &0x80 ) | 0x7e;
-            p_ts->p_buffer[11]= 0;
+            p_ts[6] = 0 &0xff;
+            p_ts[7] = 0 &0xff;
+            p_ts[8] = 0 &0xff;
+            p_ts[9] = 0 &0xff;
+            p_ts[10]= ( 0 &0x80 ) | 0x7e;
+            p_ts[11]= 0;
 
             for (int i = 12; i < 12 + i_stuffing; i++ )
             {
-                p_ts->p_buffer[i] = 0xff;
+                p_ts[i] = 0xff;
             }
         }
         else
         {
-            p_ts->p_buffer[4] = i_stuffing - 1;
+            p_ts[4] = i_stuffing - 1;
             if( i_stuffing > 1 )
             {
-                p_ts->p_buffer[5] = 0x00;
+                p_ts[5] = 0x00;
                 for (int i = 6; i < 6 + i_stuffing - 2; i++ )
                 {
-                    p_ts->p_buffer[i] = 0xff;
+                    p_ts[i] = 0xff;
                 }
             }
         }
     }
 
     /* copy payload */
-    memcpy( &p_ts->p_buffer[188 - i_payload],
+    memcpy( &p_ts[188 - i_payload],
             &p_pes->p_buffer[p_stream->i_pes_used], i_payload );
 
     p_stream->i_pes_used += i_payload;
@@ -1913,18 +2016,41 @@ static block_t *TSNew( sout_mux_t *p_mux, ts_stream_t *p_stream,
         p_stream->i_pes_used = 0;
     }
 
-    return p_ts;
+    return true;
+}
+
+/* Adaptation field only packet, to carry a PCR that is due while the PCR
+ * stream has nothing to send */
+static bool TSNewPCR( sout_mux_t *p_mux, ts_stream_t *p_stream )
+{
+    uint8_t *p_ts = TSPacketNew( p_mux->p_sys, 0, BLOCK_FLAG_CLOCK );
+    if( unlikely(p_ts == NULL) )
+        return false;
+
+    p_ts[0] = 0x47;
+    p_ts[1] = ( p_stream->i_pid >> 8 )&0x1f;
+    p_ts[2] = p_stream->i_pid & 0xff;
+    /* no payload, so the continuity counter is not incremented */
+    p_ts[3] = 0x20 | ( ( p_stream->i_continuity_counter + 15 )%16 );
+    p_ts[4] = 183;
+    p_ts[5] = 0x10;   /* flags */
+    memset( &p_ts[6], 0, 4 );
+    p_ts[10]= 0x7e;
+    p_ts[11]= 0;
+    memset( &p_ts[12], 0xff, 188 - 12 );
+
+    return true;
 }
 
-static void TSSetPCR( block_t *p_ts, mtime_t i_dts )
+static void TSSetPCR( uint8_t *p_ts, mtime_t i_dts )
 {
     mtime_t i_pcr = 9 * i_dts / 100;
 
-    p_ts->p_buffer[6]  = ( i_pcr >> 25 )&0xff;
-    p_ts->p_buffer[7]  = ( i_pcr >> 17 )&0xff;
-    p_ts->p_buffer[8]  = ( i_pcr >> 9  )&0xff;
-    p_ts->p_buffer[9]  = ( i_pcr >> 1  )&0xff;
-    p_ts->p_buffer[10]|= ( i_pcr << 7  )&0x80;
+    p_ts[6]  = ( i_pcr >> 25 )&0xff;
+    p_ts[7]  = ( i_pcr >> 17 )&0xff;
+    p_ts[8]  = ( i_pcr >> 9  )&0xff;
+    p_ts[9]  = ( i_pcr >> 1  )&0xff;
+    p_ts[10]|= ( i_pcr << 7  )&0x80;
 }
 
 static void PEStoTS( sout_buffer_chain_t *c, block_t *p_pes,
@@ -2429,3 +2555,93 @@ static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
         dvbpsi_EmptySDT( &sdt );
     }
 }
+
+/* Generates the PAT, PMT and SDT packets when the programs have changed,
+ * they are only copied into the stream afterwards */
+static int TSUpdatePSI( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    ts_stream_t *pp_psi[2 + MAX_PMT];
+    int pi_counter[2 + MAX_PMT];
+    unsigned i_psi = 0;
+
+    pp_psi[i_psi++] = &p_sys->pat;
+    if( p_sys->b_sdt )
+        pp_psi[i_psi++] = &p_sys->sdt;
+    for (unsigned i = 0; i < p_sys->i_num_pmt; i++ )
+        pp_psi[i_psi++] = &p_sys->pmt[i];
+
+    /* the continuity counters are set when the packets are sent */
+    for (unsigned i = 0; i < i_psi; i++ )
+        pi_counter[i] = pp_psi[i]->i_continuity_counter;
+
+    sout_buffer_chain_t c;
+    BufferChainInit( &c );
+    GetPAT( p_mux, &c );
+    GetPMT( p_mux, &c );
+
+    for (unsigned i = 0; i < i_psi; i++ )
+        pp_psi[i]->i_continuity_counter = pi_counter[i];
+
+    uint8_t *p_psi = malloc( c.i_depth * 188 );
+    ts_stream_t **pp_stream = malloc( c.i_depth * sizeof(*pp_stream) );
+    if( unlikely(p_psi == NULL || pp_stream == NULL) )
+    {
+        free( p_psi );
+        free( pp_stream );
+        BufferChainClean( &c );
+        return VLC_ENOMEM;
+    }
+
+    int i_packets = 0;
+    for (block_t *p_ts = c.p_first; p_ts != NULL; p_ts = p_ts->p_next )
+    {
+        int i_pid = ( ( p_ts->p_buffer[1] & 0x1f ) << 8 ) | p_ts->p_buffer[2];
+
+        memcpy( &p_psi[188 * i_packets], p_ts->p_buffer, 188 );
+        pp_stream[i_packets] = pp_psi[0];
+        for (unsigned i = 0; i < i_psi; i++ )
+            if( pp_psi[i]->i_pid == i_pid )
+            {
+                pp_stream[i_packets] = pp_psi[i];
+                break;
+            }
+        i_packets++;
+    }
+    BufferChainClean( &c );
+
+    free( p_sys->p_psi );
+    free( p_sys->pp_psi_stream );
+    p_sys->p_psi = p_psi;
+    p_sys->pp_psi_stream = pp_stream;
+    p_sys->i_psi_packets = i_packets;
+    p_sys->b_psi_changed = false;
+    return VLC_SUCCESS;
+}
+
+/* Inserts the PSI packets in their own output block(s), returns the number
+ * of packets inserted */
+static int TSInsertPSI( sout_mux_t *p_mux, uint32_t i_flags )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    int i;
+
+    if( p_sys->b_psi_changed && TSUpdatePSI( p_mux ) )
+        return 0;
+
+    p_sys->p_block = NULL;
+    for( i = 0; i < p_sys->i_psi_packets; i++ )
+    {
+        ts_stream_t *p_stream = p_sys->pp_psi_stream[i];
+        uint8_t *p_ts = TSPacketNew( p_sys, 0, i == 0 ? i_flags : 0 );
+        if( unlikely(p_ts == NULL) )
+            break;
+
+        memcpy( p_ts, &p_sys->p_psi[188 * i], 188 );
+        p_ts[3] = ( p_ts[3] & 0xf0 ) | p_stream->i_continuity_counter;
+        p_stream->i_continuity_counter = (p_stream->i_continuity_counter+1)%16;
+    }
+    p_sys->p_block = NULL;
+
+    return i;
+}
@@ -33,11 +33,13 @@ using namespace dash::logic;
 using namespace dash::buffer;
 
 
-DASHDownloader::DASHDownloader  (HTTPConnectionManager *conManager, BlockBuffer *buffer)
+DASHDownloader::DASHDownloader  (HTTPConnectionManager *conManager, BlockBuffer *buffer,
+                                 mpd::MPDUpdater *updater)
 {
     this->t_sys                     = (thread_sys_t *) malloc(sizeof(thread_sys_t));
     this->t_sys->conManager         = conManager;
     this->t_sys->buffer             = buffer;
+    this->t_sys->updater            = updater;
 }
 DASHDownloader::~DASHDownloader ()
 {
@@ -58,11 +60,16 @@ void*       DASHDownloader::download    (void *thread_sys)
     thread_sys_t            *t_sys              = (thread_sys_t *) thread_sys;
     HTTPConnectionManager   *conManager         = t_sys->conManager;
     BlockBuffer             *buffer             = t_sys->buffer;
+    mpd::MPDUpdater         *updater            = t_sys->updater;
     block_t                 *block              = block_Alloc(BLOCKSIZE);
     int                     ret                 = 0;
 
     do
     {
+        /* the segments are chosen by this thread too */
+        if(updater)
+            updater->update();
+
         ret = conManager->read(block);
         if(ret > 0)
         {
@@ -72,7 +79,14 @@ void*       DASHDownloader::download    (void *thread_sys)
             bufBlock->i_length = block->i_length;
             buffer->put(bufBlock);
         }
-    }while(ret && !buffer->getEOF());
+        else if(ret == 0 && updater)
+        {
+            /* at the live edge: wait until the next segments are listed */
+            while(!buffer->getEOF() && !updater->update())
+                msleep(LIVEEDGEPOLL);
+            conManager->resume();
+        }
+    }while((ret || updater) && !buffer->getEOF());
 
     buffer->setEOF(true);
     block_Release(block);
@@ -28,9 +28,11 @@
 #include "http/HTTPConnectionManager.h"
 #include "adaptationlogic/IAdaptationLogic.h"
 #include "buffer/BlockBuffer.h"
+#include "mpd/MPDUpdater.h"
 
 #define BLOCKSIZE           32768
 #define CHUNKDEFAULTBITRATE 1
+#define LIVEEDGEPOLL        (CLOCK_FREQ / 10)
 
 #include <iostream>
 
@@ -40,12 +42,14 @@ namespace dash
     {
         dash::http::HTTPConnectionManager   *conManager;
         buffer::BlockBuffer                 *buffer;
+        mpd::MPDUpdater                     *updater;
     };
 
     class DASHDownloader
     {
         public:
-            DASHDownloader          (http::HTTPConnectionManager *conManager, buffer::BlockBuffer *buffer);
+            DASHDownloader          (http::HTTPConnectionManager *conManager, buffer::BlockBuffer *buffer,
+                                     mpd::MPDUpdater *updater);
             virtual ~DASHDownloader ();
 
             bool            start       ();
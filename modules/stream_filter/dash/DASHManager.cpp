@@ -44,7 +44,8 @@ DASHManager::DASHManager    ( MPD *mpd,
              mpd            ( mpd ),
              stream         ( stream ),
              downloader     ( NULL ),
-             buffer         ( NULL )
+             buffer         ( NULL ),
+             updater        ( NULL )
 {
 }
 DASHManager::~DASHManager   ()
@@ -52,6 +53,7 @@ DASHManager::~DASHManager   ()
     delete this->downloader;
     delete this->buffer;
     delete this->conManager;
+    delete this->updater;
     delete this->adaptationLogic;
     delete this->mpdManager;
 }
@@ -70,7 +72,9 @@ bool    DASHManager::start()
 
     this->conManager = new dash::http::HTTPConnectionManager(this->adaptationLogic, this->stream);
     this->buffer     = new BlockBuffer(this->stream);
-    this->downloader = new DASHDownloader(this->conManager, this->buffer);
+    if ( this->mpd->isLive() && this->mpd->getMinUpdatePeriod() > 0 )
+        this->updater = new MPDUpdater(this->mpd, this->stream);
+    this->downloader = new DASHDownloader(this->conManager, this->buffer, this->updater);
 
     this->conManager->attach(this->adaptationLogic);
     this->buffer->attach(this->adaptationLogic);
@@ -63,6 +63,7 @@ namespace dash
             stream_t                            *stream;
             DASHDownloader                      *downloader;
             buffer::BlockBuffer                 *buffer;
+            mpd::MPDUpdater                     *updater;
     };
 }
 
@@ -67,3 +67,11 @@ int AbstractAdaptationLogic::getBufferPercent        () const
 {
     return this->bufferedPercent;
 }
+mtime_t AbstractAdaptationLogic::getBufferedMicroSec () const
+{
+    return this->bufferedMicroSec;
+}
+size_t AbstractAdaptationLogic::getParallelChunks    () const
+{
+    return 1;
+}
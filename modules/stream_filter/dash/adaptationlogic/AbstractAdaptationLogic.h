@@ -52,6 +52,8 @@ namespace dash
                 uint64_t                    getBpsAvg               () const;
                 uint64_t                    getBpsLastChunk         () const;
                 int                         getBufferPercent        () const;
+                mtime_t                     getBufferedMicroSec     () const;
+                virtual size_t              getParallelChunks       () const;
 
             private:
                 int                     bpsAvg;
@@ -0,0 +1,229 @@
+/*
+ * BufferBasedAdaptationLogic.cpp
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedAdaptationLogic.h"
+#include "buffer/BlockBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace dash::logic;
+using namespace dash::http;
+using namespace dash::mpd;
+
+static bool compareBandwidth (const Representation *a, const Representation *b)
+{
+    return a->getBandwidth() < b->getBandwidth();
+}
+
+BufferBasedAdaptationLogic::BufferBasedAdaptationLogic  (IMPDManager *mpdManager, stream_t *stream) :
+                            AbstractAdaptationLogic     (mpdManager, stream),
+                            mpdManager                  (mpdManager),
+                            stream                      (stream),
+                            count                       (0),
+                            currentPeriod               (mpdManager->getFirstPeriod()),
+                            currentRepresentation       (NULL),
+                            Vp                          (0),
+                            gp                          (0),
+                            width                       (0),
+                            height                      (0),
+                            parallelChunks              (1)
+{
+    this->width             = var_InheritInteger(stream, "dash-prefwidth");
+    this->height            = var_InheritInteger(stream, "dash-prefheight");
+    this->parallelChunks    = var_InheritInteger(stream, "dash-parallel");
+
+    if(this->parallelChunks < 1)
+        this->parallelChunks = 1;
+
+    this->initPeriod();
+}
+
+Chunk*  BufferBasedAdaptationLogic::getNextChunk()
+{
+    if(this->mpdManager == NULL)
+        return NULL;
+
+    if(this->currentPeriod == NULL)
+        return NULL;
+
+    Representation *rep = this->selectRepresentation();
+
+    if ( rep == NULL )
+        return NULL;
+
+    if ( rep != this->currentRepresentation )
+    {
+        msg_Dbg(this->stream, "buffer %" PRId64 " ms, switching to %" PRIu64 " bps",
+                this->getBufferedMicroSec() / 1000, rep->getBandwidth());
+        this->currentRepresentation = rep;
+    }
+
+    std::vector<Segment *> segments = this->mpdManager->getSegments(rep);
+
+    if ( this->count == segments.size() )
+    {
+        this->currentPeriod = this->mpdManager->getNextPeriod(this->currentPeriod);
+        this->count = 0;
+        this->initPeriod();
+        return this->getNextChunk();
+    }
+
+    if ( segments.size() > this->count )
+    {
+        Segment *seg = segments.at( this->count );
+        /* at the live edge, until the MPD is reloaded */
+        if ( seg->isAvailable() == false )
+            return NULL;
+        Chunk *chunk = seg->toChunk();
+        //In case of UrlTemplate, we must stay on the same segment.
+        if ( seg->isSingleShot() == true )
+            this->count++;
+        seg->done();
+        return chunk;
+    }
+    return NULL;
+}
+
+const Representation *BufferBasedAdaptationLogic::getCurrentRepresentation() const
+{
+    if ( this->currentRepresentation == NULL && this->representations.size() > 0 )
+        return this->representations.front();
+    return this->currentRepresentation;
+}
+
+size_t  BufferBasedAdaptationLogic::getParallelChunks() const
+{
+    return this->parallelChunks;
+}
+
+void    BufferBasedAdaptationLogic::initPeriod()
+{
+    this->representations.clear();
+    this->utilities.clear();
+    this->Vp = 0;
+    this->gp = 0;
+
+    if ( this->currentPeriod == NULL )
+        return;
+
+    /* same choice of the representations as IsoffMainManager */
+    std::vector<AdaptationSet *>    adaptationSets = this->currentPeriod->getAdaptationSets();
+    std::vector<Representation *>   matching;
+
+    for ( size_t i = 0; i < adaptationSets.size(); i++ )
+    {
+        std::vector<Representation *> reps = adaptationSets.at(i)->getRepresentations();
+        for ( size_t j = 0; j < reps.size(); j++ )
+        {
+            this->representations.push_back(reps.at(j));
+            if ( reps.at(j)->getWidth() == this->width && reps.at(j)->getHeight() == this->height )
+                matching.push_back(reps.at(j));
+        }
+    }
+
+    if ( matching.size() > 0 )
+        this->representations = matching;
+
+    if ( this->representations.size() == 0 )
+        return;
+
+    std::stable_sort(this->representations.begin(), this->representations.end(), compareBandwidth);
+
+    /* utility of a representation: the log of its bitrate, 1 for the lowest */
+    double lowest = std::max(this->representations.front()->getBandwidth(), (uint64_t)1);
+
+    for ( size_t i = 0; i < this->representations.size(); i++ )
+    {
+        double bandwidth = std::max(this->representations.at(i)->getBandwidth(), (uint64_t)1);
+        this->utilities.push_back(log(bandwidth / lowest) + 1);
+    }
+
+    int64_t buffersize = var_InheritInteger(this->stream, "dash-buffersize");
+    if ( buffersize <= 0 )
+        buffersize = DEFAULTBUFFERLENGTH / 1000000;
+
+    double target    = (double)buffersize * BOLA_TARGETBUFFER / 100;
+    double minimum   = std::min((double)BOLA_MINBUFFER, target / 2);
+    double utility   = this->utilities.back();
+
+    /* the scores of the lowest and the highest representations are the
+     * best ones at the minimum and at the target buffer levels */
+    if ( utility > 1 )
+    {
+        this->gp = (utility - 1) / (target / minimum - 1);
+        this->Vp = minimum / this->gp;
+    }
+}
+
+Representation* BufferBasedAdaptationLogic::selectRepresentation()
+{
+    if ( this->representations.size() == 0 )
+        return NULL;
+
+    if ( this->Vp == 0 )
+        return this->representations.front();
+
+    double  buffered    = (double)this->getBufferedMicroSec() / 1000000;
+    size_t  best        = 0;
+    double  bestScore   = 0;
+
+    for ( size_t i = 0; i < this->representations.size(); i++ )
+    {
+        double bandwidth = std::max(this->representations.at(i)->getBandwidth(), (uint64_t)1);
+        double score     = (this->Vp * (this->utilities.at(i) + this->gp) - buffered) / bandwidth;
+
+        if ( i == 0 || score > bestScore )
+        {
+            best      = i;
+            bestScore = score;
+        }
+    }
+
+    /* do not switch up beyond what the link sustains: the buffer level
+     * alone would make it oscillate */
+    size_t last = 0;
+    while ( last < this->representations.size() &&
+            this->representations.at(last) != this->currentRepresentation )
+        last++;
+
+    if ( last == this->representations.size() )
+        last = 0;
+
+    /* the session average is slow to notice a drop of the bandwidth */
+    uint64_t bps = this->getBpsAvg();
+    if ( this->getBpsLastChunk() > 0 && this->getBpsLastChunk() < bps )
+        bps = this->getBpsLastChunk();
+
+    if ( best > last && bps > 0 && this->representations.at(best)->getBandwidth() > bps )
+    {
+        size_t sustained = 0;
+        while ( sustained + 1 < this->representations.size() &&
+                this->representations.at(sustained + 1)->getBandwidth() <= bps )
+            sustained++;
+
+        best = std::max(last, sustained);
+    }
+
+    return this->representations.at(best);
+}
@@ -0,0 +1,77 @@
+/*
+ * BufferBasedAdaptationLogic.h
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef BUFFERBASEDADAPTATIONLOGIC_H_
+#define BUFFERBASEDADAPTATIONLOGIC_H_
+
+#include "adaptationlogic/AbstractAdaptationLogic.h"
+#include "mpd/IMPDManager.h"
+#include "http/Chunk.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <vector>
+
+#define BOLA_MINBUFFER      10      /* seconds */
+#define BOLA_TARGETBUFFER   75      /* percent of the buffer size */
+
+namespace dash
+{
+    namespace logic
+    {
+        /*
+         * Chooses the representation of each segment from the buffer level
+         * only (BOLA): the more is buffered, the more a higher bitrate is
+         * worth its download time. The lowest one is kept below
+         * BOLA_MINBUFFER seconds and the highest one is reached at the
+         * target buffer level. The throughput is only used to avoid
+         * switching up to a bitrate that the link cannot sustain.
+         */
+        class BufferBasedAdaptationLogic : public AbstractAdaptationLogic
+        {
+            public:
+                BufferBasedAdaptationLogic          (dash::mpd::IMPDManager *mpdManager, stream_t *stream);
+
+                dash::http::Chunk*                  getNextChunk            ();
+                const dash::mpd::Representation*    getCurrentRepresentation() const;
+                size_t                              getParallelChunks       () const;
+
+            private:
+                dash::mpd::IMPDManager                      *mpdManager;
+                stream_t                                    *stream;
+                size_t                                      count;
+                dash::mpd::Period                           *currentPeriod;
+                dash::mpd::Representation                   *currentRepresentation;
+                std::vector<dash::mpd::Representation *>    representations;
+                std::vector<double>                         utilities;
+                double                                      Vp;
+                double                                      gp;
+                int                                         width;
+                int                                         height;
+                size_t                                      parallelChunks;
+
+                void                        initPeriod              ();
+                dash::mpd::Representation*  selectRepresentation    ();
+        };
+    }
+}
+
+#endif /* BUFFERBASEDADAPTATIONLOGIC_H_ */
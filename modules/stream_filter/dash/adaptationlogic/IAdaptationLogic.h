@@ -43,7 +43,8 @@ namespace dash
                     Default,
                     AlwaysBest,
                     AlwaysLowest,
-                    RateBased
+                    RateBased,
+                    BufferBased
                 };
 
                 virtual dash::http::Chunk*                  getNextChunk            ()          = 0;
@@ -53,6 +54,10 @@ namespace dash
                  */
                 virtual uint64_t                getBpsAvg               () const = 0;
                 virtual uint64_t                getBpsLastChunk         () const = 0;
+                /**
+                 *  \return     How many of the next chunks to download at once.
+                 */
+                virtual size_t                  getParallelChunks       () const = 0;
         };
     }
 }
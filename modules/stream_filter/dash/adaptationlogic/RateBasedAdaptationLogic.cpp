@@ -74,6 +74,9 @@ Chunk*  RateBasedAdaptationLogic::getNextChunk()
     if ( segments.size() > this->count )
     {
         Segment *seg = segments.at( this->count );
+        /* at the live edge, until the MPD is reloaded */
+        if ( seg->isAvailable() == false )
+            return NULL;
         Chunk *chunk = seg->toChunk();
         //In case of UrlTemplate, we must stay on the same segment.
         if ( seg->isSingleShot() == true )
@@ -57,6 +57,23 @@ static void Close   (vlc_object_t *);
 #define DASH_BUFFER_TEXT N_("Buffer Size (Seconds)")
 #define DASH_BUFFER_LONGTEXT N_("Buffer size in seconds")
 
+#define DASH_LOGIC_TEXT N_("Adaptation logic")
+#define DASH_LOGIC_LONGTEXT N_("How the representation of each segment is " \
+    "chosen: from the measured bandwidth, or from the buffer level")
+
+#define DASH_PARALLEL_TEXT N_("Parallel downloads")
+#define DASH_PARALLEL_LONGTEXT N_("How many segments the buffer based " \
+    "logic downloads at once, over as many connections")
+
+static const int pi_logic[] = {
+    dash::logic::IAdaptationLogic::RateBased,
+    dash::logic::IAdaptationLogic::BufferBased,
+};
+static const char *const ppsz_logic[] = {
+    N_("Rate based"),
+    N_("Buffer based"),
+};
+
 vlc_module_begin ()
         set_shortname( N_("DASH"))
         set_description( N_("Dynamic Adaptive Streaming over HTTP") )
@@ -66,6 +83,11 @@ vlc_module_begin ()
         add_integer( "dash-prefwidth",  480, DASH_WIDTH_TEXT,  DASH_WIDTH_LONGTEXT,  true )
         add_integer( "dash-prefheight", 360, DASH_HEIGHT_TEXT, DASH_HEIGHT_LONGTEXT, true )
         add_integer( "dash-buffersize", 30, DASH_BUFFER_TEXT, DASH_BUFFER_LONGTEXT, true )
+        add_integer( "dash-logic", dash::logic::IAdaptationLogic::RateBased,
+                     DASH_LOGIC_TEXT, DASH_LOGIC_LONGTEXT, true )
+            change_integer_list( pi_logic, ppsz_logic )
+        add_integer_with_range( "dash-parallel", 2, 1, 8, DASH_PARALLEL_TEXT,
+                                DASH_PARALLEL_LONGTEXT, true )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -113,9 +135,10 @@ static int Open(vlc_object_t *p_obj)
         return VLC_ENOMEM;
 
     p_sys->p_mpd = mpd;
+    dash::logic::IAdaptationLogic::LogicType logic =
+        (dash::logic::IAdaptationLogic::LogicType) var_InheritInteger(p_obj, "dash-logic");
     dash::DASHManager*p_dashManager = new dash::DASHManager(p_sys->p_mpd,
-                                          dash::logic::IAdaptationLogic::RateBased,
-                                          p_stream);
+                                          logic, p_stream);
 
     if(!p_dashManager->start())
     {
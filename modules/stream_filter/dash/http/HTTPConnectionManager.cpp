@@ -34,6 +34,7 @@ using namespace dash::logic;
 const size_t    HTTPConnectionManager::PIPELINE               = 80;
 const size_t    HTTPConnectionManager::PIPELINELENGTH         = 2;
 const uint64_t  HTTPConnectionManager::CHUNKDEFAULTBITRATE    = 1;
+const size_t    HTTPConnectionManager::FETCHBLOCKSIZE         = 32768;
 
 HTTPConnectionManager::HTTPConnectionManager    (logic::IAdaptationLogic *adaptationLogic, stream_t *stream) :
                        adaptationLogic          (adaptationLogic),
@@ -45,21 +46,80 @@ HTTPConnectionManager::HTTPConnectionManager    (logic::IAdaptationLogic *adapta
                        bytesReadSession         (0),
                        bytesReadChunk           (0),
                        timeSession              (0),
-                       timeChunk                (0)
+                       timeChunk                (0),
+                       parallelChunks           (adaptationLogic->getParallelChunks()),
+                       activeDownloads          (0),
+                       busySince                (0),
+                       endOfChunks              (false)
 {
+    vlc_mutex_init(&this->lock);
+    vlc_cond_init(&this->wait);
+
+    /* one thread and one persistent connection per chunk downloaded at once */
+    if(this->parallelChunks <= 1)
+        return;
+
+    for(size_t i = 0; i < this->parallelChunks; i++)
+    {
+        worker_t *worker    = new worker_t;
+        worker->manager     = this;
+        worker->connection  = NULL;
+        worker->block       = NULL;
+
+        if(vlc_clone(&worker->thread, fetchThread, worker, VLC_THREAD_PRIORITY_LOW))
+        {
+            delete worker;
+            break;
+        }
+        this->workers.push_back(worker);
+    }
+
+    this->parallelChunks = this->workers.size();
+    if(this->parallelChunks > 0)
+        msg_Dbg(this->stream, "downloading %zu chunks in parallel", this->parallelChunks);
 }
 HTTPConnectionManager::~HTTPConnectionManager   ()
 {
     this->closeAllConnections();
+    vlc_cond_destroy(&this->wait);
+    vlc_mutex_destroy(&this->lock);
 }
 
 void                                HTTPConnectionManager::closeAllConnections      ()
 {
+    for(size_t i = 0; i < this->workers.size(); i++)
+        vlc_cancel(this->workers.at(i)->thread);
+
+    for(size_t i = 0; i < this->workers.size(); i++)
+    {
+        worker_t *worker = this->workers.at(i);
+
+        vlc_join(worker->thread, NULL);
+        delete worker->connection;
+        if(worker->block != NULL)
+            block_Release(worker->block);
+        delete worker;
+    }
+    this->workers.clear();
+
+    for(size_t i = 0; i < this->fetchQueue.size(); i++)
+    {
+        download_t *download = this->fetchQueue.at(i);
+
+        block_ChainRelease(download->data);
+        delete download->chunk;
+        delete download;
+    }
+    this->fetchQueue.clear();
+
     vlc_delete_all(this->connectionPool);
     vlc_delete_all(this->downloadQueue);
 }
 int                                 HTTPConnectionManager::read                     (block_t *block)
 {
+    if(this->workers.size() > 0)
+        return this->readParallel(block);
+
     if(this->downloadQueue.size() == 0)
         if(!this->addChunk(this->adaptationLogic->getNextChunk()))
             return 0;
@@ -164,3 +224,215 @@ bool                                HTTPConnectionManager::addChunk
 
     return true;
 }
+/* The adaptation logic may have new chunks after the MPD was reloaded */
+void                                HTTPConnectionManager::resume                   ()
+{
+    vlc_mutex_locker    locker(&this->lock);
+
+    this->endOfChunks = false;
+}
+int                                 HTTPConnectionManager::readParallel             (block_t *block)
+{
+    vlc_mutex_locker    locker(&this->lock);
+
+    for(;;)
+    {
+        /* keep the next chunks queued, for the threads to download them */
+        while(this->fetchQueue.size() < this->parallelChunks && !this->endOfChunks)
+        {
+            Chunk *chunk = this->adaptationLogic->getNextChunk();
+
+            if(chunk == NULL)
+            {
+                this->endOfChunks = true;
+                break;
+            }
+
+            if(chunk->getBitrate() <= 0)
+                chunk->setBitrate(HTTPConnectionManager::CHUNKDEFAULTBITRATE);
+
+            download_t *download    = new download_t;
+            download->chunk         = chunk;
+            download->data          = NULL;
+            download->last          = &download->data;
+            download->active        = false;
+            download->done          = false;
+
+            this->fetchQueue.push_back(download);
+            vlc_cond_broadcast(&this->wait);
+        }
+
+        if(this->fetchQueue.size() == 0)
+            return 0;
+
+        /* the chunks are read in order, whichever finishes first */
+        download_t *download = this->fetchQueue.front();
+
+        while(download->data == NULL && !download->done)
+            vlc_cond_wait(&this->wait, &this->lock);
+
+        if(download->data != NULL)
+        {
+            block_t *data   = download->data;
+            size_t  ret     = data->i_buffer < block->i_buffer ? data->i_buffer : block->i_buffer;
+
+            memcpy(block->p_buffer, data->p_buffer, ret);
+            data->p_buffer += ret;
+            data->i_buffer -= ret;
+
+            if(data->i_buffer == 0)
+            {
+                download->data = data->p_next;
+                if(download->data == NULL)
+                    download->last = &download->data;
+                block_Release(data);
+            }
+
+            block->i_length = (mtime_t)((ret * 8) / ((float)download->chunk->getBitrate() / 1000000));
+            return ret;
+        }
+
+        this->fetchQueue.pop_front();
+        delete download->chunk;
+        delete download;
+    }
+}
+void*                               HTTPConnectionManager::fetchThread              (void *data)
+{
+    worker_t                *worker     = (worker_t *) data;
+    HTTPConnectionManager   *manager    = worker->manager;
+    int                     canc        = vlc_savecancel();
+
+    vlc_mutex_lock(&manager->lock);
+    for(;;)
+    {
+        download_t *download = NULL;
+
+        for(size_t i = 0; i < manager->fetchQueue.size() && download == NULL; i++)
+            if(!manager->fetchQueue.at(i)->active)
+                download = manager->fetchQueue.at(i);
+
+        if(download == NULL)
+        {
+            mutex_cleanup_push(&manager->lock);
+            vlc_restorecancel(canc);
+            vlc_cond_wait(&manager->wait, &manager->lock);
+            canc = vlc_savecancel();
+            vlc_cleanup_pop();
+            continue;
+        }
+
+        download->active = true;
+        if(manager->activeDownloads++ == 0)
+            manager->busySince = mdate();
+        vlc_mutex_unlock(&manager->lock);
+
+        /* the network calls are the only cancellation points, and leave
+         * nothing that the destructor would not release */
+        vlc_restorecancel(canc);
+        manager->fetch(worker, download);
+        canc = vlc_savecancel();
+
+        vlc_mutex_lock(&manager->lock);
+        if(--manager->activeDownloads == 0)
+            manager->timeSession += (double)(mdate() - manager->busySince) / 1000000;
+        download->done = true;
+        vlc_cond_broadcast(&manager->wait);
+    }
+}
+void                                HTTPConnectionManager::fetch                    (worker_t *worker, download_t *download)
+{
+    Chunk *chunk = download->chunk;
+
+    /* reuse the connection of the previous chunk, if it is to the same host */
+    if(worker->connection == NULL || !worker->connection->addChunk(chunk))
+    {
+        this->dropConnection(worker);
+
+        worker->connection = new PersistentConnection(this->stream);
+        if(!worker->connection->addChunk(chunk))
+        {
+            /* the connection may still reference the chunk */
+            msg_Warn(this->stream, "cannot request %s", chunk->getUrl().c_str());
+            this->dropConnection(worker);
+            return;
+        }
+    }
+    chunk->setConnection(worker->connection);
+
+    mtime_t start   = mdate();
+    int64_t bytes   = 0;
+    int     ret     = 0;
+
+    if(worker->block == NULL)
+        worker->block = block_Alloc(HTTPConnectionManager::FETCHBLOCKSIZE);
+    if(worker->block == NULL)
+    {
+        chunk->setConnection(NULL);
+        this->dropConnection(worker);
+        return;
+    }
+
+    for(;;)
+    {
+        ret = worker->connection->read(worker->block->p_buffer, worker->block->i_buffer);
+        if(ret <= 0)
+            break;
+
+        block_t *data = block_Alloc(ret);
+        if(data == NULL)
+        {
+            ret = -1;
+            break;
+        }
+        memcpy(data->p_buffer, worker->block->p_buffer, ret);
+        bytes += ret;
+
+        vlc_mutex_lock(&this->lock);
+        block_ChainLastAppend(&download->last, data);
+        this->bytesReadSession += ret;
+        this->updateParallelStatistics();
+        vlc_cond_broadcast(&this->wait);
+        vlc_mutex_unlock(&this->lock);
+    }
+
+    if(ret < 0)
+    {
+        msg_Warn(this->stream, "download of %s failed after %" PRId64 " bytes",
+                 chunk->getUrl().c_str(), bytes);
+        chunk->setConnection(NULL);
+        this->dropConnection(worker);
+    }
+
+    mtime_t time = mdate() - start;
+
+    if(time > 0)
+    {
+        vlc_mutex_lock(&this->lock);
+        this->bpsLastChunk = bytes * 8 * CLOCK_FREQ / time;
+        this->updateParallelStatistics();
+        vlc_mutex_unlock(&this->lock);
+    }
+}
+void                                HTTPConnectionManager::dropConnection           (worker_t *worker)
+{
+    /* a connection left with queued requests would read stale chunks */
+    PersistentConnection *con = worker->connection;
+
+    worker->connection = NULL;
+    delete con;
+}
+void                                HTTPConnectionManager::updateParallelStatistics ()
+{
+    /* throughput of the link: the bytes over the time when any chunk was
+     * being downloaded, whatever the number of them at once */
+    double time = this->timeSession;
+
+    if(this->activeDownloads > 0)
+        time += (double)(mdate() - this->busySince) / 1000000;
+
+    if(time > 0)
+        this->bpsAvg = (int64_t) ((this->bytesReadSession * 8) / time);
+
+    this->notify();
+}
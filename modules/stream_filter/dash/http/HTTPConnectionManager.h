@@ -26,6 +26,7 @@
 #define HTTPCONNECTIONMANAGER_H_
 
 #include <vlc_common.h>
+#include <vlc_block.h>
 
 #include <string>
 #include <vector>
@@ -41,6 +42,26 @@ namespace dash
 {
     namespace http
     {
+        class HTTPConnectionManager;
+
+        /* a chunk downloaded in parallel with the next ones */
+        struct download_t
+        {
+            Chunk       *chunk;
+            block_t     *data;      /* downloaded, not read yet */
+            block_t     **last;
+            bool        active;     /* a thread is downloading it */
+            bool        done;
+        };
+
+        struct worker_t
+        {
+            HTTPConnectionManager   *manager;
+            PersistentConnection    *connection;
+            block_t                 *block;
+            vlc_thread_t            thread;
+        };
+
         class HTTPConnectionManager
         {
             public:
@@ -50,6 +71,7 @@ namespace dash
                 void    closeAllConnections ();
                 bool    addChunk            (Chunk *chunk);
                 int     read                (block_t *block);
+                void    resume              ();
                 void    attach              (dash::logic::IDownloadRateObserver *observer);
                 void    notify              ();
 
@@ -67,13 +89,27 @@ namespace dash
                 int64_t                                             bytesReadChunk;
                 double                                              timeSession;
                 double                                              timeChunk;
+                size_t                                              parallelChunks;
+                std::deque<download_t *>                            fetchQueue;
+                std::vector<worker_t *>                             workers;
+                vlc_mutex_t                                         lock;
+                vlc_cond_t                                          wait;
+                int                                                 activeDownloads;
+                mtime_t                                             busySince;
+                bool                                                endOfChunks;
 
                 static const size_t     PIPELINE;
                 static const size_t     PIPELINELENGTH;
                 static const uint64_t   CHUNKDEFAULTBITRATE;
+                static const size_t     FETCHBLOCKSIZE;
 
                 std::vector<PersistentConnection *>     getConnectionsForHost   (const std::string &hostname);
                 void                                    updateStatistics        (int bytes, double time);
+                int                                     readParallel            (block_t *block);
+                void                                    fetch                   (worker_t *worker, download_t *download);
+                void                                    dropConnection          (worker_t *worker);
+                void                                    updateParallelStatistics();
+                static void*                            fetchThread             (void *data);
 
         };
     }
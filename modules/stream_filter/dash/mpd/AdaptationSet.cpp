@@ -82,7 +82,12 @@ const SegmentInfoDefault *AdaptationSet::getSegmentInfoDefault() const
     return this->segmentInfoDefault;
 }
 
-void AdaptationSet::setSegmentInfoDefault(const SegmentInfoDefault *seg)
+SegmentInfoDefault *AdaptationSet::getSegmentInfoDefault()
+{
+    return this->segmentInfoDefault;
+}
+
+void AdaptationSet::setSegmentInfoDefault(SegmentInfoDefault *seg)
 {
     if ( seg != NULL )
         this->segmentInfoDefault = seg;
@@ -49,7 +49,8 @@ namespace dash
                 std::vector<Representation *>   getRepresentations      ();
                 const Representation*           getRepresentationById   ( const std::string &id ) const;
                 const SegmentInfoDefault*       getSegmentInfoDefault() const;
-                void                            setSegmentInfoDefault( const SegmentInfoDefault* seg );
+                SegmentInfoDefault*             getSegmentInfoDefault();
+                void                            setSegmentInfoDefault( SegmentInfoDefault* seg );
                 void                            setBitstreamSwitching(bool value);
                 bool                            getBitstreamSwitching() const;
                 void                            addRepresentation( Representation *rep );
@@ -57,7 +58,7 @@ namespace dash
             private:
                 bool                            subsegmentAlignmentFlag;
                 std::vector<Representation *>   representations;
-                const SegmentInfoDefault*       segmentInfoDefault;
+                SegmentInfoDefault*             segmentInfoDefault;
                 bool                            isBitstreamSwitching;
         };
     }
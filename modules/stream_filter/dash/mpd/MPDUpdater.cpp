@@ -0,0 +1,193 @@
+/*
+ * MPDUpdater.cpp
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "MPDUpdater.h"
+#include "Period.h"
+#include "AdaptationSet.h"
+#include "Representation.h"
+#include "SegmentInfo.h"
+#include "SegmentInfoDefault.h"
+
+#include <vlc_arrays.h>
+#include <vlc_xml.h>
+
+#include <cstring>
+#include <cstdlib>
+
+using namespace dash::mpd;
+
+MPDUpdater::MPDUpdater  ( MPD *mpd, stream_t *stream ) :
+            mpd         ( mpd ),
+            stream      ( stream ),
+            nextUpdate  ( 0 )
+{
+    this->url = stream->psz_access;
+    this->url += "://";
+    this->url += stream->psz_path;
+    this->nextUpdate = mdate() + mpd->getMinUpdatePeriod() * CLOCK_FREQ;
+}
+MPDUpdater::~MPDUpdater ()
+{
+}
+
+/* Returns true if the timelines were reloaded */
+bool    MPDUpdater::update      ()
+{
+    if ( this->mpd->isLive() == false || this->mpd->getMinUpdatePeriod() <= 0 ||
+         mdate() < this->nextUpdate )
+        return false;
+    this->nextUpdate = mdate() + this->mpd->getMinUpdatePeriod() * CLOCK_FREQ;
+
+    stream_t *source = stream_UrlNew( this->stream, this->url.c_str() );
+    if ( source == NULL )
+    {
+        msg_Warn( this->stream, "cannot reload the MPD %s", this->url.c_str() );
+        return false;
+    }
+
+    std::vector<SegmentTimeline *>  updated;
+    std::vector<SegmentTimeline *>  current;
+    bool                            parsed = this->parse( source, updated );
+
+    stream_Delete( source );
+    this->getTimelines( current );
+
+    if ( parsed == false || updated.size() != current.size() )
+    {
+        msg_Warn( this->stream, "the reloaded MPD doesn't match the current one" );
+        parsed = false;
+    }
+    else
+    {
+        for ( size_t i = 0; i < current.size(); i++ )
+        {
+            SegmentTimeline *timeline = updated.at( i );
+
+            current.at( i )->mergeWith( *timeline );
+            /* The segments that aren't listed anymore left the time shift
+             * window of the server: drop them, so that a channel can be
+             * followed for hours with the same memory */
+            int64_t first = timeline->getScaledTime( timeline->getFirstIndex() );
+            if ( first >= 0 )
+                current.at( i )->pruneBefore( first );
+        }
+        msg_Dbg( this->stream, "reloaded the MPD, %zu timelines updated", current.size() );
+    }
+    vlc_delete_all( updated );
+    return parsed;
+}
+
+/* The timelines, in the order of the document */
+void    MPDUpdater::getTimelines    ( std::vector<SegmentTimeline *> &timelines )
+{
+    const std::vector<Period *> &periods = this->mpd->getPeriods();
+
+    for ( size_t i = 0; i < periods.size(); i++ )
+    {
+        std::vector<AdaptationSet *> adaptSets = periods.at( i )->getAdaptationSets();
+
+        for ( size_t j = 0; j < adaptSets.size(); j++ )
+        {
+            SegmentInfoDefault  *infoDefault = adaptSets.at( j )->getSegmentInfoDefault();
+            if ( infoDefault != NULL && infoDefault->getSegmentTimeline() != NULL )
+                timelines.push_back( infoDefault->getSegmentTimeline() );
+
+            std::vector<Representation *> reps = adaptSets.at( j )->getRepresentations();
+            for ( size_t k = 0; k < reps.size(); k++ )
+            {
+                SegmentInfo *info = reps.at( k )->getSegmentInfo();
+                if ( info != NULL && info->getSegmentTimeline() != NULL )
+                    timelines.push_back( info->getSegmentTimeline() );
+            }
+        }
+    }
+}
+
+bool    MPDUpdater::parse           ( stream_t *source, std::vector<SegmentTimeline *> &timelines )
+{
+    xml_t *xml = xml_Create( source );
+    if ( xml == NULL )
+        return false;
+
+    xml_reader_t *reader = xml_ReaderCreate( xml, source );
+    if ( reader == NULL )
+    {
+        xml_Delete( xml );
+        return false;
+    }
+
+    SegmentTimeline *timeline = NULL;
+    const char      *name;
+    int             type;
+
+    while ( ( type = xml_ReaderNextNode( reader, &name ) ) > 0 )
+    {
+        if ( type == XML_READER_ENDELEM )
+        {
+            if ( !strcmp( name, "SegmentTimeline" ) )
+                timeline = NULL;
+        }
+        else if ( type != XML_READER_STARTELEM )
+            continue;
+        else if ( !strcmp( name, "SegmentTimeline" ) )
+        {
+            timeline = new SegmentTimeline;
+            timelines.push_back( timeline );
+            if ( xml_ReaderIsEmptyElement( reader ) )
+                timeline = NULL;
+        }
+        else if ( !strcmp( name, "S" ) && timeline != NULL )
+        {
+            SegmentTimeline::Element    *s = new SegmentTimeline::Element;
+            const char                  *attrName;
+            const char                  *attrValue;
+            bool                        hasTime = false;
+            bool                        hasDuration = false;
+
+            while ( ( attrName = xml_ReaderNextAttr( reader, &attrValue ) ) != NULL )
+            {
+                if ( !strcmp( attrName, "t" ) )
+                {
+                    s->t = atoll( attrValue );
+                    hasTime = true;
+                }
+                else if ( !strcmp( attrName, "d" ) )
+                {
+                    s->d = atoll( attrValue );
+                    hasDuration = true;
+                }
+                else if ( !strcmp( attrName, "r" ) )
+                    s->r = atoi( attrValue );
+            }
+            if ( hasTime == true && hasDuration == true )
+                timeline->addElement( s );
+            else
+                delete s;
+        }
+    }
+
+    xml_ReaderDelete( reader );
+    xml_Delete( xml );
+    return type == XML_READER_NONE;
+}
@@ -0,0 +1,61 @@
+/*
+ * MPDUpdater.h
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef MPDUPDATER_H_
+#define MPDUPDATER_H_
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include "mpd/MPD.h"
+#include "mpd/SegmentTimeline.h"
+
+#include <string>
+#include <vector>
+
+namespace dash
+{
+    namespace mpd
+    {
+        /* Reloads a live MPD every minimumUpdatePeriodMPD, and merges the
+         * segment timelines it lists into the ones already known. Only the
+         * S elements are read from the reloaded file, without building the
+         * tree of the whole document. */
+        class MPDUpdater
+        {
+            public:
+                MPDUpdater          ( MPD *mpd, stream_t *stream );
+                virtual ~MPDUpdater ();
+
+                bool    update      ();
+
+            private:
+                bool    parse           ( stream_t *source, std::vector<SegmentTimeline *> &timelines );
+                void    getTimelines    ( std::vector<SegmentTimeline *> &timelines );
+
+                MPD         *mpd;
+                stream_t    *stream;
+                std::string url;
+                mtime_t     nextUpdate;
+        };
+    }
+}
+
+#endif /* MPDUPDATER_H_ */
@@ -59,6 +59,10 @@ bool                    Segment::isSingleShot   () const
 {
     return true;
 }
+bool                    Segment::isAvailable    () const
+{
+    return true;
+}
 void                    Segment::done           ()
 {
     //Only used for a SegmentTemplate.
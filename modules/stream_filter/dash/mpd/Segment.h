@@ -49,6 +49,11 @@ namespace dash
                  *          when using an UrlTemplate
                  */
                 virtual bool                            isSingleShot    () const;
+                /**
+                 *  @return false if the segment is not published yet, that is
+                 *          past the live edge of a SegmentTimeline
+                 */
+                virtual bool                            isAvailable     () const;
                 virtual void                            done            ();
                 virtual void                            addBaseUrl      (BaseUrl *url);
                 virtual const std::vector<BaseUrl *>&   getBaseUrls     () const;
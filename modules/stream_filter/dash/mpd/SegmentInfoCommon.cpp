@@ -35,6 +35,7 @@ using namespace dash::mpd;
 
 SegmentInfoCommon::SegmentInfoCommon() :
     duration( -1 ),
+    startIndex( 1 ),
     initialisationSegment( NULL ),
     segmentTimeline( NULL )
 {
@@ -94,7 +95,12 @@ const SegmentTimeline *SegmentInfoCommon::getSegmentTimeline() const
     return this->segmentTimeline;
 }
 
-void SegmentInfoCommon::setSegmentTimeline( const SegmentTimeline *segTl )
+SegmentTimeline *SegmentInfoCommon::getSegmentTimeline()
+{
+    return this->segmentTimeline;
+}
+
+void SegmentInfoCommon::setSegmentTimeline( SegmentTimeline *segTl )
 {
     if ( segTl != NULL )
         this->segmentTimeline = segTl;
@@ -49,14 +49,15 @@ namespace dash
                 const std::list<std::string>&   getBaseURL() const;
                 void                    appendBaseURL( const std::string& url );
                 const SegmentTimeline*  getSegmentTimeline() const;
-                void                    setSegmentTimeline( const SegmentTimeline *segTl );
+                SegmentTimeline*        getSegmentTimeline();
+                void                    setSegmentTimeline( SegmentTimeline *segTl );
 
             private:
                 time_t                  duration;
                 int                     startIndex;
                 Segment*                initialisationSegment;
                 std::list<std::string>  baseURLs;
-                const SegmentTimeline*  segmentTimeline;
+                SegmentTimeline*        segmentTimeline;
         };
     }
 }
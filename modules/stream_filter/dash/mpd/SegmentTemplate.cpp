@@ -28,8 +28,10 @@
 #include "SegmentTimeline.h"
 #include "Representation.h"
 #include "AdaptationSet.h"
+#include "SegmentInfo.h"
 #include "SegmentInfoDefault.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -47,6 +49,37 @@ SegmentTemplate::SegmentTemplate( bool containRuntimeIdentifier,
 {
 }
 
+/* The representation SegmentInfo "inherits" the SegmentInfoDefault values */
+const SegmentInfoCommon*    SegmentTemplate::getSegmentInfo() const
+{
+    const SegmentInfoCommon     *info = this->parentRepresentation->getSegmentInfo();
+    const SegmentInfoCommon     *infoDefault = this->parentRepresentation->getParentGroup()->getSegmentInfoDefault();
+
+    if ( info != NULL && info->getSegmentTimeline() != NULL )
+        return info;
+    if ( infoDefault != NULL && infoDefault->getSegmentTimeline() != NULL )
+        return infoDefault;
+    return ( info != NULL ) ? info : infoDefault;
+}
+
+/* The segments that left the timeline of a live MPD can't be fetched anymore:
+ * skip to the oldest one still listed */
+uint64_t        SegmentTemplate::getSegmentIndex() const
+{
+    const SegmentInfoCommon     *info = this->getSegmentInfo();
+
+    if ( info != NULL && info->getSegmentTimeline() != NULL )
+        return std::max( this->currentSegmentIndex, info->getSegmentTimeline()->getFirstIndex() );
+    return this->currentSegmentIndex;
+}
+
+static void     replaceIdentifier( std::string &url, size_t pos, const char *identifier,
+                                   const std::string &value )
+{
+    if ( pos != std::string::npos && value.empty() == false )
+        url.replace( pos, strlen( identifier ), value );
+}
+
 std::string     SegmentTemplate::getSourceUrl() const
 {
     std::string     res = this->sourceUrl;
@@ -54,25 +87,37 @@ std::string     SegmentTemplate::getSourceUrl() const
     if ( this->containRuntimeIdentifier == false )
         return Segment::getSourceUrl();
 
-    if ( this->beginIndex != std::string::npos )
-        std::cerr << "Unhandled identifier \"$Index$\"" << std::endl;
-    if ( this->beginTime != std::string::npos )
+    const SegmentInfoCommon     *info = this->getSegmentInfo();
+    uint64_t                    index = this->getSegmentIndex();
+    std::string                 time;
+    std::string                 number;
+
+    if ( info == NULL )
+        return res;
+    if ( this->beginTime != std::string::npos && info->getSegmentTimeline() != NULL )
     {
-        //FIXME: This should use the current representation SegmentInfo
-        //which "inherits" the SegmentInfoDefault values.
-        if ( this->parentRepresentation->getParentGroup()->getSegmentInfoDefault() != NULL &&
-             this->parentRepresentation->getParentGroup()->getSegmentInfoDefault()->getSegmentTimeline() != NULL )
+        int64_t     t = info->getSegmentTimeline()->getScaledTime( index );
+        if ( t >= 0 )
         {
-            const SegmentTimeline::Element  *el = this->parentRepresentation->getParentGroup()->
-                    getSegmentInfoDefault()->getSegmentTimeline()->getElement( this->currentSegmentIndex );
-            if ( el != NULL )
-            {
-                std::ostringstream  oss;
-                oss << el->t;
-                res.replace( this->beginTime, strlen("$Time$"), oss.str() );
-            }
+            std::ostringstream  oss;
+            oss << t;
+            time = oss.str();
         }
     }
+    if ( this->beginIndex != std::string::npos )
+    {
+        std::ostringstream  oss;
+        oss << info->getStartIndex() + index;
+        number = oss.str();
+    }
+
+    /* Replace the last identifier first, so that the position of the other remains valid */
+    bool    timeFirst = this->beginIndex == std::string::npos || this->beginTime > this->beginIndex;
+    if ( timeFirst == true )
+        replaceIdentifier( res, this->beginTime, "$Time$", time );
+    replaceIdentifier( res, this->beginIndex, "$Index$", number );
+    if ( timeFirst == false )
+        replaceIdentifier( res, this->beginTime, "$Time$", time );
     return res;
 }
 
@@ -91,8 +136,19 @@ bool            SegmentTemplate::isSingleShot() const
     return false;
 }
 
+/* Past the end of the timeline, the segment is listed by a later update */
+bool            SegmentTemplate::isAvailable() const
+{
+    const SegmentInfoCommon     *info = this->getSegmentInfo();
+
+    if ( info == NULL || info->getSegmentTimeline() == NULL )
+        return true;
+    return info->getSegmentTimeline()->isListed( this->getSegmentIndex() );
+}
+
 void SegmentTemplate::done()
 {
-    this->currentSegmentIndex++;
+    if ( this->isAvailable() == true )
+        this->currentSegmentIndex = this->getSegmentIndex() + 1;
 }
 
@@ -31,6 +31,7 @@ namespace dash
     namespace mpd
     {
         class   Representation;
+        class   SegmentInfoCommon;
 
         class SegmentTemplate : public Segment
         {
@@ -39,12 +40,16 @@ namespace dash
                 virtual std::string     getSourceUrl() const;
                 virtual void            setSourceUrl( const std::string & url );
                 virtual bool            isSingleShot() const;
+                virtual bool            isAvailable() const;
                 virtual void            done();
             private:
+                const SegmentInfoCommon*    getSegmentInfo() const;
+                uint64_t                    getSegmentIndex() const;
+
                 bool                    containRuntimeIdentifier;
                 size_t                  beginTime;
                 size_t                  beginIndex;
-                int                     currentSegmentIndex;
+                uint64_t                currentSegmentIndex;
         };
     }
 }
@@ -28,20 +28,20 @@
 #include "SegmentTimeline.h"
 
 #include <vlc_common.h>
-#include <vlc_arrays.h>
 
-#include <iostream>
+#include <algorithm>
 
 using namespace dash::mpd;
 
 SegmentTimeline::SegmentTimeline() :
-    timescale( -1 )
+    timescale( -1 ),
+    endNumber( 0 ),
+    lastRun( 0 )
 {
 }
 
 SegmentTimeline::~SegmentTimeline()
 {
-    vlc_delete_all( this->elements );
 }
 
 int dash::mpd::SegmentTimeline::getTimescale() const
@@ -56,34 +56,158 @@ void dash::mpd::SegmentTimeline::setTimescale(int timescale)
 
 void dash::mpd::SegmentTimeline::addElement(dash::mpd::SegmentTimeline::Element *e)
 {
-    int64_t         offset = 0;
-    for ( int i = 0; i <= e->r; ++i )
+    if ( e->d > 0 )
+        this->addRun( e->t, e->d, e->r < 0 ? -1 : (int64_t)e->r + 1 );
+    delete e;
+}
+
+uint64_t SegmentTimeline::getFirstIndex() const
+{
+    if ( this->runs.empty() )
+        return this->endNumber;
+    return this->runs.front().number;
+}
+
+uint64_t SegmentTimeline::getEndIndex() const
+{
+    if ( this->runs.empty() )
+        return this->endNumber;
+    const Run &last = this->runs.back();
+    if ( last.count < 0 )
+        return UINT64_MAX;
+    return last.number + last.count;
+}
+
+bool SegmentTimeline::isListed( uint64_t index ) const
+{
+    return this->findRun( index ) < this->runs.size();
+}
+
+/* Appends segments after the last ones, or extends the last run */
+void SegmentTimeline::addRun( int64_t t, int64_t d, int64_t count )
+{
+    if ( count == 0 )
+        return;
+    if ( this->runs.empty() == false )
     {
-        this->elements.push_back( e );
-        if ( i < e->r )
+        Run &last = this->runs.back();
+
+        if ( last.count < 0 )
+        {
+            /* the open ended run stops where the next one starts */
+            last.count = std::max( (int64_t)0, ( t - last.t + last.d - 1 ) / last.d );
+            if ( last.count == 0 )
+            {
+                this->endNumber = last.number;
+                this->runs.pop_back();
+                this->addRun( t, d, count );
+                return;
+            }
+        }
+        if ( last.d == d && last.t + last.count * last.d == t )
         {
-            e = new SegmentTimeline::Element( *e );
-            offset += e->d;
-            e->t += offset;
+            last.count = ( count < 0 ) ? -1 : last.count + count;
+            return;
         }
     }
+
+    Run run;
+    run.t       = t;
+    run.d       = d;
+    run.count   = count;
+    run.number  = this->getEndIndex();
+    this->runs.push_back( run );
 }
 
-const SegmentTimeline::Element*    SegmentTimeline::getElement( unsigned int index ) const
+size_t SegmentTimeline::findRun( uint64_t index ) const
 {
-    if ( this->elements.size() <= index )
-        return NULL;
-    std::list<Element*>::const_iterator     it = this->elements.begin();
-    std::list<Element*>::const_iterator     end = this->elements.end();
-    unsigned int                            i = 0;
-    while ( it != end )
+    const size_t    size = this->runs.size();
+
+    if ( index < this->getFirstIndex() || index >= this->getEndIndex() )
+        return size;
+
+    /* the segments are mostly read one after the other */
+    for ( size_t i = this->lastRun; i < size && i <= this->lastRun + 1; i++ )
     {
-        if ( i == index )
-            return *it;
-        ++it;
-        ++i;
+        const Run &run = this->runs[i];
+        if ( index >= run.number && ( run.count < 0 || index < run.number + run.count ) )
+            return this->lastRun = i;
+    }
+
+    size_t  low = 0, high = size;
+    while ( high - low > 1 )
+    {
+        size_t  middle = ( low + high ) / 2;
+        if ( this->runs[middle].number <= index )
+            low = middle;
+        else
+            high = middle;
+    }
+    return this->lastRun = low;
+}
+
+int64_t SegmentTimeline::getScaledTime( uint64_t index ) const
+{
+    size_t  i = this->findRun( index );
+    if ( i >= this->runs.size() )
+        return -1;
+
+    const Run &run = this->runs[i];
+    return run.t + (int64_t)( index - run.number ) * run.d;
+}
+
+/* Keeps the numbers of the known segments, and appends the new ones */
+void SegmentTimeline::mergeWith( const SegmentTimeline &updated )
+{
+    std::deque<Run>::const_iterator it;
+
+    for ( it = updated.runs.begin(); it != updated.runs.end(); ++it )
+    {
+        int64_t t = it->t;
+        int64_t count = it->count;
+
+        if ( this->runs.empty() == false )
+        {
+            const Run   &last = this->runs.back();
+            int64_t     end = ( last.count < 0 ) ? last.t : last.t + last.count * last.d;
+
+            if ( t < end )
+            {
+                int64_t skip = ( end - t + it->d - 1 ) / it->d;
+                if ( count >= 0 && skip >= count )
+                    continue;
+                t += skip * it->d;
+                if ( count >= 0 )
+                    count -= skip;
+            }
+        }
+        this->addRun( t, it->d, count );
+    }
+}
+
+/* Drops the segments that start before the given time */
+void SegmentTimeline::pruneBefore( int64_t scaledTime )
+{
+    while ( this->runs.empty() == false )
+    {
+        Run     &first = this->runs.front();
+        int64_t n = ( scaledTime - first.t + first.d - 1 ) / first.d;
+
+        if ( n <= 0 )
+            break;
+        if ( first.count >= 0 && n >= first.count )
+        {
+            this->endNumber = first.number + first.count;
+            this->runs.pop_front();
+            continue;
+        }
+        first.t += n * first.d;
+        first.number += n;
+        if ( first.count >= 0 )
+            first.count -= n;
+        break;
     }
-    return NULL;
+    this->lastRun = 0;
 }
 
 dash::mpd::SegmentTimeline::Element::Element() :
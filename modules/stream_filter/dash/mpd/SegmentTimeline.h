@@ -25,13 +25,17 @@
 #define SEGMENTTIMELINE_H
 
 #include <sys/types.h>
-#include <list>
+#include <deque>
 #include <stdint.h>
 
 namespace dash
 {
     namespace mpd
     {
+        /* The S elements are kept as they are written, as runs of segments of
+         * the same duration, and the segments are numbered from the first one
+         * ever listed, so that the numbers remain valid across the updates of
+         * a live MPD. */
         class SegmentTimeline
         {
             public:
@@ -41,18 +45,35 @@ namespace dash
                     Element( const Element& e );
                     int64_t     t;
                     int64_t     d;
-                    int         r;
+                    int         r;  /* a negative value repeats until the next update */
                 };
                 SegmentTimeline();
                 ~SegmentTimeline();
                 int                     getTimescale() const;
                 void                    setTimescale( int timescale );
                 void                    addElement( Element* e );
-                const Element*          getElement( unsigned int index ) const;
+                uint64_t                getFirstIndex() const;
+                bool                    isListed( uint64_t index ) const;
+                int64_t                 getScaledTime( uint64_t index ) const;
+                void                    mergeWith( const SegmentTimeline &updated );
+                void                    pruneBefore( int64_t scaledTime );
 
             private:
+                struct  Run
+                {
+                    int64_t     t;
+                    int64_t     d;
+                    int64_t     count;  /* -1 when open ended */
+                    uint64_t    number; /* of the first segment */
+                };
+                uint64_t                getEndIndex() const;
+                void                    addRun( int64_t t, int64_t d, int64_t count );
+                size_t                  findRun( uint64_t index ) const;
+
                 int                     timescale;
-                std::list<Element*>     elements;
+                std::deque<Run>         runs;
+                uint64_t                endNumber;  /* when there is no run left */
+                mutable size_t          lastRun;    /* where the last lookup ended */
         };
     }
 }
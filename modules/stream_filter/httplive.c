@@ -35,6 +35,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 #include <gcrypt.h>
 
 #include <vlc_threads.h>
@@ -49,11 +50,17 @@
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define PREFETCH_TEXT N_("Parallel segment downloads")
+#define PREFETCH_LONGTEXT N_( \
+    "Number of the next segments that are downloaded at the same time.")
+
 vlc_module_begin()
     set_category(CAT_INPUT)
     set_subcategory(SUBCAT_INPUT_STREAM_FILTER)
     set_description(N_("Http Live Streaming stream filter"))
     set_capability("stream_filter", 20)
+    add_integer_with_range("hls-prefetch", 2, 1, 8,
+                           PREFETCH_TEXT, PREFETCH_LONGTEXT, true)
     set_callbacks(Open, Close)
 vlc_module_end()
 
@@ -61,6 +68,14 @@ vlc_module_end()
  *
  *****************************************************************************/
 #define AES_BLOCK_SIZE 16 /* Only support AES-128 */
+
+#define HLS_WINDOW      32  /* max segments between the first and the next
+                               segment to download (bits of download.done) */
+#define HLS_EWMA_FAST   2.  /* half-lives of the bandwidth averages (s) */
+#define HLS_EWMA_SLOW   5.
+#define HLS_BUFFER_LOW  2   /* segments ahead: below, be careful */
+#define HLS_BUFFER_UP   3   /* segments ahead: needed to switch up */
+
 typedef struct segment_s
 {
     int         sequence;   /* unique sequence number */
@@ -101,22 +116,39 @@ struct stream_sys_t
 {
     char         *m3u8;         /* M3U8 url */
     vlc_thread_t  reload;       /* HLS m3u8 reload thread */
-    vlc_thread_t  thread;       /* HLS segment download thread */
+    vlc_thread_t *threads;      /* HLS segment download threads */
+    int           i_threads;
 
     block_t      *peeked;
 
     /* */
     vlc_array_t  *hls_stream;   /* bandwidth adaptation */
-    uint64_t      bandwidth;    /* measured bandwidth (bits per second) */
+    uint64_t      bandwidth;    /* estimated bandwidth (bits per second) */
+
+    /* Bandwidth estimation: two moving averages of the throughput, weighted
+     * by the download times, of which the lowest is the estimate (it follows
+     * the drops quickly, and the rises slowly) */
+    struct hls_estimate_s
+    {
+        double      fast;       /* average with a short half-life (bits/s) */
+        double      slow;       /* average with a long half-life (bits/s) */
+        double      weight;     /* seconds of downloads averaged */
+    } estimate;
 
     /* Download */
     struct hls_download_s
     {
         int         stream;     /* current hls_stream  */
-        int         segment;    /* current segment for downloading */
+        int         segment;    /* first segment not downloaded yet */
+        int         next;       /* next segment to start downloading */
+        unsigned    done;       /* segments downloaded after "segment" */
+        unsigned    generation; /* incremented at each seek */
+        int         active;     /* segments being downloaded */
         int         seek;       /* segment requested by seek (default -1) */
+        bool        b_close;    /* the threads shall exit */
         vlc_mutex_t lock_wait;  /* protect segment download counter */
         vlc_cond_t  wait;       /* some condition to wait on */
+        vlc_mutex_t lock_key;   /* serializes the loading of the keys */
     } download;
 
     /* Playback */
@@ -1231,12 +1263,18 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
         return VLC_SUCCESS;
 
     /* Do we have loaded the key ? */
+    stream_sys_t *p_sys = s->p_sys;
+    vlc_mutex_lock(&p_sys->download.lock_key);
     if (!segment->b_key_loaded)
     {
         /* No ? try to download it now */
         if (hls_ManageSegmentKeys(s, hls) != VLC_SUCCESS)
+        {
+            vlc_mutex_unlock(&p_sys->download.lock_key);
             return VLC_EGENERIC;
+        }
     }
+    vlc_mutex_unlock(&p_sys->download.lock_key);
 
     /* For now, we only decode AES-128 data */
     gcry_error_t i_gcrypt_err;
@@ -1261,17 +1299,20 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
         return VLC_EGENERIC;
     }
 
+    /* segments may be decoded at the same time: compute the IV locally */
+    uint8_t iv[AES_BLOCK_SIZE];
     if (hls->b_iv_loaded == false)
     {
-        memset(hls->psz_AES_IV, 0, AES_BLOCK_SIZE);
-        hls->psz_AES_IV[15] = segment->sequence & 0xff;
-        hls->psz_AES_IV[14] = (segment->sequence >> 8)& 0xff;
-        hls->psz_AES_IV[13] = (segment->sequence >> 16)& 0xff;
-        hls->psz_AES_IV[12] = (segment->sequence >> 24)& 0xff;
+        memset(iv, 0, AES_BLOCK_SIZE);
+        iv[15] = segment->sequence & 0xff;
+        iv[14] = (segment->sequence >> 8)& 0xff;
+        iv[13] = (segment->sequence >> 16)& 0xff;
+        iv[12] = (segment->sequence >> 24)& 0xff;
     }
+    else
+        memcpy(iv, hls->psz_AES_IV, AES_BLOCK_SIZE);
 
-    i_gcrypt_err = gcry_cipher_setiv(aes_ctx, hls->psz_AES_IV,
-                                      sizeof(hls->psz_AES_IV));
+    i_gcrypt_err = gcry_cipher_setiv(aes_ctx, iv, sizeof(iv));
 
     if (i_gcrypt_err)
     {
@@ -1499,7 +1540,7 @@ static int hls_ReloadPlaylist(stream_t *s)
     if (stream_appended == true)
     {
         vlc_mutex_lock(&p_sys->download.lock_wait);
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
     }
 
@@ -1512,7 +1553,7 @@ static int hls_ReloadPlaylist(stream_t *s)
 static int BandwidthAdaptation(stream_t *s, int progid, uint64_t *bandwidth)
 {
     stream_sys_t *p_sys = s->p_sys;
-    int candidate = -1;
+    int candidate = -1, lowest = -1;
     uint64_t bw = *bandwidth;
     uint64_t bw_candidate = 0;
 
@@ -1533,13 +1574,71 @@ static int BandwidthAdaptation(stream_t *s, int progid, uint64_t *bandwidth)
                 bw_candidate = hls->bandwidth;
                 candidate = n; /* possible candidate */
             }
+            if (lowest < 0 ||
+                hls->bandwidth < hls_Get(p_sys->hls_stream, lowest)->bandwidth)
+                lowest = n;
         }
     }
+
+    /* none fits: the lowest one will stall the least */
+    if (candidate < 0 && lowest >= 0)
+    {
+        candidate = lowest;
+        bw_candidate = hls_Get(p_sys->hls_stream, lowest)->bandwidth;
+    }
     *bandwidth = bw_candidate;
     return candidate;
 }
 
-static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segment, int *cur_stream)
+/* Averages the throughput of a download (download lock held) */
+static void BandwidthEstimate(stream_sys_t *p_sys, uint64_t size,
+                              mtime_t duration, double concurrency)
+{
+    struct hls_estimate_s *e = &p_sys->estimate;
+    double seconds = (double)__MAX(duration, 1000) / CLOCK_FREQ;
+
+    /* the concurrent downloads shared the link */
+    double bw = concurrency * size * 8 / seconds;
+
+    double alpha = pow(0.5, seconds / HLS_EWMA_FAST);
+    e->fast = alpha * e->fast + (1. - alpha) * bw;
+    alpha = pow(0.5, seconds / HLS_EWMA_SLOW);
+    e->slow = alpha * e->slow + (1. - alpha) * bw;
+    e->weight += seconds;
+
+    /* correct the bias of the averages toward their initial zero */
+    double fast = e->fast / (1. - pow(0.5, e->weight / HLS_EWMA_FAST));
+    double slow = e->slow / (1. - pow(0.5, e->weight / HLS_EWMA_SLOW));
+    p_sys->bandwidth = __MIN(fast, slow);
+}
+
+/* Chooses the stream to download from next, depending on the bandwidth
+ * estimate and on how much is downloaded ahead (download lock held) */
+static int BandwidthSwitch(stream_t *s, hls_stream_t *hls, int current)
+{
+    stream_sys_t *p_sys = s->p_sys;
+    int buffered = p_sys->download.segment - p_sys->playback.segment;
+
+    /* keep some margin, and more while the playback may stall */
+    uint64_t bw = p_sys->bandwidth * 4 / 5;
+    if (buffered < HLS_BUFFER_LOW)
+        bw /= 2;
+
+    int newstream = BandwidthAdaptation(s, hls->id, &bw);
+    if ((newstream < 0) || (newstream == current))
+        return current;
+
+    /* a higher bitrate is a gamble on the estimate, that the buffer must be
+     * able to absorb; a lower one is always safe */
+    if ((bw > hls->bandwidth) && (buffered < HLS_BUFFER_UP))
+        return current;
+
+    msg_Dbg(s, "detected %s bandwidth (%"PRIu64") stream, %d segments ahead",
+             (bw >= hls->bandwidth) ? "faster" : "lower", bw, buffered);
+    return newstream;
+}
+
+static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segment)
 {
     stream_sys_t *p_sys = s->p_sys;
 
@@ -1554,11 +1653,16 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
         return VLC_SUCCESS;
     }
 
+    vlc_mutex_lock(&p_sys->download.lock_wait);
+    uint64_t bandwidth = p_sys->bandwidth;
+    int active = p_sys->download.active;
+    vlc_mutex_unlock(&p_sys->download.lock_wait);
+
     /* sanity check - can we download this segment on time? */
-    if ((p_sys->bandwidth > 0) && (hls->bandwidth > 0))
+    if ((bandwidth > 0) && (hls->bandwidth > 0))
     {
         uint64_t size = (segment->duration * hls->bandwidth); /* bits */
-        int estimated = (int)(size / p_sys->bandwidth);
+        int estimated = (int)(size / bandwidth);
         if (estimated > segment->duration)
         {
             msg_Warn(s,"downloading segment %d predicted to take %ds, which exceeds its length (%ds)",
@@ -1569,8 +1673,8 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     mtime_t start = mdate();
     if (hls_Download(s, segment) != VLC_SUCCESS)
     {
-        msg_Err(s, "downloading segment %d from stream %d failed",
-                    segment->sequence, *cur_stream);
+        msg_Err(s, "downloading segment %d from stream %"PRIu64" bits/s failed",
+                    segment->sequence, hls->bandwidth);
         vlc_mutex_unlock(&segment->lock);
         return VLC_EGENERIC;
     }
@@ -1590,26 +1694,42 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
 
     vlc_mutex_unlock(&segment->lock);
 
-    msg_Dbg(s, "downloaded segment %d from stream %d",
-                segment->sequence, *cur_stream);
+    msg_Dbg(s, "downloaded segment %d from stream %"PRIu64" bits/s",
+                segment->sequence, hls->bandwidth);
 
-    uint64_t bw = segment->size * 8 * 1000000 / __MAX(1, duration); /* bits / s */
-    p_sys->bandwidth = bw;
-    if (p_sys->b_meta && (hls->bandwidth != bw))
-    {
-        int newstream = BandwidthAdaptation(s, hls->id, &bw);
+    vlc_mutex_lock(&p_sys->download.lock_wait);
+    /* average the number of downloads sharing the link during this one */
+    double concurrency = (active + p_sys->download.active) / 2.;
+    BandwidthEstimate(p_sys, segment->size, duration, __MAX(concurrency, 1.));
 
-        /* FIXME: we need an average here */
-        if ((newstream >= 0) && (newstream != *cur_stream))
-        {
-            msg_Dbg(s, "detected %s bandwidth (%"PRIu64") stream",
-                     (bw >= hls->bandwidth) ? "faster" : "lower", bw);
-            *cur_stream = newstream;
-        }
+    if (p_sys->b_meta)
+    {
+        int current = p_sys->download.stream;
+        hls_stream_t *hls_cur = hls_Get(p_sys->hls_stream, current);
+        if (hls_cur != NULL)
+            p_sys->download.stream = BandwidthSwitch(s, hls_cur, current);
     }
+    vlc_mutex_unlock(&p_sys->download.lock_wait);
     return VLC_SUCCESS;
 }
 
+/* Tells whether there is no segment to start downloading (download lock held) */
+static bool hls_DownloadWait(stream_sys_t *p_sys, int count)
+{
+    if (p_sys->download.seek >= 0 || p_sys->download.b_close)
+        return false;
+    if (p_sys->download.next >= count)
+        return true;
+    if (p_sys->download.next - p_sys->download.segment >= HLS_WINDOW)
+        return true;
+
+    /* Sliding window (~60 seconds worth of movie) */
+    return !p_sys->b_live && (p_sys->playback.segment < (count - 6)) &&
+           (p_sys->download.next - p_sys->playback.segment > 6);
+}
+
+/* Each thread downloads the next segment that no other is downloading; the
+ * segments are then made available to the playback in order. */
 static void* hls_Thread(void *p_this)
 {
     stream_t *s = (stream_t *)p_this;
@@ -1619,68 +1739,75 @@ static void* hls_Thread(void *p_this)
 
     while (vlc_object_alive(s))
     {
+        vlc_mutex_lock(&p_sys->download.lock_wait);
         hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
         assert(hls);
 
-        /* Sliding window (~60 seconds worth of movie) */
         vlc_mutex_lock(&hls->lock);
         int count = vlc_array_count(hls->segments);
         vlc_mutex_unlock(&hls->lock);
 
         /* Is there a new segment to process? */
-        if ((!p_sys->b_live && (p_sys->playback.segment < (count - 6))) ||
-            (p_sys->download.segment >= count))
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        while (hls_DownloadWait(p_sys, count) && vlc_object_alive(s))
         {
-            /* wait */
-            vlc_mutex_lock(&p_sys->download.lock_wait);
-            while (((p_sys->download.segment - p_sys->playback.segment > 6) ||
-                    (p_sys->download.segment >= count)) &&
-                   (p_sys->download.seek == -1))
-            {
-                vlc_cond_wait(&p_sys->download.wait, &p_sys->download.lock_wait);
-                if (p_sys->b_live /*&& (mdate() >= p_sys->playlist.wakeup)*/)
-                    break;
-                if (!vlc_object_alive(s))
-                    break;
-            }
-            /* */
-            if (p_sys->download.seek >= 0)
-            {
-                p_sys->download.segment = p_sys->download.seek;
-                p_sys->download.seek = -1;
-            }
+            vlc_cond_wait(&p_sys->download.wait, &p_sys->download.lock_wait);
+            if (p_sys->b_live /*&& (mdate() >= p_sys->playlist.wakeup)*/)
+                break;
+        }
+        /* */
+        if (p_sys->download.seek >= 0)
+        {
+            p_sys->download.segment = p_sys->download.seek;
+            p_sys->download.next = p_sys->download.seek;
+            p_sys->download.done = 0;
+            p_sys->download.generation++;
+            p_sys->download.seek = -1;
+            vlc_cond_broadcast(&p_sys->download.wait);
+        }
+
+        if (p_sys->download.b_close || p_sys->b_error || !vlc_object_alive(s))
+        {
+            vlc_mutex_unlock(&p_sys->download.lock_wait);
+            break;
+        }
+        if (p_sys->download.next >= count)
+        {   /* the playlist was not reloaded yet */
             vlc_mutex_unlock(&p_sys->download.lock_wait);
+            continue;
         }
 
-        if (!vlc_object_alive(s)) break;
+        hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+        int wanted = p_sys->download.next++;
+        unsigned generation = p_sys->download.generation;
+        p_sys->download.active++;
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
 
         vlc_mutex_lock(&hls->lock);
-        segment_t *segment = segment_GetSegment(hls, p_sys->download.segment);
+        segment_t *segment = segment_GetSegment(hls, wanted);
         vlc_mutex_unlock(&hls->lock);
 
-        if ((segment != NULL) &&
-            (hls_DownloadSegmentData(s, hls, segment, &p_sys->download.stream) != VLC_SUCCESS))
-        {
-            if (!vlc_object_alive(s)) break;
+        bool b_failed = (segment != NULL) &&
+                        (hls_DownloadSegmentData(s, hls, segment) != VLC_SUCCESS);
 
-            if (!p_sys->b_live)
-            {
-                p_sys->b_error = true;
-                break;
-            }
-        }
-
-        /* download succeeded */
-        /* determine next segment to download */
+        /* determine the segments available to the playback */
         vlc_mutex_lock(&p_sys->download.lock_wait);
-        if (p_sys->download.seek >= 0)
+        p_sys->download.active--;
+        if (b_failed && !p_sys->b_live && vlc_object_alive(s))
+            p_sys->b_error = true;
+        if (generation == p_sys->download.generation &&
+            wanted >= p_sys->download.segment &&
+            wanted - p_sys->download.segment < HLS_WINDOW)
         {
-            p_sys->download.segment = p_sys->download.seek;
-            p_sys->download.seek = -1;
+            p_sys->download.done |= 1u << (wanted - p_sys->download.segment);
+            while (p_sys->download.done & 1)
+            {
+                p_sys->download.done >>= 1;
+                p_sys->download.segment++;
+            }
         }
-        else if (p_sys->download.segment < count)
-            p_sys->download.segment++;
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
 
         // In case of a successful download signal the read thread that data is available
@@ -1747,12 +1874,11 @@ static void* hls_Reload(void *p_this)
     return NULL;
 }
 
-static int Prefetch(stream_t *s, int *current)
+static int Prefetch(stream_t *s)
 {
     stream_sys_t *p_sys = s->p_sys;
-    int stream = *current;
 
-    hls_stream_t *hls = hls_Get(p_sys->hls_stream, stream);
+    hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
     if (hls == NULL)
         return VLC_EGENERIC;
 
@@ -1777,21 +1903,17 @@ static int Prefetch(stream_t *s, int *current)
             continue;
         }
 
-        if (hls_DownloadSegmentData(s, hls, segment, current) != VLC_SUCCESS)
+        if (hls_DownloadSegmentData(s, hls, segment) != VLC_SUCCESS)
             return VLC_EGENERIC;
 
         p_sys->download.segment++;
 
         /* adapt bandwidth? */
-        if (*current != stream)
-        {
-            hls_stream_t *hls = hls_Get(p_sys->hls_stream, *current);
-            if (hls == NULL)
-                return VLC_EGENERIC;
-
-             stream = *current;
-        }
+        hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+        if (hls == NULL)
+            return VLC_EGENERIC;
     }
+    p_sys->download.next = p_sys->download.segment;
 
     return VLC_SUCCESS;
 }
@@ -2020,6 +2142,13 @@ static int Open(vlc_object_t *p_this)
     vlc_cond_init(&p_sys->wait);
     vlc_mutex_init(&p_sys->lock);
 
+    vlc_mutex_init(&p_sys->download.lock_wait);
+    vlc_cond_init(&p_sys->download.wait);
+    vlc_mutex_init(&p_sys->download.lock_key);
+
+    vlc_mutex_init(&p_sys->read.lock_wait);
+    vlc_cond_init(&p_sys->read.wait);
+
     /* Parse HLS m3u8 content. */
     uint8_t *buffer = NULL;
     ssize_t len = read_M3U8_from_stream(s->p_source, &buffer);
@@ -2039,25 +2168,25 @@ static int Open(vlc_object_t *p_this)
     /* Choose first HLS stream to start with */
     int current = p_sys->playback.stream = p_sys->hls_stream->i_count-1;
     p_sys->playback.segment = p_sys->download.segment = ChooseSegment(s, current);
+    p_sys->download.stream = current;
 
     /* manage encryption key if needed */
     hls_ManageSegmentKeys(s, hls_Get(p_sys->hls_stream, current));
 
-    if (Prefetch(s, &current) != VLC_SUCCESS)
+    if (Prefetch(s) != VLC_SUCCESS)
     {
         msg_Err(s, "fetching first segment failed.");
         goto fail;
     }
 
-    p_sys->download.stream = current;
+    current = p_sys->download.stream;
     p_sys->playback.stream = current;
     p_sys->download.seek = -1;
 
-    vlc_mutex_init(&p_sys->download.lock_wait);
-    vlc_cond_init(&p_sys->download.wait);
-
-    vlc_mutex_init(&p_sys->read.lock_wait);
-    vlc_cond_init(&p_sys->read.wait);
+    int i_threads = __MAX(var_InheritInteger(s, "hls-prefetch"), 1);
+    p_sys->threads = malloc(i_threads * sizeof(*p_sys->threads));
+    if (p_sys->threads == NULL)
+        goto fail;
 
     /* Initialize HLS live stream */
     if (p_sys->b_live)
@@ -2069,27 +2198,36 @@ static int Open(vlc_object_t *p_this)
 
         if (vlc_clone(&p_sys->reload, hls_Reload, s, VLC_THREAD_PRIORITY_LOW))
         {
-            goto fail_thread;
+            free(p_sys->threads);
+            goto fail;
         }
     }
 
-    if (vlc_clone(&p_sys->thread, hls_Thread, s, VLC_THREAD_PRIORITY_INPUT))
+    while (p_sys->i_threads < i_threads)
+    {
+        if (vlc_clone(&p_sys->threads[p_sys->i_threads], hls_Thread, s,
+                      VLC_THREAD_PRIORITY_INPUT))
+            break;
+        p_sys->i_threads++;
+    }
+    if (p_sys->i_threads == 0)
     {
         if (p_sys->b_live)
             vlc_join(p_sys->reload, NULL);
-        goto fail_thread;
+        free(p_sys->threads);
+        goto fail;
     }
 
     return VLC_SUCCESS;
 
-fail_thread:
+fail:
     vlc_mutex_destroy(&p_sys->download.lock_wait);
     vlc_cond_destroy(&p_sys->download.wait);
+    vlc_mutex_destroy(&p_sys->download.lock_key);
 
     vlc_mutex_destroy(&p_sys->read.lock_wait);
     vlc_cond_destroy(&p_sys->read.wait);
 
-fail:
     /* Free hls streams */
     for (int i = 0; i < vlc_array_count(p_sys->hls_stream); i++)
     {
@@ -2127,15 +2265,19 @@ static void Close(vlc_object_t *p_this)
     /* negate the condition variable's predicate */
     p_sys->download.segment = p_sys->playback.segment = 0;
     p_sys->download.seek = 0; /* better safe than sorry */
-    vlc_cond_signal(&p_sys->download.wait);
+    p_sys->download.b_close = true;
+    vlc_cond_broadcast(&p_sys->download.wait);
     vlc_mutex_unlock(&p_sys->download.lock_wait);
 
     /* */
     if (p_sys->b_live)
         vlc_join(p_sys->reload, NULL);
-    vlc_join(p_sys->thread, NULL);
+    for (int i = 0; i < p_sys->i_threads; i++)
+        vlc_join(p_sys->threads[i], NULL);
+    free(p_sys->threads);
     vlc_mutex_destroy(&p_sys->download.lock_wait);
     vlc_cond_destroy(&p_sys->download.wait);
+    vlc_mutex_destroy(&p_sys->download.lock_key);
 
     vlc_mutex_destroy(&p_sys->read.lock_wait);
     vlc_cond_destroy(&p_sys->read.wait);
@@ -2239,11 +2381,15 @@ check:
         int count = vlc_array_count(hls->segments);
         vlc_mutex_unlock(&hls->lock);
 
-        if ((p_sys->download.segment - p_sys->playback.segment == 0) &&
-            ((count != p_sys->download.segment) || p_sys->b_live))
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        int i_segment = p_sys->download.segment;
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
+
+        if ((i_segment - p_sys->playback.segment == 0) &&
+            ((count != i_segment) || p_sys->b_live))
             msg_Err(s, "playback will stall");
-        else if ((p_sys->download.segment - p_sys->playback.segment < 3) &&
-                 ((count != p_sys->download.segment) || p_sys->b_live))
+        else if ((i_segment - p_sys->playback.segment < 3) &&
+                 ((count != i_segment) || p_sys->b_live))
             msg_Warn(s, "playback in danger of stalling");
     }
     return segment;
@@ -2294,7 +2440,7 @@ static ssize_t hls_Read(stream_t *s, uint8_t *p_read, unsigned int i_read)
             /* signal download thread */
             vlc_mutex_lock(&p_sys->download.lock_wait);
             p_sys->playback.segment++;
-            vlc_cond_signal(&p_sys->download.wait);
+            vlc_cond_broadcast(&p_sys->download.wait);
             vlc_mutex_unlock(&p_sys->download.lock_wait);
             continue;
         }
@@ -2605,7 +2751,7 @@ static int segment_Seek(stream_t *s, const uint64_t pos)
         /* Wake up download thread */
         vlc_mutex_lock(&p_sys->download.lock_wait);
         p_sys->download.seek = p_sys->playback.segment;
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
 
         /* Wait for download to be finished */
         msg_Dbg(s, "seek to segment %d", p_sys->playback.segment);
@@ -106,6 +106,16 @@ static unsigned set_track_id( chunk_t *chunk, const unsigned tid )
     return ret;
 }
 
+#define SMS_READ_SIZE 16384 /* bytes accounted at once */
+
+/* Accounts the time during which downloads were running (lock held) */
+static void sms_BusyUpdate( stream_sys_t *p_sys, mtime_t now )
+{
+    if( p_sys->download.active > 0 )
+        p_sys->download.busy += now - p_sys->download.busy_since;
+    p_sys->download.busy_since = now;
+}
+
 static int sms_Download( stream_t *s, chunk_t *chunk, char *url )
 {
     stream_sys_t *p_sys = s->p_sys;
@@ -118,9 +128,6 @@ static int sms_Download( stream_t *s, chunk_t *chunk, char *url )
     int64_t size = stream_Size( p_ts );
 
     chunk->size = size;
-    chunk->offset = p_sys->download.next_chunk_offset;
-    p_sys->download.next_chunk_offset += chunk->size;
-
     chunk->data = malloc( size );
 
     if( chunk->data == NULL )
@@ -129,7 +136,39 @@ static int sms_Download( stream_t *s, chunk_t *chunk, char *url )
         return VLC_ENOMEM;
     }
 
-    int read = stream_Read( p_ts, chunk->data, size );
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    sms_BusyUpdate( p_sys, mdate() );
+    p_sys->download.active++;
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
+    int read = 0;
+    while( read < size )
+    {
+        int val = stream_Read( p_ts, chunk->data + read,
+                               __MIN( size - read, SMS_READ_SIZE ) );
+        if( val <= 0 )
+            break;
+        read += val;
+
+        vlc_mutex_lock( &p_sys->download.lock_wait );
+        p_sys->download.received += val;
+        vlc_mutex_unlock( &p_sys->download.lock_wait );
+    }
+
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    sms_BusyUpdate( p_sys, mdate() );
+    p_sys->download.active--;
+
+    if( p_sys->download.busy > 0 )
+    {
+        uint64_t bw = p_sys->download.received * 8 * CLOCK_FREQ
+                    / p_sys->download.busy; /* bits / s */
+        sms_queue_put( p_sys->bws, bw );
+        p_sys->download.received = 0;
+        p_sys->download.busy = 0;
+    }
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
     if( read < size )
     {
         msg_Warn( s, "sms_Download: I requested %"PRIi64" bytes, "\
@@ -139,11 +178,6 @@ static int sms_Download( stream_t *s, chunk_t *chunk, char *url )
 
     stream_Delete( p_ts );
 
-    vlc_mutex_lock( &p_sys->download.lock_wait );
-    int index = es_cat_to_index( chunk->type );
-    p_sys->download.lead[index] += chunk->duration;
-    vlc_mutex_unlock( &p_sys->download.lock_wait );
-
     return VLC_SUCCESS;
 }
 
@@ -378,7 +412,12 @@ static int Download( stream_t *s, sms_stream_t *sms )
     stream_sys_t *p_sys = s->p_sys;
 
     int index = es_cat_to_index( sms->type );
+
+    vlc_mutex_lock( &p_sys->download.lock_wait );
     int64_t start_time = p_sys->download.lead[index];
+    unsigned generation = p_sys->download.generation;
+    uint64_t avg_bw = sms_queue_avg( p_sys->bws );
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
 
     quality_level_t *qlevel = get_qlevel( sms, sms->download_qlvl );
     if( unlikely( !qlevel ) )
@@ -413,7 +452,6 @@ static int Download( stream_t *s, sms_stream_t *sms )
     }
 
     /* sanity check - can we download this chunk on time? */
-    uint64_t avg_bw = sms_queue_avg( p_sys->bws );
     if( (avg_bw > 0) && (qlevel->Bitrate > 0) )
     {
         /* duration in ms */
@@ -428,14 +466,12 @@ static int Download( stream_t *s, sms_stream_t *sms )
         }
     }
 
-    mtime_t start = mdate();
     if( sms_Download( s, chunk, url ) != VLC_SUCCESS )
     {
         msg_Err( s, "downloaded chunk %u from stream %s at quality\
             %u failed", chunk->sequence, sms->name, qlevel->Bitrate );
         return VLC_EGENERIC;
     }
-    mtime_t duration = mdate() - start;
 
     unsigned real_id = set_track_id( chunk, sms->id );
     if( real_id == 0)
@@ -450,17 +486,22 @@ static int Download( stream_t *s, sms_stream_t *sms )
         get_new_chunks( s, chunk );
 
     vlc_mutex_lock( &p_sys->download.lock_wait );
-    vlc_array_append( p_sys->download.chunks, chunk );
-    vlc_cond_signal( &p_sys->download.wait );
-    vlc_mutex_unlock( &p_sys->download.lock_wait );
+    if( generation != p_sys->download.generation )
+    {
+        /* the stream was seeked meanwhile */
+        vlc_mutex_unlock( &p_sys->download.lock_wait );
+        FREENULL( chunk->data );
+        return VLC_SUCCESS;
+    }
 
-    msg_Info( s, "downloaded chunk %d from stream %s at quality %u",
-                chunk->sequence, sms->name, qlevel->Bitrate );
+    chunk->offset = p_sys->download.next_chunk_offset;
+    p_sys->download.next_chunk_offset += chunk->size;
+    vlc_array_append( p_sys->download.chunks, chunk );
 
     uint64_t actual_lead = chunk->start_time + chunk->duration;
-    int ind = es_cat_to_index( sms->type );
-    p_sys->download.ck_index[ind] = chunk->sequence;
-    p_sys->download.lead[ind] = __MIN( p_sys->download.lead[ind], actual_lead );
+    p_sys->download.ck_index[index] = chunk->sequence;
+    p_sys->download.lead[index] = __MIN( p_sys->download.lead[index] + chunk->duration,
+                                         actual_lead );
 
     if( sms->type == VIDEO_ES ||
             ( !SMS_GET_SELECTED_ST( VIDEO_ES ) && sms->type == AUDIO_ES ) )
@@ -468,12 +509,13 @@ static int Download( stream_t *s, sms_stream_t *sms )
         p_sys->playback.toffset = __MIN( p_sys->playback.toffset,
                                             (uint64_t)chunk->start_time );
     }
+    vlc_cond_broadcast( &p_sys->download.wait );
 
-    unsigned dur_ms = __MAX( 1, duration / 1000 );
-    uint64_t bw = chunk->size * 8 * 1000 / dur_ms; /* bits / s */
-    if( sms_queue_put( p_sys->bws, bw ) != VLC_SUCCESS )
-        return VLC_EGENERIC;
     avg_bw = sms_queue_avg( p_sys->bws );
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
+    msg_Info( s, "downloaded chunk %d from stream %s at quality %u",
+                chunk->sequence, sms->name, qlevel->Bitrate );
 
     if( sms->type != VIDEO_ES )
         return VLC_SUCCESS;
@@ -482,6 +524,19 @@ static int Download( stream_t *s, sms_stream_t *sms )
     if( chunk->sequence <= 1 )
         return VLC_SUCCESS;
 
+    /* the other tracks use their share of the bandwidth */
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    for( int i = 0; i < 3; i++ )
+    {
+        sms_stream_t *other = SMS_GET_SELECTED_ST( index_to_es_cat( i ) );
+        if( other == NULL || other == sms )
+            continue;
+        quality_level_t *other_qlevel = get_qlevel( other, other->download_qlvl );
+        if( other_qlevel != NULL && other_qlevel->Bitrate < avg_bw )
+            avg_bw -= other_qlevel->Bitrate;
+    }
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
     unsigned new_qlevel_id = BandwidthAdaptation( s, sms, avg_bw );
     quality_level_t *new_qlevel = get_qlevel( sms, new_qlevel_id );
     if( unlikely( !new_qlevel ) )
@@ -490,6 +545,16 @@ static int Download( stream_t *s, sms_stream_t *sms )
         return VLC_EGENERIC;
     }
 
+    /* the init chunk describes the levels of all the tracks, which the other
+     * workers may be changing too */
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    if( generation != p_sys->download.generation )
+    {
+        /* a seek restarted the downloads, with a new init chunk */
+        vlc_mutex_unlock( &p_sys->download.lock_wait );
+        return VLC_SUCCESS;
+    }
+
     if( new_qlevel->Bitrate != qlevel->Bitrate )
     {
         msg_Warn( s, "detected %s bandwidth (%u) stream",
@@ -505,56 +570,117 @@ static int Download( stream_t *s, sms_stream_t *sms )
         chunk_t *new_init_ck = build_init_chunk( s );
         if( !new_init_ck )
         {
+            vlc_mutex_unlock( &p_sys->download.lock_wait );
             return VLC_EGENERIC;
         }
 
         new_init_ck->offset = p_sys->download.next_chunk_offset;
         p_sys->download.next_chunk_offset += new_init_ck->size;
-
-        vlc_mutex_lock( &p_sys->download.lock_wait );
         vlc_array_append( p_sys->download.chunks, new_init_ck );
         vlc_array_append( p_sys->init_chunks, new_init_ck );
-        vlc_mutex_unlock( &p_sys->download.lock_wait );
     }
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
     return VLC_SUCCESS;
 }
 
-static inline int64_t get_lead( stream_t *s )
+/* Each track is downloaded on its own, until it leads the playback by 10
+ * seconds, so that the small audio chunks don't wait behind the video ones.
+ * XXX replace magic number 10 by a value depending on
+ * LookAheadFragmentCount and DVRWindowLength */
+static bool track_is_ahead( stream_sys_t *p_sys, sms_stream_t *sms )
 {
-    stream_sys_t *p_sys = s->p_sys;
-    int64_t lead = 0;
-    int64_t alead = p_sys->download.lead[es_cat_to_index( AUDIO_ES )];
-    int64_t vlead = p_sys->download.lead[es_cat_to_index( VIDEO_ES )];
-    bool video = SMS_GET_SELECTED_ST( VIDEO_ES ) ? true : false;
-    bool audio = SMS_GET_SELECTED_ST( AUDIO_ES ) ? true : false;
-
-    if( video && audio )
-        lead = __MIN( vlead, alead );
-    else if( video )
-        lead = vlead;
-    else
-        lead = alead;
-
-    lead -= p_sys->playback.toffset;
-    return lead;
+    int index = es_cat_to_index( sms->type );
+
+    if( !p_sys->b_live &&
+        p_sys->download.ck_index[index] >= sms->vod_chunks_nb - 1 )
+        return true;
+
+    int64_t lead = p_sys->download.lead[index] - p_sys->playback.toffset;
+    return lead > 10 * p_sys->timescale + p_sys->download.start_time;
 }
 
-static int next_track( stream_t *s )
+static void* sms_Worker( void *data )
 {
+    sms_worker_t *worker = data;
+    stream_t *s = worker->s;
     stream_sys_t *p_sys = s->p_sys;
-    uint64_t tmp, min = 0;
-    int cat, ret = UNKNOWN_ES;
-    for( int i = 0; i < 3; i++ )
+
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    for( ;; )
     {
-        tmp = p_sys->download.lead[i];
-        cat = index_to_es_cat( i );
-        if( (!min || tmp < min) && SMS_GET_SELECTED_ST( cat ) )
+        while( !p_sys->b_close && ( p_sys->b_tseek || p_sys->b_error ||
+               track_is_ahead( p_sys, worker->sms ) ) )
+            vlc_cond_wait( &p_sys->download.wait, &p_sys->download.lock_wait );
+
+        if( p_sys->b_close )
+            break;
+        vlc_mutex_unlock( &p_sys->download.lock_wait );
+
+        int ret = Download( s, worker->sms );
+
+        vlc_mutex_lock( &p_sys->download.lock_wait );
+        if( ret != VLC_SUCCESS )
         {
-            min = tmp;
-            ret = cat;
+            msg_Warn( s, "Stopping the downloads of stream %s",
+                      worker->sms->name );
+            p_sys->b_error = true;
+            vlc_cond_broadcast( &p_sys->download.wait );
         }
     }
-    return ret;
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/* Drops the downloaded chunks, to start again from the time to seek to
+ * (lock held) */
+static int sms_Reset( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    int count = vlc_array_count( p_sys->download.chunks );
+    chunk_t *ck = NULL;
+    for( int i = 0; i < count; i++ )
+    {
+        ck = vlc_array_item_at_index( p_sys->download.chunks, i );
+        if( unlikely( !ck ) )
+            return VLC_EGENERIC;
+        ck->read_pos = 0;
+        if( ck->data == NULL )
+            continue;
+        FREENULL( ck->data );
+    }
+
+    vlc_array_destroy( p_sys->download.chunks );
+    p_sys->download.chunks = vlc_array_new();
+    p_sys->download.generation++;
+
+    p_sys->playback.toffset = p_sys->time_pos;
+    for( int i = 0; i < 3; i++ )
+    {
+        p_sys->download.lead[i] = p_sys->time_pos;
+        p_sys->download.ck_index[i] = 0;
+    }
+    p_sys->download.next_chunk_offset = 0;
+
+    p_sys->playback.boffset = 0;
+    p_sys->playback.index = 0;
+
+    chunk_t *new_init_ck = build_init_chunk( s );
+    if( !new_init_ck )
+        return VLC_EGENERIC;
+
+    new_init_ck->offset = p_sys->download.next_chunk_offset;
+    p_sys->download.next_chunk_offset += new_init_ck->size;
+
+    vlc_array_append( p_sys->download.chunks, new_init_ck );
+    vlc_array_append( p_sys->init_chunks, new_init_ck );
+    p_sys->b_tseek = false;
+    vlc_cond_broadcast( &p_sys->download.wait );
+    return VLC_SUCCESS;
 }
 
 void* sms_Thread( void *p_this )
@@ -588,7 +714,7 @@ void* sms_Thread( void *p_this )
      * and for some reason the n^th advertised video fragment is related to
      * the n+1^th advertised audio chunk or vice versa */
 
-    int64_t start_time = 0, lead = 0;
+    int64_t start_time = 0;
 
     for( int i = 0; i < 3; i++ )
     {
@@ -604,76 +730,43 @@ void* sms_Thread( void *p_this )
                 goto cancel;
         }
     }
+    p_sys->download.start_time = start_time;
 
-    while( 1 )
+    /* Then the tracks are downloaded concurrently */
+    for( int i = 0; i < 3; i++ )
     {
-        /* XXX replace magic number 10 by a value depending on
-         * LookAheadFragmentCount and DVRWindowLength */
-        vlc_mutex_lock( &p_sys->download.lock_wait );
-
-        if( p_sys->b_close )
-        {
-            vlc_mutex_unlock( &p_sys->download.lock_wait );
-            break;
-        }
-
-        lead = get_lead( s );
-
-        while( lead > 10 * p_sys->timescale + start_time || NO_MORE_CHUNKS )
-        {
-            vlc_cond_wait( &p_sys->download.wait, &p_sys->download.lock_wait );
-            lead = get_lead( s );
-
-            if( p_sys->b_close )
-                break;
-        }
+        sms_worker_t *worker = &p_sys->download.workers[i];
+
+        worker->s = s;
+        worker->sms = SMS_GET_SELECTED_ST( index_to_es_cat( i ) );
+        worker->b_started = worker->sms != NULL &&
+            !vlc_clone( &worker->thread, sms_Worker, worker,
+                        VLC_THREAD_PRIORITY_INPUT );
+        if( worker->sms != NULL && !worker->b_started )
+            msg_Err( s, "cannot start the downloads of stream %s",
+                     worker->sms->name );
+    }
 
-        if( p_sys->b_tseek )
+    vlc_mutex_lock( &p_sys->download.lock_wait );
+    while( !p_sys->b_close )
+    {
+        if( p_sys->b_tseek && sms_Reset( s ) != VLC_SUCCESS )
         {
-            int count = vlc_array_count( p_sys->download.chunks );
-            chunk_t *ck = NULL;
-            for( int i = 0; i < count; i++ )
-            {
-                ck = vlc_array_item_at_index( p_sys->download.chunks, i );
-                if( unlikely( !ck ) )
-                    goto cancel;
-                ck->read_pos = 0;
-                if( ck->data == NULL )
-                    continue;
-                FREENULL( ck->data );
-            }
-
-            vlc_array_destroy( p_sys->download.chunks );
-            p_sys->download.chunks = vlc_array_new();
-
-            p_sys->playback.toffset = p_sys->time_pos;
-            for( int i = 0; i < 3; i++ )
-            {
-                p_sys->download.lead[i] = p_sys->time_pos;
-                p_sys->download.ck_index[i] = 0;
-            }
-            p_sys->download.next_chunk_offset = 0;
-
-            p_sys->playback.boffset = 0;
-            p_sys->playback.index = 0;
-
-            chunk_t *new_init_ck = build_init_chunk( s );
-            if( !new_init_ck )
-                goto cancel;
-
-            new_init_ck->offset = p_sys->download.next_chunk_offset;
-            p_sys->download.next_chunk_offset += new_init_ck->size;
-
-            vlc_array_append( p_sys->download.chunks, new_init_ck );
-            vlc_array_append( p_sys->init_chunks, new_init_ck );
+            msg_Err( s, "cannot seek" );
+            p_sys->b_error = true;
             p_sys->b_tseek = false;
+            vlc_cond_broadcast( &p_sys->download.wait );
         }
-        vlc_mutex_unlock( &p_sys->download.lock_wait );
-
-        sms = SMS_GET_SELECTED_ST( next_track( s ) );
-        if( Download( s, sms ) != VLC_SUCCESS )
-            goto cancel;
+        vlc_cond_wait( &p_sys->download.wait, &p_sys->download.lock_wait );
     }
+    vlc_mutex_unlock( &p_sys->download.lock_wait );
+
+    for( int i = 0; i < 3; i++ )
+        if( p_sys->download.workers[i].b_started )
+            vlc_join( p_sys->download.workers[i].thread, NULL );
+
+    vlc_restorecancel( canc );
+    return NULL;
 
 cancel:
     p_sys->b_error = true;
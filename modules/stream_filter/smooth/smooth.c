@@ -481,7 +481,7 @@ static void Close( vlc_object_t *p_this )
     for( int i = 0; i < 3; i++ )
         p_sys->download.lead[i] = 0;
     p_sys->playback.toffset = 0;
-    vlc_cond_signal(&p_sys->download.wait);
+    vlc_cond_broadcast( &p_sys->download.wait );
     vlc_mutex_unlock( &p_sys->download.lock_wait );
 
     vlc_join( p_sys->thread, NULL );
@@ -575,7 +575,7 @@ static int sms_Read( stream_t *s, uint8_t *p_read, int i_read )
                 vlc_mutex_lock( &p_sys->download.lock_wait );
                 p_sys->playback.toffset += chunk->duration;
                 vlc_mutex_unlock( &p_sys->download.lock_wait );
-                vlc_cond_signal( &p_sys->download.wait);
+                vlc_cond_broadcast( &p_sys->download.wait );
             }
             if( !p_sys->b_cache || p_sys->b_live )
             {
@@ -721,7 +721,7 @@ static int chunk_Seek( stream_t *s, const uint64_t pos )
             p_sys->download.lead[i] = 0;
         p_sys->playback.toffset = 0;
 
-        vlc_cond_signal( &p_sys->download.wait);
+        vlc_cond_broadcast( &p_sys->download.wait );
         vlc_mutex_unlock( &p_sys->download.lock_wait );
 
         return VLC_SUCCESS;
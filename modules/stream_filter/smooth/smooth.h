@@ -85,10 +85,20 @@ typedef struct sms_stream_s
 
 } sms_stream_t;
 
+/* Downloads the chunks of one track */
+typedef struct sms_worker_s
+{
+    vlc_thread_t  thread;
+    stream_t      *s;
+    sms_stream_t  *sms;
+    bool          b_started;
+
+} sms_worker_t;
+
 struct stream_sys_t
 {
     char         *base_url;    /* URL common part for chunks */
-    vlc_thread_t thread;       /* SMS chunk download thread */
+    vlc_thread_t thread;       /* SMS chunk download control thread */
 
     vlc_array_t  *sms_streams; /* available streams */
     vlc_array_t  *selected_st; /* selected streams */
@@ -111,6 +121,18 @@ struct stream_sys_t
         vlc_array_t  *chunks;     /* chunks that have been downloaded */
         vlc_mutex_t  lock_wait;   /* protect chunk download counter. */
         vlc_cond_t   wait;        /* some condition to wait on */
+
+        int64_t      start_time;  /* of the first chunk */
+        unsigned     generation;  /* of the downloads, changed by a seek */
+        sms_worker_t workers[3];  /* one per selected track */
+
+        /* The bandwidth is shared by the tracks: it is estimated from the
+         * bytes received by all the downloads, over the time during which
+         * at least one of them was running */
+        unsigned     active;      /* downloads in progress */
+        uint64_t     received;    /* bytes, since the last estimation */
+        mtime_t      busy;        /* time, since the last estimation */
+        mtime_t      busy_since;
     } download;
 
     /* Playback */
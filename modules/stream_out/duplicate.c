@@ -275,13 +275,25 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
 
         p_buffer->p_next = NULL;
 
+        /* Every output gets a reference to the same payload; outputs that
+         * need to write to it (decoders, some muxers) copy it with block_Unshare() */
+        if( p_sys->i_nb_streams > 1 )
+        {
+            p_buffer = block_Share( p_buffer );
+            if( unlikely(p_buffer == NULL) )
+            {
+                p_buffer = p_next;
+                continue;
+            }
+        }
+
         for( i_stream = 0; i_stream < p_sys->i_nb_streams - 1; i_stream++ )
         {
             p_dup_stream = p_sys->pp_streams[i_stream];
 
             if( id->pp_ids[i_stream] )
             {
-                block_t *p_dup = block_Duplicate( p_buffer );
+                block_t *p_dup = block_Hold( p_buffer );
 
                 if( p_dup )
                     sout_StreamIdSend( p_dup_stream, id->pp_ids[i_stream], p_dup );
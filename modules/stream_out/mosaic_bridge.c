@@ -522,6 +522,11 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
         return VLC_SUCCESS;
     }
 
+    /* The decoder may write to the payload */
+    p_buffer = block_ChainUnshare( p_buffer );
+    if( unlikely(p_buffer == NULL) )
+        return VLC_SUCCESS;
+
     while ( (p_pic = p_sys->p_decoder->pf_decode_video( p_sys->p_decoder,
                                                         &p_buffer )) )
     {
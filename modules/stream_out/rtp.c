@@ -286,6 +286,7 @@ static int               MuxSend( sout_stream_t *, sout_stream_id_t *,
 
 static sout_access_out_t *GrabberCreate( sout_stream_t *p_sout );
 static void* ThreadSend( void * );
+static void InitTimestamp( sout_stream_id_t *, int64_t );
 static void *rtp_listen_thread( void * );
 
 static void SDPHandleUrl( sout_stream_t *, const char * );
@@ -389,6 +390,9 @@ struct sout_stream_id_t
 
     block_fifo_t     *p_fifo;
     int64_t           i_caching;
+
+    /* VoD sessions of the same live ES sharing the packets */
+    media_es_t       *p_share;
 };
 
 /*****************************************************************************
@@ -982,6 +986,7 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     id->rtsp_id = NULL;
     id->p_fifo = NULL;
     id->listen.fd = NULL;
+    id->p_share = NULL;
 
     id->b_first_packet = true;
     id->i_caching =
@@ -1191,6 +1196,18 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
         goto error;
     }
 
+    /* Packetize live VoD ES once for all the sessions */
+    if( format && p_fmt != NULL && p_sys->p_vod_media != NULL
+#ifdef HAVE_SRTP
+     && id->srtp == NULL
+#endif
+      )
+    {
+        id->p_share = vod_share_id( p_sys->p_vod_media, p_fmt->i_id, id );
+        if( id->p_share != NULL && !vod_share_leads( id->p_share, id ) )
+            msg_Dbg( p_stream, "forwarding the packets of another session" );
+    }
+
     /* Update p_sys context */
     vlc_mutex_lock( &p_sys->lock_es );
     TAB_APPEND( p_sys->i_es, p_sys->es, id );
@@ -1230,6 +1247,8 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_t *id )
         vlc_join( id->thread, NULL );
         block_FifoRelease( id->p_fifo );
     }
+    if( id->p_share != NULL )
+        vod_unshare_id( id->p_share, id );
 
     free( id->rtp_fmt.fmtp );
 
@@ -1270,6 +1289,19 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
     assert( p_stream->p_sys->p_mux == NULL );
     (void)p_stream;
 
+    if( id->p_share != NULL && !vod_share_leads( id->p_share, id ) )
+    {   /* Another session packetizes this live ES: the input only sets
+         * the timeline of the packets forwarded from it */
+        mtime_t i_pts = p_buffer->i_pts > VLC_TS_INVALID ? p_buffer->i_pts
+                                                         : p_buffer->i_dts;
+        vlc_mutex_lock( &id->lock_sink );
+        if( !id->b_ts_init && i_pts > VLC_TS_INVALID )
+            InitTimestamp( id, i_pts );
+        vlc_mutex_unlock( &id->lock_sink );
+        block_ChainRelease( p_buffer );
+        return VLC_SUCCESS;
+    }
+
     while( p_buffer != NULL )
     {
         p_next = p_buffer->p_next;
@@ -1394,15 +1426,109 @@ static int  HttpCallback( httpd_file_sys_t *p_args,
 /****************************************************************************
  * RTP send
  ****************************************************************************/
-static void* ThreadSend( void *data )
+#ifdef HAVE_SRTP
+static block_t *ProtectSRTP( sout_stream_id_t *id, block_t *out )
+{   /* FIXME: this is awfully inefficient */
+    size_t len = out->i_buffer;
+    out = block_Realloc( out, 0, len + 10 );
+    out->i_buffer = len;
+
+    int canc = vlc_savecancel ();
+    int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
+    vlc_restorecancel (canc);
+    if( val )
+    {
+        errno = val;
+        msg_Dbg( id->p_stream, "SRTP sending error: %m" );
+        block_Release( out );
+        return NULL;
+    }
+    out->i_buffer = len;
+    return out;
+}
+#endif
+
+/* Packets due within that delay are sent along with the current one */
+#define SEND_WINDOW (CLOCK_FREQ / 1000)
+#define SEND_BATCH  64
+
+/* Sends packets to all the sinks of an ES. If src is not NULL, the packets
+ * were sent by the RTP stream of another session first, with the timestamps
+ * pi_ts, and get the SSRC, sequence numbers and timestamps of this one, in
+ * place. */
+static void SendBatch( sout_stream_id_t *id, const sout_stream_id_t *src,
+                       const uint32_t *pi_ts, block_t **batch, unsigned n )
 {
 #ifdef _WIN32
 # define ENOBUFS      WSAENOBUFS
 # define EAGAIN       WSAEWOULDBLOCK
 # define EWOULDBLOCK  WSAEWOULDBLOCK
 #endif
+    vlc_mutex_lock( &id->lock_sink );
+    if( src != NULL )
+    {
+        if( !id->b_ts_init )
+        {   /* the timeline of this session is not known yet */
+            vlc_mutex_unlock( &id->lock_sink );
+            return;
+        }
+        rtp_rewrite_headers( batch, n, pi_ts,
+                             id->i_ts_offset - src->i_ts_offset,
+                             &id->i_sequence, id->ssrc );
+    }
+
+    unsigned deadc = 0; /* How many dead sockets? */
+    int deadv[id->sinkc]; /* Dead sockets list */
+
+    for( int i = 0; i < id->sinkc; i++ )
+    {
+        int fd = id->sinkv[i].rtp_fd;
+
+#ifdef HAVE_SRTP
+        if( !id->srtp ) /* FIXME: SRTCP support */
+#endif
+            for( unsigned j = 0; j < n; j++ )
+                SendRTCP( id->sinkv[i].rtcp, batch[j] );
+
+        for( unsigned j = 0; j < n; )
+        {
+            int val = net_SendBlocks( fd, &batch[j], n - j );
+            if( val > 0 )
+            {
+                j += val;
+                continue;
+            }
+            if( net_errno != EAGAIN && net_errno != EWOULDBLOCK
+             && net_errno != ENOBUFS && net_errno != ENOMEM )
+            {
+                int type;
+                getsockopt( fd, SOL_SOCKET, SO_TYPE,
+                            &type, &(socklen_t){ sizeof(type) });
+                if( type != SOCK_DGRAM )
+                {   /* Broken connection */
+                    deadv[deadc++] = fd;
+                    break;
+                }
+                /* ICMP soft error: ignore and retry */
+                send( fd, batch[j]->p_buffer, batch[j]->i_buffer, 0 );
+            }
+            j++;
+        }
+    }
+    id->i_seq_sent_next = ntohs(((uint16_t *) batch[n - 1]->p_buffer)[1]) + 1;
+    vlc_mutex_unlock( &id->lock_sink );
+    for( unsigned i = 0; i < deadc; i++ )
+    {
+        msg_Dbg( id->p_stream, "removing socket %d", deadv[i] );
+        rtp_del_sink( id, deadv[i] );
+    }
+}
+
+static void* ThreadSend( void *data )
+{
     sout_stream_id_t *id = data;
     unsigned i_caching = id->i_caching;
+    block_t *batch[SEND_BATCH];
 
     for (;;)
     {
@@ -1411,24 +1537,7 @@ static void* ThreadSend( void *data )
 
 #ifdef HAVE_SRTP
         if( id->srtp )
-        {   /* FIXME: this is awfully inefficient */
-            size_t len = out->i_buffer;
-            out = block_Realloc( out, 0, len + 10 );
-            out->i_buffer = len;
-
-            int canc = vlc_savecancel ();
-            int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
-            vlc_restorecancel (canc);
-            if( val )
-            {
-                errno = val;
-                msg_Dbg( id->p_stream, "SRTP sending error: %m" );
-                block_Release( out );
-                out = NULL;
-            }
-            else
-                out->i_buffer = len;
-        }
+            out = ProtectSRTP( id, out );
         if (out)
             mwait (out->i_dts + i_caching);
         vlc_cleanup_pop ();
@@ -1439,44 +1548,30 @@ static void* ThreadSend( void *data )
         vlc_cleanup_pop ();
 #endif
 
-        ssize_t len = out->i_buffer;
-        int canc = vlc_savecancel ();
-
-        vlc_mutex_lock( &id->lock_sink );
-        unsigned deadc = 0; /* How many dead sockets? */
-        int deadv[id->sinkc]; /* Dead sockets list */
+        unsigned n = 0;
+        mtime_t now = mdate ();
 
-        for( int i = 0; i < id->sinkc; i++ )
+        batch[n++] = out;
+        while( n < SEND_BATCH && block_FifoCount( id->p_fifo ) > 0 )
         {
+            if( block_FifoShow( id->p_fifo )->i_dts + i_caching > now + SEND_WINDOW )
+                break;
+            out = block_FifoGet( id->p_fifo );
 #ifdef HAVE_SRTP
-            if( !id->srtp ) /* FIXME: SRTCP support */
+            if( id->srtp && ( out = ProtectSRTP( id, out ) ) == NULL )
+                continue;
 #endif
-                SendRTCP( id->sinkv[i].rtcp, out );
-
-            if( send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 ) == -1
-             && net_errno != EAGAIN && net_errno != EWOULDBLOCK
-             && net_errno != ENOBUFS && net_errno != ENOMEM )
-            {
-                int type;
-                getsockopt( id->sinkv[i].rtp_fd, SOL_SOCKET, SO_TYPE,
-                            &type, &(socklen_t){ sizeof(type) });
-                if( type == SOCK_DGRAM )
-                    /* ICMP soft error: ignore and retry */
-                    send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 );
-                else
-                    /* Broken connection */
-                    deadv[deadc++] = id->sinkv[i].rtp_fd;
-            }
+            batch[n++] = out;
         }
-        id->i_seq_sent_next = ntohs(((uint16_t *) out->p_buffer)[1]) + 1;
-        vlc_mutex_unlock( &id->lock_sink );
-        block_Release( out );
 
-        for( unsigned i = 0; i < deadc; i++ )
-        {
-            msg_Dbg( id->p_stream, "removing socket %d", deadv[i] );
-            rtp_del_sink( id, deadv[i] );
-        }
+        int canc = vlc_savecancel ();
+
+        SendBatch( id, NULL, NULL, batch, n );
+        if( id->p_share != NULL )
+            vod_share_forward( id->p_share, id, batch, n );
+        for( unsigned j = 0; j < n; j++ )
+            block_Release( batch[j] );
+
         vlc_restorecancel (canc);
     }
     return NULL;
@@ -1613,29 +1708,32 @@ int64_t rtp_get_ts( const sout_stream_t *p_stream, const sout_stream_id_t *id,
     return p_sys->i_pts_zero + npt; 
 }
 
+static void InitTimestamp( sout_stream_id_t *id, int64_t i_pts )
+{
+    sout_stream_sys_t *p_sys = id->p_stream->p_sys;
+    vlc_mutex_lock( &p_sys->lock_ts );
+    if( p_sys->i_npt_zero == VLC_TS_INVALID )
+    {
+        /* This is the first packet of any ES. We initialize the
+         * NPT=0 time reference, and the offset to match the
+         * arbitrary PTS reference. */
+        p_sys->i_npt_zero = i_pts + id->i_caching;
+        p_sys->i_pts_offset = p_sys->i_pts_zero - i_pts;
+    }
+    vlc_mutex_unlock( &p_sys->lock_ts );
+
+    /* And in any case this is the first packet of this ES, so we
+     * initialize the offset for this ES. */
+    id->i_ts_offset = rtp_compute_ts( id->rtp_fmt.clock_rate,
+                                      p_sys->i_pts_offset );
+    id->b_ts_init = true;
+}
+
 void rtp_packetize_common( sout_stream_id_t *id, block_t *out,
                            int b_marker, int64_t i_pts )
 {
     if( !id->b_ts_init )
-    {
-        sout_stream_sys_t *p_sys = id->p_stream->p_sys;
-        vlc_mutex_lock( &p_sys->lock_ts );
-        if( p_sys->i_npt_zero == VLC_TS_INVALID )
-        {
-            /* This is the first packet of any ES. We initialize the
-             * NPT=0 time reference, and the offset to match the
-             * arbitrary PTS reference. */
-            p_sys->i_npt_zero = i_pts + id->i_caching;
-            p_sys->i_pts_offset = p_sys->i_pts_zero - i_pts;
-        }
-        vlc_mutex_unlock( &p_sys->lock_ts );
-
-        /* And in any case this is the first packet of this ES, so we
-         * initialize the offset for this ES. */
-        id->i_ts_offset = rtp_compute_ts( id->rtp_fmt.clock_rate,
-                                          p_sys->i_pts_offset );
-        id->b_ts_init = true;
-    }
+        InitTimestamp( id, i_pts );
 
     uint32_t i_timestamp = rtp_compute_ts( id->rtp_fmt.clock_rate, i_pts )
                            + id->i_ts_offset;
@@ -1660,6 +1758,20 @@ void rtp_packetize_send( sout_stream_id_t *id, block_t *out )
     block_FifoPut( id->p_fifo, out );
 }
 
+/** Sends packets of another session playing the same live ES, as if this
+ * RTP stream had packetized them itself. pi_ts are the timestamps the
+ * packets were sent with by src. Protected packets cannot be rewritten, so
+ * SRTP streams never share their packets. */
+void rtp_forward( sout_stream_id_t *id, const sout_stream_id_t *src,
+                  const uint32_t *pi_ts, block_t **pp_packets,
+                  unsigned i_packets )
+{
+#ifdef HAVE_SRTP
+    assert( id->srtp == NULL && src->srtp == NULL );
+#endif
+    SendBatch( id, src, pi_ts, pp_packets, i_packets );
+}
+
 /**
  * @return configured max RTP payload size (including payload type-specific
  * headers, excluding RTP and transport headers)
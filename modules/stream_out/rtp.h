@@ -24,6 +24,7 @@
 
 typedef struct rtsp_stream_t rtsp_stream_t;
 typedef struct rtsp_stream_id_t rtsp_stream_id_t;
+typedef struct media_es_t media_es_t;
 
 rtsp_stream_t *RtspSetup( vlc_object_t *owner, vod_media_t *media,
                           const char *path );
@@ -58,6 +59,32 @@ void rtp_packetize_common (sout_stream_id_t *id, block_t *out,
                            int b_marker, int64_t i_pts);
 void rtp_packetize_send (sout_stream_id_t *id, block_t *out);
 size_t rtp_mtu (const sout_stream_id_t *id);
+void rtp_forward (sout_stream_id_t *id, const sout_stream_id_t *src,
+                  const uint32_t *pi_ts, block_t **pp_packets,
+                  unsigned i_packets);
+
+/**
+ * Gives packets sent by the RTP stream of another session the SSRC, sequence
+ * numbers and timestamps of this one. The timestamps are mapped from the
+ * ones the packets had when the other stream sent them (pi_ts), as another
+ * session may already have rewritten the headers.
+ */
+static inline void rtp_rewrite_headers (block_t *const *pp_packets,
+                                        unsigned i_packets,
+                                        const uint32_t *pi_ts,
+                                        uint32_t i_ts_delta,
+                                        uint16_t *pi_seq,
+                                        const uint8_t *p_ssrc)
+{
+    for (unsigned i = 0; i < i_packets; i++)
+    {
+        uint8_t *p = pp_packets[i]->p_buffer;
+
+        SetWBE (p + 2, (*pi_seq)++);
+        SetDWBE (p + 4, pi_ts[i] + i_ts_delta);
+        memcpy (p + 8, p_ssrc, 4);
+    }
+}
 
 int rtp_packetize_xiph_config( sout_stream_id_t *id, const char *fmtp,
                                int64_t i_pts );
@@ -106,4 +133,10 @@ int vod_init_id(vod_media_t *p_media, const char *psz_session, int es_id,
                 uint32_t *ssrc, uint16_t *seq_init);
 void vod_detach_id(vod_media_t *p_media, const char *psz_session,
                    sout_stream_id_t *sout_id);
+media_es_t *vod_share_id(vod_media_t *p_media, int es_id,
+                         sout_stream_id_t *sout_id);
+void vod_unshare_id(media_es_t *p_es, sout_stream_id_t *sout_id);
+bool vod_share_leads(media_es_t *p_es, const sout_stream_id_t *sout_id);
+void vod_share_forward(media_es_t *p_es, const sout_stream_id_t *sout_id,
+                       block_t **pp_packets, unsigned i_packets);
 
@@ -33,6 +33,7 @@
 
 #include <vlc_common.h>
 #include <vlc_sout.h>
+#include <vlc_block.h>
 
 #include <vlc_httpd.h>
 #include <vlc_url.h>
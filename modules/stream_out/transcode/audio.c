@@ -173,6 +173,12 @@ int transcode_audio_new( sout_stream_t *p_stream,
 
 void transcode_audio_close( sout_stream_id_t *id )
 {
+    if( id->p_pipeline )
+    {
+        transcode_pipeline_Delete( id->p_pipeline );
+        id->p_pipeline = NULL;
+    }
+
     /* Close decoder */
     if( id->p_decoder->p_module )
         module_unneed( id->p_decoder, id->p_decoder->p_module );
@@ -192,17 +198,125 @@ void transcode_audio_close( sout_stream_id_t *id )
         aout_FiltersDelete( (vlc_object_t *)NULL, id->p_af_chain );
 }
 
+/* The following functions run either on the input thread (out is then set)
+ * or on the pipeline thread of their stage (out is NULL) */
+static void EncodeAudio( sout_stream_t *p_stream, sout_stream_id_t *id,
+                         block_t *p_audio_buf, block_t **out )
+{
+    VLC_UNUSED(p_stream);
+    block_t *p_block = id->p_encoder->pf_encode_audio( id->p_encoder,
+                                                       p_audio_buf );
+    if( id->p_pipeline )
+        transcode_pipeline_Output( id->p_pipeline, p_block );
+    else
+        block_ChainAppend( out, p_block );
+    block_Release( p_audio_buf );
+}
+
+static void FilterAudio( sout_stream_t *p_stream, sout_stream_id_t *id,
+                         block_t *p_audio_buf, block_t **out )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    if( p_sys->b_master_sync )
+    {
+        mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
+        mtime_t i_drift = 0;
+
+        if( likely( p_audio_buf->i_pts != VLC_TS_INVALID ) )
+            i_drift = p_audio_buf->i_pts - i_pts;
+
+        if ( unlikely(i_drift > MASTER_SYNC_MAX_DRIFT
+             || i_drift < -MASTER_SYNC_MAX_DRIFT) )
+        {
+            msg_Dbg( p_stream,
+                "drift is too high (%"PRId64"), resetting master sync",
+                i_drift );
+            date_Set( &id->interpolated_pts, p_audio_buf->i_pts );
+            i_pts = p_audio_buf->i_pts + 1;
+        }
+        if( likely(p_audio_buf->i_pts != VLC_TS_INVALID ) )
+        {
+            vlc_mutex_lock( &p_sys->lock_sync );
+            p_sys->i_master_drift = p_audio_buf->i_pts - i_pts;
+            vlc_mutex_unlock( &p_sys->lock_sync );
+        }
+        date_Increment( &id->interpolated_pts, p_audio_buf->i_nb_samples );
+        p_audio_buf->i_pts = i_pts;
+    }
+
+    p_audio_buf->i_dts = p_audio_buf->i_pts;
+
+    /* Run filter chain */
+    p_audio_buf = aout_FiltersPlay( id->p_af_chain, p_audio_buf,
+                                    INPUT_RATE_DEFAULT );
+    if( !p_audio_buf )
+        abort();
+
+    p_audio_buf->i_dts = p_audio_buf->i_pts;
+
+    if( id->p_pipeline )
+        transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_ENCODE,
+                                 p_audio_buf );
+    else
+        EncodeAudio( p_stream, id, p_audio_buf, out );
+}
+
+static void DecodeAudio( sout_stream_t *p_stream, sout_stream_id_t *id,
+                         block_t *in, block_t **out )
+{
+    block_t *p_audio_buf;
+
+    while( (p_audio_buf = id->p_decoder->pf_decode_audio( id->p_decoder,
+                                                          &in )) )
+    {
+        if( id->p_pipeline )
+            transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_FILTER,
+                                     p_audio_buf );
+        else
+            FilterAudio( p_stream, id, p_audio_buf, out );
+    }
+}
+
+static void DecodeAudioStage( sout_stream_t *p_stream, void *id,
+                              void *p_item )
+{
+    DecodeAudio( p_stream, id, p_item, NULL );
+}
+
+static void FilterAudioStage( sout_stream_t *p_stream, void *id,
+                              void *p_item )
+{
+    FilterAudio( p_stream, id, p_item, NULL );
+}
+
+static void EncodeAudioStage( sout_stream_t *p_stream, void *id,
+                              void *p_item )
+{
+    EncodeAudio( p_stream, id, p_item, NULL );
+}
+
+static void ReleaseBlock( void *p_item )
+{
+    block_Release( p_item );
+}
+
 int transcode_audio_process( sout_stream_t *p_stream,
                                     sout_stream_id_t *id,
                                     block_t *in, block_t **out )
 {
-    sout_stream_sys_t *p_sys = p_stream->p_sys;
-    block_t *p_block, *p_audio_buf;
     *out = NULL;
 
     if( unlikely( in == NULL ) )
     {
         block_t *p_block;
+
+        /* Wait for the threads, then flush the encoder from here */
+        if( id->p_pipeline )
+        {
+            transcode_pipeline_Drain( id->p_pipeline, TRANSCODE_STAGE_DECODE );
+            transcode_pipeline_Fetch( id->p_pipeline, out );
+        }
         do {
            p_block = id->p_encoder->pf_encode_audio(id->p_encoder, NULL );
            block_ChainAppend( out, p_block );
@@ -210,47 +324,14 @@ int transcode_audio_process( sout_stream_t *p_stream,
         return VLC_SUCCESS;
     }
 
-    while( (p_audio_buf = id->p_decoder->pf_decode_audio( id->p_decoder,
-                                                          &in )) )
+    if( id->p_pipeline )
     {
-        if( p_sys->b_master_sync )
-        {
-            mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
-            mtime_t i_drift = 0;
-
-            if( likely( p_audio_buf->i_pts != VLC_TS_INVALID ) )
-                i_drift = p_audio_buf->i_pts - i_pts;
-
-            if ( unlikely(i_drift > MASTER_SYNC_MAX_DRIFT
-                 || i_drift < -MASTER_SYNC_MAX_DRIFT) )
-            {
-                msg_Dbg( p_stream,
-                    "drift is too high (%"PRId64"), resetting master sync",
-                    i_drift );
-                date_Set( &id->interpolated_pts, p_audio_buf->i_pts );
-                i_pts = p_audio_buf->i_pts + 1;
-            }
-            if( likely(p_audio_buf->i_pts != VLC_TS_INVALID ) )
-                p_sys->i_master_drift = p_audio_buf->i_pts - i_pts;
-            date_Increment( &id->interpolated_pts, p_audio_buf->i_nb_samples );
-            p_audio_buf->i_pts = i_pts;
-        }
-
-        p_audio_buf->i_dts = p_audio_buf->i_pts;
-
-        /* Run filter chain */
-        p_audio_buf = aout_FiltersPlay( id->p_af_chain, p_audio_buf,
-                                        INPUT_RATE_DEFAULT );
-        if( !p_audio_buf )
-            abort();
-
-        p_audio_buf->i_dts = p_audio_buf->i_pts;
-
-        p_block = id->p_encoder->pf_encode_audio( id->p_encoder, p_audio_buf );
-
-        block_ChainAppend( out, p_block );
-        block_Release( p_audio_buf );
+        transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_DECODE, in );
+        transcode_pipeline_Fetch( id->p_pipeline, out );
+        transcode_pipeline_Report( id->p_pipeline, false );
     }
+    else
+        DecodeAudio( p_stream, id, in, out );
 
     return VLC_SUCCESS;
 }
@@ -301,5 +382,28 @@ bool transcode_audio_add( sout_stream_t *p_stream, es_format_t *p_fmt,
 
     date_Init( &id->interpolated_pts, p_fmt->audio.i_rate, 1 );
 
+    if( p_sys->i_threads >= 1 )
+    {
+        static const transcode_stage_desc_t stages[TRANSCODE_STAGE_COUNT] =
+        {
+            { "decode", DecodeAudioStage, ReleaseBlock },
+            { "filter", FilterAudioStage, ReleaseBlock },
+            { "encode", EncodeAudioStage, ReleaseBlock },
+        };
+
+        id->p_pipeline = transcode_pipeline_New( p_stream, id, "audio",
+                                                 stages, TRANSCODE_STAGE_COUNT,
+                                                 TRANSCODE_AUDIO_QUEUE,
+                                                 VLC_THREAD_PRIORITY_AUDIO );
+        if( id->p_pipeline == NULL )
+        {
+            transcode_audio_close( id );
+            sout_StreamIdDel( p_stream->p_next, id->id );
+            id->id = NULL;
+            return false;
+        }
+        transcode_pipeline_Start( id->p_pipeline, &id->p_encoder->fmt_out );
+    }
+
     return true;
 }
@@ -0,0 +1,468 @@
+/*****************************************************************************
+ * ladder.c: transcoding stream output module (video renditions)
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************
+ * The ladder adds renditions of the transcoded video at other sizes, from
+ * the same decoded and filtered pictures. The renditions are sorted by
+ * decreasing size and each is scaled from the previous one, so that every
+ * picture goes through a single cascaded downscale. Each rendition is
+ * output as another elementary stream, with an id allocated from a range
+ * of its own (TRANSCODE_LADDER_ID and above), so it cannot collide with the
+ * ids the demuxers give the input streams, even those added later.
+ *****************************************************************************/
+
+#include "transcode.h"
+
+#include <vlc_modules.h>
+
+typedef struct
+{
+    encoder_t            *p_encoder;
+    filter_chain_t       *p_scale;     /* from the previous rendition */
+    void                 *id;          /* output stream */
+    int                   i_id;        /* its ES id */
+    bool                  b_open;
+
+    /* encoder thread (threads>=1), else blocks encoded on the input thread */
+    transcode_pipeline_t *p_pipeline;
+    block_t              *p_out;
+
+    char                  psz_name[32];
+} rendition_t;
+
+struct transcode_ladder_t
+{
+    int          i_renditions;
+    rendition_t  renditions[];
+};
+
+static int RungCompare( const void *a, const void *b )
+{
+    const transcode_rung_t *p_a = a, *p_b = b;
+    uint64_t i_a = (uint64_t)p_a->i_width * p_a->i_height;
+    uint64_t i_b = (uint64_t)p_b->i_width * p_b->i_height;
+
+    return i_a < i_b ? 1 : i_a > i_b ? -1 : 0;
+}
+
+/**
+ * Parses a list of renditions such as "1280x720@3000,640x360@800"
+ * (width x height, optionally @ bitrate in kb/s).
+ */
+int transcode_ladder_Parse( sout_stream_t *p_stream, sout_stream_sys_t *p_sys,
+                           const char *psz_ladder )
+{
+    char *psz_dup = strdup( psz_ladder );
+    char *psz_save;
+
+    if( unlikely(psz_dup == NULL) )
+        return VLC_ENOMEM;
+
+    for( char *psz = strtok_r( psz_dup, ",", &psz_save ); psz != NULL;
+         psz = strtok_r( NULL, ",", &psz_save ) )
+    {
+        transcode_rung_t rung = { 0, 0, 0 };
+
+        if( sscanf( psz, "%ux%u@%d", &rung.i_width, &rung.i_height,
+                    &rung.i_bitrate ) < 2 ||
+            rung.i_width < 16 || rung.i_height < 16 )
+        {
+            msg_Warn( p_stream, "invalid rendition `%s' ignored", psz );
+            continue;
+        }
+        rung.i_width &= ~1;
+        rung.i_height &= ~1;
+        rung.i_bitrate *= 1000;
+
+        transcode_rung_t *p_rungs = realloc( p_sys->p_ladder,
+                                             ( p_sys->i_ladder + 1 ) * sizeof( rung ) );
+        if( unlikely(p_rungs == NULL) )
+            break;
+        p_rungs[p_sys->i_ladder++] = rung;
+        p_sys->p_ladder = p_rungs;
+    }
+    free( psz_dup );
+
+    qsort( p_sys->p_ladder, p_sys->i_ladder, sizeof( *p_sys->p_ladder ),
+           RungCompare );
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+        msg_Dbg( p_stream, "video rendition %ux%u %dkb/s",
+                 p_sys->p_ladder[i].i_width, p_sys->p_ladder[i].i_height,
+                 p_sys->p_ladder[i].i_bitrate / 1000 );
+    return VLC_SUCCESS;
+}
+
+static void EncodeRendition( sout_stream_t *p_stream, void *p_opaque,
+                             void *p_item )
+{
+    VLC_UNUSED(p_stream);
+    rendition_t *p_rend = p_opaque;
+    picture_t *p_pic = p_item;
+
+    transcode_pipeline_Output( p_rend->p_pipeline,
+        p_rend->p_encoder->pf_encode_video( p_rend->p_encoder, p_pic ) );
+    picture_Release( p_pic );
+}
+
+static void ReleasePicture( void *p_item )
+{
+    picture_Release( p_item );
+}
+
+/**
+ * Creates the renditions of a video stream. Their encoders are only opened
+ * along with the main one, by transcode_ladder_Open().
+ */
+transcode_ladder_t *transcode_ladder_New( sout_stream_t *p_stream )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    transcode_ladder_t *p_ladder;
+
+    p_ladder = calloc( 1, sizeof( *p_ladder ) +
+                          p_sys->i_ladder * sizeof( rendition_t ) );
+    if( unlikely(p_ladder == NULL) )
+        return NULL;
+
+    for( int i = 0; i < p_sys->i_ladder; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+
+        p_rend->p_encoder = sout_EncoderCreate( p_stream );
+        if( unlikely(p_rend->p_encoder == NULL) )
+            goto error;
+        p_rend->p_encoder->p_module = NULL;
+        p_rend->i_id = p_sys->i_ladder_id++;
+        es_format_Init( &p_rend->p_encoder->fmt_in, VIDEO_ES, 0 );
+        es_format_Init( &p_rend->p_encoder->fmt_out, VIDEO_ES, 0 );
+        snprintf( p_rend->psz_name, sizeof( p_rend->psz_name ), "video %ux%u",
+                  p_sys->p_ladder[i].i_width, p_sys->p_ladder[i].i_height );
+        p_ladder->i_renditions++;
+
+        if( p_sys->i_threads >= 1 )
+        {
+            static const transcode_stage_desc_t stage =
+                { "encode", EncodeRendition, ReleasePicture };
+            int i_priority = p_sys->b_high_priority ?
+                VLC_THREAD_PRIORITY_OUTPUT : VLC_THREAD_PRIORITY_VIDEO;
+
+            p_rend->p_pipeline = transcode_pipeline_New( p_stream, p_rend,
+                                                         p_rend->psz_name,
+                                                         &stage, 1,
+                                                         TRANSCODE_VIDEO_QUEUE,
+                                                         i_priority );
+            if( p_rend->p_pipeline == NULL )
+                goto error;
+        }
+    }
+    return p_ladder;
+
+error:
+    transcode_ladder_Delete( p_stream, p_ladder );
+    return NULL;
+}
+
+/* (Re)builds the scalers, each rendition being scaled from the previous
+ * opened one, or from the pictures of the main encoder for the first one */
+static void BuildScalers( sout_stream_t *p_stream, transcode_ladder_t *p_ladder,
+                          const es_format_t *p_fmt_main )
+{
+    const es_format_t *p_fmt_src = p_fmt_main;
+
+    for( int i = 0; i < p_ladder->i_renditions; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+
+        if( p_rend->p_scale )
+            filter_chain_Delete( p_rend->p_scale );
+        p_rend->p_scale = NULL;
+        if( !p_rend->b_open )
+            continue;
+
+        p_rend->p_scale = filter_chain_New( p_stream, "video filter2", false,
+                                       transcode_video_filter_allocation_init,
+                                       transcode_video_filter_allocation_clear,
+                                       p_stream->p_sys );
+        if( p_rend->p_scale == NULL )
+            continue;
+        filter_chain_Reset( p_rend->p_scale, p_fmt_src,
+                            &p_rend->p_encoder->fmt_in );
+
+        const video_format_t *p_src = &p_fmt_src->video;
+        const video_format_t *p_dst = &p_rend->p_encoder->fmt_in.video;
+        if( p_src->i_chroma != p_dst->i_chroma ||
+            p_src->i_width != p_dst->i_width ||
+            p_src->i_height != p_dst->i_height )
+        {
+            if( !filter_chain_AppendFilter( p_rend->p_scale, NULL, NULL,
+                                            p_fmt_src,
+                                            &p_rend->p_encoder->fmt_in ) )
+                msg_Err( p_stream, "cannot scale %s", p_rend->psz_name );
+        }
+        p_fmt_src = &p_rend->p_encoder->fmt_in;
+    }
+}
+
+static int OpenRendition( sout_stream_t *p_stream, rendition_t *p_rend,
+                          const transcode_rung_t *p_rung,
+                          const encoder_t *p_main )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    encoder_t *p_enc = p_rend->p_encoder;
+    const video_format_t *p_vmain = &p_main->fmt_in.video;
+
+    /* Same settings as the main encoder, except the size and bitrate */
+    es_format_Clean( &p_enc->fmt_in );
+    es_format_Copy( &p_enc->fmt_in, &p_main->fmt_in );
+    es_format_Clean( &p_enc->fmt_out );
+    es_format_Copy( &p_enc->fmt_out, &p_main->fmt_out );
+    free( p_enc->fmt_out.p_extra );
+    p_enc->fmt_out.p_extra = NULL;
+    p_enc->fmt_out.i_extra = 0;
+    p_enc->fmt_out.i_codec = p_sys->i_vcodec;
+    p_enc->fmt_out.i_id = p_rend->i_id;
+
+    p_enc->fmt_in.video.i_width = p_enc->fmt_in.video.i_visible_width =
+    p_enc->fmt_out.video.i_width = p_enc->fmt_out.video.i_visible_width =
+        p_rung->i_width;
+    p_enc->fmt_in.video.i_height = p_enc->fmt_in.video.i_visible_height =
+    p_enc->fmt_out.video.i_height = p_enc->fmt_out.video.i_visible_height =
+        p_rung->i_height;
+    p_enc->fmt_in.video.i_x_offset = p_enc->fmt_in.video.i_y_offset = 0;
+
+    /* Keep the display aspect ratio of the main rendition */
+    vlc_ureduce( &p_enc->fmt_out.video.i_sar_num,
+                 &p_enc->fmt_out.video.i_sar_den,
+                 (uint64_t)p_vmain->i_sar_num * p_vmain->i_width * p_rung->i_height,
+                 (uint64_t)p_vmain->i_sar_den * p_vmain->i_height * p_rung->i_width,
+                 0 );
+    p_enc->fmt_in.video.i_sar_num = p_enc->fmt_out.video.i_sar_num;
+    p_enc->fmt_in.video.i_sar_den = p_enc->fmt_out.video.i_sar_den;
+
+    if( p_rung->i_bitrate > 0 )
+        p_enc->fmt_out.i_bitrate = p_rung->i_bitrate;
+    else
+        p_enc->fmt_out.i_bitrate = (uint64_t)p_main->fmt_out.i_bitrate *
+            p_rung->i_width * p_rung->i_height /
+            ( p_vmain->i_width * p_vmain->i_height );
+
+    p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+    p_enc->i_threads = p_sys->i_threads;
+    p_enc->p_cfg = p_sys->p_video_cfg;
+
+    p_enc->p_module = module_need( p_enc, "encoder", p_sys->psz_venc, true );
+    if( !p_enc->p_module )
+    {
+        msg_Err( p_stream, "cannot open the encoder of %s", p_rend->psz_name );
+        return VLC_EGENERIC;
+    }
+    p_enc->fmt_in.video.i_chroma = p_enc->fmt_in.i_codec;
+    p_enc->fmt_out.i_codec = vlc_fourcc_GetCodec( VIDEO_ES,
+                                                  p_enc->fmt_out.i_codec );
+    return VLC_SUCCESS;
+}
+
+/**
+ * Opens the encoders of the renditions once the main one is opened.
+ * Renditions that cannot be encoded are skipped.
+ */
+void transcode_ladder_Open( sout_stream_t *p_stream,
+                            transcode_ladder_t *p_ladder,
+                            const encoder_t *p_main )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    for( int i = 0; i < p_ladder->i_renditions; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+
+        p_rend->b_open = OpenRendition( p_stream, p_rend, &p_sys->p_ladder[i],
+                                        p_main ) == VLC_SUCCESS;
+
+        if( p_rend->p_pipeline )
+        {
+            /* the input thread will add the stream */
+            if( p_rend->b_open )
+                transcode_pipeline_Start( p_rend->p_pipeline,
+                                          &p_rend->p_encoder->fmt_out );
+            else
+                transcode_pipeline_Fail( p_rend->p_pipeline );
+        }
+        else if( p_rend->b_open )
+        {
+            p_rend->id = sout_StreamIdAdd( p_stream->p_next,
+                                           &p_rend->p_encoder->fmt_out );
+            if( !p_rend->id )
+                msg_Err( p_stream, "cannot add %s", p_rend->psz_name );
+        }
+    }
+
+    BuildScalers( p_stream, p_ladder, &p_main->fmt_in );
+}
+
+/**
+ * Rebuilds the scalers after the format of the main encoder changed.
+ */
+void transcode_ladder_Reset( sout_stream_t *p_stream,
+                             transcode_ladder_t *p_ladder,
+                             const encoder_t *p_main )
+{
+    BuildScalers( p_stream, p_ladder, &p_main->fmt_in );
+}
+
+/**
+ * Scales and encodes a picture of the main rendition for every other
+ * rendition. The picture is not released.
+ */
+void transcode_ladder_Encode( transcode_ladder_t *p_ladder, picture_t *p_pic )
+{
+    picture_t *p_src = picture_Hold( p_pic );
+    mtime_t i_date = p_pic->date;
+
+    for( int i = 0; i < p_ladder->i_renditions && p_src; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+
+        if( !p_rend->b_open || !p_rend->p_scale )
+            continue;
+
+        picture_t *p_scaled = filter_chain_VideoFilter( p_rend->p_scale,
+                                                        p_src );
+        p_src = NULL;
+        if( p_scaled == NULL )
+            break;
+        p_scaled->date = i_date;
+
+        /* the next rendition is scaled from this one */
+        if( i + 1 < p_ladder->i_renditions )
+            p_src = picture_Hold( p_scaled );
+
+        if( p_rend->p_pipeline )
+            transcode_pipeline_Push( p_rend->p_pipeline, 0, p_scaled );
+        else
+        {
+            block_ChainAppend( &p_rend->p_out,
+                p_rend->p_encoder->pf_encode_video( p_rend->p_encoder,
+                                                    p_scaled ) );
+            picture_Release( p_scaled );
+        }
+    }
+
+    if( p_src )
+        picture_Release( p_src );
+}
+
+static void SendRendition( sout_stream_t *p_stream, rendition_t *p_rend,
+                           block_t *p_out )
+{
+    if( p_rend->p_pipeline )
+    {
+        block_t *p_chain;
+        int i_state = transcode_pipeline_Fetch( p_rend->p_pipeline, &p_chain );
+
+        if( i_state == TRANSCODE_PIPELINE_RUNNING && !p_rend->id )
+        {
+            p_rend->id = sout_StreamIdAdd( p_stream->p_next,
+                            transcode_pipeline_GetFormat( p_rend->p_pipeline ) );
+            if( !p_rend->id )
+            {
+                msg_Err( p_stream, "cannot add %s", p_rend->psz_name );
+                transcode_pipeline_Fail( p_rend->p_pipeline );
+            }
+        }
+        transcode_pipeline_Report( p_rend->p_pipeline, false );
+        block_ChainAppend( &p_chain, p_out );
+        p_out = p_chain;
+    }
+    else
+    {
+        block_ChainAppend( &p_rend->p_out, p_out );
+        p_out = p_rend->p_out;
+        p_rend->p_out = NULL;
+    }
+
+    if( p_out == NULL )
+        return;
+    if( p_rend->id )
+        sout_StreamIdSend( p_stream->p_next, p_rend->id, p_out );
+    else
+        block_ChainRelease( p_out );
+}
+
+/**
+ * Sends the encoded renditions. Must be called from the input thread.
+ */
+void transcode_ladder_Send( sout_stream_t *p_stream,
+                            transcode_ladder_t *p_ladder )
+{
+    for( int i = 0; i < p_ladder->i_renditions; i++ )
+        SendRendition( p_stream, &p_ladder->renditions[i], NULL );
+}
+
+/**
+ * Flushes the encoders at the end of the stream, once the main pipeline
+ * is drained.
+ */
+void transcode_ladder_Flush( sout_stream_t *p_stream,
+                             transcode_ladder_t *p_ladder )
+{
+    for( int i = 0; i < p_ladder->i_renditions; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+        block_t *p_out = NULL, *p_block;
+
+        if( p_rend->p_pipeline )
+            transcode_pipeline_Drain( p_rend->p_pipeline, 0 );
+        if( p_rend->b_open )
+        {
+            do {
+                p_block = p_rend->p_encoder->pf_encode_video( p_rend->p_encoder,
+                                                              NULL );
+                block_ChainAppend( &p_out, p_block );
+            } while( p_block );
+        }
+        SendRendition( p_stream, p_rend, p_out );
+    }
+}
+
+void transcode_ladder_Delete( sout_stream_t *p_stream,
+                              transcode_ladder_t *p_ladder )
+{
+    for( int i = 0; i < p_ladder->i_renditions; i++ )
+    {
+        rendition_t *p_rend = &p_ladder->renditions[i];
+
+        if( p_rend->p_pipeline )
+            transcode_pipeline_Delete( p_rend->p_pipeline );
+        if( p_rend->id )
+            sout_StreamIdDel( p_stream->p_next, p_rend->id );
+        if( p_rend->p_scale )
+            filter_chain_Delete( p_rend->p_scale );
+        block_ChainRelease( p_rend->p_out );
+
+        if( p_rend->p_encoder->p_module )
+            module_unneed( p_rend->p_encoder, p_rend->p_encoder->p_module );
+        es_format_Clean( &p_rend->p_encoder->fmt_in );
+        es_format_Clean( &p_rend->p_encoder->fmt_out );
+        vlc_object_release( p_rend->p_encoder );
+    }
+    free( p_ladder );
+}
@@ -0,0 +1,454 @@
+/*****************************************************************************
+ * pipeline.c: transcoding stream output module (threaded stages)
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#include "transcode.h"
+
+#include <assert.h>
+
+/* Interval between two statistics reports */
+#define PIPELINE_REPORT_INTERVAL (INT64_C(10) * CLOCK_FREQ)
+
+typedef struct
+{
+    void    *p_item;
+    mtime_t i_date;     /* date it was queued */
+} stage_item_t;
+
+typedef struct
+{
+    unsigned i_items;
+    unsigned i_stalls;     /* times the producer waited for room */
+    mtime_t  i_stalled;    /* time the producer waited for room */
+    unsigned i_depth_max;
+    uint64_t i_depth_sum;  /* queue depth seen by each new item */
+    mtime_t  i_wait;       /* time spent by the items in the queue */
+    mtime_t  i_busy;       /* time spent processing the items */
+} stage_stats_t;
+
+typedef struct
+{
+    transcode_pipeline_t *p_pipeline;
+    const char           *psz_name;
+    transcode_stage_cb    pf_process;
+    void                (*pf_release)( void * );
+
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;   /* an item was queued */
+    vlc_cond_t      room;   /* an item was dequeued */
+    vlc_cond_t      idle;   /* the queue is empty and nothing is processed */
+
+    stage_item_t   *p_items;
+    unsigned        i_size;
+    unsigned        i_first;
+    unsigned        i_count;
+    bool            b_busy;
+    bool            b_abort;
+
+    stage_stats_t   stats;
+} stage_t;
+
+struct transcode_pipeline_t
+{
+    sout_stream_t    *p_stream;
+    void             *p_opaque;
+    const char       *psz_name;
+
+    /* Encoded blocks waiting for the input thread to mux them */
+    vlc_mutex_t       lock;
+    block_t          *p_out;
+    block_t         **pp_out_last;
+    unsigned          i_out;
+    unsigned          i_out_max;
+    int               i_state;
+    es_format_t       fmt_out;  /* encoder output, set once running */
+
+    mtime_t           i_last_report;
+
+    int               i_stages;
+    stage_t           stages[];
+};
+
+static void *StageThread( void *data )
+{
+    stage_t *p_stage = data;
+    transcode_pipeline_t *p_pipeline = p_stage->p_pipeline;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_stage->lock );
+    for( ;; )
+    {
+        while( !p_stage->b_abort && p_stage->i_count == 0 )
+            vlc_cond_wait( &p_stage->wait, &p_stage->lock );
+        if( p_stage->b_abort )
+            break;
+
+        stage_item_t item = p_stage->p_items[p_stage->i_first];
+        p_stage->i_first = ( p_stage->i_first + 1 ) % p_stage->i_size;
+        p_stage->i_count--;
+        p_stage->b_busy = true;
+        vlc_cond_signal( &p_stage->room );
+        vlc_mutex_unlock( &p_stage->lock );
+
+        mtime_t i_start = mdate();
+        p_stage->pf_process( p_pipeline->p_stream, p_pipeline->p_opaque,
+                             item.p_item );
+        mtime_t i_end = mdate();
+
+        vlc_mutex_lock( &p_stage->lock );
+        p_stage->b_busy = false;
+        p_stage->stats.i_items++;
+        p_stage->stats.i_wait += i_start - item.i_date;
+        p_stage->stats.i_busy += i_end - i_start;
+        if( p_stage->i_count == 0 )
+            vlc_cond_broadcast( &p_stage->idle );
+    }
+    vlc_cond_broadcast( &p_stage->idle );
+    vlc_mutex_unlock( &p_stage->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/**
+ * Creates one thread per stage, each with a queue of i_depth items.
+ * A stage takes whatever the previous one pushes to it (the first one takes
+ * what the input thread pushes), and releases it with its pf_release if the
+ * pipeline is destroyed first.
+ */
+transcode_pipeline_t *transcode_pipeline_New( sout_stream_t *p_stream,
+                                              void *p_opaque,
+                                              const char *psz_name,
+                                              const transcode_stage_desc_t *p_desc,
+                                              int i_stages,
+                                              unsigned i_depth, int i_priority )
+{
+    transcode_pipeline_t *p_pipeline =
+        calloc( 1, sizeof( *p_pipeline ) + i_stages * sizeof( stage_t ) );
+    if( unlikely(p_pipeline == NULL) )
+        return NULL;
+
+    p_pipeline->p_stream = p_stream;
+    p_pipeline->p_opaque = p_opaque;
+    p_pipeline->psz_name = psz_name;
+    p_pipeline->i_stages = i_stages;
+    vlc_mutex_init( &p_pipeline->lock );
+    p_pipeline->pp_out_last = &p_pipeline->p_out;
+    p_pipeline->i_state = TRANSCODE_PIPELINE_STARTING;
+    p_pipeline->i_last_report = mdate();
+
+    int i_started;
+    for( i_started = 0; i_started < i_stages; i_started++ )
+    {
+        stage_t *p_stage = &p_pipeline->stages[i_started];
+
+        p_stage->p_pipeline = p_pipeline;
+        p_stage->psz_name = p_desc[i_started].psz_name;
+        p_stage->pf_process = p_desc[i_started].pf_process;
+        p_stage->pf_release = p_desc[i_started].pf_release;
+        p_stage->p_items = malloc( i_depth * sizeof( *p_stage->p_items ) );
+        if( unlikely(p_stage->p_items == NULL) )
+            break;
+        p_stage->i_size = i_depth;
+        vlc_mutex_init( &p_stage->lock );
+        vlc_cond_init( &p_stage->wait );
+        vlc_cond_init( &p_stage->room );
+        vlc_cond_init( &p_stage->idle );
+
+        if( vlc_clone( &p_stage->thread, StageThread, p_stage, i_priority ) )
+        {
+            vlc_cond_destroy( &p_stage->idle );
+            vlc_cond_destroy( &p_stage->room );
+            vlc_cond_destroy( &p_stage->wait );
+            vlc_mutex_destroy( &p_stage->lock );
+            free( p_stage->p_items );
+            break;
+        }
+    }
+
+    if( i_started < i_stages )
+    {
+        msg_Err( p_stream, "cannot spawn %s transcoding threads", psz_name );
+        while( i_started-- > 0 )
+        {
+            stage_t *p_stage = &p_pipeline->stages[i_started];
+
+            vlc_mutex_lock( &p_stage->lock );
+            p_stage->b_abort = true;
+            vlc_cond_signal( &p_stage->wait );
+            vlc_mutex_unlock( &p_stage->lock );
+            vlc_join( p_stage->thread, NULL );
+
+            vlc_cond_destroy( &p_stage->idle );
+            vlc_cond_destroy( &p_stage->room );
+            vlc_cond_destroy( &p_stage->wait );
+            vlc_mutex_destroy( &p_stage->lock );
+            free( p_stage->p_items );
+        }
+        vlc_mutex_destroy( &p_pipeline->lock );
+        free( p_pipeline );
+        return NULL;
+    }
+
+    msg_Dbg( p_stream, "%s transcoding pipeline started (%u items per queue)",
+             psz_name, i_depth );
+    return p_pipeline;
+}
+
+void transcode_pipeline_Delete( transcode_pipeline_t *p_pipeline )
+{
+    /* Abort every stage first: a stage may be waiting for room downstream */
+    for( int i = 0; i < p_pipeline->i_stages; i++ )
+    {
+        stage_t *p_stage = &p_pipeline->stages[i];
+
+        vlc_mutex_lock( &p_stage->lock );
+        p_stage->b_abort = true;
+        vlc_cond_signal( &p_stage->wait );
+        vlc_cond_broadcast( &p_stage->room );
+        vlc_cond_broadcast( &p_stage->idle );
+        vlc_mutex_unlock( &p_stage->lock );
+    }
+
+    for( int i = 0; i < p_pipeline->i_stages; i++ )
+        vlc_join( p_pipeline->stages[i].thread, NULL );
+
+    transcode_pipeline_Report( p_pipeline, true );
+
+    for( int i = 0; i < p_pipeline->i_stages; i++ )
+    {
+        stage_t *p_stage = &p_pipeline->stages[i];
+
+        for( unsigned j = 0; j < p_stage->i_count; j++ )
+            p_stage->pf_release(
+                p_stage->p_items[(p_stage->i_first + j) % p_stage->i_size].p_item );
+
+        vlc_cond_destroy( &p_stage->idle );
+        vlc_cond_destroy( &p_stage->room );
+        vlc_cond_destroy( &p_stage->wait );
+        vlc_mutex_destroy( &p_stage->lock );
+        free( p_stage->p_items );
+    }
+
+    block_ChainRelease( p_pipeline->p_out );
+    if( p_pipeline->i_state == TRANSCODE_PIPELINE_RUNNING )
+        es_format_Clean( &p_pipeline->fmt_out );
+    vlc_mutex_destroy( &p_pipeline->lock );
+    free( p_pipeline );
+}
+
+/**
+ * Queues an item for a stage, waiting for room if the queue is full.
+ * The item is released if the pipeline is being destroyed.
+ */
+void transcode_pipeline_Push( transcode_pipeline_t *p_pipeline, int i_stage,
+                              void *p_item )
+{
+    stage_t *p_stage = &p_pipeline->stages[i_stage];
+
+    vlc_mutex_lock( &p_stage->lock );
+    if( p_stage->i_count >= p_stage->i_size && !p_stage->b_abort )
+    {
+        mtime_t i_start = mdate();
+
+        do
+            vlc_cond_wait( &p_stage->room, &p_stage->lock );
+        while( p_stage->i_count >= p_stage->i_size && !p_stage->b_abort );
+        p_stage->stats.i_stalls++;
+        p_stage->stats.i_stalled += mdate() - i_start;
+    }
+
+    if( p_stage->b_abort )
+    {
+        vlc_mutex_unlock( &p_stage->lock );
+        p_stage->pf_release( p_item );
+        return;
+    }
+
+    stage_item_t *p_slot = &p_stage->p_items[
+        (p_stage->i_first + p_stage->i_count) % p_stage->i_size];
+    p_slot->p_item = p_item;
+    p_slot->i_date = mdate();
+    p_stage->i_count++;
+    p_stage->stats.i_depth_sum += p_stage->i_count;
+    if( p_stage->i_count > p_stage->stats.i_depth_max )
+        p_stage->stats.i_depth_max = p_stage->i_count;
+    vlc_cond_signal( &p_stage->wait );
+    vlc_mutex_unlock( &p_stage->lock );
+}
+
+/**
+ * Waits until the given stage and the following ones have processed
+ * everything queued to them. Stages only ever wait for the following
+ * ones, so a stage can drain the rest of the pipeline.
+ */
+void transcode_pipeline_Drain( transcode_pipeline_t *p_pipeline, int i_stage )
+{
+    for( int i = i_stage; i < p_pipeline->i_stages; i++ )
+    {
+        stage_t *p_stage = &p_pipeline->stages[i];
+
+        vlc_mutex_lock( &p_stage->lock );
+        while( ( p_stage->i_count > 0 || p_stage->b_busy ) &&
+               !p_stage->b_abort )
+            vlc_cond_wait( &p_stage->idle, &p_stage->lock );
+        vlc_mutex_unlock( &p_stage->lock );
+    }
+}
+
+/**
+ * Hands encoded blocks over to the input thread.
+ */
+void transcode_pipeline_Output( transcode_pipeline_t *p_pipeline,
+                                block_t *p_block )
+{
+    if( p_block == NULL )
+        return;
+
+    vlc_mutex_lock( &p_pipeline->lock );
+    for( block_t *p = p_block; p != NULL; p = p->p_next )
+        p_pipeline->i_out++;
+    if( p_pipeline->i_out > p_pipeline->i_out_max )
+        p_pipeline->i_out_max = p_pipeline->i_out;
+    block_ChainLastAppend( &p_pipeline->pp_out_last, p_block );
+    vlc_mutex_unlock( &p_pipeline->lock );
+}
+
+/**
+ * Takes the encoded blocks to be muxed.
+ * @return the state of the pipeline (TRANSCODE_PIPELINE_*)
+ */
+int transcode_pipeline_Fetch( transcode_pipeline_t *p_pipeline,
+                              block_t **pp_out )
+{
+    vlc_mutex_lock( &p_pipeline->lock );
+    int i_state = p_pipeline->i_state;
+    *pp_out = p_pipeline->p_out;
+    p_pipeline->p_out = NULL;
+    p_pipeline->pp_out_last = &p_pipeline->p_out;
+    p_pipeline->i_out = 0;
+    vlc_mutex_unlock( &p_pipeline->lock );
+
+    return i_state;
+}
+
+/**
+ * Signals that the encoder is ready. The output format is copied, as the
+ * stages may change the encoder format while the input thread uses it.
+ */
+void transcode_pipeline_Start( transcode_pipeline_t *p_pipeline,
+                               const es_format_t *p_fmt_out )
+{
+    vlc_mutex_lock( &p_pipeline->lock );
+    assert( p_pipeline->i_state == TRANSCODE_PIPELINE_STARTING );
+    es_format_Copy( &p_pipeline->fmt_out, p_fmt_out );
+    p_pipeline->i_state = TRANSCODE_PIPELINE_RUNNING;
+    vlc_mutex_unlock( &p_pipeline->lock );
+}
+
+/**
+ * Signals that the stream cannot be transcoded. The stages should drop
+ * their input from then on.
+ */
+void transcode_pipeline_Fail( transcode_pipeline_t *p_pipeline )
+{
+    vlc_mutex_lock( &p_pipeline->lock );
+    if( p_pipeline->i_state == TRANSCODE_PIPELINE_RUNNING )
+        es_format_Clean( &p_pipeline->fmt_out );
+    p_pipeline->i_state = TRANSCODE_PIPELINE_FAILED;
+    vlc_mutex_unlock( &p_pipeline->lock );
+}
+
+/**
+ * Returns the output format given to transcode_pipeline_Start().
+ * Only valid once Fetch() returned TRANSCODE_PIPELINE_RUNNING.
+ */
+es_format_t *transcode_pipeline_GetFormat( transcode_pipeline_t *p_pipeline )
+{
+    return &p_pipeline->fmt_out;
+}
+
+int transcode_pipeline_GetState( transcode_pipeline_t *p_pipeline )
+{
+    vlc_mutex_lock( &p_pipeline->lock );
+    int i_state = p_pipeline->i_state;
+    vlc_mutex_unlock( &p_pipeline->lock );
+
+    return i_state;
+}
+
+/**
+ * Logs the latency and queue depth of each stage since the last report.
+ * The stage with the highest load limits the throughput of the stream.
+ */
+void transcode_pipeline_Report( transcode_pipeline_t *p_pipeline,
+                                bool b_force )
+{
+    mtime_t i_now = mdate();
+    mtime_t i_interval = i_now - p_pipeline->i_last_report;
+
+    if( !b_force && i_interval < PIPELINE_REPORT_INTERVAL )
+        return;
+    if( i_interval <= 0 )
+        i_interval = 1;
+    p_pipeline->i_last_report = i_now;
+
+    stage_stats_t stats[p_pipeline->i_stages];
+    for( int i = 0; i < p_pipeline->i_stages; i++ )
+    {
+        stage_t *p_stage = &p_pipeline->stages[i];
+
+        vlc_mutex_lock( &p_stage->lock );
+        stats[i] = p_stage->stats;
+        memset( &p_stage->stats, 0, sizeof( p_stage->stats ) );
+        vlc_mutex_unlock( &p_stage->lock );
+    }
+
+    for( int i = 0; i < p_pipeline->i_stages; i++ )
+    {
+        /* Do not count the time spent waiting for the next stage */
+        mtime_t i_work = stats[i].i_busy;
+        if( i + 1 < p_pipeline->i_stages )
+            i_work -= stats[i + 1].i_stalled;
+
+        unsigned i_items = __MAX( stats[i].i_items, 1 );
+        msg_Dbg( p_pipeline->p_stream, "%s %s: %u items, load %.0f%%, "
+                 "%.2f ms queued, %.2f ms processing, depth %.1f avg %u max "
+                 "(%u items), %u stalls", p_pipeline->psz_name,
+                 p_pipeline->stages[i].psz_name, stats[i].i_items,
+                 100. * i_work / i_interval,
+                 stats[i].i_wait / 1000. / i_items,
+                 i_work / 1000. / i_items,
+                 (double)stats[i].i_depth_sum / i_items, stats[i].i_depth_max,
+                 p_pipeline->stages[i].i_size, stats[i].i_stalls );
+    }
+
+    vlc_mutex_lock( &p_pipeline->lock );
+    unsigned i_out_max = p_pipeline->i_out_max;
+    p_pipeline->i_out_max = 0;
+    vlc_mutex_unlock( &p_pipeline->lock );
+
+    msg_Dbg( p_pipeline->p_stream, "%s mux: up to %u blocks waiting",
+             p_pipeline->psz_name, i_out_max );
+}
@@ -75,6 +75,12 @@
 #define MAXHEIGHT_TEXT N_("Maximum video height")
 #define MAXHEIGHT_LONGTEXT N_( \
     "Maximum output video height." )
+#define LADDER_TEXT N_("Video renditions")
+#define LADDER_LONGTEXT N_( \
+    "Comma-separated list of additional video renditions to encode from " \
+    "the same decoded pictures (eg: 1280x720@3000,640x360@800 for the " \
+    "width, height and bitrate in kb/s). Each rendition is output as " \
+    "another stream, with an id from a range the input streams do not use." )
 #define VFILTER_TEXT N_("Video filter")
 #define VFILTER_LONGTEXT N_( \
     "Video filters will be applied to the video streams (after overlays " \
@@ -125,11 +131,12 @@
 
 #define THREADS_TEXT N_("Number of threads")
 #define THREADS_LONGTEXT N_( \
-    "Number of threads used for the transcoding." )
+    "Number of threads used for the transcoding. If set, the audio and " \
+    "video tracks are decoded, filtered and encoded by separate threads." )
 #define HP_TEXT N_("High priority")
 #define HP_LONGTEXT N_( \
-    "Runs the optional encoder thread at the OUTPUT priority instead of " \
-    "VIDEO." )
+    "Runs the optional video transcoding threads at the OUTPUT priority " \
+    "instead of VIDEO." )
 
 #define ASYNC_TEXT N_("Synchronise on audio track")
 #define ASYNC_LONGTEXT N_( \
@@ -187,6 +194,8 @@ vlc_module_begin ()
                  MAXHEIGHT_LONGTEXT, true )
     add_module_list( SOUT_CFG_PREFIX "vfilter", "video filter2",
                      NULL, VFILTER_TEXT, VFILTER_LONGTEXT, false )
+    add_string( SOUT_CFG_PREFIX "ladder", NULL, LADDER_TEXT,
+                LADDER_LONGTEXT, true )
 
     set_section( N_("Audio"), NULL )
     add_module( SOUT_CFG_PREFIX "aenc", "encoder", NULL, AENC_TEXT,
@@ -234,7 +243,7 @@ static const char *const ppsz_sout_options[] = {
     "deinterlace-module", "threads", "hurry-up", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
     "sfilter", "osd", "audio-sync", "high-priority", "maxwidth", "maxheight",
-    NULL
+    "ladder", NULL
 };
 
 /*****************************************************************************
@@ -260,6 +269,8 @@ static int Open( vlc_object_t *p_this )
     }
     p_sys = calloc( 1, sizeof( *p_sys ) );
     p_sys->i_master_drift = 0;
+    p_sys->i_ladder_id = TRANSCODE_LADDER_ID;
+    vlc_mutex_init( &p_sys->lock_sync );
 
     config_ChainParse( p_stream, SOUT_CFG_PREFIX, ppsz_sout_options,
                    p_stream->p_cfg );
@@ -365,6 +376,11 @@ static int Open( vlc_object_t *p_this )
         p_sys->psz_vf2 = NULL;
     free( psz_string );
 
+    psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "ladder" );
+    if( psz_string && *psz_string )
+        transcode_ladder_Parse( p_stream, p_sys, psz_string );
+    free( psz_string );
+
     p_sys->b_deinterlace = var_GetBool( p_stream, SOUT_CFG_PREFIX "deinterlace" );
 
     psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "deinterlace-module" );
@@ -489,6 +505,7 @@ static void Close( vlc_object_t * p_this )
     free( p_sys->psz_alang );
 
     free( p_sys->psz_vf2 );
+    free( p_sys->p_ladder );
 
     config_ChainDestroy( p_sys->p_video_cfg );
     free( p_sys->psz_venc );
@@ -505,6 +522,7 @@ static void Close( vlc_object_t * p_this )
     config_ChainDestroy( p_sys->p_osd_cfg );
     free( p_sys->psz_osdenc );
 
+    vlc_mutex_destroy( &p_sys->lock_sync );
     free( p_sys );
 }
 
@@ -513,6 +531,11 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     sout_stream_sys_t *p_sys = p_stream->p_sys;
     sout_stream_id_t *id;
 
+    /* Renditions get ids of their own range, skip the input ones in it
+     * (renditions of a previous transcode) */
+    if( p_fmt->i_id >= p_sys->i_ladder_id )
+        p_sys->i_ladder_id = p_fmt->i_id + 1;
+
     id = calloc( 1, sizeof( sout_stream_id_t ) );
     if( !id )
         goto error;
@@ -651,6 +674,14 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
         return VLC_EGENERIC;
     }
 
+    /* The decoders may modify the data in place (NULL flushes them) */
+    if( p_buffer != NULL )
+    {
+        p_buffer = block_ChainUnshare( p_buffer );
+        if( unlikely(p_buffer == NULL) )
+            return VLC_ENOMEM;
+    }
+
     switch( id->p_decoder->fmt_in.i_cat )
     {
     case AUDIO_ES:
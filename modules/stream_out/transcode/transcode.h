@@ -9,20 +9,28 @@
 #include <vlc_es.h>
 #include <vlc_codec.h>
 
-#include <vlc_picture_fifo.h>
-
 #define MASTER_SYNC_MAX_DRIFT 100000
 
-struct sout_stream_sys_t
+/* Queue depths between the stages of the threaded pipelines */
+#define TRANSCODE_VIDEO_QUEUE 8
+#define TRANSCODE_AUDIO_QUEUE 32
+
+/* First ES id of the video renditions, out of the range of the demuxers */
+#define TRANSCODE_LADDER_ID 0x10000000
+
+typedef struct transcode_pipeline_t transcode_pipeline_t;
+typedef struct transcode_ladder_t transcode_ladder_t;
+
+/* Additional video rendition */
+typedef struct
 {
-    sout_stream_id_t *id_video;
-    block_t         *p_buffers;
-    vlc_mutex_t     lock_out;
-    vlc_cond_t      cond;
-    bool            b_abort;
-    picture_fifo_t *pp_pics;
-    vlc_thread_t    thread;
+    unsigned        i_width;
+    unsigned        i_height;
+    int             i_bitrate;
+} transcode_rung_t;
 
+struct sout_stream_sys_t
+{
     /* Audio */
     vlc_fourcc_t    i_acodec;   /* codec audio (0 if not transcode) */
     char            *psz_aenc;
@@ -53,6 +61,10 @@ struct sout_stream_sys_t
 
     char            *psz_vf2;
 
+    transcode_rung_t *p_ladder; /* sorted by decreasing size */
+    int             i_ladder;
+    int             i_ladder_id; /* next rendition ES id */
+
     /* SPU */
     vlc_fourcc_t    i_scodec;   /* codec spu (0 if not transcode) */
     char            *psz_senc;
@@ -69,6 +81,7 @@ struct sout_stream_sys_t
 
     /* Sync */
     bool            b_master_sync;
+    vlc_mutex_t     lock_sync;  /* the audio and video threads use the drift */
     mtime_t         i_master_drift;
 };
 
@@ -99,8 +112,59 @@ struct sout_stream_id_t
 
     /* Sync */
     date_t          interpolated_pts;
+
+    /* Threaded decode/filter/encode stages (NULL if threads=0) */
+    transcode_pipeline_t *p_pipeline;
+
+    /* Other video renditions (NULL if none) */
+    transcode_ladder_t   *p_ladder;
 };
 
+/* PIPELINE */
+
+enum
+{
+    TRANSCODE_STAGE_DECODE,
+    TRANSCODE_STAGE_FILTER,
+    TRANSCODE_STAGE_ENCODE,
+    TRANSCODE_STAGE_COUNT
+};
+
+enum
+{
+    TRANSCODE_PIPELINE_STARTING, /* the output is not known yet */
+    TRANSCODE_PIPELINE_RUNNING,
+    TRANSCODE_PIPELINE_FAILED,
+};
+
+typedef void (*transcode_stage_cb)( sout_stream_t *, void *p_opaque,
+                                    void *p_item );
+
+typedef struct
+{
+    const char        *psz_name;
+    transcode_stage_cb pf_process;
+    void             (*pf_release)( void * );
+} transcode_stage_desc_t;
+
+transcode_pipeline_t *transcode_pipeline_New( sout_stream_t *,
+                                              void *p_opaque,
+                                              const char *psz_name,
+                                              const transcode_stage_desc_t *,
+                                              int i_stages,
+                                              unsigned i_depth,
+                                              int i_priority );
+void transcode_pipeline_Delete  ( transcode_pipeline_t * );
+void transcode_pipeline_Push    ( transcode_pipeline_t *, int, void * );
+void transcode_pipeline_Drain   ( transcode_pipeline_t *, int );
+void transcode_pipeline_Output  ( transcode_pipeline_t *, block_t * );
+int  transcode_pipeline_Fetch   ( transcode_pipeline_t *, block_t ** );
+void transcode_pipeline_Start   ( transcode_pipeline_t *, const es_format_t * );
+void transcode_pipeline_Fail    ( transcode_pipeline_t * );
+int  transcode_pipeline_GetState( transcode_pipeline_t * );
+es_format_t *transcode_pipeline_GetFormat( transcode_pipeline_t * );
+void transcode_pipeline_Report  ( transcode_pipeline_t *, bool );
+
 /* OSD */
 
 int transcode_osd_new( sout_stream_t *p_stream, sout_stream_id_t *id );
@@ -134,3 +198,19 @@ int  transcode_video_process( sout_stream_t *, sout_stream_id_t *,
                                      block_t *, block_t ** );
 bool transcode_video_add    ( sout_stream_t *, es_format_t *,
                                 sout_stream_id_t *);
+int  transcode_video_filter_allocation_init( filter_t *, void * );
+void transcode_video_filter_allocation_clear( filter_t * );
+
+/* LADDER */
+
+int  transcode_ladder_Parse ( sout_stream_t *, sout_stream_sys_t *,
+                              const char * );
+transcode_ladder_t *transcode_ladder_New( sout_stream_t * );
+void transcode_ladder_Open  ( sout_stream_t *, transcode_ladder_t *,
+                              const encoder_t * );
+void transcode_ladder_Reset ( sout_stream_t *, transcode_ladder_t *,
+                              const encoder_t * );
+void transcode_ladder_Encode( transcode_ladder_t *, picture_t * );
+void transcode_ladder_Send  ( sout_stream_t *, transcode_ladder_t * );
+void transcode_ladder_Flush ( sout_stream_t *, transcode_ladder_t * );
+void transcode_ladder_Delete( sout_stream_t *, transcode_ladder_t * );
@@ -83,8 +83,8 @@ static void transcode_video_filter_buffer_del( filter_t *p_filter, picture_t *p_
     picture_Release( p_pic );
 }
 
-static int transcode_video_filter_allocation_init( filter_t *p_filter,
-                                                   void *p_data )
+int transcode_video_filter_allocation_init( filter_t *p_filter,
+                                            void *p_data )
 {
     VLC_UNUSED(p_data);
     p_filter->pf_video_buffer_new = transcode_video_filter_buffer_new;
@@ -92,49 +92,11 @@ static int transcode_video_filter_allocation_init( filter_t *p_filter,
     return VLC_SUCCESS;
 }
 
-static void transcode_video_filter_allocation_clear( filter_t *p_filter )
+void transcode_video_filter_allocation_clear( filter_t *p_filter )
 {
     VLC_UNUSED(p_filter);
 }
 
-static void* EncoderThread( void *obj )
-{
-    sout_stream_sys_t *p_sys = (sout_stream_sys_t*)obj;
-    sout_stream_id_t *id = p_sys->id_video;
-    picture_t *p_pic;
-    int canc = vlc_savecancel ();
-
-    for( ;; )
-    {
-        block_t *p_block;
-
-        vlc_mutex_lock( &p_sys->lock_out );
-        while( !p_sys->b_abort &&
-               (p_pic = picture_fifo_Pop( p_sys->pp_pics )) == NULL )
-            vlc_cond_wait( &p_sys->cond, &p_sys->lock_out );
-
-        if( p_sys->b_abort )
-        {
-            vlc_mutex_unlock( &p_sys->lock_out );
-            break;
-        }
-        vlc_mutex_unlock( &p_sys->lock_out );
-
-        p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
-
-        vlc_mutex_lock( &p_sys->lock_out );
-        block_ChainAppend( &p_sys->p_buffers, p_block );
-
-        vlc_mutex_unlock( &p_sys->lock_out );
-        picture_Release( p_pic );
-    }
-
-    block_ChainRelease( p_sys->p_buffers );
-
-    vlc_restorecancel (canc);
-    return NULL;
-}
-
 int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_t *id )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
@@ -223,38 +185,6 @@ int transcode_video_new( sout_stream_t *p_stream, sout_stream_id_t *id )
     }
     id->p_encoder->p_module = NULL;
 
-    if( p_sys->i_threads >= 1 )
-    {
-        int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
-                           VLC_THREAD_PRIORITY_VIDEO;
-        p_sys->id_video = id;
-        vlc_mutex_init( &p_sys->lock_out );
-        vlc_cond_init( &p_sys->cond );
-        p_sys->pp_pics = picture_fifo_New();
-        if( p_sys->pp_pics == NULL )
-        {
-            msg_Err( p_stream, "cannot create picture fifo" );
-            vlc_mutex_destroy( &p_sys->lock_out );
-            vlc_cond_destroy( &p_sys->cond );
-            module_unneed( id->p_decoder, id->p_decoder->p_module );
-            id->p_decoder->p_module = NULL;
-            free( id->p_decoder->p_owner );
-            return VLC_ENOMEM;
-        }
-        p_sys->p_buffers = NULL;
-        p_sys->b_abort = false;
-        if( vlc_clone( &p_sys->thread, EncoderThread, p_sys, i_priority ) )
-        {
-            msg_Err( p_stream, "cannot spawn encoder thread" );
-            vlc_mutex_destroy( &p_sys->lock_out );
-            vlc_cond_destroy( &p_sys->cond );
-            picture_fifo_Delete( p_sys->pp_pics );
-            module_unneed( id->p_decoder, id->p_decoder->p_module );
-            id->p_decoder->p_module = NULL;
-            free( id->p_decoder->p_owner );
-            return VLC_EGENERIC;
-        }
-    }
     return VLC_SUCCESS;
 }
 
@@ -540,6 +470,10 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
     id->p_encoder->fmt_out.i_codec =
         vlc_fourcc_GetCodec( VIDEO_ES, id->p_encoder->fmt_out.i_codec );
 
+    /* The input thread adds the stream when the decoding is threaded */
+    if( id->p_pipeline )
+        return VLC_SUCCESS;
+
     id->id = sout_StreamIdAdd( p_stream->p_next, &id->p_encoder->fmt_out );
     if( !id->id )
     {
@@ -553,19 +487,15 @@ static int transcode_video_encoder_open( sout_stream_t *p_stream,
 void transcode_video_close( sout_stream_t *p_stream,
                                    sout_stream_id_t *id )
 {
-    if( p_stream->p_sys->i_threads >= 1 )
+    if( id->p_pipeline )
     {
-        vlc_mutex_lock( &p_stream->p_sys->lock_out );
-        p_stream->p_sys->b_abort = true;
-        vlc_cond_signal( &p_stream->p_sys->cond );
-        vlc_mutex_unlock( &p_stream->p_sys->lock_out );
-
-        vlc_join( p_stream->p_sys->thread, NULL );
-        vlc_mutex_destroy( &p_stream->p_sys->lock_out );
-        vlc_cond_destroy( &p_stream->p_sys->cond );
-
-        picture_fifo_Delete( p_stream->p_sys->pp_pics );
-        p_stream->p_sys->pp_pics = NULL;
+        transcode_pipeline_Delete( id->p_pipeline );
+        id->p_pipeline = NULL;
+    }
+    if( id->p_ladder )
+    {
+        transcode_ladder_Delete( p_stream, id->p_ladder );
+        id->p_ladder = NULL;
     }
 
     /* Close decoder */
@@ -587,9 +517,34 @@ void transcode_video_close( sout_stream_t *p_stream,
         filter_chain_Delete( id->p_uf_chain );
 }
 
+/* The following functions run either on the input thread (out is then set)
+ * or on the pipeline thread of their stage (out is NULL) */
+static void EncodeVideo( sout_stream_id_t *id, picture_t *p_pic,
+                         block_t **out )
+{
+    block_t *p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
+
+    if( id->p_pipeline )
+        transcode_pipeline_Output( id->p_pipeline, p_block );
+    else
+        block_ChainAppend( out, p_block );
+    picture_Release( p_pic );
+}
+
+static void SendToEncoder( sout_stream_id_t *id, picture_t *p_pic,
+                           block_t **out )
+{
+    if( id->p_pipeline )
+        transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_ENCODE,
+                                 p_pic );
+    else
+        EncodeVideo( id, p_pic, out );
+}
+
 static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need_duplicate, sout_stream_t *p_stream, sout_stream_id_t *id, block_t **out )
 {
     picture_t *p_pic2 = NULL;
+    mtime_t i_pts = VLC_TS_INVALID;
 
     /*
      * Encoding
@@ -633,17 +588,9 @@ static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need
         }
     }
 
-    if( p_sys->i_threads == 0 )
-    {
-        block_t *p_block;
-
-        p_block = id->p_encoder->pf_encode_video( id->p_encoder, p_pic );
-        block_ChainAppend( out, p_block );
-    }
-
     if( p_sys->b_master_sync )
     {
-        mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
+        i_pts = date_Get( &id->interpolated_pts ) + 1;
         mtime_t i_video_drift = p_pic->date - i_pts;
         if (unlikely ( i_video_drift  > MASTER_SYNC_MAX_DRIFT
               || i_video_drift < -MASTER_SYNC_MAX_DRIFT ) )
@@ -658,72 +605,117 @@ static void OutputFrame( sout_stream_sys_t *p_sys, picture_t *p_pic, bool b_need
 
         if( unlikely( b_need_duplicate ) )
         {
-
-           if( p_sys->i_threads >= 1 )
+           if( id->p_pipeline )
            {
-               /* We can't modify the picture, we need to duplicate it */
+               /* We can't modify the picture, the encoder thread owns it */
                p_pic2 = video_new_buffer_encoder( id->p_encoder );
                if( likely( p_pic2 != NULL ) )
-               {
                    picture_Copy( p_pic2, p_pic );
-                   p_pic2->date = i_pts;
-               }
            }
            else
-           {
-               block_t *p_block;
-               p_pic->date = i_pts;
-               p_block = id->p_encoder->pf_encode_video(id->p_encoder, p_pic);
-               block_ChainAppend( out, p_block );
-           }
+               p_pic2 = picture_Hold( p_pic );
        }
     }
 
-    if( p_sys->i_threads == 0 )
-    {
-        picture_Release( p_pic );
-    }
-    else
+    if( id->p_ladder )
+        transcode_ladder_Encode( id->p_ladder, p_pic );
+    SendToEncoder( id, p_pic, out );
+
+    if( p_pic2 != NULL )
     {
-        vlc_mutex_lock( &p_sys->lock_out );
-        picture_fifo_Push( p_sys->pp_pics, p_pic );
-        if( p_pic2 != NULL )
-        {
-            picture_fifo_Push( p_sys->pp_pics, p_pic2 );
-        }
-        vlc_cond_signal( &p_sys->cond );
-        vlc_mutex_unlock( &p_sys->lock_out );
+        p_pic2->date = i_pts;
+        if( id->p_ladder )
+            transcode_ladder_Encode( id->p_ladder, p_pic2 );
+        SendToEncoder( id, p_pic2, out );
     }
 }
 
-int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
-                                    block_t *in, block_t **out )
+static void FilterVideo( sout_stream_t *p_stream, sout_stream_id_t *id,
+                         picture_t *p_pic, block_t **out )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
     bool b_need_duplicate = false;
-    picture_t *p_pic;
-    *out = NULL;
 
-    if( unlikely( in == NULL ) )
+    if( p_sys->b_master_sync )
     {
-        if( p_sys->i_threads == 0 )
+        mtime_t i_master_drift;
+        mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
+        mtime_t i_video_drift = p_pic->date - i_pts;
+
+        vlc_mutex_lock( &p_sys->lock_sync );
+        i_master_drift = p_sys->i_master_drift;
+        vlc_mutex_unlock( &p_sys->lock_sync );
+
+        if ( unlikely( i_video_drift > MASTER_SYNC_MAX_DRIFT
+              || i_video_drift < -MASTER_SYNC_MAX_DRIFT ) )
         {
-            block_t *p_block;
-            do {
-                p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
-                block_ChainAppend( out, p_block );
-            } while( p_block );
+            msg_Dbg( p_stream,
+                "drift is too high (%"PRId64", resetting master sync",
+                i_video_drift );
+            date_Set( &id->interpolated_pts, p_pic->date );
+            i_pts = p_pic->date + 1;
         }
-        else
+        i_video_drift = p_pic->date - i_pts;
+
+        /* Set the pts of the frame being encoded */
+        p_pic->date = i_pts;
+
+        if( unlikely( i_video_drift < (i_master_drift - 50000) ) )
         {
-            /*
-             * FIXME: we need EncoderThread() to flush buffers and signal us
-             * when it's done so we can send the last frames to the chain
-             */
+#if 0
+            msg_Dbg( p_stream, "dropping frame (%i)",
+                     (int)(i_video_drift - i_master_drift) );
+#endif
+            picture_Release( p_pic );
+            return;
         }
-        return VLC_SUCCESS;
+        else if( unlikely( i_video_drift > (i_master_drift + 50000) ) )
+        {
+#if 0
+            msg_Dbg( p_stream, "adding frame (%i)",
+                     (int)(i_video_drift - i_master_drift) );
+#endif
+            b_need_duplicate = true;
+        }
+    }
+
+    /* Run the filter and output chains; first with the picture,
+     * and then with NULL as many times as we need until they
+     * stop outputting frames.
+     */
+    for ( ;; ) {
+        picture_t *p_filtered_pic = p_pic;
+
+        /* Run filter chain */
+        if( id->p_f_chain )
+            p_filtered_pic = filter_chain_VideoFilter( id->p_f_chain, p_filtered_pic );
+        if( !p_filtered_pic )
+            break;
+
+        for ( ;; ) {
+            picture_t *p_user_filtered_pic = p_filtered_pic;
+
+            /* Run user specified filter chain */
+            if( id->p_uf_chain )
+                p_user_filtered_pic = filter_chain_VideoFilter( id->p_uf_chain, p_user_filtered_pic );
+            if( !p_user_filtered_pic )
+                break;
+
+            OutputFrame( p_sys, p_user_filtered_pic, b_need_duplicate, p_stream, id, out );
+            b_need_duplicate = false;
+
+            p_filtered_pic = NULL;
+        }
+
+        p_pic = NULL;
     }
+}
 
+static int DecodeVideo( sout_stream_t *p_stream, sout_stream_id_t *id,
+                        block_t *in, block_t **out )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    picture_t *p_pic;
 
     while( (p_pic = id->p_decoder->pf_decode_video( id->p_decoder, &in )) )
     {
@@ -740,45 +732,6 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
             }
         }
 
-        if( p_sys->b_master_sync )
-        {
-            mtime_t i_master_drift = p_sys->i_master_drift;
-            mtime_t i_pts = date_Get( &id->interpolated_pts ) + 1;
-            mtime_t i_video_drift = p_pic->date - i_pts;
-
-            if ( unlikely( i_video_drift > MASTER_SYNC_MAX_DRIFT
-                  || i_video_drift < -MASTER_SYNC_MAX_DRIFT ) )
-            {
-                msg_Dbg( p_stream,
-                    "drift is too high (%"PRId64", resetting master sync",
-                    i_video_drift );
-                date_Set( &id->interpolated_pts, p_pic->date );
-                i_pts = p_pic->date + 1;
-            }
-            i_video_drift = p_pic->date - i_pts;
-            b_need_duplicate = false;
-
-            /* Set the pts of the frame being encoded */
-            p_pic->date = i_pts;
-
-            if( unlikely( i_video_drift < (i_master_drift - 50000) ) )
-            {
-#if 0
-                msg_Dbg( p_stream, "dropping frame (%i)",
-                         (int)(i_video_drift - i_master_drift) );
-#endif
-                picture_Release( p_pic );
-                continue;
-            }
-            else if( unlikely( i_video_drift > (i_master_drift + 50000) ) )
-            {
-#if 0
-                msg_Dbg( p_stream, "adding frame (%i)",
-                         (int)(i_video_drift - i_master_drift) );
-#endif
-                b_need_duplicate = true;
-            }
-        }
         if( unlikely (
              id->p_encoder->p_module &&
              !video_format_IsSimilar( &p_sys->fmt_input_video, &id->p_decoder->fmt_out.video )
@@ -789,6 +742,11 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
                         p_sys->fmt_input_video.i_sar_num, id->p_decoder->fmt_out.video.i_sar_num,
                         p_sys->fmt_input_video.i_sar_den, id->p_decoder->fmt_out.video.i_sar_den
                     );
+            /* The filters and the encoder must be idle to be reset */
+            if( id->p_pipeline )
+                transcode_pipeline_Drain( id->p_pipeline,
+                                          TRANSCODE_STAGE_FILTER );
+
             /* Close filters */
             if( id->p_f_chain )
                 filter_chain_Delete( id->p_f_chain );
@@ -806,6 +764,8 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
             transcode_video_encoder_init( p_stream, id );
             conversion_video_filter_append( id );
             memcpy( &p_sys->fmt_input_video, &id->p_decoder->fmt_out.video, sizeof(video_format_t));
+            if( id->p_ladder )
+                transcode_ladder_Reset( p_stream, id->p_ladder, id->p_encoder );
         }
 
 
@@ -825,54 +785,144 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
             if( transcode_video_encoder_open( p_stream, id ) != VLC_SUCCESS )
             {
                 picture_Release( p_pic );
-                transcode_video_close( p_stream, id );
-                id->b_transcode = false;
+                if( in != NULL )
+                    block_Release( in );
                 return VLC_EGENERIC;
             }
+            if( id->p_ladder )
+                transcode_ladder_Open( p_stream, id->p_ladder, id->p_encoder );
+            if( id->p_pipeline )
+                transcode_pipeline_Start( id->p_pipeline,
+                                          &id->p_encoder->fmt_out );
         }
 
-        /* Run the filter and output chains; first with the picture,
-         * and then with NULL as many times as we need until they
-         * stop outputting frames.
-         */
-        for ( ;; ) {
-            picture_t *p_filtered_pic = p_pic;
+        if( id->p_pipeline )
+            transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_FILTER,
+                                     p_pic );
+        else
+            FilterVideo( p_stream, id, p_pic, out );
+    }
 
-            /* Run filter chain */
-            if( id->p_f_chain )
-                p_filtered_pic = filter_chain_VideoFilter( id->p_f_chain, p_filtered_pic );
-            if( !p_filtered_pic )
-                break;
+    return VLC_SUCCESS;
+}
 
-            for ( ;; ) {
-                picture_t *p_user_filtered_pic = p_filtered_pic;
+static void DecodeVideoStage( sout_stream_t *p_stream, void *p_opaque,
+                              void *p_item )
+{
+    sout_stream_id_t *id = p_opaque;
+    block_t *in = p_item;
 
-                /* Run user specified filter chain */
-                if( id->p_uf_chain )
-                    p_user_filtered_pic = filter_chain_VideoFilter( id->p_uf_chain, p_user_filtered_pic );
-                if( !p_user_filtered_pic )
-                    break;
+    if( transcode_pipeline_GetState( id->p_pipeline ) ==
+        TRANSCODE_PIPELINE_FAILED )
+    {
+        block_Release( in );
+        return;
+    }
+    if( DecodeVideo( p_stream, id, in, NULL ) != VLC_SUCCESS )
+        transcode_pipeline_Fail( id->p_pipeline );
+}
 
-                OutputFrame( p_sys, p_user_filtered_pic, b_need_duplicate, p_stream, id, out );
-                b_need_duplicate = false;
+static void FilterVideoStage( sout_stream_t *p_stream, void *id,
+                              void *p_item )
+{
+    FilterVideo( p_stream, id, p_item, NULL );
+}
 
-                p_filtered_pic = NULL;
-            }
+static void EncodeVideoStage( sout_stream_t *p_stream, void *id,
+                              void *p_item )
+{
+    VLC_UNUSED(p_stream);
+    EncodeVideo( id, p_item, NULL );
+}
+
+static void ReleaseBlock( void *p_item )
+{
+    block_Release( p_item );
+}
+
+static void ReleasePicture( void *p_item )
+{
+    picture_Release( p_item );
+}
+
+/* Takes the encoded blocks from the threads, adding the output stream on
+ * the input thread once the encoder is opened */
+static int FetchVideo( sout_stream_t *p_stream, sout_stream_id_t *id,
+                       block_t **out )
+{
+    int i_state = transcode_pipeline_Fetch( id->p_pipeline, out );
 
-            p_pic = NULL;
+    if( i_state == TRANSCODE_PIPELINE_RUNNING && !id->id )
+    {
+        id->id = sout_StreamIdAdd( p_stream->p_next,
+                               transcode_pipeline_GetFormat( id->p_pipeline ) );
+        if( !id->id )
+        {
+            msg_Err( p_stream, "cannot add this stream" );
+            i_state = TRANSCODE_PIPELINE_FAILED;
         }
     }
+    if( i_state != TRANSCODE_PIPELINE_RUNNING )
+    {
+        /* nothing can be sent without an output stream */
+        block_ChainRelease( *out );
+        *out = NULL;
+    }
+    return i_state;
+}
 
-    if( p_sys->i_threads >= 1 )
+int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_t *id,
+                                    block_t *in, block_t **out )
+{
+    *out = NULL;
+
+    if( unlikely( in == NULL ) )
     {
-        /* Pick up any return data the encoder thread wants to output. */
-        vlc_mutex_lock( &p_sys->lock_out );
-        *out = p_sys->p_buffers;
-        p_sys->p_buffers = NULL;
-        vlc_mutex_unlock( &p_sys->lock_out );
+        block_t *p_block;
+
+        /* Wait for the threads, then flush the encoder from here */
+        if( id->p_pipeline )
+        {
+            transcode_pipeline_Drain( id->p_pipeline, TRANSCODE_STAGE_DECODE );
+            if( FetchVideo( p_stream, id, out ) != TRANSCODE_PIPELINE_RUNNING )
+                return VLC_SUCCESS;
+        }
+        if( id->p_encoder->p_module )
+        {
+            do {
+                p_block = id->p_encoder->pf_encode_video(id->p_encoder, NULL );
+                block_ChainAppend( out, p_block );
+            } while( p_block );
+        }
+        if( id->p_ladder )
+            transcode_ladder_Flush( p_stream, id->p_ladder );
+        return VLC_SUCCESS;
     }
 
-    return VLC_SUCCESS;
+    if( id->p_pipeline )
+    {
+        transcode_pipeline_Push( id->p_pipeline, TRANSCODE_STAGE_DECODE, in );
+
+        if( FetchVideo( p_stream, id, out ) != TRANSCODE_PIPELINE_FAILED )
+        {
+            transcode_pipeline_Report( id->p_pipeline, false );
+            if( id->p_ladder )
+                transcode_ladder_Send( p_stream, id->p_ladder );
+            return VLC_SUCCESS;
+        }
+    }
+    else if( DecodeVideo( p_stream, id, in, out ) == VLC_SUCCESS )
+    {
+        if( id->p_ladder )
+            transcode_ladder_Send( p_stream, id->p_ladder );
+        return VLC_SUCCESS;
+    }
+
+    block_ChainRelease( *out );
+    *out = NULL;
+    transcode_video_close( p_stream, id );
+    id->b_transcode = false;
+    return VLC_EGENERIC;
 }
 
 bool transcode_video_add( sout_stream_t *p_stream, es_format_t *p_fmt,
@@ -907,6 +957,39 @@ bool transcode_video_add( sout_stream_t *p_stream, es_format_t *p_fmt,
         id->p_encoder->fmt_out.video.i_frame_rate_base = ENC_FRAMERATE_BASE;
     }
 
+    if( p_sys->i_threads >= 1 )
+    {
+        static const transcode_stage_desc_t stages[TRANSCODE_STAGE_COUNT] =
+        {
+            { "decode", DecodeVideoStage, ReleaseBlock },
+            { "filter", FilterVideoStage, ReleasePicture },
+            { "encode", EncodeVideoStage, ReleasePicture },
+        };
+        int i_priority = p_sys->b_high_priority ? VLC_THREAD_PRIORITY_OUTPUT :
+                           VLC_THREAD_PRIORITY_VIDEO;
+
+        id->p_pipeline = transcode_pipeline_New( p_stream, id, "video",
+                                                 stages, TRANSCODE_STAGE_COUNT,
+                                                 TRANSCODE_VIDEO_QUEUE,
+                                                 i_priority );
+        if( id->p_pipeline == NULL )
+        {
+            transcode_video_close( p_stream, id );
+            return false;
+        }
+    }
+
+    if( p_sys->i_ladder > 0 )
+    {
+        id->p_ladder = transcode_ladder_New( p_stream );
+        if( id->p_ladder == NULL )
+        {
+            msg_Err( p_stream, "cannot create the video renditions" );
+            transcode_video_close( p_stream, id );
+            return false;
+        }
+    }
+
     return true;
 }
 
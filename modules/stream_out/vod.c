@@ -49,13 +49,17 @@
  * Exported prototypes
  *****************************************************************************/
 
-typedef struct media_es_t media_es_t;
-
 struct media_es_t
 {
     int es_id;
     rtp_format_t rtp_fmt;
     rtsp_stream_id_t *rtsp_id;
+
+    /* RTP streams of the sessions sharing the packets of a live ES: the
+     * first one packetizes, the others only forward its packets */
+    vlc_mutex_t lock_share;
+    int i_share;
+    sout_stream_id_t **share;
 };
 
 struct vod_media_t
@@ -246,6 +250,8 @@ static vod_media_t *MediaNew( vod_t *p_vod, const char *psz_name,
             free(p_es);
             continue;
         }
+        vlc_mutex_init(&p_es->lock_share);
+        TAB_INIT(p_es->i_share, p_es->share);
 
         TAB_APPEND( p_media->i_es, p_media->es, p_es );
         msg_Dbg(p_vod, "  - added ES %u %s (%4.4s)",
@@ -318,6 +324,8 @@ static void MediaDel( vod_t *p_vod, vod_media_t *p_media )
     {
         media_es_t *p_es = p_media->es[0];
         TAB_REMOVE( p_media->i_es, p_media->es, p_es );
+        assert( p_es->i_share == 0 );
+        vlc_mutex_destroy( &p_es->lock_share );
         free( p_es->rtp_fmt.fmtp );
         free( p_es );
     }
@@ -548,3 +556,64 @@ void vod_detach_id(vod_media_t *p_media, const char *psz_session,
     RtspTrackDetach(p_media->rtsp, psz_session, sout_id);
 }
 
+
+/* Share the packets of a live ES between the sessions playing it, so that
+ * it is packetized only once. Returns NULL if the ES cannot be shared. */
+media_es_t *vod_share_id(vod_media_t *p_media, int es_id,
+                         sout_stream_id_t *sout_id)
+{
+    /* Sessions of seekable media do not play the same thing; and the
+     * packets of muxed media come out of a muxer per session */
+    if (p_media->i_length > 0 || p_media->psz_mux != NULL)
+        return NULL;
+
+    media_es_t *p_es = NULL;
+    for (int i = 0; i < p_media->i_es; i++)
+        if (p_media->es[i]->es_id == es_id)
+        {
+            p_es = p_media->es[i];
+            break;
+        }
+    if (p_es == NULL)
+        return NULL;
+
+    vlc_mutex_lock(&p_es->lock_share);
+    TAB_APPEND(p_es->i_share, p_es->share, sout_id);
+    vlc_mutex_unlock(&p_es->lock_share);
+    return p_es;
+}
+
+void vod_unshare_id(media_es_t *p_es, sout_stream_id_t *sout_id)
+{
+    vlc_mutex_lock(&p_es->lock_share);
+    TAB_REMOVE(p_es->i_share, p_es->share, sout_id);
+    vlc_mutex_unlock(&p_es->lock_share);
+}
+
+/* Whether this RTP stream packetizes the ES for the other sessions */
+bool vod_share_leads(media_es_t *p_es, const sout_stream_id_t *sout_id)
+{
+    vlc_mutex_lock(&p_es->lock_share);
+    bool leads = p_es->share[0] == sout_id;
+    vlc_mutex_unlock(&p_es->lock_share);
+    return leads;
+}
+
+/* Pass the packets sent by the leading RTP stream to the other ones.
+ * Each of them rewrites the headers in place, so the timestamps are mapped
+ * from the ones the leader sent. */
+void vod_share_forward(media_es_t *p_es, const sout_stream_id_t *sout_id,
+                       block_t **pp_packets, unsigned i_packets)
+{
+    uint32_t pi_ts[i_packets];
+
+    for (unsigned i = 0; i < i_packets; i++)
+        pi_ts[i] = GetDWBE(pp_packets[i]->p_buffer + 4);
+
+    vlc_mutex_lock(&p_es->lock_share);
+    if (p_es->share[0] == sout_id)
+        for (int i = 1; i < p_es->i_share; i++)
+            rtp_forward(p_es->share[i], sout_id, pi_ts,
+                        pp_packets, i_packets);
+    vlc_mutex_unlock(&p_es->lock_share);
+}
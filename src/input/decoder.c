@@ -384,6 +384,11 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
+    /* Decoders and packetizers may modify the data in place */
+    p_block = block_ChainUnshare( p_block );
+    if( unlikely(p_block == NULL) )
+        return;
+
     if( b_do_pace )
     {
         /* The fifo is not consummed when buffering and so will
@@ -223,7 +223,7 @@ static inline bool EsFmtIsTeletext( const es_format_t *p_fmt )
  *****************************************************************************/
 es_out_t *input_EsOutNew( input_thread_t *p_input, int i_rate )
 {
-    es_out_t     *out = malloc( sizeof( *out ) );
+    es_out_t     *out = calloc( 1, sizeof( *out ) );
     if( !out )
         return NULL;
 
@@ -239,6 +239,7 @@ es_out_t *input_EsOutNew( input_thread_t *p_input, int i_rate )
     out->pf_del     = EsOutDel;
     out->pf_control = EsOutControl;
     out->pf_destroy = EsOutDelete;
+    out->pf_send_chain = EsOutSend;
     out->p_sys      = p_sys;
 
     vlc_mutex_init_recursive( &p_sys->lock );
@@ -1894,11 +1895,14 @@ static void EsOutSelect( es_out_t *out, es_out_id_t *es, bool b_force )
 }
 
 /**
- * Send a block for the given es_out
+ * Send a block, or a chain of blocks, for the given es_out
+ *
+ * A chain is accounted and queued to the decoder at once, with a single
+ * lock of the counters and of the es_out.
  *
  * \param out the es_out to send from
  * \param es the es_out_id
- * \param p_block the data block to send
+ * \param p_block the data block (or chain of blocks) to send
  */
 static int EsOutSend( es_out_t *out, es_out_id_t *es, block_t *p_block )
 {
@@ -1908,21 +1912,34 @@ static int EsOutSend( es_out_t *out, es_out_id_t *es, block_t *p_block )
     if( libvlc_stats( p_input ) )
     {
         uint64_t i_total;
+        size_t i_size = 0;
+        unsigned i_corrupted = 0, i_discontinuity = 0;
+
+        for( block_t *b = p_block; b != NULL; b = b->p_next )
+        {
+            i_size += b->i_buffer;
+            /* Update number of corrupted data packats */
+            if( b->i_flags & BLOCK_FLAG_CORRUPTED )
+                i_corrupted++;
+            /* Update number of discontinuities */
+            if( b->i_flags & BLOCK_FLAG_DISCONTINUITY )
+                i_discontinuity++;
+        }
 
         vlc_mutex_lock( &p_input->p->counters.counters_lock );
         stats_Update( p_input->p->counters.p_demux_read,
-                      p_block->i_buffer, &i_total );
+                      i_size, &i_total );
         stats_Update( p_input->p->counters.p_demux_bitrate, i_total, NULL );
 
-        /* Update number of corrupted data packats */
-        if( p_block->i_flags & BLOCK_FLAG_CORRUPTED )
+        if( i_corrupted > 0 )
         {
-            stats_Update( p_input->p->counters.p_demux_corrupted, 1, NULL );
+            stats_Update( p_input->p->counters.p_demux_corrupted,
+                          i_corrupted, NULL );
         }
-        /* Update number of discontinuities */
-        if( p_block->i_flags & BLOCK_FLAG_DISCONTINUITY )
+        if( i_discontinuity > 0 )
         {
-            stats_Update( p_input->p->counters.p_demux_discontinuity, 1, NULL );
+            stats_Update( p_input->p->counters.p_demux_discontinuity,
+                          i_discontinuity, NULL );
         }
         vlc_mutex_unlock( &p_input->p->counters.counters_lock );
     }
@@ -1932,17 +1949,20 @@ static int EsOutSend( es_out_t *out, es_out_id_t *es, block_t *p_block )
     /* Mark preroll blocks */
     if( p_sys->i_preroll_end >= 0 )
     {
-        int64_t i_date = p_block->i_pts;
-        if( p_block->i_pts <= VLC_TS_INVALID )
-            i_date = p_block->i_dts;
+        for( block_t *b = p_block; b != NULL; b = b->p_next )
+        {
+            int64_t i_date = b->i_pts;
+            if( b->i_pts <= VLC_TS_INVALID )
+                i_date = b->i_dts;
 
-        if( i_date < p_sys->i_preroll_end )
-            p_block->i_flags |= BLOCK_FLAG_PREROLL;
+            if( i_date < p_sys->i_preroll_end )
+                b->i_flags |= BLOCK_FLAG_PREROLL;
+        }
     }
 
     if( !es->p_dec )
     {
-        block_Release( p_block );
+        block_ChainRelease( p_block );
         vlc_mutex_unlock( &p_sys->lock );
         return VLC_SUCCESS;
     }
@@ -1968,7 +1988,15 @@ static int EsOutSend( es_out_t *out, es_out_id_t *es, block_t *p_block )
     /* Decode */
     if( es->p_dec_record )
     {
-        block_t *p_dup = block_Duplicate( p_block );
+        block_t *p_dup = NULL;
+        block_t **pp_last = &p_dup;
+
+        for( block_t *b = p_block; b != NULL; b = b->p_next )
+        {
+            block_t *p_copy = block_Duplicate( b );
+            if( p_copy )
+                block_ChainLastAppend( &pp_last, p_copy );
+        }
         if( p_dup )
             input_DecoderDecode( es->p_dec_record, p_dup,
                                  p_input->p->b_out_pace_control );
@@ -241,6 +241,7 @@ static int          Send   ( es_out_t *, es_out_id_t *, block_t * );
 static void         Del    ( es_out_t *, es_out_id_t * );
 static int          Control( es_out_t *, int i_query, va_list );
 static void         Destroy( es_out_t * );
+static int          SendChain( es_out_t *, es_out_id_t *, block_t * );
 
 static int          TsStart( es_out_t * );
 static void         TsAutoStop( es_out_t * );
@@ -291,7 +292,7 @@ static FILE *GetTmpFile( char **ppsz_file, const char *psz_path );
  *****************************************************************************/
 es_out_t *input_EsOutTimeshiftNew( input_thread_t *p_input, es_out_t *p_next_out, int i_rate )
 {
-    es_out_t *p_out = malloc( sizeof(*p_out) );
+    es_out_t *p_out = calloc( 1, sizeof(*p_out) );
     if( !p_out )
         return NULL;
 
@@ -308,6 +309,7 @@ es_out_t *input_EsOutTimeshiftNew( input_thread_t *p_input, es_out_t *p_next_out
     p_out->pf_del     = Del;
     p_out->pf_control = Control;
     p_out->pf_destroy = Destroy;
+    p_out->pf_send_chain = SendChain;
     p_out->p_sys      = p_sys;
 
     /* */
@@ -425,6 +427,41 @@ static int Send( es_out_t *p_out, es_out_id_t *p_es, block_t *p_block )
 
     return i_ret;
 }
+static int SendChain( es_out_t *p_out, es_out_id_t *p_es, block_t *p_chain )
+{
+    es_out_sys_t *p_sys = p_out->p_sys;
+    int i_ret = VLC_SUCCESS;
+
+    vlc_mutex_lock( &p_sys->lock );
+
+    TsAutoStop( p_out );
+
+    if( p_sys->b_delayed )
+    {
+        /* The storage works on single blocks */
+        while( p_chain )
+        {
+            block_t *p_next = p_chain->p_next;
+            ts_cmd_t cmd;
+
+            p_chain->p_next = NULL;
+            CmdInitSend( &cmd, p_es, p_chain );
+            TsPushCmd( p_sys->p_ts, &cmd );
+            p_chain = p_next;
+        }
+    }
+    else if( p_es->p_es )
+        i_ret = es_out_SendChain( p_sys->p_out, p_es->p_es, p_chain );
+    else
+    {
+        block_ChainRelease( p_chain );
+        i_ret = VLC_EGENERIC;
+    }
+
+    vlc_mutex_unlock( &p_sys->lock );
+
+    return i_ret;
+}
 static void Del( es_out_t *p_out, es_out_id_t *p_es )
 {
     es_out_sys_t *p_sys = p_out->p_sys;
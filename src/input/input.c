@@ -680,6 +680,13 @@ static void MainLoopInterface( input_thread_t *p_input )
 
     es_out_SetTimes( p_input->p->p_es_out, f_position, i_time, i_length );
 
+    /* update the seek index coverage, for the demuxers that have one */
+    double f_coverage;
+    if( !demux_Control( p_input->p->input.p_demux,
+                        DEMUX_GET_INDEX_COVERAGE, &f_coverage )
+     && (float)f_coverage != var_GetFloat( p_input, "index-coverage" ) )
+        var_SetFloat( p_input, "index-coverage", f_coverage );
+
     /* update current bookmark */
     vlc_mutex_lock( &p_input->p->p_item->lock );
     p_input->p->bookmark.i_time_offset = i_time;
@@ -1727,13 +1727,23 @@ static block_t *AReadBlock( stream_t *s, bool *pb_eof )
         if( p_input && p_block && libvlc_stats (p_access) )
         {
             uint64_t total;
+            size_t i_size = 0;
+            unsigned i_packets = 0;
+
+            /* the access may return several packets at once */
+            for( block_t *b = p_block; b != NULL; b = b->p_next )
+            {
+                i_size += b->i_buffer;
+                i_packets++;
+            }
 
             vlc_mutex_lock( &p_input->p->counters.counters_lock );
             stats_Update( p_input->p->counters.p_read_bytes,
-                          p_block->i_buffer, &total );
+                          i_size, &total );
             stats_Update( p_input->p->counters.p_input_bitrate,
                           total, NULL );
-            stats_Update( p_input->p->counters.p_read_packets, 1, NULL );
+            stats_Update( p_input->p->counters.p_read_packets, i_packets,
+                          NULL );
             vlc_mutex_unlock( &p_input->p->counters.counters_lock );
         }
         return p_block;
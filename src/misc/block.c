@@ -39,6 +39,7 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
 
 /**
  * @section Block handling functions.
@@ -156,6 +157,11 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
 
     block_Check( p_block );
 
+    /* The payload may be moved or resized: it must not be shared */
+    p_block = block_Unshare( p_block );
+    if( p_block == NULL )
+        return NULL;
+
     /* Corner case: empty block requested */
     if( i_prebody <= 0 && i_body <= (size_t)(-i_prebody) )
     {
@@ -262,6 +268,130 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
     return p_block;
 }
 
+/**
+ * @section Shared blocks
+ * A shared payload is owned by its original block and released with it once
+ * the last block referring to it is released.
+ */
+typedef struct
+{
+    block_t    *origin;
+    atomic_uint refs;
+} block_share_t;
+
+typedef struct
+{
+    block_t        self;
+    block_share_t *share;
+} block_ref_t;
+
+static void block_ref_Release (block_t *block)
+{
+    block_share_t *share = ((block_ref_t *)block)->share;
+
+    block_Invalidate (block);
+    free (block);
+
+    if (atomic_fetch_sub (&share->refs, 1) == 1)
+    {
+        block_Release (share->origin);
+        free (share);
+    }
+}
+
+static block_t *block_ref_New (block_share_t *share, const block_t *from)
+{
+    block_ref_t *ref = malloc (sizeof (*ref));
+    if (unlikely(ref == NULL))
+        return NULL;
+
+    block_t *block = &ref->self;
+    block_Init (block, from->p_start, from->i_size);
+    BlockMetaCopy (block, from);
+    block->p_next = NULL;
+    block->p_buffer = from->p_buffer;
+    block->i_buffer = from->i_buffer;
+    block->pf_release = block_ref_Release;
+    ref->share = share;
+    return block;
+}
+
+/**
+ * Makes the payload of a block shareable with block_Hold().
+ * The block is consumed; the returned block has the same payload and
+ * properties. Shareable blocks are returned as is.
+ *
+ * @return the shareable block, or NULL on error (the block is then released)
+ */
+block_t *block_Share (block_t *block)
+{
+    if (block->pf_release == block_ref_Release)
+        return block;
+
+    block_share_t *share = malloc (sizeof (*share));
+    if (unlikely(share == NULL))
+    {
+        block_Release (block);
+        return NULL;
+    }
+
+    block_t *ref = block_ref_New (share, block);
+    if (unlikely(ref == NULL))
+    {
+        free (share);
+        block_Release (block);
+        return NULL;
+    }
+    ref->p_next = block->p_next;
+    block->p_next = NULL;
+    share->origin = block;
+    atomic_init (&share->refs, 1);
+    return ref;
+}
+
+/**
+ * Returns a new block referring to the payload of a shareable block,
+ * without copying it. Other blocks are duplicated.
+ * The payload is read-only as long as several blocks refer to it; the
+ * blocks themselves (payload bounds, properties) are independent.
+ */
+block_t *block_Hold (block_t *block)
+{
+    if (block->pf_release != block_ref_Release)
+        return block_Duplicate (block);
+
+    block_share_t *share = ((block_ref_t *)block)->share;
+    block_t *ref = block_ref_New (share, block);
+    if (likely(ref != NULL))
+        atomic_fetch_add (&share->refs, 1);
+    return ref;
+}
+
+/**
+ * Makes the payload of a block writable: it is copied if other blocks
+ * refer to it. Modules writing to the payload of blocks they did not
+ * allocate (encryption, in place conversions) must call this first.
+ *
+ * @return the writable block, or NULL on error (the block is then released)
+ */
+block_t *block_Unshare (block_t *block)
+{
+    if (block->pf_release != block_ref_Release)
+        return block;
+
+    block_share_t *share = ((block_ref_t *)block)->share;
+    if (atomic_load (&share->refs) == 1)
+        return block; /* last reference */
+
+    block_t *copy = block_Alloc (block->i_buffer);
+    if (likely(copy != NULL))
+    {
+        BlockMetaCopy (copy, block);
+        memcpy (copy->p_buffer, block->p_buffer, block->i_buffer);
+    }
+    block_Release (block);
+    return copy;
+}
 
 static void block_heap_Release (block_t *block)
 {
@@ -29,6 +29,7 @@
 
 #include <vlc_common.h>
 #include <vlc_httpd.h>
+#include <vlc_block.h>
 
 #include <assert.h>
 
@@ -56,6 +57,10 @@
 #   include <winsock2.h>
 #else
 #   include <sys/socket.h>
+#   include <sys/uio.h>
+#endif
+#ifdef HAVE_EPOLL_CREATE1
+#   include <sys/epoll.h>
 #endif
 
 #if defined( _WIN32 )
@@ -65,9 +70,33 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* most blocks and bytes a stream client is sent in one go */
+#define HTTPD_STREAM_IOV    64
+#define HTTPD_STREAM_BURST  (256 * 1024)
+
+/* default number of worker threads per host, if not set */
+#define HTTPD_WORKERS_MAX   4
+
 static void httpd_ClientClean( httpd_client_t *cl );
 
-/* each host run in his own thread */
+/* Each worker thread serves its own share of the clients of a host. The
+ * clients are only added and removed by their worker, with the host lock
+ * held; their I/O is done without it. The message state machine and the
+ * URL callbacks are still run under the host lock. */
+typedef struct
+{
+    httpd_host_t *host;
+    vlc_thread_t thread;
+
+    int            i_client;
+    httpd_client_t **client;
+
+#ifdef HAVE_EPOLL_CREATE1
+    int          epfd;
+#endif
+} httpd_worker_t;
+
+/* each host is served by its own worker threads */
 struct httpd_host_t
 {
     VLC_COMMON_MEMBERS
@@ -80,7 +109,9 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
+    unsigned        i_worker;
+    httpd_worker_t *worker;
+
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -91,9 +122,6 @@ struct httpd_host_t
     int         i_url;
     httpd_url_t **url;
 
-    int            i_client;
-    httpd_client_t **client;
-
     /* TLS data */
     vlc_tls_creds_t *p_tls;
 };
@@ -126,6 +154,7 @@ enum
     HTTPD_CLIENT_SEND_DONE,
 
     HTTPD_CLIENT_WAITING,
+    HTTPD_CLIENT_STREAMING,
 
     HTTPD_CLIENT_DEAD,
 
@@ -149,7 +178,10 @@ struct httpd_client_t
     int     fd;
 
     bool    b_stream_mode;
+    bool    b_chunked;
+    bool    b_killed;   /* URL deleted, to be closed by its worker */
     uint8_t i_state;
+    short   i_events;   /* poll events waited for */
 
     mtime_t i_activity_date;
     mtime_t i_activity_timeout;
@@ -165,6 +197,13 @@ struct httpd_client_t
 
     /* TLS data */
     vlc_tls_t *p_tls;
+
+    /* stream sent from the queued blocks (see httpd_StreamHold) */
+    httpd_stream_t *p_stream;
+    uint64_t i_stream_seq;      /* sequence of the next block to send */
+    size_t   i_stream_offset;   /* bytes of it already sent */
+    unsigned i_hold;
+    block_t  *pp_hold[HTTPD_STREAM_IOV];
 };
 
 
@@ -615,6 +654,12 @@ void httpd_RedirectDelete( httpd_redirect_t *rdir )
 /*****************************************************************************
  * High Level Funtions: httpd_stream_t
  *****************************************************************************/
+typedef struct
+{
+    block_t *p_block;   /* shared, hence read-only */
+    int64_t  i_pos;     /* absolute position of its first byte */
+} httpd_stream_block_t;
+
 struct httpd_stream_t
 {
     vlc_mutex_t lock;
@@ -626,11 +671,16 @@ struct httpd_stream_t
     uint8_t *p_header;
     int     i_header;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* queue of the last blocks, addressed by sequence number: the clients
+     * are sent the blocks themselves, without copying them */
+    int64_t     i_buffer_size;      /* bytes to keep queued */
+    httpd_stream_block_t *p_queue;  /* circular, by sequence number */
+    unsigned    i_queue_size;       /* power of two */
+    uint64_t    i_first;            /* oldest queued block */
+    uint64_t    i_next;             /* next block to be queued */
+    uint64_t    i_last;             /* a new connection will start with that */
     int64_t     i_buffer_pos;       /* absolute position from begining */
-    int64_t     i_buffer_last_pos;  /* a new connection will start with that */
+    int64_t     i_buffer_last_pos;  /* position of i_last */
 };
 
 static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
@@ -646,59 +696,13 @@ static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
 
     if( answer->i_body_offset > 0 )
     {
-        int64_t i_write;
-        int     i_pos;
-
-#if 0
-        fprintf( stderr, "httpd_StreamCallBack i_body_offset=%lld\n",
-                 answer->i_body_offset );
-#endif
-
-        if( answer->i_body_offset >= stream->i_buffer_pos )
-        {
-            /* fprintf( stderr, "httpd_StreamCallBack: no data\n" ); */
-            return VLC_EGENERIC;    /* wait, no data available */
-        }
-        if( answer->i_body_offset + stream->i_buffer_size <
-            stream->i_buffer_pos )
-        {
-            /* this client isn't fast enough */
-#if 0
-            fprintf( stderr, "fixing i_body_offset (old=%lld new=%lld)\n",
-                     answer->i_body_offset, stream->i_buffer_last_pos );
-#endif
-            answer->i_body_offset = stream->i_buffer_last_pos;
-        }
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        i_write = stream->i_buffer_pos - answer->i_body_offset;
-        if( i_write > HTTPD_CL_BUFSIZE )
-        {
-            i_write = HTTPD_CL_BUFSIZE;
-        }
-        else if( i_write <= 0 )
-        {
-            return VLC_EGENERIC;    /* wait, no data available */
-        }
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN( i_write, stream->i_buffer_size - i_pos );
-
-        /* using HTTPD_MSG_ANSWER -> data available */
-        answer->i_proto  = HTTPD_PROTO_HTTP;
-        answer->i_version= 0;
-        answer->i_type   = HTTPD_MSG_ANSWER;
-
-        answer->i_body = i_write;
-        answer->p_body = xmalloc( i_write );
-        memcpy( answer->p_body, &stream->p_buffer[i_pos], i_write );
-
-        answer->i_body_offset += i_write;
-
-        return VLC_SUCCESS;
+        /* the data is sent by the host from the queued blocks */
+        return VLC_EGENERIC;
     }
     else
     {
+        uint64_t i_seq = 0;
+
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
@@ -717,6 +721,7 @@ static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
                 memcpy( answer->p_body, stream->p_header, stream->i_header );
             }
             answer->i_body_offset = stream->i_buffer_last_pos;
+            i_seq = stream->i_last;
             vlc_mutex_unlock( &stream->lock );
         }
         else
@@ -758,6 +763,13 @@ static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
             httpd_MsgAdd( answer, "Content-type",  "%s", stream->psz_mime );
         }
         httpd_MsgAdd( answer, "Cache-Control", "%s", "no-cache" );
+
+        if( answer->i_body_offset > 0 )
+        {
+            cl->p_stream = stream;
+            cl->i_stream_seq = i_seq;
+            cl->i_stream_offset = 0;
+        }
         return VLC_SUCCESS;
     }
 }
@@ -786,7 +798,10 @@ httpd_stream_t *httpd_StreamNew( httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = xmalloc( stream->i_buffer_size );
+    stream->i_queue_size = 256;
+    stream->p_queue = xmalloc( stream->i_queue_size *
+                               sizeof( *stream->p_queue ) );
+    stream->i_first = stream->i_next = stream->i_last = 0;
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -819,56 +834,127 @@ int httpd_StreamHeader( httpd_stream_t *stream, uint8_t *p_data, int i_data )
     return VLC_SUCCESS;
 }
 
-int httpd_StreamSend( httpd_stream_t *stream, uint8_t *p_data, int i_data )
+/* Queues a block, making room for it if needed (stream lock held) */
+static void httpd_StreamQueue( httpd_stream_t *stream, block_t *p_block )
 {
-    int i_count;
-    int i_pos;
+    unsigned i_mask = stream->i_queue_size - 1;
 
-    if( i_data < 0 || p_data == NULL )
+    if( stream->i_next - stream->i_first > i_mask )
     {
-        return VLC_SUCCESS;
+        unsigned i_size = 2 * stream->i_queue_size;
+        httpd_stream_block_t *p_queue = xmalloc( i_size * sizeof( *p_queue ) );
+
+        for( uint64_t i = stream->i_first; i < stream->i_next; i++ )
+            p_queue[i & (i_size - 1)] = stream->p_queue[i & i_mask];
+        free( stream->p_queue );
+        stream->p_queue = p_queue;
+        stream->i_queue_size = i_size;
+        i_mask = i_size - 1;
     }
+
+    httpd_stream_block_t *p_entry = &stream->p_queue[stream->i_next++ & i_mask];
+    p_entry->p_block = p_block;
+    p_entry->i_pos = stream->i_buffer_pos;
+    stream->i_buffer_pos += p_block->i_buffer;
+}
+
+int httpd_StreamSendBlock( httpd_stream_t *stream, block_t *p_block )
+{
     vlc_mutex_lock( &stream->lock );
 
-    /* save this pointer (to be used by new connection) */
+    /* save this position (to be used by new connection) */
+    stream->i_last = stream->i_next;
     stream->i_buffer_last_pos = stream->i_buffer_pos;
 
-    i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    i_count = i_data;
-    while( i_count > 0)
+    while( p_block != NULL )
     {
-        int i_copy;
-
-        i_copy = __MIN( i_count, stream->i_buffer_size - i_pos );
-
-        /* Ok, we can't go past the end of our buffer */
-        memcpy( &stream->p_buffer[i_pos], p_data, i_copy );
-
-        i_pos = ( i_pos + i_copy ) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+        block_t *p_next = p_block->p_next;
+
+        p_block->p_next = NULL;
+        if( p_block->i_buffer == 0 )
+            block_Release( p_block );
+        else if( ( p_block = block_Share( p_block ) ) != NULL )
+            httpd_StreamQueue( stream, p_block );
+        p_block = p_next;
     }
 
-    stream->i_buffer_pos += i_data;
+    /* drop the oldest blocks, but never the ones just queued */
+    const unsigned i_mask = stream->i_queue_size - 1;
+    while( stream->i_first < stream->i_last &&
+           stream->i_buffer_pos - stream->p_queue[stream->i_first & i_mask].i_pos
+               > stream->i_buffer_size )
+        block_Release( stream->p_queue[stream->i_first++ & i_mask].p_block );
 
     vlc_mutex_unlock( &stream->lock );
     return VLC_SUCCESS;
 }
 
+int httpd_StreamSend( httpd_stream_t *stream, uint8_t *p_data, int i_data )
+{
+    if( i_data < 0 || p_data == NULL )
+    {
+        return VLC_SUCCESS;
+    }
+
+    block_t *p_block = block_Alloc( i_data );
+    if( unlikely(p_block == NULL) )
+        return VLC_ENOMEM;
+    memcpy( p_block->p_buffer, p_data, i_data );
+    return httpd_StreamSendBlock( stream, p_block );
+}
+
 void httpd_StreamDelete( httpd_stream_t *stream )
 {
     httpd_UrlDelete( stream->url );
     vlc_mutex_destroy( &stream->lock );
     free( stream->psz_mime );
     free( stream->p_header );
-    free( stream->p_buffer );
+    for( uint64_t i = stream->i_first; i < stream->i_next; i++ )
+        block_Release( stream->p_queue[i & (stream->i_queue_size - 1)].p_block );
+    free( stream->p_queue );
     free( stream );
 }
 
+/* Holds the next queued blocks for a stream client (host lock held) */
+static void httpd_StreamHold( httpd_client_t *cl )
+{
+    httpd_stream_t *stream = cl->p_stream;
+    size_t i_burst = 0;
+
+    vlc_mutex_lock( &stream->lock );
+    if( cl->i_stream_seq < stream->i_first )
+    {
+        /* this client isn't fast enough */
+        cl->i_stream_seq = stream->i_last;
+        cl->i_stream_offset = 0;
+    }
+
+    const unsigned i_mask = stream->i_queue_size - 1;
+    for( uint64_t i = cl->i_stream_seq;
+         i < stream->i_next && cl->i_hold < HTTPD_STREAM_IOV &&
+         i_burst < HTTPD_STREAM_BURST; i++ )
+    {
+        block_t *p_block = block_Hold( stream->p_queue[i & i_mask].p_block );
+        if( unlikely(p_block == NULL) )
+            break;
+        cl->pp_hold[cl->i_hold++] = p_block;
+        i_burst += p_block->i_buffer;
+    }
+    vlc_mutex_unlock( &stream->lock );
+}
+
+/* Releases the blocks held by a stream client */
+static void httpd_StreamRelease( httpd_client_t *cl )
+{
+    for( unsigned i = 0; i < cl->i_hold; i++ )
+        block_Release( cl->pp_hold[i] );
+    cl->i_hold = 0;
+}
+
 /*****************************************************************************
  * Low level
  *****************************************************************************/
-static void* httpd_HostThread( void * );
+static int httpd_WorkerStart( httpd_host_t *, httpd_worker_t * );
 static httpd_host_t *httpd_HostCreate( vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t * );
 
@@ -1000,6 +1086,8 @@ static httpd_host_t *httpd_HostCreate( vlc_object_t *p_this,
     vlc_mutex_init( &host->lock );
     vlc_cond_init( &host->wait );
     host->i_ref = 1;
+    host->i_worker = 0;
+    host->worker = NULL;
 
     host->fds = net_ListenTCP( p_this, url.psz_host, port );
     if( host->fds == NULL )
@@ -1018,17 +1106,25 @@ static httpd_host_t *httpd_HostCreate( vlc_object_t *p_this,
     host->port     = port;
     host->i_url    = 0;
     host->url      = NULL;
-    host->i_client = 0;
-    host->client   = NULL;
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if( vlc_clone( &host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW ) )
+    /* create the threads */
+    int i_worker = var_InheritInteger( p_this, "http-threads" );
+    if( i_worker <= 0 )
+        i_worker = __MIN( vlc_GetCPUCount(), HTTPD_WORKERS_MAX );
+    host->worker = malloc( i_worker * sizeof( *host->worker ) );
+    if( unlikely(host->worker == NULL) )
+        goto error;
+    while( host->i_worker < (unsigned)i_worker
+        && !httpd_WorkerStart( host, &host->worker[host->i_worker] ) )
+        host->i_worker++;
+    if( host->i_worker == 0 )
     {
         msg_Err( p_this, "cannot spawn http host thread" );
         goto error;
     }
+    msg_Dbg( p_this, "HTTP host on port %u with %u thread(s)", port,
+             host->i_worker );
 
     /* now add it to httpd */
     TAB_APPEND( httpd.i_host, httpd.host, host );
@@ -1043,6 +1139,7 @@ error:
 
     if( host != NULL )
     {
+        free( host->worker );
         net_ListenClose( host->fds );
         vlc_cond_destroy( &host->wait );
         vlc_mutex_destroy( &host->lock );
@@ -1058,6 +1155,7 @@ error:
 void httpd_HostDelete( httpd_host_t *host )
 {
     int i;
+    unsigned j;
     bool delete = false;
 
     vlc_mutex_lock( &httpd.mutex );
@@ -1076,8 +1174,10 @@ void httpd_HostDelete( httpd_host_t *host )
     }
     TAB_REMOVE( httpd.i_host, httpd.host, host );
 
-    vlc_cancel( host->thread );
-    vlc_join( host->thread, NULL );
+    for( j = 0; j < host->i_worker; j++ )
+        vlc_cancel( host->worker[j].thread );
+    for( j = 0; j < host->i_worker; j++ )
+        vlc_join( host->worker[j].thread, NULL );
 
     msg_Dbg( host, "HTTP host removed" );
 
@@ -1085,16 +1185,24 @@ void httpd_HostDelete( httpd_host_t *host )
     {
         msg_Err( host, "url still registered: %s", host->url[i]->psz_url );
     }
-    for( i = 0; i < host->i_client; i++ )
+    for( j = 0; j < host->i_worker; j++ )
     {
-        httpd_client_t *cl = host->client[i];
-        msg_Warn( host, "client still connected" );
-        httpd_ClientClean( cl );
-        TAB_REMOVE( host->i_client, host->client, cl );
-        free( cl );
-        i--;
-        /* TODO */
+        httpd_worker_t *w = &host->worker[j];
+
+        for( i = 0; i < w->i_client; i++ )
+        {
+            httpd_client_t *cl = w->client[i];
+            msg_Warn( host, "client still connected" );
+            httpd_ClientClean( cl );
+            free( cl );
+            /* TODO */
+        }
+        free( w->client );
+#ifdef HAVE_EPOLL_CREATE1
+        close( w->epfd );
+#endif
     }
+    free( host->worker );
 
     vlc_tls_Delete( host->p_tls );
     net_ListenClose( host->fds );
@@ -1138,7 +1246,7 @@ httpd_url_t *httpd_UrlNew( httpd_host_t *host, const char *psz_url,
     }
 
     TAB_APPEND( host->i_url, host->url, url );
-    vlc_cond_signal( &host->wait );
+    vlc_cond_broadcast( &host->wait );
     vlc_mutex_unlock( &host->lock );
 
     return url;
@@ -1170,18 +1278,25 @@ void httpd_UrlDelete( httpd_url_t *url )
     free( url->psz_user );
     free( url->psz_password );
 
-    for( i = 0; i < host->i_client; i++ )
+    for( unsigned j = 0; j < host->i_worker; j++ )
     {
-        httpd_client_t *client = host->client[i];
+        httpd_worker_t *w = &host->worker[j];
 
-        if( client->url == url )
+        for( i = 0; i < w->i_client; i++ )
         {
-            /* TODO complete it */
-            msg_Warn( host, "force closing connections" );
-            httpd_ClientClean( client );
-            TAB_REMOVE( host->i_client, host->client, client );
-            free( client );
-            i--;
+            httpd_client_t *client = w->client[i];
+
+            if( client->url == url )
+            {
+                /* TODO complete it */
+                msg_Warn( host, "force closing connections" );
+                /* The worker may be sending to the client: wake it up, it
+                 * will close the connection. */
+                client->url = NULL;
+                client->p_stream = NULL;
+                client->b_killed = true;
+                shutdown( client->fd, SHUT_RDWR );
+            }
         }
     }
     free( url );
@@ -1274,6 +1389,11 @@ static void httpd_ClientInit( httpd_client_t *cl, mtime_t now )
     cl->i_buffer = 0;
     cl->p_buffer = xmalloc( cl->i_buffer_size );
     cl->b_stream_mode = false;
+    cl->b_chunked = false;
+    cl->b_killed = false;
+    cl->i_events = 0;
+    cl->p_stream = NULL;
+    cl->i_hold = 0;
 
     httpd_MsgInit( &cl->query );
     httpd_MsgInit( &cl->answer );
@@ -1301,6 +1421,7 @@ static void httpd_ClientClean( httpd_client_t *cl )
 
     httpd_MsgClean( &cl->answer );
     httpd_MsgClean( &cl->query );
+    httpd_StreamRelease( cl );
 
     free( cl->p_buffer );
     cl->p_buffer = NULL;
@@ -1780,7 +1901,40 @@ static void httpd_ClientRecv( httpd_client_t *cl )
 #endif
 }
 
-static void httpd_ClientSend( httpd_client_t *cl )
+/* Frames the pending body of a chunked answer, and terminates the answer
+ * once the callback has reset the body offset */
+static void httpd_ClientChunk( httpd_client_t *cl )
+{
+    httpd_message_t *answer = &cl->answer;
+    bool b_last = answer->i_body_offset == 0;
+    size_t i_chunk = 0;
+
+    if( !cl->b_chunked || ( answer->i_body <= 0 && !b_last ) )
+        return;
+
+    uint8_t *p_chunk = xmalloc( __MAX( answer->i_body, 0 ) + 16 );
+    if( answer->i_body > 0 )
+    {
+        i_chunk = sprintf( (char *)p_chunk, "%x\r\n", answer->i_body );
+        memcpy( &p_chunk[i_chunk], answer->p_body, answer->i_body );
+        i_chunk += answer->i_body;
+        memcpy( &p_chunk[i_chunk], "\r\n", 2 );
+        i_chunk += 2;
+    }
+    if( b_last )
+    {
+        memcpy( &p_chunk[i_chunk], "0\r\n\r\n", 5 );
+        i_chunk += 5;
+        cl->b_chunked = false;
+        cl->b_stream_mode = false;
+    }
+
+    free( answer->p_body );
+    answer->p_body = p_chunk;
+    answer->i_body = i_chunk;
+}
+
+static void httpd_ClientSend( httpd_host_t *host, httpd_client_t *cl )
 {
     int i;
     int i_len;
@@ -1842,9 +1996,13 @@ static void httpd_ClientSend( httpd_client_t *cl )
                 httpd_MsgClean( &cl->answer );
                 cl->answer.i_body_offset = i_offset;
 
-                cl->url->catch[i_msg].cb( cl->url->catch[i_msg].p_sys, cl,
-                                          &cl->answer, &cl->query );
+                vlc_mutex_lock( &host->lock );
+                if( cl->url != NULL )
+                    cl->url->catch[i_msg].cb( cl->url->catch[i_msg].p_sys, cl,
+                                              &cl->answer, &cl->query );
+                vlc_mutex_unlock( &host->lock );
             }
+            httpd_ClientChunk( cl );
 
             if( cl->answer.i_body > 0 )
             {
@@ -1900,427 +2058,632 @@ static void httpd_ClientTlsHandshake( httpd_client_t *cl )
     }
 }
 
-static void* httpd_HostThread( void *data )
+/* Runs the message state machine of a client, and returns the poll events
+ * that it now waits for (host lock held) */
+static short httpd_ClientProcess( httpd_host_t *host, httpd_client_t *cl )
 {
-    httpd_host_t *host = data;
-    int canc = vlc_savecancel();
-
-    vlc_mutex_lock( &host->lock );
-    while( host->i_ref > 0 )
+    if( cl->i_state == HTTPD_CLIENT_RECEIVE_DONE )
     {
-        struct pollfd ufd[host->nfd + host->i_client];
-        unsigned nfd;
-        for( nfd = 0; nfd < host->nfd; nfd++ )
-        {
-            ufd[nfd].fd = host->fds[nfd];
-            ufd[nfd].events = POLLIN;
-            ufd[nfd].revents = 0;
-        }
+        httpd_message_t *answer = &cl->answer;
+        httpd_message_t *query  = &cl->query;
+        int i_msg = query->i_type;
 
-        /* add all socket that should be read/write and close dead connection */
-        while( host->i_url <= 0 )
+        httpd_MsgInit( answer );
+
+        /* Handle what we received */
+        if( i_msg == HTTPD_MSG_ANSWER )
         {
-            mutex_cleanup_push( &host->lock );
-            vlc_restorecancel( canc );
-            vlc_cond_wait( &host->wait, &host->lock );
-            canc = vlc_savecancel();
-            vlc_cleanup_pop();
+            cl->url     = NULL;
+            cl->i_state = HTTPD_CLIENT_DEAD;
         }
-
-        mtime_t now = mdate();
-        bool b_low_delay = false;
-
-        for(int i_client = 0; i_client < host->i_client; i_client++ )
+        else if( i_msg == HTTPD_MSG_OPTIONS )
         {
-            httpd_client_t *cl = host->client[i_client];
-            if( cl->i_ref < 0 || ( cl->i_ref == 0 &&
-                ( cl->i_state == HTTPD_CLIENT_DEAD ||
-                  ( cl->i_activity_timeout > 0 &&
-                    cl->i_activity_date+cl->i_activity_timeout < now) ) ) )
-            {
-                httpd_ClientClean( cl );
-                TAB_REMOVE( host->i_client, host->client, cl );
-                free( cl );
-                i_client--;
-                continue;
-            }
 
-            struct pollfd *pufd = ufd + nfd;
-            assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+            answer->i_type   = HTTPD_MSG_ANSWER;
+            answer->i_proto  = query->i_proto;
+            answer->i_status = 200;
+            answer->i_body = 0;
+            answer->p_body = NULL;
 
-            pufd->fd = cl->fd;
-            pufd->events = pufd->revents = 0;
+            httpd_MsgAdd( answer, "Server", "VLC/%s", VERSION );
+            httpd_MsgAdd( answer, "Content-Length", "0" );
 
-            if( ( cl->i_state == HTTPD_CLIENT_RECEIVING )
-                  || ( cl->i_state == HTTPD_CLIENT_TLS_HS_IN ) )
+            switch( query->i_proto )
             {
-                pufd->events = POLLIN;
-            }
-            else if( ( cl->i_state == HTTPD_CLIENT_SENDING )
-                  || ( cl->i_state == HTTPD_CLIENT_TLS_HS_OUT ) )
-            {
-                pufd->events = POLLOUT;
-            }
-            else if( cl->i_state == HTTPD_CLIENT_RECEIVE_DONE )
-            {
-                httpd_message_t *answer = &cl->answer;
-                httpd_message_t *query  = &cl->query;
-                int i_msg = query->i_type;
-
-                httpd_MsgInit( answer );
+                case HTTPD_PROTO_HTTP:
+                    answer->i_version = 1;
+                    httpd_MsgAdd( answer, "Allow",
+                                  "GET,HEAD,POST,OPTIONS" );
+                    break;
 
-                /* Handle what we received */
-                if( i_msg == HTTPD_MSG_ANSWER )
+                case HTTPD_PROTO_RTSP:
                 {
-                    cl->url     = NULL;
-                    cl->i_state = HTTPD_CLIENT_DEAD;
-                }
-                else if( i_msg == HTTPD_MSG_OPTIONS )
-                {
-
-                    answer->i_type   = HTTPD_MSG_ANSWER;
-                    answer->i_proto  = query->i_proto;
-                    answer->i_status = 200;
-                    answer->i_body = 0;
-                    answer->p_body = NULL;
-
-                    httpd_MsgAdd( answer, "Server", "VLC/%s", VERSION );
-                    httpd_MsgAdd( answer, "Content-Length", "0" );
-
-                    switch( query->i_proto )
+                    const char *p;
+                    answer->i_version = 0;
+
+                    p = httpd_MsgGet( query, "Cseq" );
+                    if( p != NULL )
+                        httpd_MsgAdd( answer, "Cseq", "%s", p );
+                    p = httpd_MsgGet( query, "Timestamp" );
+                    if( p != NULL )
+                        httpd_MsgAdd( answer, "Timestamp", "%s", p );
+
+                    p = httpd_MsgGet( query, "Require" );
+                    if( p != NULL )
                     {
-                        case HTTPD_PROTO_HTTP:
-                            answer->i_version = 1;
-                            httpd_MsgAdd( answer, "Allow",
-                                          "GET,HEAD,POST,OPTIONS" );
-                            break;
-
-                        case HTTPD_PROTO_RTSP:
-                        {
-                            const char *p;
-                            answer->i_version = 0;
-
-                            p = httpd_MsgGet( query, "Cseq" );
-                            if( p != NULL )
-                                httpd_MsgAdd( answer, "Cseq", "%s", p );
-                            p = httpd_MsgGet( query, "Timestamp" );
-                            if( p != NULL )
-                                httpd_MsgAdd( answer, "Timestamp", "%s", p );
-
-                            p = httpd_MsgGet( query, "Require" );
-                            if( p != NULL )
-                            {
-                                answer->i_status = 551;
-                                httpd_MsgAdd( query, "Unsupported", "%s", p );
-                            }
-
-                            httpd_MsgAdd( answer, "Public", "DESCRIBE,SETUP,"
-                                          "TEARDOWN,PLAY,PAUSE,GET_PARAMETER" );
-                            break;
-                        }
+                        answer->i_status = 551;
+                        httpd_MsgAdd( query, "Unsupported", "%s", p );
                     }
 
-                    cl->i_buffer = -1;  /* Force the creation of the answer in
-                                         * httpd_ClientSend */
-                    cl->i_state = HTTPD_CLIENT_SENDING;
+                    httpd_MsgAdd( answer, "Public", "DESCRIBE,SETUP,"
+                                  "TEARDOWN,PLAY,PAUSE,GET_PARAMETER" );
+                    break;
                 }
-                else if( i_msg == HTTPD_MSG_NONE )
-                {
-                    if( query->i_proto == HTTPD_PROTO_NONE )
-                    {
-                        cl->url = NULL;
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    }
-                    else
-                    {
-                        char *p;
+            }
+
+            cl->i_buffer = -1;  /* Force the creation of the answer in
+                                 * httpd_ClientSend */
+            cl->i_state = HTTPD_CLIENT_SENDING;
+        }
+        else if( i_msg == HTTPD_MSG_NONE )
+        {
+            if( query->i_proto == HTTPD_PROTO_NONE )
+            {
+                cl->url = NULL;
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            }
+            else
+            {
+                char *p;
 
-                        /* unimplemented */
-                        answer->i_proto  = query->i_proto ;
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_version= 0;
-                        answer->i_status = 501;
+                /* unimplemented */
+                answer->i_proto  = query->i_proto ;
+                answer->i_type   = HTTPD_MSG_ANSWER;
+                answer->i_version= 0;
+                answer->i_status = 501;
 
-                        answer->i_body = httpd_HtmlError (&p, 501, NULL);
-                        answer->p_body = (uint8_t *)p;
-                        httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
+                answer->i_body = httpd_HtmlError (&p, 501, NULL);
+                answer->p_body = (uint8_t *)p;
+                httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                    }
-                }
-                else
-                {
-                    bool b_auth_failed = false;
+                cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                cl->i_state = HTTPD_CLIENT_SENDING;
+            }
+        }
+        else
+        {
+            bool b_auth_failed = false;
 
-                    /* Search the url and trigger callbacks */
-                    for(int i = 0; i < host->i_url; i++ )
-                    {
-                        httpd_url_t *url = host->url[i];
+            /* Search the url and trigger callbacks */
+            for(int i = 0; i < host->i_url; i++ )
+            {
+                httpd_url_t *url = host->url[i];
 
-                        if( !strcmp( url->psz_url, query->psz_url ) )
+                if( !strcmp( url->psz_url, query->psz_url ) )
+                {
+                    if( url->catch[i_msg].cb )
+                    {
+                        if( answer && ( *url->psz_user || *url->psz_password ) )
                         {
-                            if( url->catch[i_msg].cb )
+                            /* create the headers */
+                            const char *b64 = httpd_MsgGet( query, "Authorization" ); /* BASIC id */
+                            char *user = NULL, *pass = NULL;
+
+                            if( b64 != NULL
+                             && !strncasecmp( b64, "BASIC", 5 ) )
                             {
-                                if( answer && ( *url->psz_user || *url->psz_password ) )
-                                {
-                                    /* create the headers */
-                                    const char *b64 = httpd_MsgGet( query, "Authorization" ); /* BASIC id */
-                                    char *user = NULL, *pass = NULL;
-
-                                    if( b64 != NULL
-                                     && !strncasecmp( b64, "BASIC", 5 ) )
-                                    {
-                                        b64 += 5;
-                                        while( *b64 == ' ' )
-                                            b64++;
-
-                                        user = vlc_b64_decode( b64 );
-                                        if (user != NULL)
-                                        {
-                                            pass = strchr (user, ':');
-                                            if (pass != NULL)
-                                                *pass++ = '\0';
-                                        }
-                                    }
-
-                                    if ((user == NULL) || (pass == NULL)
-                                     || strcmp (user, url->psz_user)
-                                     || strcmp (pass, url->psz_password))
-                                    {
-                                        httpd_MsgAdd( answer,
-                                                      "WWW-Authenticate",
-                                                      "Basic realm=\"VLC stream\"" );
-                                        /* We fail for all url */
-                                        b_auth_failed = true;
-                                        free( user );
-                                        break;
-                                    }
-
-                                    free( user );
-                                }
+                                b64 += 5;
+                                while( *b64 == ' ' )
+                                    b64++;
 
-                                if( !url->catch[i_msg].cb( url->catch[i_msg].p_sys, cl, answer, query ) )
+                                user = vlc_b64_decode( b64 );
+                                if (user != NULL)
                                 {
-                                    if( answer->i_proto == HTTPD_PROTO_NONE )
-                                    {
-                                        /* Raw answer from a CGI */
-                                        cl->i_buffer = cl->i_buffer_size;
-                                    }
-                                    else
-                                        cl->i_buffer = -1;
-
-                                    /* only one url can answer */
-                                    answer = NULL;
-                                    if( cl->url == NULL )
-                                    {
-                                        cl->url = url;
-                                    }
+                                    pass = strchr (user, ':');
+                                    if (pass != NULL)
+                                        *pass++ = '\0';
                                 }
                             }
-                        }
-                    }
 
-                    if( answer )
-                    {
-                        char *p;
-
-                        answer->i_proto  = query->i_proto;
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_version= 0;
+                            if ((user == NULL) || (pass == NULL)
+                             || strcmp (user, url->psz_user)
+                             || strcmp (pass, url->psz_password))
+                            {
+                                httpd_MsgAdd( answer,
+                                              "WWW-Authenticate",
+                                              "Basic realm=\"VLC stream\"" );
+                                /* We fail for all url */
+                                b_auth_failed = true;
+                                free( user );
+                                break;
+                            }
 
-                        if( b_auth_failed )
-                        {
-                            answer->i_status = 401;
+                            free( user );
                         }
-                        else
+
+                        if( !url->catch[i_msg].cb( url->catch[i_msg].p_sys, cl, answer, query ) )
                         {
-                            /* no url registered */
-                            answer->i_status = 404;
-                        }
+                            if( answer->i_proto == HTTPD_PROTO_NONE )
+                            {
+                                /* Raw answer from a CGI */
+                                cl->i_buffer = cl->i_buffer_size;
+                            }
+                            else
+                            {
+                                const char *psz_te = httpd_MsgGet( answer, "Transfer-Encoding" );
 
-                        answer->i_body = httpd_HtmlError (&p,
-                                                          answer->i_status,
-                                                          query->psz_url);
-                        answer->p_body = (uint8_t *)p;
+                                if( psz_te != NULL && answer->i_body_offset > 0 &&
+                                    !strcasecmp( psz_te, "chunked" ) )
+                                    cl->b_stream_mode = cl->b_chunked = true;
+                                cl->i_buffer = -1;
+                            }
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                        httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
-                        httpd_MsgAdd( answer, "Content-Type", "%s", "text/html" );
+                            /* only one url can answer */
+                            answer = NULL;
+                            if( cl->url == NULL )
+                            {
+                                cl->url = url;
+                            }
+                        }
                     }
-
-                    cl->i_state = HTTPD_CLIENT_SENDING;
                 }
             }
-            else if( cl->i_state == HTTPD_CLIENT_SEND_DONE )
+
+            if( answer )
             {
-                if( !cl->b_stream_mode || cl->answer.i_body_offset == 0 )
-                {
-                    const char *psz_connection = httpd_MsgGet( &cl->answer, "Connection" );
-                    const char *psz_query = httpd_MsgGet( &cl->query, "Connection" );
-                    bool b_connection = false;
-                    bool b_keepalive = false;
-                    bool b_query = false;
-
-                    cl->url = NULL;
-                    if( psz_connection )
-                    {
-                        b_connection = ( strcasecmp( psz_connection, "Close" ) == 0 );
-                        b_keepalive = ( strcasecmp( psz_connection, "Keep-Alive" ) == 0 );
-                    }
+                char *p;
 
-                    if( psz_query )
-                    {
-                        b_query = ( strcasecmp( psz_query, "Close" ) == 0 );
-                    }
+                answer->i_proto  = query->i_proto;
+                answer->i_type   = HTTPD_MSG_ANSWER;
+                answer->i_version= 0;
 
-                    if( ( ( cl->query.i_proto == HTTPD_PROTO_HTTP ) &&
-                          ( ( cl->query.i_version == 0 && b_keepalive ) ||
-                            ( cl->query.i_version == 1 && !b_connection ) ) ) ||
-                        ( ( cl->query.i_proto == HTTPD_PROTO_RTSP ) &&
-                          !b_query && !b_connection ) )
-                    {
-                        httpd_MsgClean( &cl->query );
-                        httpd_MsgInit( &cl->query );
-
-                        cl->i_buffer = 0;
-                        cl->i_buffer_size = 1000;
-                        free( cl->p_buffer );
-                        cl->p_buffer = xmalloc( cl->i_buffer_size );
-                        cl->i_state = HTTPD_CLIENT_RECEIVING;
-                    }
-                    else
-                    {
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    }
-                    httpd_MsgClean( &cl->answer );
+                if( b_auth_failed )
+                {
+                    answer->i_status = 401;
                 }
                 else
                 {
-                    int64_t i_offset = cl->answer.i_body_offset;
-                    httpd_MsgClean( &cl->answer );
+                    /* no url registered */
+                    answer->i_status = 404;
+                }
 
-                    cl->answer.i_body_offset = i_offset;
-                    free( cl->p_buffer );
-                    cl->p_buffer = NULL;
-                    cl->i_buffer = 0;
-                    cl->i_buffer_size = 0;
+                answer->i_body = httpd_HtmlError (&p,
+                                                  answer->i_status,
+                                                  query->psz_url);
+                answer->p_body = (uint8_t *)p;
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
-                }
+                cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
+                httpd_MsgAdd( answer, "Content-Type", "%s", "text/html" );
             }
-            else if( cl->i_state == HTTPD_CLIENT_WAITING )
-            {
-                int64_t i_offset = cl->answer.i_body_offset;
-                int     i_msg = cl->query.i_type;
 
-                httpd_MsgInit( &cl->answer );
-                cl->answer.i_body_offset = i_offset;
+            cl->i_state = HTTPD_CLIENT_SENDING;
+        }
+    }
+    if( cl->i_state == HTTPD_CLIENT_SEND_DONE )
+    {
+        if( !cl->b_stream_mode || cl->answer.i_body_offset == 0 )
+        {
+            const char *psz_connection = httpd_MsgGet( &cl->answer, "Connection" );
+            const char *psz_query = httpd_MsgGet( &cl->query, "Connection" );
+            bool b_connection = false;
+            bool b_keepalive = false;
+            bool b_query = false;
+
+            cl->url = NULL;
+            if( psz_connection )
+            {
+                b_connection = ( strcasecmp( psz_connection, "Close" ) == 0 );
+                b_keepalive = ( strcasecmp( psz_connection, "Keep-Alive" ) == 0 );
+            }
 
-                cl->url->catch[i_msg].cb( cl->url->catch[i_msg].p_sys, cl,
-                                          &cl->answer, &cl->query );
-                if( cl->answer.i_type != HTTPD_MSG_NONE )
-                {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
+            if( psz_query )
+            {
+                b_query = ( strcasecmp( psz_query, "Close" ) == 0 );
             }
 
-            if (pufd->events != 0)
-                nfd++;
+            if( ( ( cl->query.i_proto == HTTPD_PROTO_HTTP ) &&
+                  ( ( cl->query.i_version == 0 && b_keepalive ) ||
+                    ( cl->query.i_version == 1 && !b_connection ) ) ) ||
+                ( ( cl->query.i_proto == HTTPD_PROTO_RTSP ) &&
+                  !b_query && !b_connection ) )
+            {
+                httpd_MsgClean( &cl->query );
+                httpd_MsgInit( &cl->query );
+
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 1000;
+                free( cl->p_buffer );
+                cl->p_buffer = xmalloc( cl->i_buffer_size );
+                cl->i_state = HTTPD_CLIENT_RECEIVING;
+            }
             else
-                b_low_delay = true;
+            {
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            }
+            httpd_MsgClean( &cl->answer );
         }
-        vlc_mutex_unlock( &host->lock );
-        vlc_restorecancel( canc );
+        else
+        {
+            int64_t i_offset = cl->answer.i_body_offset;
+            httpd_MsgClean( &cl->answer );
 
-        /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
-        int ret = poll( ufd, nfd, b_low_delay ? 20 : -1 );
+            cl->answer.i_body_offset = i_offset;
+            free( cl->p_buffer );
+            cl->p_buffer = NULL;
+            cl->i_buffer = 0;
+            cl->i_buffer_size = 0;
 
-        canc = vlc_savecancel();
-        vlc_mutex_lock( &host->lock );
-        switch( ret )
+            /* stream clients are sent the queued blocks directly */
+            cl->i_state = cl->p_stream != NULL ? HTTPD_CLIENT_STREAMING
+                                               : HTTPD_CLIENT_WAITING;
+        }
+    }
+    if( cl->i_state == HTTPD_CLIENT_WAITING )
+    {
+        int64_t i_offset = cl->answer.i_body_offset;
+        int     i_msg = cl->query.i_type;
+
+        httpd_MsgInit( &cl->answer );
+        cl->answer.i_body_offset = i_offset;
+
+        cl->url->catch[i_msg].cb( cl->url->catch[i_msg].p_sys, cl,
+                                  &cl->answer, &cl->query );
+        if( cl->answer.i_type != HTTPD_MSG_NONE )
         {
-            case -1:
-                if (errno != EINTR)
-                {
-                    /* Kernel on low memory or a bug: pace */
-                    msg_Err( host, "polling error: %m" );
-                    msleep( 100000 );
-                }
-            case 0:
-                continue;
+            httpd_ClientChunk( cl );
+            /* we have new data, so re-enter send mode */
+            cl->i_buffer      = 0;
+            cl->p_buffer      = cl->answer.p_body;
+            cl->i_buffer_size = cl->answer.i_body;
+            cl->answer.p_body = NULL;
+            cl->answer.i_body = 0;
+            cl->i_state = HTTPD_CLIENT_SENDING;
         }
+    }
+    if( cl->i_state == HTTPD_CLIENT_STREAMING && cl->i_hold == 0 )
+        httpd_StreamHold( cl );
 
-        /* Handle client sockets */
-        now = mdate();
-        nfd = host->nfd;
+    switch( cl->i_state )
+    {
+        case HTTPD_CLIENT_RECEIVING:
+        case HTTPD_CLIENT_TLS_HS_IN:
+            return POLLIN;
+        case HTTPD_CLIENT_SENDING:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            return POLLOUT;
+        case HTTPD_CLIENT_STREAMING:
+            return ( cl->i_hold > 0 ) ? POLLOUT : 0;
+    }
+    return 0;
+}
 
-        for( int i_client = 0; i_client < host->i_client; i_client++ )
+/* Sends the held blocks to a stream client */
+static void httpd_ClientStream( httpd_client_t *cl, short revents )
+{
+    ssize_t i_len;
+
+    if( cl->i_hold == 0 )
+    {
+        /* no data yet, only waiting for errors */
+        if( revents & (POLLERR|POLLHUP) )
+            cl->i_state = HTTPD_CLIENT_DEAD;
+        return;
+    }
+
+#ifndef _WIN32
+    if( cl->p_tls == NULL )
+    {
+        struct iovec iov[HTTPD_STREAM_IOV];
+
+        for( unsigned i = 0; i < cl->i_hold; i++ )
         {
-            httpd_client_t *cl = host->client[i_client];
-            const struct pollfd *pufd = &ufd[nfd];
+            iov[i].iov_base = cl->pp_hold[i]->p_buffer;
+            iov[i].iov_len = cl->pp_hold[i]->i_buffer;
+        }
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + cl->i_stream_offset;
+        iov[0].iov_len -= cl->i_stream_offset;
 
-            assert( pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])] );
+        do
+            i_len = writev( cl->fd, iov, cl->i_hold );
+        while( i_len == -1 && errno == EINTR );
+    }
+    else
+#endif
+        i_len = httpd_NetSend( cl,
+                    cl->pp_hold[0]->p_buffer + cl->i_stream_offset,
+                    cl->pp_hold[0]->i_buffer - cl->i_stream_offset );
 
-            if( cl->fd != pufd->fd )
-                continue; // we were not waiting for this client
-            ++nfd;
-            if( pufd->revents == 0 )
-                continue; // no event received
+    if( i_len > 0 )
+    {
+        size_t i_sent = cl->i_stream_offset + i_len;
+
+        for( unsigned i = 0;
+             i < cl->i_hold && i_sent >= cl->pp_hold[i]->i_buffer; i++ )
+        {
+            i_sent -= cl->pp_hold[i]->i_buffer;
+            cl->i_stream_seq++;
+        }
+        cl->i_stream_offset = i_sent;
+    }
+#if defined( _WIN32 )
+    else if( i_len == 0 || WSAGetLastError() != WSAEWOULDBLOCK )
+#else
+    else if( i_len == 0 || errno != EAGAIN )
+#endif
+    {
+        /* error */
+        cl->i_state = HTTPD_CLIENT_DEAD;
+    }
+    httpd_StreamRelease( cl );
+}
 
-            cl->i_activity_date = now;
+/* Does the I/O that a client is ready for (without the host lock) */
+static void httpd_ClientIO( httpd_host_t *host, httpd_client_t *cl,
+                            short revents, mtime_t now )
+{
+    cl->i_activity_date = now;
 
-            if( cl->i_state == HTTPD_CLIENT_RECEIVING )
-            {
-                httpd_ClientRecv( cl );
-            }
-            else if( cl->i_state == HTTPD_CLIENT_SENDING )
-            {
-                httpd_ClientSend( cl );
-            }
-            else if( cl->i_state == HTTPD_CLIENT_TLS_HS_IN
-                  || cl->i_state == HTTPD_CLIENT_TLS_HS_OUT )
+    switch( cl->i_state )
+    {
+        case HTTPD_CLIENT_RECEIVING:
+            httpd_ClientRecv( cl );
+            break;
+        case HTTPD_CLIENT_SENDING:
+            httpd_ClientSend( host, cl );
+            break;
+        case HTTPD_CLIENT_STREAMING:
+            httpd_ClientStream( cl, revents );
+            break;
+        case HTTPD_CLIENT_TLS_HS_IN:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            httpd_ClientTlsHandshake( cl );
+            break;
+        default:
+            /* not waiting for data: the connection was closed */
+            if( revents & (POLLERR|POLLHUP) )
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            break;
+    }
+}
+
+/* Sets the poll events a client waits for */
+static void httpd_WorkerWatch( httpd_worker_t *w, httpd_client_t *cl,
+                               short i_events )
+{
+#ifdef HAVE_EPOLL_CREATE1
+    if( cl->i_events != i_events )
+    {
+        struct epoll_event ev;
+
+        ev.events = ( ( i_events & POLLIN ) ? EPOLLIN : 0 )
+                  | ( ( i_events & POLLOUT ) ? EPOLLOUT : 0 );
+        ev.data.ptr = cl;
+        epoll_ctl( w->epfd, EPOLL_CTL_MOD, cl->fd, &ev );
+    }
+#else
+    (void) w;
+#endif
+    cl->i_events = i_events;
+}
+
+/* Accepts a new connection, if any (host lock held) */
+static void httpd_WorkerAccept( httpd_worker_t *w, int fd, mtime_t now )
+{
+    httpd_host_t *host = w->host;
+    httpd_client_t *cl;
+
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+                &(int){ 1 }, sizeof(int));
+
+    vlc_tls_t *p_tls;
+
+    if( host->p_tls != NULL )
+        p_tls = vlc_tls_SessionCreate( host->p_tls, fd, NULL );
+    else
+        p_tls = NULL;
+
+    cl = httpd_ClientNew( fd, p_tls, now );
+    if( unlikely(cl == NULL) )
+    {
+        if( p_tls != NULL )
+            vlc_tls_SessionDelete( p_tls );
+        net_Close( fd );
+        return;
+    }
+
+#ifdef HAVE_EPOLL_CREATE1
+    struct epoll_event ev;
+
+    ev.events = 0;
+    ev.data.ptr = cl;
+    if( epoll_ctl( w->epfd, EPOLL_CTL_ADD, fd, &ev ) )
+    {
+        msg_Err( host, "cannot watch connection: %m" );
+        httpd_ClientClean( cl );
+        free( cl );
+        return;
+    }
+#endif
+    TAB_APPEND( w->i_client, w->client, cl );
+}
+
+static void* httpd_WorkerThread( void *data )
+{
+    httpd_worker_t *w = data;
+    httpd_host_t *host = w->host;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &host->lock );
+    while( host->i_ref > 0 )
+    {
+        /* wait for an url to serve */
+        while( host->i_url <= 0 )
+        {
+            mutex_cleanup_push( &host->lock );
+            vlc_restorecancel( canc );
+            vlc_cond_wait( &host->wait, &host->lock );
+            canc = vlc_savecancel();
+            vlc_cleanup_pop();
+        }
+
+        mtime_t now = mdate();
+        bool b_low_delay = false;
+
+        /* process the received messages and close dead connections */
+        for( int i_client = 0; i_client < w->i_client; i_client++ )
+        {
+            httpd_client_t *cl = w->client[i_client];
+            if( cl->b_killed || cl->i_ref < 0 || ( cl->i_ref == 0 &&
+                ( cl->i_state == HTTPD_CLIENT_DEAD ||
+                  ( cl->i_activity_timeout > 0 &&
+                    cl->i_activity_date+cl->i_activity_timeout < now) ) ) )
             {
-                httpd_ClientTlsHandshake( cl );
+                httpd_ClientClean( cl );
+                TAB_REMOVE( w->i_client, w->client, cl );
+                free( cl );
+                i_client--;
+                continue;
             }
+
+            short i_events = httpd_ClientProcess( host, cl );
+            if( i_events == 0 )
+                b_low_delay = true;
+            httpd_WorkerWatch( w, cl, i_events );
         }
+        vlc_mutex_unlock( &host->lock );
+
+        /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
+        int i_timeout = b_low_delay ? 20 : -1;
+        bool b_accept = false;
+#ifdef HAVE_EPOLL_CREATE1
+        struct epoll_event ev[64];
+
+        vlc_restorecancel( canc );
+        int ret = epoll_wait( w->epfd, ev, 64, i_timeout );
+        canc = vlc_savecancel();
+#else
+        /* clients are only added and removed by this thread */
+        struct pollfd ufd[host->nfd + w->i_client];
+        unsigned nfd;
 
-        /* Handle server sockets (accept new connections) */
         for( nfd = 0; nfd < host->nfd; nfd++ )
         {
-            httpd_client_t *cl;
-            int fd = ufd[nfd].fd;
-
-            assert (fd == host->fds[nfd]);
+            ufd[nfd].fd = host->fds[nfd];
+            ufd[nfd].events = POLLIN;
+            ufd[nfd].revents = 0;
+        }
+        for( int i_client = 0; i_client < w->i_client; i_client++ )
+        {
+            httpd_client_t *cl = w->client[i_client];
 
-            if( ufd[nfd].revents == 0 )
-                continue;
+            ufd[nfd].fd = cl->fd;
+            ufd[nfd].events = cl->i_events;
+            ufd[nfd].revents = 0;
+            nfd++;
+        }
 
-            /* */
-            fd = vlc_accept (fd, NULL, NULL, true);
-            if (fd == -1)
-                continue;
-            setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                        &(int){ 1 }, sizeof(int));
+        vlc_restorecancel( canc );
+        int ret = poll( ufd, nfd, i_timeout );
+        canc = vlc_savecancel();
+#endif
+        if( ret == -1 && errno != EINTR )
+        {
+            /* Kernel on low memory or a bug: pace */
+            msg_Err( host, "polling error: %m" );
+            msleep( 100000 );
+        }
 
-            vlc_tls_t *p_tls;
+        /* Handle client sockets */
+        now = mdate();
+#ifdef HAVE_EPOLL_CREATE1
+        for( int i = 0; i < ret; i++ )
+        {
+            httpd_client_t *cl = ev[i].data.ptr;
+            short revents = 0;
 
-            if( host->p_tls != NULL )
-                p_tls = vlc_tls_SessionCreate( host->p_tls, fd, NULL );
+            if( cl == NULL )
+            {
+                b_accept = true;
+                continue;
+            }
+            if( ev[i].events & EPOLLIN )
+                revents |= POLLIN;
+            if( ev[i].events & EPOLLOUT )
+                revents |= POLLOUT;
+            if( ev[i].events & EPOLLERR )
+                revents |= POLLERR;
+            if( ev[i].events & EPOLLHUP )
+                revents |= POLLHUP;
+            httpd_ClientIO( host, cl, revents, now );
+        }
+#else
+        for( unsigned i = 0; ret > 0 && i < nfd; i++ )
+        {
+            if( ufd[i].revents == 0 )
+                continue; // no event received
+            if( i < host->nfd )
+                b_accept = true;
             else
-                p_tls = NULL;
+                httpd_ClientIO( host, w->client[i - host->nfd],
+                                ufd[i].revents, now );
+        }
+#endif
 
-            cl = httpd_ClientNew( fd, p_tls, now );
+        vlc_mutex_lock( &host->lock );
 
-            TAB_APPEND( host->i_client, host->client, cl );
-        }
+        /* Handle server sockets (accept new connections) */
+        if( b_accept )
+            for( unsigned i = 0; i < host->nfd; i++ )
+                httpd_WorkerAccept( w, host->fds[i], now );
     }
     vlc_mutex_unlock( &host->lock );
     return NULL;
 }
+
+static int httpd_WorkerStart( httpd_host_t *host, httpd_worker_t *w )
+{
+    w->host = host;
+    w->i_client = 0;
+    w->client = NULL;
+
+#ifdef HAVE_EPOLL_CREATE1
+    w->epfd = epoll_create1( EPOLL_CLOEXEC );
+    if( w->epfd == -1 )
+    {
+        msg_Err( host, "cannot create polling instance: %m" );
+        return -1;
+    }
+
+    /* the connections are shared by the threads as they accept them */
+    for( unsigned i = 0; i < host->nfd; i++ )
+    {
+        struct epoll_event ev;
+
+        ev.events = EPOLLIN;
+# ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;
+# endif
+        ev.data.ptr = NULL;
+        if( epoll_ctl( w->epfd, EPOLL_CTL_ADD, host->fds[i], &ev ) )
+        {
+            msg_Err( host, "cannot watch socket: %m" );
+            close( w->epfd );
+            return -1;
+        }
+    }
+#endif
+
+    if( vlc_clone( &w->thread, httpd_WorkerThread, w,
+                   VLC_THREAD_PRIORITY_LOW ) )
+    {
+#ifdef HAVE_EPOLL_CREATE1
+        close( w->epfd );
+#endif
+        return -1;
+    }
+    return 0;
+}
@@ -50,6 +50,7 @@
 #endif
 
 #include <vlc_network.h>
+#include <vlc_block.h>
 
 #ifndef INADDR_ANY
 #   define INADDR_ANY  0x00000000
@@ -441,6 +442,67 @@ error:
     return -1;
 }
 
+/**
+ * Sends blocks as datagrams on a connected socket, with as few system calls
+ * as possible (one per NET_SEND_BATCH blocks where sendmmsg() exists).
+ * Does not wait: stops at the first block the socket would not take.
+ *
+ * @return the number of blocks sent, or -1 if none could be sent
+ * (net_errno is then set).
+ */
+int net_SendBlocks( int fd, block_t *const *pp_blocks, unsigned i_count )
+{
+    unsigned i_sent = 0;
+
+#ifdef HAVE_SENDMMSG
+# define NET_SEND_BATCH 64
+    struct mmsghdr msgv[NET_SEND_BATCH];
+    struct iovec iov[NET_SEND_BATCH];
+
+    while( i_sent < i_count )
+    {
+        unsigned n = __MIN( i_count - i_sent, NET_SEND_BATCH );
+
+        memset( msgv, 0, n * sizeof( *msgv ) );
+        for( unsigned i = 0; i < n; i++ )
+        {
+            iov[i].iov_base = pp_blocks[i_sent + i]->p_buffer;
+            iov[i].iov_len = pp_blocks[i_sent + i]->i_buffer;
+            msgv[i].msg_hdr.msg_iov = &iov[i];
+            msgv[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int val = sendmmsg( fd, msgv, n, 0 );
+        if( val == -1 )
+        {
+            if( net_errno == EINTR )
+                continue;
+            break;
+        }
+        i_sent += val;
+        if( (unsigned)val < n )
+            break;
+    }
+#else
+    while( i_sent < i_count )
+    {
+        const block_t *p_block = pp_blocks[i_sent];
+
+        if( send( fd, p_block->p_buffer, p_block->i_buffer, 0 ) == -1 )
+        {
+            if( net_errno == EINTR )
+                continue;
+            break;
+        }
+        i_sent++;
+    }
+#endif
+
+    if( i_sent == 0 && i_count > 0 )
+        return -1;
+    return i_sent;
+}
+
 #undef net_Gets
 /**
  * Reads a line from a file descriptor.
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * http.c: test the HTTP access connection reuse
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <string.h>
+
+#include "../http_server.h"
+
+/* A file served with byte ranges, by a server keeping the connections */
+#define FILE_SIZE   (2 * 1024 * 1024)
+#define SEEKS       20
+#define READ_SIZE   4096
+
+static uint8_t data_byte( uint64_t i_pos )
+{
+    return ( (uint32_t)i_pos * UINT32_C(2654435761) ) >> 24;
+}
+
+/* Returns the body of a resource */
+static char *resource( const char *psz_path, size_t *pi_size )
+{
+    if( strcmp( psz_path, "/file" ) )
+        return NULL;
+
+    uint8_t *p = malloc( FILE_SIZE );
+    if( p == NULL )
+        return NULL;
+    for( uint64_t i = 0; i < FILE_SIZE; i++ )
+        p[i] = data_byte( i );
+    *pi_size = FILE_SIZE;
+    return (char *)p;
+}
+
+static unsigned connections( void )
+{
+    http_server_stats_t stats;
+
+    http_server_get_stats( &stats );
+    return stats.connections;
+}
+
+static stream_t *open_file( vlc_object_t *obj )
+{
+    char psz_url[64];
+
+    snprintf( psz_url, sizeof( psz_url ), "http://127.0.0.1:%u/file",
+              http_server_port() );
+    return stream_UrlNew( obj, psz_url );
+}
+
+static void check_read( stream_t *s, uint64_t i_pos, size_t i_size )
+{
+    uint8_t buf[READ_SIZE];
+
+    assert( i_size <= sizeof( buf ) );
+    int val = stream_Read( s, buf, i_size );
+    assert( val == (int)i_size );
+    for( int i = 0; i < val; i++ )
+        assert( buf[i] == data_byte( i_pos + i ) );
+    (void) i_pos;
+}
+
+/* Reading files from the same server one after the other */
+static int test_sequential( vlc_object_t *obj )
+{
+    for( unsigned i = 0; i < 2; i++ )
+    {
+        stream_t *s = open_file( obj );
+        if( s == NULL )
+            return -1;
+        assert( stream_Size( s ) == FILE_SIZE );
+
+        for( uint64_t i_pos = 0; i_pos < FILE_SIZE; i_pos += READ_SIZE )
+            check_read( s, i_pos, READ_SIZE );
+        uint8_t byte;
+        int val = stream_Read( s, &byte, 1 );
+        assert( val == 0 );
+        (void) val;
+        stream_Delete( s );
+    }
+    log( "2 files read with %u connections\n", connections() );
+
+    /* the second one used the kept connection */
+    assert( connections() == 1 );
+    return 0;
+}
+
+/* Seeking in a file */
+static void test_seek( vlc_object_t *obj )
+{
+    unsigned i_before = connections();
+    stream_t *s = open_file( obj );
+    assert( s != NULL );
+
+    check_read( s, 0, READ_SIZE );
+    for( unsigned i = 0; i < SEEKS; i++ )
+    {
+        /* far enough from the data that was read before */
+        uint64_t i_pos = ( i * 7 % SEEKS ) * ( FILE_SIZE / SEEKS ) + i * 13;
+        if( i_pos + READ_SIZE > FILE_SIZE )
+            i_pos = FILE_SIZE - READ_SIZE;
+
+        int val = stream_Seek( s, i_pos );
+        assert( val == VLC_SUCCESS );
+        (void) val;
+        check_read( s, i_pos, READ_SIZE );
+    }
+    stream_Delete( s );
+
+    http_server_stats_t stats;
+    http_server_get_stats( &stats );
+    unsigned n = stats.connections - i_before;
+    log( "%u seeks with %u new connections, %u requests\n", SEEKS, n,
+         stats.requests );
+
+    /* only the first, open-ended, response was not read to the end */
+    assert( n <= 2 );
+}
+
+int main( void )
+{
+    test_init();
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs,
+                                           test_defaults_args );
+    assert( p_vlc != NULL );
+
+    vlc_object_t *obj = vlc_object_create( p_vlc->p_libvlc_int,
+                                           sizeof( *obj ) );
+    assert( obj != NULL );
+
+    http_server_start( resource, true );
+
+    int i_ret = 0;
+    if( test_sequential( obj ) < 0 )
+    {
+        log( "HTTP access not available, skipping\n" );
+        i_ret = 77;
+    }
+    else
+        test_seek( obj );
+
+    http_server_stop();
+
+    vlc_object_release( obj );
+    libvlc_release( p_vlc );
+    return i_ret;
+}
@@ -0,0 +1,264 @@
+/*****************************************************************************
+ * rtp.c: test the RTP FEC (SMPTE 2022-1) recovery over a lossy loopback
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../../../modules/access/rtp/fec.h"
+
+/* Matrices of L columns and D rows of media packets, each followed by its
+ * row and column FEC packets; the first sequence number is chosen for the
+ * sequence to wrap around */
+#define L           10
+#define D           5
+#define MATRICES    40
+#define FIRST_SEQ   65000
+#define LOSS        5       /* percentage of lost media packets */
+#define PT_MEDIA    33
+#define PT_FEC      96
+#define MAX_PAYLOAD 1316
+
+static uint8_t media[L * D][RTP_FEC_MTU];
+static size_t media_len[L * D];
+static bool received[L * D];
+
+/* Builds the FEC packet protecting count packets, offset apart */
+static size_t fec_build( uint8_t *buf, unsigned first, unsigned offset,
+                         unsigned count, bool b_row, uint16_t seq )
+{
+    size_t size = 0;
+
+    for( unsigned k = 0; k < count; k++ )
+        size = __MAX( size, media_len[first + k * offset] - 12 );
+
+    memset( buf, 0, 28 + size );
+    buf[0] = 0x80;
+    buf[1] = PT_FEC;
+    SetWBE( buf + 2, seq );
+    SetWBE( buf + 12, GetWBE( media[first] + 2 ) ); /* SNBase */
+    buf[16] = 0x80; /* E */
+    buf[24] = b_row ? 0x40 : 0x00; /* D */
+    buf[25] = offset;
+    buf[26] = count;
+
+    uint16_t len = 0;
+    for( unsigned k = 0; k < count; k++ )
+    {
+        const uint8_t *p = media[first + k * offset];
+        size_t i_len = media_len[first + k * offset];
+
+        buf[0] ^= p[0] & 0x3F;
+        buf[1] ^= p[1] & 0x80;
+        buf[16] ^= p[1] & 0x7F;
+        len ^= i_len - 12;
+        for( unsigned i = 0; i < 4; i++ )
+            buf[20 + i] ^= p[4 + i];
+        for( size_t i = 12; i < i_len; i++ )
+            buf[16 + i] ^= p[i];
+    }
+    SetWBE( buf + 14, len );
+    return 28 + size;
+}
+
+/* Counts the lost packets that the rows and columns can recover, once
+ * recovered packets are used to recover others */
+static unsigned recoverable( void )
+{
+    bool have[L * D];
+    unsigned n = 0;
+    bool progress = true;
+
+    memcpy( have, received, sizeof( have ) );
+    while( progress )
+    {
+        progress = false;
+        for( unsigned r = 0; r < D; r++ )
+        {
+            unsigned missing = 0, last = 0;
+            for( unsigned c = 0; c < L; c++ )
+                if( !have[r * L + c] )
+                    missing++, last = r * L + c;
+            if( missing == 1 )
+                have[last] = true, n++, progress = true;
+        }
+        for( unsigned c = 0; c < L; c++ )
+        {
+            unsigned missing = 0, last = 0;
+            for( unsigned r = 0; r < D; r++ )
+                if( !have[r * L + c] )
+                    missing++, last = r * L + c;
+            if( missing == 1 )
+                have[last] = true, n++, progress = true;
+        }
+    }
+    return n;
+}
+
+static void loopback( int fd[2] )
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof( addr );
+
+    for( unsigned i = 0; i < 2; i++ )
+    {
+        fd[i] = socket( AF_INET, SOCK_DGRAM, 0 );
+        assert( fd[i] != -1 );
+    }
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = bind( fd[1], (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = getsockname( fd[1], (struct sockaddr *)&addr, &len );
+    assert( val == 0 );
+    val = connect( fd[0], (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    (void) val;
+}
+
+static void send_packet( int fd, const uint8_t *p, size_t len )
+{
+    ssize_t val = send( fd, p, len, 0 );
+    assert( val == (ssize_t)len );
+    (void) val;
+}
+
+int main( void )
+{
+    test_init();
+
+    int fd[2];
+    loopback( fd );
+
+    rtp_fec_t *fec = rtp_fec_create();
+    assert( fec != NULL );
+
+    srand( 42 );
+
+    uint16_t seq = FIRST_SEQ, fec_seq = 0;
+    unsigned i_lost = 0, i_recovered = 0, i_expected = 0;
+    mtime_t i_time = 0;
+
+    for( unsigned m = 0; m < MATRICES; m++ )
+    {
+        /* media, with random sizes, markers and losses */
+        for( unsigned i = 0; i < L * D; i++ )
+        {
+            uint8_t *p = media[i];
+
+            media_len[i] = 12 + 1 + rand() % MAX_PAYLOAD;
+            p[0] = 0x80;
+            p[1] = ( ( rand() & 1 ) ? 0x80 : 0 ) | PT_MEDIA;
+            SetWBE( p + 2, seq++ );
+            SetDWBE( p + 4, 3600 * ( m * L * D + i ) );
+            SetDWBE( p + 8, 0x12345678 );
+            for( size_t j = 12; j < media_len[i]; j++ )
+                p[j] = rand();
+
+            received[i] = ( rand() % 100 ) >= LOSS;
+            if( received[i] )
+                send_packet( fd[0], p, media_len[i] );
+            else
+                i_lost++;
+        }
+
+        /* rows, then columns */
+        uint8_t buf[RTP_FEC_SIZE];
+        for( unsigned r = 0; r < D; r++ )
+            send_packet( fd[0], buf,
+                         fec_build( buf, r * L, 1, L, true, fec_seq++ ) );
+        for( unsigned c = 0; c < L; c++ )
+            send_packet( fd[0], buf,
+                         fec_build( buf, c, L, D, false, fec_seq++ ) );
+
+        /* receive what was not lost */
+        for( ;; )
+        {
+            block_t *block = block_Alloc( RTP_FEC_SIZE );
+            assert( block != NULL );
+
+            ssize_t val = recv( fd[1], block->p_buffer, block->i_buffer,
+                                MSG_DONTWAIT );
+            if( val == -1 )
+            {
+                assert( errno == EAGAIN || errno == EWOULDBLOCK );
+                block_Release( block );
+                break;
+            }
+            block->i_buffer = val;
+            if( ( block->p_buffer[1] & 0x7F ) == PT_FEC )
+                rtp_fec_queue( fec, block );
+            else
+            {
+                rtp_fec_media( fec, block );
+                block_Release( block );
+            }
+        }
+
+        /* recover the lost ones, and check them */
+        unsigned i_expect = recoverable();
+        mtime_t i_start = mdate();
+        for( bool progress = true; progress; )
+        {
+            progress = false;
+            for( unsigned i = 0; i < L * D; i++ )
+            {
+                if( received[i] )
+                    continue;
+
+                block_t *block = rtp_fec_recover( fec,
+                                                  GetWBE( media[i] + 2 ) );
+                if( block == NULL )
+                    continue;
+                assert( block->i_buffer == media_len[i] );
+                assert( !memcmp( block->p_buffer, media[i], media_len[i] ) );
+                block_Release( block );
+                received[i] = true;
+                i_recovered++;
+                progress = true;
+            }
+        }
+        i_time += mdate() - i_start;
+        i_expected += i_expect;
+
+        /* the ones left cannot be recovered */
+        for( unsigned i = 0; i < L * D; i++ )
+            assert( received[i]
+                 || rtp_fec_recover( fec, GetWBE( media[i] + 2 ) ) == NULL );
+    }
+
+    log( "%u packets lost out of %u, %u recovered in %"PRId64" us\n",
+         i_lost, MATRICES * L * D, i_recovered, i_time );
+    assert( i_recovered > 0 );
+    assert( i_recovered == i_expected );
+
+    rtp_fec_destroy( fec );
+    close( fd[0] );
+    close( fd[1] );
+    return 0;
+}
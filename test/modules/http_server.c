@@ -0,0 +1,256 @@
+/*****************************************************************************
+ * http_server.c: HTTP server on the loopback for the network module tests
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+
+#undef NDEBUG
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "http_server.h"
+
+#define SERVERS     8
+#define CHUNK       4096
+
+static struct
+{
+    int         fd;
+    unsigned    port;
+    vlc_thread_t threads[SERVERS];
+    http_resource_cb resource;
+    bool        b_keep_alive;
+
+    vlc_mutex_t lock;
+    int         clients[SERVERS];   /* -1 if none */
+    unsigned    rate;   /* bytes per second, 0 for unlimited */
+    mtime_t     date;   /* when the link is free again */
+    http_server_stats_t stats;
+} server;
+
+/* Sends at the rate of the (shared) link */
+static bool send_throttled( int fd, const char *p, size_t i_size )
+{
+    while( i_size > 0 )
+    {
+        size_t i_chunk = __MIN( i_size, CHUNK );
+
+        vlc_mutex_lock( &server.lock );
+        mtime_t i_date = __MAX( mdate(), server.date );
+        if( server.rate > 0 )
+            server.date = i_date + (mtime_t)i_chunk * CLOCK_FREQ / server.rate;
+        vlc_mutex_unlock( &server.lock );
+        mwait( i_date );
+
+        ssize_t val = send( fd, p, i_chunk, MSG_NOSIGNAL );
+        if( val <= 0 )
+            return false;
+        p += val;
+        i_size -= val;
+    }
+    return true;
+}
+
+/* Answers one request, returns false to close the connection */
+static bool answer( int fd, const char *req, const char *end )
+{
+    char path[256];
+    size_t i_size = 0;
+    char *p_body = NULL;
+
+    if( sscanf( req, "GET %255s ", path ) == 1 )
+        p_body = server.resource( path, &i_size );
+
+    const char *psz_close = strstr( req, "\r\nConnection: close" );
+    bool b_close = !server.b_keep_alive || ( psz_close && psz_close < end );
+
+    char header[256];
+    uint64_t i_start = 0, i_end = i_size - 1;
+    const char *psz_range = strstr( req, "\r\nRange: bytes=" );
+    if( p_body == NULL )
+        snprintf( header, sizeof( header ), "HTTP/1.1 404 Not Found\r\n"
+                  "Content-Length: 0\r\n%s\r\n",
+                  b_close ? "Connection: close\r\n" : "" );
+    else if( psz_range != NULL && psz_range < end && i_size > 0 )
+    {
+        int val = sscanf( psz_range, "\r\nRange: bytes=%"SCNu64"-%"SCNu64,
+                          &i_start, &i_end );
+        assert( val >= 1 && i_start < i_size );
+        (void) val;
+        if( i_end >= i_size )
+            i_end = i_size - 1;
+        snprintf( header, sizeof( header ), "HTTP/1.1 206 Partial Content\r\n"
+                  "Content-Range: bytes %"PRIu64"-%"PRIu64"/%zu\r\n"
+                  "Content-Length: %"PRIu64"\r\n%s\r\n", i_start, i_end,
+                  i_size, i_end + 1 - i_start,
+                  b_close ? "Connection: close\r\n" : "" );
+    }
+    else
+        snprintf( header, sizeof( header ), "HTTP/1.1 200 OK\r\n"
+                  "Accept-Ranges: bytes\r\nContent-Length: %zu\r\n%s\r\n",
+                  i_size, b_close ? "Connection: close\r\n" : "" );
+
+    bool b_ok = send( fd, header, strlen( header ), MSG_NOSIGNAL ) > 0;
+    if( b_ok && p_body != NULL && i_size > 0 )
+        b_ok = send_throttled( fd, p_body + i_start, i_end + 1 - i_start );
+    free( p_body );
+    return b_ok && !b_close;
+}
+
+/* Answers the requests of a connection, until one of them closes it */
+static void serve_client( int fd )
+{
+    char req[2048];
+    size_t i_req = 0;
+
+    for( ;; )
+    {
+        char *end;
+        req[i_req] = '\0';
+        while( ( end = strstr( req, "\r\n\r\n" ) ) == NULL )
+        {
+            if( i_req >= sizeof( req ) - 1 )
+                return;
+            ssize_t val = recv( fd, req + i_req, sizeof( req ) - 1 - i_req, 0 );
+            if( val <= 0 )
+                return;
+            i_req += val;
+            req[i_req] = '\0';
+        }
+        end += 4;
+
+        vlc_mutex_lock( &server.lock );
+        server.stats.requests++;
+        if( ++server.stats.active > server.stats.max_active )
+            server.stats.max_active = server.stats.active;
+        vlc_mutex_unlock( &server.lock );
+
+        bool b_keep = answer( fd, req, end );
+
+        vlc_mutex_lock( &server.lock );
+        server.stats.active--;
+        vlc_mutex_unlock( &server.lock );
+        if( !b_keep )
+            return;
+
+        /* keep what was received of the next request */
+        i_req -= end - req;
+        memmove( req, end, i_req );
+    }
+}
+
+static void *serve( void *data )
+{
+    int *p_client = data;
+
+    for( ;; )
+    {
+        int fd = accept( server.fd, NULL, NULL );
+        if( fd == -1 )
+            break; /* shut down */
+
+        vlc_mutex_lock( &server.lock );
+        server.stats.connections++;
+        *p_client = fd;
+        vlc_mutex_unlock( &server.lock );
+
+        serve_client( fd );
+
+        vlc_mutex_lock( &server.lock );
+        *p_client = -1;
+        vlc_mutex_unlock( &server.lock );
+        close( fd );
+    }
+    return NULL;
+}
+
+void http_server_start( http_resource_cb resource, bool b_keep_alive )
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof( addr );
+
+    server.fd = socket( AF_INET, SOCK_STREAM, 0 );
+    assert( server.fd != -1 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = bind( server.fd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = getsockname( server.fd, (struct sockaddr *)&addr, &len );
+    assert( val == 0 );
+    val = listen( server.fd, 16 );
+    assert( val == 0 );
+    (void) val;
+    server.port = ntohs( addr.sin_port );
+    server.resource = resource;
+    server.b_keep_alive = b_keep_alive;
+
+    vlc_mutex_init( &server.lock );
+    server.rate = 0;
+    server.date = 0;
+    memset( &server.stats, 0, sizeof( server.stats ) );
+    for( unsigned i = 0; i < SERVERS; i++ )
+    {
+        server.clients[i] = -1;
+        val = vlc_clone( &server.threads[i], serve, &server.clients[i],
+                         VLC_THREAD_PRIORITY_LOW );
+        assert( val == 0 );
+    }
+}
+
+void http_server_stop( void )
+{
+    shutdown( server.fd, SHUT_RDWR );
+    /* the clients may keep their connections */
+    vlc_mutex_lock( &server.lock );
+    for( unsigned i = 0; i < SERVERS; i++ )
+        if( server.clients[i] != -1 )
+            shutdown( server.clients[i], SHUT_RDWR );
+    vlc_mutex_unlock( &server.lock );
+    for( unsigned i = 0; i < SERVERS; i++ )
+        vlc_join( server.threads[i], NULL );
+    close( server.fd );
+    vlc_mutex_destroy( &server.lock );
+}
+
+unsigned http_server_port( void )
+{
+    return server.port;
+}
+
+void http_server_set_rate( unsigned i_rate )
+{
+    vlc_mutex_lock( &server.lock );
+    server.rate = i_rate;
+    vlc_mutex_unlock( &server.lock );
+}
+
+void http_server_get_stats( http_server_stats_t *p_stats )
+{
+    vlc_mutex_lock( &server.lock );
+    *p_stats = server.stats;
+    vlc_mutex_unlock( &server.lock );
+}
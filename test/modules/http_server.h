@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * http_server.h: HTTP server on the loopback for the network module tests
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef TEST_HTTP_SERVER_H
+#define TEST_HTTP_SERVER_H
+
+/**
+ * Returns the body of a resource, allocated with malloc(), or NULL to answer
+ * 404. It is called from the threads of the server.
+ */
+typedef char *(*http_resource_cb)( const char *psz_path, size_t *pi_size );
+
+typedef struct
+{
+    unsigned connections;   /* accepted so far */
+    unsigned requests;
+    unsigned active;        /* requests being answered */
+    unsigned max_active;
+} http_server_stats_t;
+
+/**
+ * Starts the server on a free port of the loopback. Byte ranges are always
+ * served; the connections are kept between requests if b_keep_alive.
+ */
+void http_server_start( http_resource_cb, bool b_keep_alive );
+void http_server_stop( void );
+
+unsigned http_server_port( void );
+
+/** Throttles the bodies, sent over one shared link (0 for unlimited). */
+void http_server_set_rate( unsigned i_rate );
+
+void http_server_get_stats( http_server_stats_t * );
+
+#endif
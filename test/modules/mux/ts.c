@@ -0,0 +1,202 @@
+/*****************************************************************************
+ * ts.c: test and benchmark the TS muxer
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+
+/* One high bitrate video and several audio tracks */
+#define VIDEO_BITRATE   (80 * 1000 * 1000)
+#define AUDIO_BITRATE   (384 * 1000)
+#define AUDIO_STREAMS   8
+#define DURATION        (4 * CLOCK_FREQ)
+#define PCR_INTERVAL    (100 * 1000)
+
+#define VIDEO_FRAME     (CLOCK_FREQ / 25)
+#define AUDIO_FRAME     (CLOCK_FREQ * 1152 / 48000)
+
+static block_t *frame( mtime_t i_dts, mtime_t i_length, int i_bitrate )
+{
+    size_t i_size = (uint64_t)i_bitrate * i_length / CLOCK_FREQ / 8;
+    block_t *p_block = block_Alloc( i_size );
+
+    assert( p_block != NULL );
+    memset( p_block->p_buffer, 0xa5, i_size );
+    p_block->i_dts = p_block->i_pts = i_dts;
+    p_block->i_length = i_length;
+    return p_block;
+}
+
+/* Muxes DURATION worth of data, and returns the time it took */
+static mtime_t mux( sout_instance_t *p_sout, const char *psz_path,
+                    const char *psz_mux )
+{
+    es_format_t video, audio[AUDIO_STREAMS];
+    sout_input_t *p_video, *pp_audio[AUDIO_STREAMS];
+
+    sout_access_out_t *p_access = sout_AccessOutNew( p_sout, "file",
+                                                     psz_path );
+    assert( p_access != NULL );
+    sout_mux_t *p_mux = sout_MuxNew( p_sout, psz_mux, p_access );
+    if( p_mux == NULL )
+    {
+        sout_AccessOutDelete( p_access );
+        return -1;
+    }
+
+    es_format_Init( &video, VIDEO_ES, VLC_CODEC_MPGV );
+    p_video = sout_MuxAddStream( p_mux, &video );
+    assert( p_video != NULL );
+    for( unsigned i = 0; i < AUDIO_STREAMS; i++ )
+    {
+        es_format_Init( &audio[i], AUDIO_ES, VLC_CODEC_MPGA );
+        pp_audio[i] = sout_MuxAddStream( p_mux, &audio[i] );
+        assert( pp_audio[i] != NULL );
+    }
+
+    mtime_t i_start = mdate();
+    mtime_t i_audio = VLC_TS_0;
+    for( mtime_t i_dts = VLC_TS_0; i_dts < VLC_TS_0 + DURATION;
+         i_dts += VIDEO_FRAME )
+    {
+        block_t *p_frame = frame( i_dts, VIDEO_FRAME, VIDEO_BITRATE );
+        if( ( i_dts - VLC_TS_0 ) % ( 12 * VIDEO_FRAME ) == 0 )
+            p_frame->i_flags |= BLOCK_FLAG_TYPE_I;
+        sout_MuxSendBuffer( p_mux, p_video, p_frame );
+
+        for( ; i_audio < i_dts + VIDEO_FRAME; i_audio += AUDIO_FRAME )
+            for( unsigned i = 0; i < AUDIO_STREAMS; i++ )
+                sout_MuxSendBuffer( p_mux, pp_audio[i],
+                                    frame( i_audio, AUDIO_FRAME,
+                                           AUDIO_BITRATE ) );
+    }
+    mtime_t i_time = mdate() - i_start;
+
+    for( unsigned i = 0; i < AUDIO_STREAMS; i++ )
+        sout_MuxDeleteStream( p_mux, pp_audio[i] );
+    sout_MuxDeleteStream( p_mux, p_video );
+    sout_MuxDelete( p_mux );
+    sout_AccessOutDelete( p_access );
+    return i_time;
+}
+
+/* Checks the packets, the continuity counters and the PCR intervals */
+static void check( const char *psz_path )
+{
+    uint8_t p[188];
+    int pi_counter[8192];
+    int i_pcr_pid = -1;
+    int64_t i_last_pcr = -1;
+    unsigned i_packets = 0, i_pat = 0, i_pcrs = 0;
+    FILE *file = fopen( psz_path, "rb" );
+
+    assert( file != NULL );
+    for( unsigned i = 0; i < 8192; i++ )
+        pi_counter[i] = -1;
+
+    size_t i_read;
+    while( ( i_read = fread( p, 1, 188, file ) ) == 188 )
+    {
+        int i_pid = ( ( p[1] & 0x1f ) << 8 ) | p[2];
+        int i_cc = p[3] & 0x0f;
+        bool b_payload = p[3] & 0x10;
+
+        assert( p[0] == 0x47 );
+        i_packets++;
+        if( i_pid == 0 )
+            i_pat++;
+
+        if( b_payload )
+        {
+            if( pi_counter[i_pid] >= 0 )
+                assert( i_cc == ( pi_counter[i_pid] + 1 ) % 16 );
+            pi_counter[i_pid] = i_cc;
+        }
+
+        if( ( p[3] & 0x20 ) && p[4] >= 7 && ( p[5] & 0x10 ) )
+        {
+            int64_t i_pcr = ( (int64_t)GetDWBE( &p[6] ) << 1 ) | ( p[10] >> 7 );
+
+            if( i_pcr_pid < 0 )
+                i_pcr_pid = i_pid;
+            assert( i_pid == i_pcr_pid );
+            if( i_last_pcr >= 0 )
+                assert( ( i_pcr - i_last_pcr ) * 100 / 9 <= PCR_INTERVAL );
+            i_last_pcr = i_pcr;
+            i_pcrs++;
+        }
+    }
+    assert( i_read == 0 );
+    fclose( file );
+
+    log( "%u packets, %u PAT, %u PCR\n", i_packets, i_pat, i_pcrs );
+    assert( i_packets > 0 && i_pat > 0 && i_pcrs > 0 );
+}
+
+int main( void )
+{
+    char psz_path[] = "/tmp/vlc-test-ts-XXXXXX";
+    int fd = mkstemp( psz_path );
+
+    assert( fd != -1 );
+    close( fd );
+
+    test_init();
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs,
+                                           test_defaults_args );
+    assert( p_vlc != NULL );
+
+    sout_instance_t *p_sout = vlc_object_create( p_vlc->p_libvlc_int,
+                                                 sizeof( *p_sout ) );
+    assert( p_sout != NULL );
+    p_sout->psz_sout = NULL;
+    p_sout->i_out_pace_nocontrol = 0;
+    p_sout->p_stream = NULL;
+    vlc_mutex_init( &p_sout->lock );
+
+    static const char *const ppsz_mux[] = {
+        "ts{batch=1}", "ts{batch=7}", "ts{batch=7,psi=100}",
+    };
+    int i_ret = 0;
+    for( unsigned i = 0; i < sizeof( ppsz_mux ) / sizeof( ppsz_mux[0] ); i++ )
+    {
+        mtime_t i_time = mux( p_sout, psz_path, ppsz_mux[i] );
+        if( i_time < 0 )
+        {
+            log( "TS muxer not available, skipping\n" );
+            i_ret = 77;
+            break;
+        }
+        log( "%s: %"PRId64" Mb/s muxed in %"PRId64" us\n", ppsz_mux[i],
+             (int64_t)( VIDEO_BITRATE + AUDIO_STREAMS * AUDIO_BITRATE )
+                 / 1000000, i_time );
+        check( psz_path );
+    }
+
+    vlc_mutex_destroy( &p_sout->lock );
+    vlc_object_release( p_sout );
+    libvlc_release( p_vlc );
+    unlink( psz_path );
+    return i_ret;
+}
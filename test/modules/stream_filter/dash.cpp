@@ -0,0 +1,459 @@
+/*****************************************************************************
+ * dash.cpp: replay bandwidth traces through the DASH adaptation logics
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* The downloads and the playback are simulated on a virtual clock, so the
+ * results only depend on the traces and on the logics. The segment timelines
+ * of live streams are tested too. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include "adaptationlogic/AdaptationLogicFactory.h"
+#include "mpd/IMPDManager.h"
+#include "mpd/Period.h"
+#include "mpd/AdaptationSet.h"
+#include "mpd/Representation.h"
+#include "mpd/Segment.h"
+#include "mpd/SegmentTemplate.h"
+#include "mpd/SegmentTimeline.h"
+#include "mpd/SegmentInfoDefault.h"
+
+#include <vector>
+
+using namespace dash::logic;
+using namespace dash::mpd;
+
+#define SEGMENTS    150
+#define DURATION    2       /* seconds per segment */
+#define BUFFERSIZE  30      /* seconds, as dash-buffersize */
+
+static const uint64_t bitrates[] = { 250000, 500000, 1000000, 2000000, 4000000 };
+#define BITRATES    (sizeof (bitrates) / sizeof (bitrates[0]))
+
+/* Bandwidth traces, in bits per second for each second, repeated */
+struct trace_t
+{
+    const char      *name;
+    const unsigned  *rates;
+    unsigned        count;
+};
+
+static const unsigned constant_rates[] = { 6000000 };
+static const unsigned drop_rates[] = {
+    6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000,
+    6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000,
+    6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000,
+    6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000,
+    6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000, 6000000,
+    700000, 700000, 700000, 700000, 700000, 700000, 700000, 700000,
+    700000, 700000, 700000, 700000, 700000, 700000, 700000, 700000,
+    700000, 700000, 700000, 700000, 700000, 700000, 700000, 700000,
+    700000, 700000, 700000, 700000, 700000, 700000, 700000, 700000,
+    700000, 700000, 700000, 700000, 700000, 700000, 700000, 700000,
+};
+static const unsigned fluctuating_rates[] = {
+    3000000, 3000000, 3000000, 3000000, 3000000, 3000000, 3000000, 3000000,
+    600000, 600000, 600000, 600000, 600000, 600000, 600000, 600000,
+};
+
+static const trace_t traces[] = {
+    { "constant",       constant_rates,     sizeof (constant_rates) / sizeof (unsigned) },
+    { "drop",           drop_rates,         sizeof (drop_rates) / sizeof (unsigned) },
+    { "fluctuating",    fluctuating_rates,  sizeof (fluctuating_rates) / sizeof (unsigned) },
+};
+#define TRACES      (sizeof (traces) / sizeof (traces[0]))
+
+struct result_t
+{
+    double      startup;    /* seconds until the playback starts */
+    double      stalled;    /* seconds of rebuffering */
+    unsigned    stalls;
+    unsigned    switches;
+    uint64_t    average;    /* bits per second */
+    uint64_t    last;       /* bitrate of the last segment */
+};
+
+/* One period of representations, with a segment list each */
+class SimulatedManager : public IMPDManager
+{
+    public:
+        SimulatedManager ()
+        {
+            AdaptationSet *set = new AdaptationSet();
+
+            for (size_t i = 0; i < BITRATES; i++)
+            {
+                Representation *rep = new Representation();
+                rep->setBandwidth(bitrates[i]);
+                set->addRepresentation(rep);
+
+                std::vector<Segment *> list;
+                for (unsigned n = 0; n < SEGMENTS; n++)
+                {
+                    char url[64];
+                    snprintf(url, sizeof (url), "http://127.0.0.1/%" PRIu64 "/%u.m4s",
+                             bitrates[i], n);
+                    Segment *seg = new Segment(rep);
+                    seg->setSourceUrl(url);
+                    list.push_back(seg);
+                }
+                this->segments.push_back(list);
+            }
+            Period *period = new Period();
+            period->addAdaptationSet(set);
+            this->periods.push_back(period);
+        }
+        virtual ~SimulatedManager ()
+        {
+            for (size_t i = 0; i < this->segments.size(); i++)
+                vlc_delete_all(this->segments.at(i));
+            vlc_delete_all(this->periods);
+        }
+
+        const std::vector<Period *>& getPeriods () const
+        {
+            return this->periods;
+        }
+        Period* getFirstPeriod ()
+        {
+            return this->periods.front();
+        }
+        Period* getNextPeriod (Period *)
+        {
+            return NULL;
+        }
+        Representation* getBestRepresentation (Period *period)
+        {
+            return period->getAdaptationSets().front()->getRepresentations().back();
+        }
+        std::vector<Segment *> getSegments (const Representation *rep)
+        {
+            for (size_t i = 0; i < BITRATES; i++)
+                if (bitrates[i] == rep->getBandwidth())
+                    return this->segments.at(i);
+            return std::vector<Segment *>();
+        }
+        Representation* getRepresentation (Period *period, uint64_t bitrate) const
+        {
+            /* same choice as the other managers */
+            std::vector<Representation *> reps = period->getAdaptationSets().front()->getRepresentations();
+            Representation *best = NULL;
+
+            for (size_t i = 0; i < reps.size(); i++)
+                if (best == NULL || (reps.at(i)->getBandwidth() > best->getBandwidth() &&
+                                     reps.at(i)->getBandwidth() < bitrate))
+                    best = reps.at(i);
+            return best;
+        }
+        Representation* getRepresentation (Period *period, uint64_t bitrate, int, int) const
+        {
+            return this->getRepresentation(period, bitrate);
+        }
+        const MPD* getMPD () const
+        {
+            return NULL;
+        }
+
+    private:
+        std::vector<Period *>                   periods;
+        std::vector<std::vector<Segment *> >    segments;
+};
+
+/* Virtual time and playback */
+struct player_t
+{
+    double      now;
+    double      buffered;
+    bool        playing;
+    result_t    *result;
+};
+
+static void advance (player_t *p, double duration)
+{
+    p->now += duration;
+    if (!p->playing)
+        return;
+
+    if (p->buffered >= duration)
+    {
+        p->buffered -= duration;
+        return;
+    }
+
+    /* the buffer runs out before the end of the download */
+    p->result->stalled += duration - p->buffered;
+    p->result->stalls++;
+    p->buffered = 0;
+    p->playing = false;
+}
+
+/* Downloads bits at the rates of the trace, from the current time */
+static double download (player_t *p, const trace_t *trace, double bits)
+{
+    double start = p->now;
+
+    while (bits > 0)
+    {
+        unsigned second = (unsigned)p->now;
+        double rate = trace->rates[second % trace->count];
+        double step = (second + 1) - p->now;
+
+        if (rate * step >= bits)
+            step = bits / rate;
+        bits -= rate * step;
+        advance(p, step);
+    }
+    return p->now - start;
+}
+
+static result_t simulate (IAdaptationLogic::LogicType type, const trace_t *trace,
+                          stream_t *stream)
+{
+    SimulatedManager    manager;
+    IAdaptationLogic    *logic = AdaptationLogicFactory::create(type, &manager, stream);
+    result_t            result;
+    player_t            player;
+    double              bits = 0, time = 0;
+    uint64_t            previous = 0;
+    unsigned            count = 0;
+
+    assert(logic != NULL);
+    memset(&result, 0, sizeof (result));
+    result.startup = -1;
+    player.now = 0;
+    player.buffered = 0;
+    player.playing = false;
+    player.result = &result;
+
+    for (;;)
+    {
+        dash::http::Chunk *chunk = logic->getNextChunk();
+        if (chunk == NULL)
+            break;
+
+        uint64_t bitrate = chunk->getBitrate();
+        delete chunk;
+
+        if (previous != 0 && bitrate != previous)
+            result.switches++;
+        previous = bitrate;
+
+        /* the downloader waits for room in the buffer */
+        if (player.buffered + DURATION > BUFFERSIZE)
+            advance(&player, player.buffered + DURATION - BUFFERSIZE);
+
+        double size = (double)bitrate * DURATION;
+        double duration = download(&player, trace, size);
+
+        bits += size;
+        time += duration;
+        logic->downloadRateChanged(bits / time, size / duration);
+
+        player.buffered += DURATION;
+        if (!player.playing)
+        {
+            if (result.startup < 0)
+                result.startup = player.now;
+            player.playing = true;
+        }
+        logic->bufferLevelChanged(player.buffered * 1000000,
+                                  player.buffered * 100 / BUFFERSIZE);
+
+        result.average += bitrate;
+        count++;
+    }
+
+    assert(count == SEGMENTS);
+    result.average /= count;
+    result.last = previous;
+    delete logic;
+    return result;
+}
+
+static void report (const char *name, const trace_t *trace, const result_t &r)
+{
+    log("%-12s %-12s startup %.2f s, %u stalls (%.2f s), %u switches, "
+        "average %" PRIu64 " bps\n", name, trace->name, r.startup, r.stalls,
+        r.stalled, r.switches, r.average);
+}
+
+static void add_element (SegmentTimeline *timeline, int64_t t, int64_t d, int r)
+{
+    SegmentTimeline::Element *e = new SegmentTimeline::Element;
+    e->t = t;
+    e->d = d;
+    e->r = r;
+    timeline->addElement(e);
+}
+
+static void test_timeline (void)
+{
+    /* long repeated runs are not expanded */
+    SegmentTimeline *timeline = new SegmentTimeline;
+    add_element(timeline, 0, 2000, 999999);
+    add_element(timeline, 2000000000, 1500, 0);
+    add_element(timeline, 2000001500, 2000, -1);
+
+    assert(timeline->getFirstIndex() == 0);
+    assert(timeline->getScaledTime(0) == 0);
+    assert(timeline->getScaledTime(500000) == 1000000000);
+    assert(timeline->getScaledTime(999999) == 1999998000);
+    assert(timeline->getScaledTime(1000000) == 2000000000);
+    assert(timeline->getScaledTime(1000001) == 2000001500);
+    assert(timeline->getScaledTime(2000001) == 2000001500 + INT64_C(2000000000));
+    for (uint64_t i = 999000; i < 1001000; i++)
+        assert(timeline->getScaledTime(i) >= 0);
+
+    /* an update closes the open ended run, and keeps the numbers */
+    SegmentTimeline update;
+    add_element(&update, 1999998000, 2000, 0);
+    add_element(&update, 2000000000, 1500, 0);
+    add_element(&update, 2000001500, 2000, 9);
+    add_element(&update, 2000021500, 1000, -1);
+    timeline->mergeWith(update);
+    timeline->pruneBefore(update.getScaledTime(update.getFirstIndex()));
+
+    assert(timeline->getFirstIndex() == 999999);
+    assert(!timeline->isListed(999998));
+    assert(timeline->getScaledTime(999998) == -1);
+    assert(timeline->getScaledTime(1000010) == 2000019500);
+    assert(timeline->getScaledTime(1000011) == 2000021500);
+    assert(timeline->getScaledTime(1000012) == 2000022500);
+
+    /* the URLs of a template, from the timeline of the adaptation set */
+    AdaptationSet *set = new AdaptationSet;
+    SegmentInfoDefault *info = new SegmentInfoDefault;
+    info->setStartIndex(10);
+    info->setSegmentTimeline(timeline);
+    set->setSegmentInfoDefault(info);
+    Representation *rep = new Representation;
+    rep->setParentGroup(set);
+    set->addRepresentation(rep);
+
+    SegmentTemplate segment(true, rep);
+    segment.setSourceUrl("http://127.0.0.1/$Time$/$Index$.m4s");
+    /* the segments that left the window are skipped */
+    assert(segment.getSourceUrl() == "http://127.0.0.1/1999998000/1000009.m4s");
+    segment.done();
+    assert(segment.getSourceUrl() == "http://127.0.0.1/2000000000/1000010.m4s");
+    delete set;
+
+    /* a live window slides for hours, in constant memory */
+    timeline = new SegmentTimeline;
+    add_element(timeline, 0, 2, 29);
+    for (unsigned k = 1; k <= 100000; k++)
+    {
+        SegmentTimeline window;
+        add_element(&window, 2 * k, 2, 29);
+        timeline->mergeWith(window);
+        timeline->pruneBefore(2 * k);
+
+        assert(timeline->getFirstIndex() == k);
+        assert(timeline->getScaledTime(k + 29) == 2 * (k + 29));
+        assert(!timeline->isListed(k + 30));
+    }
+    delete timeline;
+}
+
+static void test_live_edge (void)
+{
+    /* five segments listed, 0 to 4 */
+    SegmentTimeline *timeline = new SegmentTimeline;
+    add_element(timeline, 0, 2, 4);
+
+    AdaptationSet *set = new AdaptationSet;
+    SegmentInfoDefault *info = new SegmentInfoDefault;
+    info->setStartIndex(0);
+    info->setSegmentTimeline(timeline);
+    set->setSegmentInfoDefault(info);
+    Representation *rep = new Representation;
+    rep->setParentGroup(set);
+    set->addRepresentation(rep);
+
+    SegmentTemplate segment(true, rep);
+    segment.setSourceUrl("http://127.0.0.1/$Time$/$Index$.m4s");
+    for (unsigned i = 0; i < 5; i++)
+    {
+        assert(segment.isAvailable());
+        segment.done();
+    }
+
+    /* reading past the end holds the index until the update */
+    assert(!segment.isAvailable());
+    segment.done();
+    segment.done();
+    assert(!segment.isAvailable());
+
+    SegmentTimeline update;
+    add_element(&update, 4, 2, 4);
+    timeline->mergeWith(update);
+    timeline->pruneBefore(update.getScaledTime(update.getFirstIndex()));
+
+    assert(segment.isAvailable());
+    assert(segment.getSourceUrl() == "http://127.0.0.1/10/5.m4s");
+    segment.done();
+    assert(segment.getSourceUrl() == "http://127.0.0.1/12/6.m4s");
+    delete set;
+}
+
+int main (void)
+{
+    test_init();
+
+    test_timeline();
+    test_live_edge();
+
+    libvlc_instance_t *p_vlc = libvlc_new(test_defaults_nargs, test_defaults_args);
+    assert(p_vlc != NULL);
+
+    stream_t *stream = (stream_t *)vlc_object_create(p_vlc->p_libvlc_int, sizeof (stream_t));
+    assert(stream != NULL);
+    var_Create(stream, "dash-buffersize", VLC_VAR_INTEGER);
+    var_SetInteger(stream, "dash-buffersize", BUFFERSIZE);
+    var_Create(stream, "dash-prefwidth", VLC_VAR_INTEGER);
+    var_Create(stream, "dash-prefheight", VLC_VAR_INTEGER);
+    var_Create(stream, "dash-parallel", VLC_VAR_INTEGER);
+    var_SetInteger(stream, "dash-parallel", 1);
+
+    for (size_t i = 0; i < TRACES; i++)
+    {
+        result_t rate = simulate(IAdaptationLogic::RateBased, &traces[i], stream);
+        result_t buffer = simulate(IAdaptationLogic::BufferBased, &traces[i], stream);
+
+        report("rate based", &traces[i], rate);
+        report("buffer based", &traces[i], buffer);
+
+        /* starts with the lowest bitrate, and never runs out of buffer */
+        assert(buffer.startup <= (double)bitrates[0] * DURATION / traces[i].rates[0] + 0.001);
+        assert(buffer.stalls == 0);
+    }
+
+    /* a fast link ends up with the best bitrate, and stays there */
+    result_t r = simulate(IAdaptationLogic::BufferBased, &traces[0], stream);
+    assert(r.last == bitrates[BITRATES - 1]);
+    assert(r.switches < BITRATES);
+
+    vlc_object_release(stream);
+    libvlc_release(p_vlc);
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * httplive.c: test the HLS bandwidth adaptation against a throttled server
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <string.h>
+
+#include "../http_server.h"
+
+/* Two variants of 1 second segments: the declared bitrates are what the
+ * adaptation compares with the measured one, the real segments are smaller
+ * so that the test runs quickly */
+#define SEGMENTS    20
+#define BW_LO       200000
+#define BW_HI       2000000
+#define SIZE_LO     8000
+#define SIZE_HI     64000
+#define THROTTLE    (1000000 / 8)   /* bytes per second */
+
+static uint8_t segment_byte( unsigned n, bool b_hi )
+{
+    return 2 * n + b_hi;
+}
+
+/* Returns the body of a resource */
+static char *resource( const char *psz_path, size_t *pi_size )
+{
+    char *psz = NULL;
+    unsigned n;
+    char var[3];
+
+    if( !strcmp( psz_path, "/index.m3u8" ) )
+    {
+        if( asprintf( &psz, "#EXTM3U\n"
+                      "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=%d\n"
+                      "lo.m3u8\n"
+                      "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=%d\n"
+                      "hi.m3u8\n", BW_LO, BW_HI ) < 0 )
+            return NULL;
+    }
+    else if( sscanf( psz_path, "/%2[a-z]/%u.ts", var, &n ) == 2 )
+    {
+        bool b_hi = !strcmp( var, "hi" );
+        *pi_size = b_hi ? SIZE_HI : SIZE_LO;
+        psz = malloc( *pi_size );
+        if( psz != NULL )
+            memset( psz, segment_byte( n, b_hi ), *pi_size );
+        return psz;
+    }
+    else if( sscanf( psz_path, "/%2[a-z].m3u8", var ) == 1 )
+    {
+        char buf[64 * SEGMENTS];
+        size_t len = snprintf( buf, sizeof( buf ), "#EXTM3U\n"
+                               "#EXT-X-TARGETDURATION:1\n"
+                               "#EXT-X-MEDIA-SEQUENCE:0\n" );
+        for( unsigned i = 0; i < SEGMENTS; i++ )
+            len += snprintf( buf + len, sizeof( buf ) - len,
+                             "#EXTINF:1,\n%s/%u.ts\n", var, i );
+        snprintf( buf + len, sizeof( buf ) - len, "#EXT-X-ENDLIST\n" );
+        psz = strdup( buf );
+    }
+
+    if( psz != NULL )
+        *pi_size = strlen( psz );
+    return psz;
+}
+
+/* Plays the whole stream, checks it, and returns the segments of the higher
+ * bitrate that were played in the second half */
+static int play( vlc_object_t *obj, unsigned rate )
+{
+    char psz_url[64];
+
+    http_server_set_rate( rate );
+
+    snprintf( psz_url, sizeof( psz_url ), "http://127.0.0.1:%u/index.m3u8",
+              http_server_port() );
+    stream_t *p_source = stream_UrlNew( obj, psz_url );
+    assert( p_source != NULL );
+    stream_t *s = stream_FilterNew( p_source, "httplive" );
+    if( s == NULL )
+    {
+        stream_Delete( p_source );
+        return -1;
+    }
+
+    mtime_t i_start = mdate();
+    int i_hi = 0;
+    for( unsigned n = 0; n < SEGMENTS; n++ )
+    {
+        /* every segment is played once, in order, from either variant */
+        uint8_t buf[SIZE_HI];
+        int val = stream_Read( s, buf, 1 );
+        assert( val == 1 );
+        bool b_hi = buf[0] & 1;
+        assert( buf[0] == segment_byte( n, b_hi ) );
+
+        size_t i_size = b_hi ? SIZE_HI : SIZE_LO;
+        val = stream_Read( s, buf + 1, i_size - 1 );
+        assert( val == (int)i_size - 1 );
+        for( size_t i = 1; i < i_size; i++ )
+            assert( buf[i] == buf[0] );
+
+        if( b_hi && n >= SEGMENTS / 2 )
+            i_hi++;
+    }
+    log( "%u bytes/s: %d segments of the higher bitrate out of %u, "
+         "played in %"PRId64" ms\n", rate, i_hi, SEGMENTS / 2,
+         ( mdate() - i_start ) / 1000 );
+
+    stream_Delete( s );
+    return i_hi;
+}
+
+int main( void )
+{
+    test_init();
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs,
+                                           test_defaults_args );
+    assert( p_vlc != NULL );
+
+    vlc_object_t *obj = vlc_object_create( p_vlc->p_libvlc_int,
+                                           sizeof( *obj ) );
+    assert( obj != NULL );
+
+    http_server_start( resource, false );
+
+    int i_ret = 0;
+    int i_hi = play( obj, 0 );
+    if( i_hi < 0 )
+    {
+        log( "HLS stream filter not available, skipping\n" );
+        i_ret = 77;
+    }
+    else
+    {
+        /* a fast link keeps the higher bitrate */
+        assert( i_hi == SEGMENTS / 2 );
+
+        /* a slow one switches to the lower, and stays there */
+        i_hi = play( obj, THROTTLE );
+        assert( i_hi == 0 );
+    }
+
+    http_server_stop();
+
+    vlc_object_release( obj );
+    libvlc_release( p_vlc );
+    return i_ret;
+}
@@ -0,0 +1,239 @@
+/*****************************************************************************
+ * smooth.c: test the concurrent Smooth Streaming downloads
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <string.h>
+
+#include "../http_server.h"
+
+/* A video track, slow to download, and an audio track, of 2 seconds chunks */
+#define CHUNKS      10
+#define DURATION    20000000    /* 2 seconds, in 100 ns units */
+#define BW_LO       400000
+#define BW_HI       800000
+#define SIZE_LO     16000
+#define SIZE_HI     32000
+#define SIZE_AUDIO  1000
+#define DELAY       100000      /* before each video chunk */
+
+#define MOOF_SIZE   48
+
+static const char manifest_head[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<SmoothStreamingMedia MajorVersion=\"2\" MinorVersion=\"0\" "
+    "Duration=\"%d\">\n";
+static const char manifest_video[] =
+    "<StreamIndex Type=\"video\" Chunks=\"%d\" QualityLevels=\"2\" "
+    "MaxWidth=\"320\" MaxHeight=\"240\" "
+    "Url=\"QualityLevels({bitrate})/Fragments(video={start time})\">\n"
+    "<QualityLevel Index=\"0\" Bitrate=\"%d\" FourCC=\"H264\" MaxWidth=\"320\" "
+    "MaxHeight=\"240\" CodecPrivateData=\"000000016742C00DDB0A0000000168CA8CB2\"/>\n"
+    "<QualityLevel Index=\"1\" Bitrate=\"%d\" FourCC=\"H264\" MaxWidth=\"320\" "
+    "MaxHeight=\"240\" CodecPrivateData=\"000000016742C00DDB0A0000000168CA8CB2\"/>\n";
+static const char manifest_audio[] =
+    "<StreamIndex Type=\"audio\" Chunks=\"%d\" QualityLevels=\"1\" "
+    "Url=\"QualityLevels({bitrate})/Fragments(audio={start time})\">\n"
+    "<QualityLevel Index=\"0\" Bitrate=\"64000\" FourCC=\"AACL\" "
+    "SamplingRate=\"48000\" Channels=\"2\" BitsPerSample=\"16\" "
+    "PacketSize=\"4\" AudioTag=\"255\" CodecPrivateData=\"1190\"/>\n";
+
+static size_t append_chunks( char *buf, size_t len, size_t size )
+{
+    len += snprintf( buf + len, size - len, "<c t=\"0\" d=\"%d\"/>\n", DURATION );
+    for( unsigned i = 1; i < CHUNKS; i++ )
+        len += snprintf( buf + len, size - len, "<c d=\"%d\"/>\n", DURATION );
+    len += snprintf( buf + len, size - len, "</StreamIndex>\n" );
+    return len;
+}
+
+/* A fragment: moof/mfhd, moof/traf/tfhd, and a mdat filled with its number */
+static char *fragment( unsigned n, unsigned i_track, size_t i_size )
+{
+    uint8_t *p = malloc( i_size );
+    if( p == NULL )
+        return NULL;
+
+    memset( p, 0, MOOF_SIZE );
+    SetDWBE( p, MOOF_SIZE );
+    memcpy( p + 4, "moof", 4 );
+    SetDWBE( p + 8, 16 );
+    memcpy( p + 12, "mfhd", 4 );
+    SetDWBE( p + 20, n + 1 );
+    SetDWBE( p + 24, 24 );
+    memcpy( p + 28, "traf", 4 );
+    SetDWBE( p + 32, 16 );
+    memcpy( p + 36, "tfhd", 4 );
+    SetDWBE( p + 44, i_track );
+    SetDWBE( p + MOOF_SIZE, i_size - MOOF_SIZE );
+    memcpy( p + MOOF_SIZE + 4, "mdat", 4 );
+    memset( p + MOOF_SIZE + 8, n, i_size - MOOF_SIZE - 8 );
+    return (char *)p;
+}
+
+/* Returns the body of a resource */
+static char *resource( const char *psz_path, size_t *pi_size )
+{
+    unsigned bitrate;
+    uint64_t time;
+    char track[6];
+
+    if( !strcmp( psz_path, "/Manifest" ) )
+    {
+        char buf[4096];
+        size_t len = snprintf( buf, sizeof( buf ), manifest_head,
+                               CHUNKS * DURATION );
+        len += snprintf( buf + len, sizeof( buf ) - len, manifest_video,
+                         CHUNKS, BW_LO, BW_HI );
+        len = append_chunks( buf, len, sizeof( buf ) );
+        len += snprintf( buf + len, sizeof( buf ) - len, manifest_audio,
+                         CHUNKS );
+        len = append_chunks( buf, len, sizeof( buf ) );
+        len += snprintf( buf + len, sizeof( buf ) - len,
+                         "</SmoothStreamingMedia>\n" );
+        assert( len < sizeof( buf ) );
+        *pi_size = len;
+        return strdup( buf );
+    }
+    if( sscanf( psz_path, "/QualityLevels(%u)/Fragments(%5[a-z]=%"SCNu64")",
+                &bitrate, track, &time ) == 3 && time % DURATION == 0 &&
+        time / DURATION < CHUNKS )
+    {
+        unsigned n = time / DURATION;
+
+        if( !strcmp( track, "audio" ) )
+            *pi_size = SIZE_AUDIO;
+        else
+        {
+            msleep( DELAY );
+            *pi_size = bitrate == BW_HI ? SIZE_HI : SIZE_LO;
+        }
+        /* the track IDs are replaced by the stream filter */
+        return fragment( n, 42, *pi_size );
+    }
+    return NULL;
+}
+
+/* Plays the whole stream, and checks that every chunk of both tracks was
+ * received once, in order */
+static int play( vlc_object_t *obj )
+{
+    char psz_url[64];
+
+    snprintf( psz_url, sizeof( psz_url ), "http://127.0.0.1:%u/Manifest",
+              http_server_port() );
+    stream_t *p_source = stream_UrlNew( obj, psz_url );
+    assert( p_source != NULL );
+    stream_t *s = stream_FilterNew( p_source, "smooth" );
+    if( s == NULL )
+    {
+        stream_Delete( p_source );
+        return -1;
+    }
+
+    mtime_t i_start = mdate();
+    unsigned next[2] = { 0, 0 };
+    for( ;; )
+    {
+        uint8_t hdr[MOOF_SIZE];
+        int val = stream_Read( s, hdr, 8 );
+        if( val == 0 )
+            break;
+        assert( val == 8 );
+
+        uint32_t i_size = GetDWBE( hdr );
+        assert( i_size >= 8 );
+        if( !memcmp( hdr + 4, "uuid", 4 ) )
+        {
+            /* the stream description, at the start */
+            val = stream_Read( s, NULL, i_size - 8 );
+            assert( val == (int)i_size - 8 );
+            continue;
+        }
+
+        assert( !memcmp( hdr + 4, "moof", 4 ) && i_size == MOOF_SIZE );
+        val = stream_Read( s, hdr + 8, MOOF_SIZE - 8 );
+        assert( val == MOOF_SIZE - 8 );
+        unsigned i_track = GetDWBE( hdr + 44 );
+        assert( i_track == 1 || i_track == 2 );
+        unsigned n = GetDWBE( hdr + 20 ) - 1;
+        assert( n == next[i_track - 1] );
+        next[i_track - 1]++;
+
+        val = stream_Read( s, hdr, 8 );
+        assert( val == 8 && !memcmp( hdr + 4, "mdat", 4 ) );
+        i_size = GetDWBE( hdr ) - 8;
+        uint8_t *p_data = malloc( i_size );
+        assert( p_data != NULL );
+        val = stream_Read( s, p_data, i_size );
+        assert( val == (int)i_size );
+        for( uint32_t i = 0; i < i_size; i++ )
+            assert( p_data[i] == n );
+        free( p_data );
+    }
+    http_server_stats_t stats;
+    http_server_get_stats( &stats );
+    log( "played %u video and %u audio chunks in %"PRId64" ms, "
+         "with up to %u downloads at once\n", next[0], next[1],
+         ( mdate() - i_start ) / 1000, stats.max_active );
+    assert( next[0] == CHUNKS && next[1] == CHUNKS );
+
+    stream_Delete( s );
+    return 0;
+}
+
+int main( void )
+{
+    test_init();
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs,
+                                           test_defaults_args );
+    assert( p_vlc != NULL );
+
+    vlc_object_t *obj = vlc_object_create( p_vlc->p_libvlc_int,
+                                           sizeof( *obj ) );
+    assert( obj != NULL );
+
+    http_server_start( resource, false );
+
+    int i_ret = 0;
+    if( play( obj ) < 0 )
+    {
+        log( "Smooth Streaming stream filter not available, skipping\n" );
+        i_ret = 77;
+    }
+    else
+    {
+        /* the audio chunks were fetched while the video ones were slow */
+        http_server_stats_t stats;
+        http_server_get_stats( &stats );
+        assert( stats.max_active >= 2 );
+    }
+
+    http_server_stop();
+
+    vlc_object_release( obj );
+    libvlc_release( p_vlc );
+    return i_ret;
+}
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * rtp.c: test the forwarding of shared RTP packets
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+#include "../../../modules/stream_out/rtp.h"
+
+#define PACKETS  16
+#define SESSIONS 4 /* the leader and three followers */
+
+/* One RTSP session of a shared live VoD ES */
+typedef struct
+{
+    bool     b_ts_init;
+    uint32_t i_ts_offset;
+    uint16_t i_sequence;
+    uint8_t  ssrc[4];
+} session_t;
+
+/* Does what vod_share_forward() and rtp_forward() do with the leader batch */
+static void forward( const session_t *sessions, session_t *followers,
+                     block_t **pp, uint32_t (*sent)[PACKETS][3] )
+{
+    uint32_t pi_ts[PACKETS];
+
+    for( unsigned i = 0; i < PACKETS; i++ )
+        pi_ts[i] = GetDWBE( pp[i]->p_buffer + 4 );
+
+    for( unsigned s = 1; s < SESSIONS; s++ )
+    {
+        session_t *p_fw = &followers[s];
+
+        if( !p_fw->b_ts_init )
+            continue;
+        rtp_rewrite_headers( pp, PACKETS, pi_ts,
+                             p_fw->i_ts_offset - sessions[0].i_ts_offset,
+                             &p_fw->i_sequence, p_fw->ssrc );
+        for( unsigned i = 0; i < PACKETS; i++ )
+        {
+            const uint8_t *p = pp[i]->p_buffer;
+
+            sent[s][i][0] = GetWBE( p + 2 );
+            sent[s][i][1] = GetDWBE( p + 4 );
+            sent[s][i][2] = GetDWBE( p + 8 );
+        }
+    }
+}
+
+static void check( const session_t *sessions, const uint32_t *pi_ts,
+                   uint32_t (*sent)[PACKETS][3], unsigned s )
+{
+    for( unsigned i = 0; i < PACKETS; i++ )
+    {
+        assert( sent[s][i][0] == (uint16_t)(sessions[s].i_sequence + i) );
+        assert( sent[s][i][1] == pi_ts[i] - sessions[0].i_ts_offset
+                                 + sessions[s].i_ts_offset );
+        assert( sent[s][i][2] == GetDWBE( sessions[s].ssrc ) );
+    }
+}
+
+static void test_forward( unsigned i_skip )
+{
+    session_t sessions[SESSIONS], followers[SESSIONS];
+    block_t *pp[PACKETS];
+    uint32_t pi_ts[PACKETS];
+    uint32_t sent[SESSIONS][PACKETS][3];
+
+    for( unsigned s = 0; s < SESSIONS; s++ )
+    {
+        sessions[s].b_ts_init = s != i_skip;
+        sessions[s].i_ts_offset = 0xfffff000u + 90000 * 7 * s;
+        sessions[s].i_sequence = 0xfff8 + 1000 * s;
+        SetDWBE( sessions[s].ssrc, 0x11111111 * (s + 1) );
+    }
+    memcpy( followers, sessions, sizeof (sessions) );
+
+    for( unsigned i = 0; i < PACKETS; i++ )
+    {
+        pp[i] = block_Alloc( 12 );
+        assert( pp[i] != NULL );
+
+        uint8_t *p = pp[i]->p_buffer;
+        pi_ts[i] = sessions[0].i_ts_offset + 3000 * (i / 4);
+        p[0] = 0x80;
+        p[1] = 96;
+        SetWBE( p + 2, sessions[0].i_sequence + i );
+        SetDWBE( p + 4, pi_ts[i] );
+        memcpy( p + 8, sessions[0].ssrc, 4 );
+    }
+
+    forward( sessions, followers, pp, sent );
+
+    for( unsigned s = 1; s < SESSIONS; s++ )
+    {
+        if( s == i_skip )
+        {   /* not sent, and the sequence numbers are left alone */
+            assert( followers[s].i_sequence == sessions[s].i_sequence );
+            continue;
+        }
+        check( sessions, pi_ts, sent, s );
+        assert( followers[s].i_sequence
+                == (uint16_t)(sessions[s].i_sequence + PACKETS) );
+    }
+
+    for( unsigned i = 0; i < PACKETS; i++ )
+        block_Release( pp[i] );
+}
+
+int main( void )
+{
+    test_forward( 0 );
+    /* a follower without a timeline must not change what the next see */
+    for( unsigned s = 1; s < SESSIONS; s++ )
+        test_forward( s );
+    return 0;
+}
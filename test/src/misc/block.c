@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * block.c: test for shared block payloads
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+static const uint8_t annexb[] = { 0, 0, 0, 1, 0x65, 0x88, 0x84, 0x00 };
+
+/* Rewrites the start code into a length prefix, as the MP4 muxer does */
+static block_t *convert_in_place( block_t *p_block )
+{
+    p_block = block_Unshare( p_block );
+    assert( p_block != NULL );
+    SetDWBE( p_block->p_buffer, p_block->i_buffer - 4 );
+    return p_block;
+}
+
+static void test_duplicate( void )
+{
+    block_t *p_block = block_Alloc( sizeof( annexb ) );
+    assert( p_block != NULL );
+    memcpy( p_block->p_buffer, annexb, sizeof( annexb ) );
+    p_block->i_dts = p_block->i_pts = 42;
+    p_block->i_flags = BLOCK_FLAG_TYPE_I;
+
+    /* Two duplicate branches, as stream_out/duplicate sends them */
+    p_block = block_Share( p_block );
+    assert( p_block != NULL );
+    block_t *p_first = block_Hold( p_block );
+    block_t *p_second = p_block;
+    assert( p_first != NULL );
+    assert( p_first->p_buffer == p_second->p_buffer );
+
+    /* The first branch writes in place: it must get a private copy */
+    p_first = convert_in_place( p_first );
+    assert( p_first->p_buffer != p_second->p_buffer );
+    assert( GetDWBE( p_first->p_buffer ) == sizeof( annexb ) - 4 );
+    assert( p_first->i_dts == 42 && p_first->i_pts == 42 );
+    assert( p_first->i_flags == BLOCK_FLAG_TYPE_I );
+
+    /* The other branch still sees the original payload */
+    assert( p_second->i_buffer == sizeof( annexb ) );
+    assert( !memcmp( p_second->p_buffer, annexb, sizeof( annexb ) ) );
+
+    /* It now holds the last reference: no copy is needed any more */
+    const uint8_t *p_payload = p_second->p_buffer;
+    p_second = convert_in_place( p_second );
+    assert( p_second->p_buffer == p_payload );
+    assert( !memcmp( p_first->p_buffer, p_second->p_buffer,
+                     sizeof( annexb ) ) );
+
+    block_Release( p_first );
+    block_Release( p_second );
+}
+
+static void test_realloc( void )
+{
+    block_t *p_block = block_Alloc( sizeof( annexb ) );
+    assert( p_block != NULL );
+    memcpy( p_block->p_buffer, annexb, sizeof( annexb ) );
+
+    p_block = block_Share( p_block );
+    assert( p_block != NULL );
+    block_t *p_other = block_Hold( p_block );
+    assert( p_other != NULL );
+
+    /* Prepending a header must not touch the shared payload */
+    p_block = block_Realloc( p_block, 4, p_block->i_buffer );
+    assert( p_block != NULL );
+    memset( p_block->p_buffer, 0xff, p_block->i_buffer );
+    assert( !memcmp( p_other->p_buffer, annexb, sizeof( annexb ) ) );
+
+    block_Release( p_block );
+    block_Release( p_other );
+}
+
+static void test_chain( void )
+{
+    block_t *p_chain = NULL, **pp_last = &p_chain;
+    block_t *p_others[2];
+
+    /* a chain of two shared blocks, as the input sends them to decoders */
+    for( int i = 0; i < 2; i++ )
+    {
+        block_t *p_block = block_Alloc( sizeof( annexb ) );
+        assert( p_block != NULL );
+        memcpy( p_block->p_buffer, annexb, sizeof( annexb ) );
+        p_block = block_Share( p_block );
+        assert( p_block != NULL );
+        p_others[i] = block_Hold( p_block );
+        assert( p_others[i] != NULL );
+        block_ChainLastAppend( &pp_last, p_block );
+    }
+
+    p_chain = block_ChainUnshare( p_chain );
+    assert( p_chain != NULL && p_chain->p_next != NULL );
+    assert( p_chain->p_next->p_next == NULL );
+    int i = 0;
+    for( block_t *p_block = p_chain; p_block; p_block = p_block->p_next )
+    {
+        assert( p_block->p_buffer != p_others[i]->p_buffer );
+        memset( p_block->p_buffer, 0xff, p_block->i_buffer );
+        assert( !memcmp( p_others[i]->p_buffer, annexb, sizeof( annexb ) ) );
+        i++;
+    }
+
+    block_ChainRelease( p_chain );
+    block_Release( p_others[0] );
+    block_Release( p_others[1] );
+}
+
+int main( void )
+{
+    test_init();
+
+    log( "Testing duplicated blocks with an in-place writer\n" );
+    test_duplicate();
+    log( "Testing block_Realloc() on a shared block\n" );
+    test_realloc();
+    log( "Testing block_ChainUnshare()\n" );
+    test_chain();
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*****************************************************************************
+ * httpd.c: load test of the HTTP server streaming
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_httpd.h>
+
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Many clients of one stream, fed with blocks of TS packets */
+#define CLIENTS     400
+#define BLOCK_SIZE  1316
+#define BURST       16
+#define ROUNDS      100
+
+typedef struct
+{
+    int      fd;
+    char     header[512];
+    unsigned i_header;      /* bytes of the HTTP and stream headers */
+    bool     b_ready;       /* all the headers were received */
+    uint64_t i_received;    /* bytes of stream data */
+} client_t;
+
+static unsigned free_port( void )
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof( addr );
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    assert( fd != -1 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = bind( fd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = getsockname( fd, (struct sockaddr *)&addr, &len );
+    assert( val == 0 );
+    (void) val;
+    close( fd );
+    return ntohs( addr.sin_port );
+}
+
+static int connect_to( unsigned port, const char *psz_request )
+{
+    struct sockaddr_in addr;
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    assert( fd != -1 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = connect( fd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = send( fd, psz_request, strlen( psz_request ), 0 );
+    assert( val == (int)strlen( psz_request ) );
+    (void) val;
+    return fd;
+}
+
+/* Block n carries its number, then bytes derived from it */
+static block_t *data_block( uint32_t n )
+{
+    block_t *p_block = block_Alloc( BLOCK_SIZE );
+
+    assert( p_block != NULL );
+    SetDWBE( p_block->p_buffer, n );
+    for( unsigned i = 4; i < BLOCK_SIZE; i++ )
+        p_block->p_buffer[i] = n + i;
+    return p_block;
+}
+
+static uint8_t data_byte( uint64_t i_pos )
+{
+    uint32_t n = i_pos / BLOCK_SIZE;
+    unsigned i = i_pos % BLOCK_SIZE;
+
+    return ( i < 4 ) ? n >> ( 8 * ( 3 - i ) ) : (uint8_t)( n + i );
+}
+
+/* Reads what the client was sent, and checks it; returns false on EOF */
+static bool client_read( client_t *c )
+{
+    uint8_t buf[65536];
+    ssize_t val = recv( c->fd, buf, sizeof( buf ), 0 );
+
+    if( val == 0 )
+        return false;
+    if( val < 0 )
+    {
+        assert( errno == EAGAIN || errno == EWOULDBLOCK );
+        return true;
+    }
+
+    uint8_t *p = buf;
+    while( val > 0 && !c->b_ready )
+    {
+        assert( c->i_header < sizeof( c->header ) - 1 );
+        c->header[c->i_header++] = *p++;
+        val--;
+        c->header[c->i_header] = '\0';
+        c->b_ready = strstr( c->header, "\r\n\r\nHDR!" ) != NULL;
+    }
+    for( ssize_t i = 0; i < val; i++ )
+        assert( p[i] == data_byte( c->i_received + i ) );
+    c->i_received += val;
+    return true;
+}
+
+/* Reads until every client has received i_total bytes of data */
+static void wait_clients( client_t *clients, uint64_t i_total )
+{
+    struct pollfd ufd[CLIENTS];
+
+    for( ;; )
+    {
+        unsigned n = 0;
+
+        for( unsigned i = 0; i < CLIENTS; i++ )
+        {
+            if( clients[i].b_ready && clients[i].i_received >= i_total )
+                continue;
+            ufd[n].fd = clients[i].fd;
+            ufd[n].events = POLLIN;
+            n++;
+        }
+        if( n == 0 )
+            break;
+
+        int val = poll( ufd, n, -1 );
+        assert( val > 0 );
+        (void) val;
+        for( unsigned i = 0, j = 0; i < CLIENTS && j < n; i++ )
+        {
+            if( clients[i].fd != ufd[j].fd )
+                continue;
+            if( ufd[j++].revents )
+            {
+                bool b_open = client_read( &clients[i] );
+                assert( b_open );
+                (void) b_open;
+            }
+        }
+    }
+}
+
+static void test_httpd( vlc_object_t *obj, unsigned port )
+{
+    httpd_host_t *host = vlc_http_HostNew( obj );
+    assert( host != NULL );
+
+    httpd_stream_t *stream = httpd_StreamNew( host, "/stream",
+                                              "application/octet-stream",
+                                              NULL, NULL );
+    assert( stream != NULL );
+    httpd_StreamHeader( stream, (uint8_t *)"HDR!", 4 );
+
+    /* unknown URL */
+    char buf[256];
+    int fd = connect_to( port, "GET /none HTTP/1.0\r\n\r\n" );
+    ssize_t val = recv( fd, buf, sizeof( buf ) - 1, MSG_WAITALL );
+    assert( val > 0 );
+    buf[val] = '\0';
+    assert( !strncmp( buf, "HTTP/1.0 404", 12 ) );
+    close( fd );
+
+    /* many clients of the stream */
+    static client_t clients[CLIENTS];
+    for( unsigned i = 0; i < CLIENTS; i++ )
+    {
+        clients[i].fd = connect_to( port, "GET /stream HTTP/1.0\r\n\r\n" );
+        fcntl( clients[i].fd, F_SETFL, O_NONBLOCK );
+        clients[i].i_header = 0;
+        clients[i].header[0] = '\0';
+        clients[i].b_ready = false;
+        clients[i].i_received = 0;
+    }
+    wait_clients( clients, 0 );
+    for( unsigned i = 0; i < CLIENTS; i++ )
+        assert( !strncmp( clients[i].header, "HTTP/1.0 200", 12 ) );
+
+    mtime_t i_start = mdate();
+    uint32_t n = 0;
+    for( unsigned round = 0; round < ROUNDS; round++ )
+    {
+        if( round & 1 )
+        {   /* as a chain */
+            block_t *p_chain = NULL;
+            for( unsigned i = 0; i < BURST; i++ )
+                block_ChainAppend( &p_chain, data_block( n++ ) );
+            httpd_StreamSendBlock( stream, p_chain );
+        }
+        else
+            for( unsigned i = 0; i < BURST; i++ )
+                httpd_StreamSendBlock( stream, data_block( n++ ) );
+
+        wait_clients( clients, (uint64_t)n * BLOCK_SIZE );
+    }
+    mtime_t i_time = mdate() - i_start;
+
+    log( "%u clients: %"PRIu64" MB sent in %"PRId64" ms\n", CLIENTS,
+         (uint64_t)CLIENTS * n * BLOCK_SIZE / 1000000, i_time / 1000 );
+
+    /* deleting the stream closes the connections */
+    httpd_StreamDelete( stream );
+    for( unsigned i = 0; i < CLIENTS; i++ )
+    {
+        fcntl( clients[i].fd, F_SETFL, 0 );
+        while( client_read( &clients[i] ) );
+        close( clients[i].fd );
+    }
+    httpd_HostDelete( host );
+}
+
+int main( void )
+{
+    char psz_port[32];
+    unsigned port = free_port();
+
+    test_init();
+
+    snprintf( psz_port, sizeof( psz_port ), "--http-port=%u", port );
+    const char *args[test_defaults_nargs + 2];
+    for( int i = 0; i < test_defaults_nargs; i++ )
+        args[i] = test_defaults_args[i];
+    args[test_defaults_nargs] = "--http-host=127.0.0.1";
+    args[test_defaults_nargs + 1] = psz_port;
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs + 2, args );
+    assert( p_vlc != NULL );
+
+    vlc_object_t *obj = vlc_object_create( p_vlc->p_libvlc_int,
+                                           sizeof( *obj ) );
+    assert( obj != NULL );
+
+    test_httpd( obj, port );
+
+    vlc_object_release( obj );
+    libvlc_release( p_vlc );
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * sendblocks.c: test and benchmark batched datagram sending
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_network.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* 7 TS packets per datagram, as the UDP output sends them */
+#define PACKET_SIZE 1316
+#define BATCH       32
+#define ROUNDS      2000
+
+static int sock_pair( int *rfd )
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof( addr );
+    int bufsize = 4 * 1024 * 1024;
+
+    *rfd = socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( *rfd != -1 );
+    setsockopt( *rfd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof( bufsize ) );
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = bind( *rfd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = getsockname( *rfd, (struct sockaddr *)&addr, &len );
+    assert( val == 0 );
+
+    int wfd = socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( wfd != -1 );
+    val = connect( wfd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    (void) val;
+    return wfd;
+}
+
+/* Receives one batch and checks that the datagrams are intact and ordered */
+static void check_batch( int rfd, unsigned round )
+{
+    uint8_t buf[PACKET_SIZE + 1];
+
+    for( unsigned i = 0; i < BATCH; i++ )
+    {
+        ssize_t val = recv( rfd, buf, sizeof( buf ), 0 );
+        assert( val == PACKET_SIZE );
+        (void) val;
+        assert( GetDWBE( buf ) == round * BATCH + i );
+        assert( buf[PACKET_SIZE - 1] == (uint8_t)i );
+    }
+}
+
+static mtime_t run( int wfd, int rfd, block_t **pp_blocks, bool b_batch )
+{
+    mtime_t i_start = mdate();
+
+    for( unsigned round = 0; round < ROUNDS; round++ )
+    {
+        for( unsigned i = 0; i < BATCH; i++ )
+            SetDWBE( pp_blocks[i]->p_buffer, round * BATCH + i );
+
+        if( b_batch )
+        {
+            int val = net_SendBlocks( wfd, pp_blocks, BATCH );
+            assert( val == BATCH );
+            (void) val;
+        }
+        else
+            for( unsigned i = 0; i < BATCH; i++ )
+            {
+                ssize_t val = send( wfd, pp_blocks[i]->p_buffer,
+                                    pp_blocks[i]->i_buffer, 0 );
+                assert( val == PACKET_SIZE );
+                (void) val;
+            }
+
+        check_batch( rfd, round );
+    }
+    return mdate() - i_start;
+}
+
+int main( void )
+{
+    block_t *pp_blocks[BATCH];
+    int rfd, wfd = sock_pair( &rfd );
+
+    for( unsigned i = 0; i < BATCH; i++ )
+    {
+        pp_blocks[i] = block_Alloc( PACKET_SIZE );
+        assert( pp_blocks[i] != NULL );
+        memset( pp_blocks[i]->p_buffer, 0x47, PACKET_SIZE );
+        pp_blocks[i]->p_buffer[PACKET_SIZE - 1] = i;
+    }
+
+    /* empty batch */
+    int val = net_SendBlocks( wfd, pp_blocks, 0 );
+    assert( val == 0 );
+    (void) val;
+
+    log( "Sending %u datagrams one by one\n", BATCH * ROUNDS );
+    mtime_t i_single = run( wfd, rfd, pp_blocks, false );
+    log( "Sending %u datagrams by batches of %u\n", BATCH * ROUNDS, BATCH );
+    mtime_t i_batch = run( wfd, rfd, pp_blocks, true );
+
+    log( "send(): %"PRId64" us, net_SendBlocks(): %"PRId64" us\n",
+         i_single, i_batch );
+
+    for( unsigned i = 0; i < BATCH; i++ )
+        block_Release( pp_blocks[i] );
+    net_Close( wfd );
+    net_Close( rfd );
+    return 0;
+}
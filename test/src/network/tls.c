@@ -0,0 +1,212 @@
+/*****************************************************************************
+ * tls.c: test the TLS sessions resumption and record sizes
+ *****************************************************************************
+ * Copyright (C) 2013 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_httpd.h>
+#include <vlc_tls.h>
+
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Segments fetched from a HTTPS server, one connection each */
+#define SEGMENTS     8
+#define SEGMENT_SIZE (2 * 1024 * 1024)
+#define RECORD_SMALL 1360   /* as the GnuTLS plugin sends first */
+
+static struct
+{
+    vlc_mutex_t lock;
+    unsigned    established;    /* full handshakes, on both sides */
+    unsigned    resumed;
+} sessions;
+
+static void log_cb( void *data, int level, const libvlc_log_t *ctx,
+                    const char *fmt, va_list ap )
+{
+    char msg[256];
+
+    vsnprintf( msg, sizeof( msg ), fmt, ap );
+    vlc_mutex_lock( &sessions.lock );
+    if( !strcmp( msg, "TLS session established" ) )
+        sessions.established++;
+    else if( !strcmp( msg, "TLS session resumed" ) )
+        sessions.resumed++;
+    vlc_mutex_unlock( &sessions.lock );
+    (void) data; (void) level; (void) ctx;
+}
+
+static unsigned free_port( void )
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof( addr );
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    assert( fd != -1 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = bind( fd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+    val = getsockname( fd, (struct sockaddr *)&addr, &len );
+    assert( val == 0 );
+    (void) val;
+    close( fd );
+    return ntohs( addr.sin_port );
+}
+
+static int segment_fill( httpd_file_sys_t *data, httpd_file_t *file,
+                         uint8_t *psz_request, uint8_t **pp_data, int *pi_data )
+{
+    *pp_data = malloc( SEGMENT_SIZE );
+    assert( *pp_data != NULL );
+    memset( *pp_data, 'x', SEGMENT_SIZE );
+    *pi_data = SEGMENT_SIZE;
+    (void) data; (void) file; (void) psz_request;
+    return VLC_SUCCESS;
+}
+
+/* Fetches the segment through a new connection and new credentials, as the
+ * HTTP access does */
+static void fetch( vlc_object_t *obj, unsigned port )
+{
+    struct sockaddr_in addr;
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    assert( fd != -1 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    int val = connect( fd, (struct sockaddr *)&addr, sizeof( addr ) );
+    assert( val == 0 );
+
+    vlc_tls_creds_t *crd = vlc_tls_ClientCreate( obj );
+    assert( crd != NULL );
+    /* the certificate is self-signed: no host name to check */
+    vlc_tls_t *tls = vlc_tls_ClientSessionCreate( crd, fd, NULL, "https" );
+    assert( tls != NULL );
+
+    static const char req[] = "GET /segment HTTP/1.1\r\n"
+                              "Host: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    val = tls_Send( tls, req, sizeof( req ) - 1 );
+    assert( val == sizeof( req ) - 1 );
+
+    static uint8_t buf[65536];
+    size_t i_total = 0, i_first = 0, i_max = 0;
+    for( ;; )
+    {
+        /* one record at most per read */
+        val = tls_Recv( tls, buf, sizeof( buf ) );
+        if( val < 0 && ( errno == EAGAIN || errno == EINTR ) )
+            continue; /* not application data */
+        if( val <= 0 )
+            break;
+        if( i_first == 0 )
+            i_first = val;
+        if( (size_t)val > i_max )
+            i_max = val;
+        i_total += val;
+    }
+    assert( i_total > SEGMENT_SIZE );
+
+    /* small records first, large ones once the stream is running */
+    assert( i_first <= RECORD_SMALL );
+    assert( i_max > RECORD_SMALL );
+
+    vlc_tls_SessionDelete( tls );
+    vlc_tls_Delete( crd );
+    close( fd );
+}
+
+int main( void )
+{
+    char psz_port[32];
+    unsigned port = free_port();
+
+    test_init();
+
+    snprintf( psz_port, sizeof( psz_port ), "--https-port=%u", port );
+    const char *args[test_defaults_nargs + 4];
+    for( int i = 0; i < test_defaults_nargs; i++ )
+        args[i] = test_defaults_args[i];
+    args[test_defaults_nargs] = "--http-host=127.0.0.1";
+    args[test_defaults_nargs + 1] = psz_port;
+    args[test_defaults_nargs + 2] = "--http-cert="SRCDIR"/samples/tls.crt";
+    args[test_defaults_nargs + 3] = "--http-key="SRCDIR"/samples/tls.key";
+
+    libvlc_instance_t *p_vlc = libvlc_new( test_defaults_nargs + 4, args );
+    assert( p_vlc != NULL );
+
+    vlc_mutex_init( &sessions.lock );
+    sessions.established = sessions.resumed = 0;
+    libvlc_log_set( p_vlc, log_cb, NULL );
+
+    vlc_object_t *obj = vlc_object_create( p_vlc->p_libvlc_int,
+                                           sizeof( *obj ) );
+    assert( obj != NULL );
+
+    int i_ret = 0;
+    httpd_host_t *host = vlc_https_HostNew( obj );
+    if( host == NULL )
+    {
+        log( "TLS server not available, skipping\n" );
+        i_ret = 77;
+        goto out;
+    }
+    httpd_file_t *file = httpd_FileNew( host, "/segment", "video/MP2T",
+                                        NULL, NULL, segment_fill, NULL );
+    assert( file != NULL );
+
+    mtime_t i_first = 0, i_start = mdate();
+    for( unsigned i = 0; i < SEGMENTS; i++ )
+    {
+        fetch( obj, port );
+        if( i == 0 )
+            i_first = mdate() - i_start;
+    }
+    mtime_t i_others = mdate() - i_start - i_first;
+
+    httpd_FileDelete( file );
+    httpd_HostDelete( host );
+
+    vlc_mutex_lock( &sessions.lock );
+    log( "%u full handshakes, %u resumed sessions\n", sessions.established,
+         sessions.resumed );
+    log( "first segment in %"PRId64" us, then %"PRId64" us per segment\n",
+         i_first, i_others / ( SEGMENTS - 1 ) );
+
+    /* only the first connection needed a full handshake, on each side */
+    assert( sessions.established == 2 );
+    assert( sessions.resumed == 2 * ( SEGMENTS - 1 ) );
+    vlc_mutex_unlock( &sessions.lock );
+
+out:
+    vlc_object_release( obj );
+    libvlc_log_unset( p_vlc );
+    libvlc_release( p_vlc );
+    vlc_mutex_destroy( &sessions.lock );
+    return i_ret;
+}